@@ -0,0 +1,170 @@
+#include "asset_manifest.h"
+#include "asset_pack.h"
+
+#include <mutex>
+#include <string.h>
+#include <unordered_map>
+
+struct KnownAssetHash
+{
+    u64 timestamp;
+    u64 hash;
+};
+
+struct AssetHashes
+{
+    std::mutex                                      mutex;
+    std::unordered_map<std::string, KnownAssetHash> known; // By normalized path
+};
+
+static AssetHashes GlobalAssetHashes;
+
+static const char* AssetKindNames[AssetKind_Count] = { "model", "texture", "shader" };
+
+// MurmurHash64A
+u64 HashBytes(const void* data, u64 size, u64 seed)
+{
+    const u64 m = 0xc6a4a7935bd1e995ULL;
+    const u32 r = 47;
+
+    u64 h = seed ^ (size * m);
+
+    const u8* bytes = (const u8*)data;
+    const u8* end = bytes + (size & ~7ULL);
+    for (; bytes != end; bytes += 8)
+    {
+        u64 k;
+        memcpy(&k, bytes, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    if (size & 7)
+    {
+        for (int i = (int)(size & 7) - 1; i >= 0; --i)
+            h ^= (u64)bytes[i] << (8 * i);
+        h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+const char* GetAssetKindName(AssetKind kind)
+{
+    return kind < AssetKind_Count ? AssetKindNames[kind] : "unknown";
+}
+
+bool LoadAssetManifest(const char* filepath)
+{
+    MappedFile file = MapFile(filepath);
+    if (file.data == NULL)
+        return false;
+
+    AssetHashes& hashes = GlobalAssetHashes;
+    std::lock_guard<std::mutex> lock(hashes.mutex);
+
+    // One asset per line: kind, hash, timestamp and path (the rest of the line)
+    u32 entryCount = 0;
+    const char* text = (const char*)file.data;
+    const char* end = text + file.size;
+    while (text < end)
+    {
+        const char* lineEnd = (const char*)memchr(text, '\n', end - text);
+        if (lineEnd == NULL)
+            lineEnd = end;
+        std::string line(text, lineEnd);
+        text = lineEnd + 1;
+
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        u32 version = 0;
+        if (sscanf(line.c_str(), "version %u", &version) == 1)
+        {
+            if (version != ASSET_MANIFEST_VERSION)
+            {
+                ILOG("Asset manifest %s is out of date", filepath);
+                hashes.known.clear();
+                UnmapFile(file);
+                return false;
+            }
+            continue;
+        }
+
+        char kind[16] = {};
+        unsigned long long hash = 0;
+        unsigned long long timestamp = 0;
+        int pathStart = 0;
+        if (sscanf(line.c_str(), "%15s %llx %llu %n", kind, &hash, &timestamp, &pathStart) != 3 || pathStart <= 0)
+            continue;
+
+        KnownAssetHash known = { timestamp, hash };
+        hashes.known[NormalizeAssetPath(line.c_str() + pathStart)] = known;
+        entryCount++;
+    }
+
+    UnmapFile(file);
+    ILOG("Asset manifest %s has %u assets", filepath, entryCount);
+    return true;
+}
+
+bool WriteAssetManifest(const char* filepath, const std::vector<AssetManifestEntry>& entries)
+{
+    FILE* file = fopen(filepath, "w");
+    if (!file)
+    {
+        ELOG("fopen() failed writing asset manifest %s", filepath);
+        return false;
+    }
+
+    fprintf(file, "# Written by the cooker: kind, content hash, last write timestamp and path of every source asset\n");
+    fprintf(file, "version %u\n", ASSET_MANIFEST_VERSION);
+    for (u32 i = 0; i < entries.size(); ++i)
+    {
+        const AssetManifestEntry& entry = entries[i];
+        fprintf(file, "%s %016llx %llu %s\n", GetAssetKindName(entry.kind), (unsigned long long)entry.hash, (unsigned long long)entry.timestamp, entry.path.c_str());
+    }
+
+    bool success = !ferror(file);
+    fclose(file);
+    return success;
+}
+
+u64 GetAssetHash(const char* filepath)
+{
+    u64 timestamp = GetFileLastWriteTimestamp(filepath);
+    if (timestamp == 0)
+        return 0;
+
+    AssetHashes& hashes = GlobalAssetHashes;
+    std::string path = NormalizeAssetPath(filepath);
+    {
+        std::lock_guard<std::mutex> lock(hashes.mutex);
+        std::unordered_map<std::string, KnownAssetHash>::const_iterator it = hashes.known.find(path);
+        if (it != hashes.known.end() && it->second.timestamp == timestamp)
+            return it->second.hash;
+    }
+
+    MappedFile file = MapFile(filepath);
+    if (file.data == NULL)
+        return 0;
+
+    u64 hash = HashBytes(file.data, file.size);
+    UnmapFile(file);
+    if (hash == 0)
+        hash = 1; // 0 means unreadable
+
+    std::lock_guard<std::mutex> lock(hashes.mutex);
+    KnownAssetHash known = { timestamp, hash };
+    hashes.known[path] = known;
+    return hash;
+}
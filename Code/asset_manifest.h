@@ -0,0 +1,44 @@
+//
+// asset_manifest.h: Content hashes of the source assets. The mesh and texture caches are keyed by
+// the hash of their source instead of its timestamp, so a cache cooked on another machine (or
+// before a fresh checkout) stays valid as long as the source is the same. The cooker saves the
+// hashes it computed to a manifest, and they are reused from it while the source is not written.
+//
+
+#pragma once
+
+#include "platform.h"
+
+#define ASSET_MANIFEST_FILENAME "asset_manifest.txt"
+#define ASSET_MANIFEST_VERSION  1
+
+enum AssetKind
+{
+    AssetKind_Model,
+    AssetKind_Texture,
+    AssetKind_Shader,
+    AssetKind_Count
+};
+
+struct AssetManifestEntry
+{
+    std::string path;      // Relative to the working directory
+    AssetKind   kind;
+    u64         timestamp; // Last write of the source when it was hashed
+    u64         hash;
+};
+
+u64 HashBytes(const void* data, u64 size, u64 seed = 0);
+
+/** Reads the hashes of a manifest, GetAssetHash() returns them from then on. */
+bool LoadAssetManifest(const char* filepath);
+
+bool WriteAssetManifest(const char* filepath, const std::vector<AssetManifestEntry>& entries);
+
+/**
+ * Hash of the contents of a source asset, 0 if it cannot be read. It comes from the manifest if
+ * the source was not written since, otherwise the file is hashed once per run. Thread safe.
+ */
+u64 GetAssetHash(const char* filepath);
+
+const char* GetAssetKindName(AssetKind kind);
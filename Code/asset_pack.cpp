@@ -0,0 +1,190 @@
+#include "asset_pack.h"
+#include "job_system.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <stdlib.h>
+#include <unordered_set>
+
+// Compiled in stb.cpp with the rest of stb_image_write, which does not declare it in its header
+extern "C" unsigned char* stbi_zlib_compress(unsigned char* data, int data_len, int* out_len, int quality);
+
+#define ASSET_PACK_COMPRESSION_QUALITY 8
+#define ASSET_PACK_MIN_SAVING          8 // Compressed entries have to be at least 1/8 smaller, else they are stored as is
+
+std::string NormalizeAssetPath(const char* filepath)
+{
+    std::vector<std::string> segments;
+    std::string segment;
+    for (const char* c = filepath; ; ++c)
+    {
+        if (*c == '/' || *c == '\\' || *c == '\0')
+        {
+            if (segment == ".." && !segments.empty() && segments.back() != "..")
+                segments.pop_back();
+            else if (!segment.empty() && segment != ".")
+                segments.push_back(segment);
+            segment.clear();
+
+            if (*c == '\0')
+                break;
+        }
+        else
+        {
+            segment += (char)tolower((unsigned char)*c);
+        }
+    }
+
+    std::string path;
+    for (u32 i = 0; i < segments.size(); ++i)
+    {
+        if (i > 0)
+            path += '/';
+        path += segments[i];
+    }
+    return path;
+}
+
+static void WriteZeros(FILE* file, u64 count)
+{
+    static const u8 zeros[ASSET_PACK_ALIGNMENT] = {};
+    while (count > 0)
+    {
+        u64 size = count < sizeof(zeros) ? count : sizeof(zeros);
+        fwrite(zeros, 1, size, file);
+        count -= size;
+    }
+}
+
+// Compresses the chunks of a file on the workers, false if they do not shrink enough to be worth it
+static bool CompressAssetPackEntry(const MappedFile& source, std::vector<u32>& chunkSizes, std::vector<u8*>& chunks)
+{
+    u32 chunkCount = (u32)((source.size + ASSET_PACK_CHUNK_SIZE - 1) / ASSET_PACK_CHUNK_SIZE);
+    chunkSizes.assign(chunkCount, 0);
+    chunks.assign(chunkCount, NULL);
+
+    ParallelFor(chunkCount, [&](u32 i) {
+        u64 begin = (u64)i * ASSET_PACK_CHUNK_SIZE;
+        int size = (int)std::min<u64>(ASSET_PACK_CHUNK_SIZE, source.size - begin);
+        int compressedSize = 0;
+        chunks[i] = stbi_zlib_compress((unsigned char*)(source.data + begin), size, &compressedSize, ASSET_PACK_COMPRESSION_QUALITY);
+        chunkSizes[i] = (u32)compressedSize;
+    });
+
+    bool compressed = true;
+    u64 storedSize = chunkCount * sizeof(u32);
+    for (u32 i = 0; i < chunkCount; ++i)
+    {
+        compressed = compressed && chunks[i] != NULL;
+        storedSize += chunkSizes[i];
+    }
+
+    if (!compressed || storedSize > source.size - source.size / ASSET_PACK_MIN_SAVING)
+    {
+        for (u32 i = 0; i < chunkCount; ++i)
+            free(chunks[i]);
+        chunkSizes.clear();
+        chunks.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool WriteAssetPack(const char* packPath, const std::vector<std::string>& filepaths, bool compress)
+{
+    FILE* file = fopen(packPath, "wb");
+    if (!file)
+    {
+        ELOG("fopen() failed writing asset pack %s", packPath);
+        return false;
+    }
+
+    AssetPackHeader header = {};
+    header.magic = ASSET_PACK_MAGIC;
+    header.version = ASSET_PACK_VERSION;
+    header.chunkSize = ASSET_PACK_CHUNK_SIZE;
+
+    u64 offset = ASSET_PACK_ALIGNMENT; // The header gets a page of its own
+    WriteZeros(file, offset);
+
+    std::vector<AssetPackEntry> entries;
+    std::string paths;
+    std::unordered_set<std::string> packedPaths;
+    for (u32 i = 0; i < filepaths.size(); ++i)
+    {
+        std::string path = NormalizeAssetPath(filepaths[i].c_str());
+        if (path.empty() || !packedPaths.insert(path).second)
+            continue;
+
+        MappedFile source = MapFile(filepaths[i].c_str());
+        if (source.data == NULL)
+        {
+            ELOG("Could not read %s, it is left out of the asset pack", filepaths[i].c_str());
+            continue;
+        }
+
+        AssetPackEntry entry = {};
+        entry.pathOffset = (u32)paths.size();
+        entry.pathLength = (u32)path.size();
+        entry.dataOffset = offset;
+        entry.size = source.size;
+        entry.sourceTimestamp = GetFileLastWriteTimestamp(filepaths[i].c_str());
+        paths += path;
+
+        std::vector<u32> chunkSizes;
+        std::vector<u8*> chunks;
+        if (compress && CompressAssetPackEntry(source, chunkSizes, chunks))
+        {
+            entry.chunkCount = (u32)chunks.size();
+            entry.storedSize = chunkSizes.size() * sizeof(u32);
+            fwrite(chunkSizes.data(), sizeof(u32), chunkSizes.size(), file);
+            for (u32 chunk = 0; chunk < chunks.size(); ++chunk)
+            {
+                fwrite(chunks[chunk], 1, chunkSizes[chunk], file);
+                entry.storedSize += chunkSizes[chunk];
+                free(chunks[chunk]);
+            }
+        }
+        else
+        {
+            entry.storedSize = source.size;
+            fwrite(source.data, 1, source.size, file);
+        }
+        UnmapFile(source);
+
+        // At least one zero byte after the data, so stored text files can be served as C strings
+        u64 end = (entry.dataOffset + entry.storedSize + ASSET_PACK_ALIGNMENT) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+        WriteZeros(file, end - (entry.dataOffset + entry.storedSize));
+        offset = end;
+
+        entries.push_back(entry);
+    }
+
+    std::sort(entries.begin(), entries.end(), [&paths](const AssetPackEntry& a, const AssetPackEntry& b) {
+        return paths.compare(a.pathOffset, a.pathLength, paths, b.pathOffset, b.pathLength) < 0;
+    });
+
+    header.entryCount = (u32)entries.size();
+    header.tocOffset = offset;
+    fwrite(entries.data(), sizeof(AssetPackEntry), entries.size(), file);
+    header.pathsOffset = header.tocOffset + entries.size() * sizeof(AssetPackEntry);
+    header.pathsSize = paths.size();
+    fwrite(paths.data(), 1, paths.size(), file);
+
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+
+    bool success = !ferror(file);
+    fclose(file);
+
+    if (success)
+    {
+        ILOG("Asset pack %s written with %u files", packPath, header.entryCount);
+    }
+    else
+    {
+        ELOG("Failed writing asset pack %s", packPath);
+    }
+    return success;
+}
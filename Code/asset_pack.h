@@ -0,0 +1,52 @@
+//
+// asset_pack.h: Asset packs. The files a run opened (shaders, images, models and their cooked
+// caches) are written back to back into one archive, each entry aligned to a page, with a table
+// of contents sorted by path. Once mounted (see MountAssetPack() in platform.h) the whole pack is
+// one mapping and files are served by pointer into it, without opening them one by one.
+//
+
+#pragma once
+
+#include "platform.h"
+
+#define ASSET_PACK_MAGIC      0x4B504D47 // "GMPK"
+#define ASSET_PACK_VERSION    1
+#define ASSET_PACK_FILENAME   "assets.pack"
+#define ASSET_PACK_ALIGNMENT  4096       // Of every entry, so they start on a page of the mapping
+#define ASSET_PACK_CHUNK_SIZE KB(256)    // Compressed entries are split into chunks decompressed in parallel
+
+struct AssetPackHeader
+{
+    u32 magic;
+    u32 version;
+    u32 entryCount;
+    u32 chunkSize;
+    u64 tocOffset;   // AssetPackEntry[entryCount], sorted by path
+    u64 pathsOffset; // Paths of the entries, back to back
+    u64 pathsSize;
+};
+
+struct AssetPackEntry
+{
+    u32 pathOffset;      // Relative to the paths, normalized by NormalizeAssetPath()
+    u32 pathLength;
+    u64 dataOffset;      // Aligned to ASSET_PACK_ALIGNMENT, followed by at least one zero byte
+    u64 size;            // Of the file
+    u64 storedSize;      // In the pack (the size, unless compressed)
+    u64 sourceTimestamp; // Last write of the file when packed, so caches keep validating against it
+    u32 chunkCount;      // 0 if stored as is, else the data starts with the u32 sizes of its zlib chunks
+    u32 padding;
+};
+
+/**
+ * Paths as stored in the table of contents: forward slashes, lower case and without "./" parts,
+ * so the different spellings of a relative path find the same entry.
+ */
+std::string NormalizeAssetPath(const char* filepath);
+
+/**
+ * Writes the files to a new pack, their data in the order given (the order a run opened them, so
+ * startup reads the pack front to back). With compress set, entries that shrink enough are stored
+ * as zlib chunks, compressed on the worker threads. Returns false if the pack could not be written.
+ */
+bool WriteAssetPack(const char* packPath, const std::vector<std::string>& filepaths, bool compress);
@@ -1,36 +1,95 @@
 #include "assimp_model_loading.h"
+#include "asset_manifest.h"
+#include "buffer_management.h"
+#include "geometry_pool.h"
+#include "gltf_model_loading.h"
+#include "import_workers.h"
+#include "job_system.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "meshlets.h"
+#include "model_registry.h"
+#include "obj_model_loading.h"
+#include "residency.h"
+#include "texture_streaming.h"
+#include "vertex_quantization.h"
+
+#include <assimp/cfileio.h>
+#include <cctype>
+#include <string.h>
+#include <unordered_map>
+
+// Any change to these flags changes the imported data, so they are part of the mesh cache key
+static const u32 AssimpImportFlags =
+    aiProcess_Triangulate |
+    aiProcess_GenSmoothNormals |
+    aiProcess_CalcTangentSpace |
+    aiProcess_JoinIdenticalVertices |
+    aiProcess_PreTransformVertices |
+    aiProcess_OptimizeMeshes |
+    aiProcess_SortByPType;
+
+// Same for the processing done on top of Assimp
+static const u32 MeshImportOptions =
+    MeshImportOption_OptimizeMeshes |
+    (MESH_LOD_COUNT > 1 ? MeshImportOption_GenerateLods : 0) |
+    (MESHLET_CULLING ? MeshImportOption_BuildMeshlets : 0) |
+    (QUANTIZED_VERTICES ? MeshImportOption_QuantizeVertices : 0);
+
+VertexBufferLayout CreateImportVertexLayout(bool hasTexCoords, bool hasTangentSpace)
+{
+    VertexBufferLayout vertexBufferLayout = {};
+    vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 0, 3, 0, GL_FLOAT, GL_FALSE });
+    vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 1, 3, 3 * sizeof(float), GL_FLOAT, GL_FALSE });
+    vertexBufferLayout.stride = 6 * sizeof(float);
+    if (hasTexCoords)
+    {
+        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 2, 2, vertexBufferLayout.stride, GL_FLOAT, GL_FALSE });
+        vertexBufferLayout.stride += 2 * sizeof(float);
+    }
+    if (hasTangentSpace)
+    {
+        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 3, 3, vertexBufferLayout.stride, GL_FLOAT, GL_FALSE });
+        vertexBufferLayout.stride += 3 * sizeof(float);
+
+        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 4, 3, vertexBufferLayout.stride, GL_FLOAT, GL_FALSE });
+        vertexBufferLayout.stride += 3 * sizeof(float);
+    }
+    return vertexBufferLayout;
+}
 
-void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices)
+void ProcessAssimpMesh(aiMesh* mesh, Submesh& submesh)
 {
-    std::vector<float> vertices;
-    std::vector<u32> indices;
+    bool hasTexCoords = mesh->mTextureCoords[0] != nullptr; // does the mesh contain texture coordinates?
+    bool hasTangentSpace = mesh->mTangents != nullptr && mesh->mBitangents != nullptr;
 
-    bool hasTexCoords = false;
-    bool hasTangentSpace = false;
+    // create the vertex format
+    VertexBufferLayout vertexBufferLayout = CreateImportVertexLayout(hasTexCoords, hasTangentSpace);
 
-    // process vertices
+    // process vertices (the final size is known, so the vertices are written in place)
+    std::vector<u8> vertices(mesh->mNumVertices * vertexBufferLayout.stride);
+    float* vertex = (float*)vertices.data();
     for (unsigned int i = 0; i < mesh->mNumVertices; i++)
     {
-        vertices.push_back(mesh->mVertices[i].x);
-        vertices.push_back(mesh->mVertices[i].y);
-        vertices.push_back(mesh->mVertices[i].z);
-        vertices.push_back(mesh->mNormals[i].x);
-        vertices.push_back(mesh->mNormals[i].y);
-        vertices.push_back(mesh->mNormals[i].z);
-
-        if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+        *vertex++ = mesh->mVertices[i].x;
+        *vertex++ = mesh->mVertices[i].y;
+        *vertex++ = mesh->mVertices[i].z;
+        *vertex++ = mesh->mNormals[i].x;
+        *vertex++ = mesh->mNormals[i].y;
+        *vertex++ = mesh->mNormals[i].z;
+
+        if (hasTexCoords)
         {
-            hasTexCoords = true;
-            vertices.push_back(mesh->mTextureCoords[0][i].x);
-            vertices.push_back(mesh->mTextureCoords[0][i].y);
+            *vertex++ = mesh->mTextureCoords[0][i].x;
+            *vertex++ = mesh->mTextureCoords[0][i].y;
         }
 
-        if (mesh->mTangents != nullptr && mesh->mBitangents)
+        if (hasTangentSpace)
         {
-            hasTangentSpace = true;
-            vertices.push_back(mesh->mTangents[i].x);
-            vertices.push_back(mesh->mTangents[i].y);
-            vertices.push_back(mesh->mTangents[i].z);
+            *vertex++ = mesh->mTangents[i].x;
+            *vertex++ = mesh->mTangents[i].y;
+            *vertex++ = mesh->mTangents[i].z;
 
             // For some reason ASSIMP gives me the bitangents flipped.
             // Maybe it's my fault, but when I generate my own geometry
@@ -40,53 +99,53 @@ void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, Mesh* myMesh, u32 bas
             // I think that (even if the documentation says the opposite)
             // it returns a left-handed tangent space matrix.
             // SOLUTION: I invert the components of the bitangent here.
-            vertices.push_back(-mesh->mBitangents[i].x);
-            vertices.push_back(-mesh->mBitangents[i].y);
-            vertices.push_back(-mesh->mBitangents[i].z);
+            *vertex++ = -mesh->mBitangents[i].x;
+            *vertex++ = -mesh->mBitangents[i].y;
+            *vertex++ = -mesh->mBitangents[i].z;
         }
     }
 
     // process indices
+    u32 indexCount = 0;
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+        indexCount += mesh->mFaces[i].mNumIndices;
+
+    std::vector<u32> indices(indexCount);
+    u32* index = indices.data();
     for (unsigned int i = 0; i < mesh->mNumFaces; i++)
     {
-        aiFace face = mesh->mFaces[i];
+        const aiFace& face = mesh->mFaces[i];
         for (unsigned int j = 0; j < face.mNumIndices; j++)
         {
-            indices.push_back(face.mIndices[j]);
+            *index++ = face.mIndices[j];
         }
     }
 
-    // store the proper (previously proceessed) material for this mesh
-    submeshMaterialIndices.push_back(baseMeshMaterialIndex + mesh->mMaterialIndex);
-
-    // create the vertex format
-    VertexBufferLayout vertexBufferLayout = {};
-    vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 0, 3, 0 });
-    vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 1, 3, 3 * sizeof(float) });
-    vertexBufferLayout.stride = 6 * sizeof(float);
-    if (hasTexCoords)
-    {
-        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 2, 2, vertexBufferLayout.stride });
-        vertexBufferLayout.stride += 2 * sizeof(float);
-    }
-    if (hasTangentSpace)
-    {
-        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 3, 3, vertexBufferLayout.stride });
-        vertexBufferLayout.stride += 3 * sizeof(float);
-
-        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 4, 3, vertexBufferLayout.stride });
-        vertexBufferLayout.stride += 3 * sizeof(float);
-    }
-
-    // add the submesh into the mesh
-    Submesh submesh = {};
+    // fill the submesh
     submesh.vertexBufferLayout = vertexBufferLayout;
     submesh.vertices.swap(vertices);
     submesh.indices.swap(indices);
-    myMesh->submeshes.push_back(submesh);
+    submesh.indexType = GL_UNSIGNED_INT;
+}
+
+std::string GetDirectoryOf(const std::string& path)
+{
+    size_t separator = path.find_last_of("/\\");
+    return separator != std::string::npos ? path.substr(0, separator) : std::string(".");
+}
+
+static void AddAssimpTexture(aiMaterial* material, aiTextureType type, u32 materialIdx, MaterialTexture texture, const std::string& directory, ImportedModel& imported)
+{
+    if (material->GetTextureCount(type) > 0)
+    {
+        aiString aiFilename;
+        material->GetTexture(type, 0, &aiFilename);
+        imported.texturePaths.push_back(directory + "/" + aiFilename.C_Str());
+        imported.textureSlots.push_back(materialIdx * MaterialTexture_Count + texture);
+    }
 }
 
-void ProcessAssimpMaterial(App* app, aiMaterial* material, Material& myMaterial, String directory)
+void ProcessAssimpMaterial(aiMaterial* material, u32 materialIdx, const std::string& directory, ImportedModel& imported)
 {
     aiString name;
     aiColor3D diffuseColor;
@@ -99,6 +158,7 @@ void ProcessAssimpMaterial(App* app, aiMaterial* material, Material& myMaterial,
     material->Get(AI_MATKEY_COLOR_SPECULAR, specularColor);
     material->Get(AI_MATKEY_SHININESS, shininess);
 
+    Material& myMaterial = imported.materials[materialIdx];
     myMaterial.name = name.C_Str();
     myMaterial.albedo = vec3(diffuseColor.r, diffuseColor.g, diffuseColor.b);
     myMaterial.emissive = vec3(emissiveColor.r, emissiveColor.g, emissiveColor.b);
@@ -107,141 +167,559 @@ void ProcessAssimpMaterial(App* app, aiMaterial* material, Material& myMaterial,
     myMaterial.specular = vec3(specularColor.r, specularColor.g, specularColor.b);
     myMaterial.shininess = shininess;
 
-    aiString aiFilename;
-    if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0)
+    // The textures are only gathered here, they are decoded all at once later on
+    AddAssimpTexture(material, aiTextureType_DIFFUSE,  materialIdx, MaterialTexture_Albedo,   directory, imported);
+    AddAssimpTexture(material, aiTextureType_EMISSIVE, materialIdx, MaterialTexture_Emissive, directory, imported);
+    AddAssimpTexture(material, aiTextureType_SPECULAR, materialIdx, MaterialTexture_Specular, directory, imported);
+    AddAssimpTexture(material, aiTextureType_NORMALS,  materialIdx, MaterialTexture_Normals,  directory, imported);
+    AddAssimpTexture(material, aiTextureType_HEIGHT,   materialIdx, MaterialTexture_Bump,     directory, imported);
+
+    //myMaterial.createNormalFromBump();
+}
+
+void FlattenAssimpNode(const aiScene* scene, aiNode* node, std::vector<aiMesh*>& meshes)
+{
+    // gather all the node's meshes (if any)
+    for (unsigned int i = 0; i < node->mNumMeshes; i++)
     {
-        material->GetTexture(aiTextureType_DIFFUSE, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.albedoTextureIdx = LoadTexture2D(app, filepath.str);
+        meshes.push_back(scene->mMeshes[node->mMeshes[i]]);
     }
-    if (material->GetTextureCount(aiTextureType_EMISSIVE) > 0)
+
+    // then do the same for each of its children
+    for (unsigned int i = 0; i < node->mNumChildren; i++)
     {
-        material->GetTexture(aiTextureType_EMISSIVE, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.emissiveTextureIdx = LoadTexture2D(app, filepath.str);
+        FlattenAssimpNode(scene, node->mChildren[i], meshes);
     }
-    if (material->GetTextureCount(aiTextureType_SPECULAR) > 0)
+}
+
+// Assimp opens the model and the files it references (.mtl, ...) through MapFile(), so they can come from the asset pack
+struct AssimpMappedFile
+{
+    MappedFile file;
+    size_t     position;
+};
+
+static size_t ReadAssimpFile(aiFile* file, char* buffer, size_t size, size_t count)
+{
+    AssimpMappedFile* mapped = (AssimpMappedFile*)file->UserData;
+    if (size == 0)
+        return 0;
+
+    size_t available = (size_t)(mapped->file.size - mapped->position) / size;
+    if (count > available)
+        count = available;
+
+    memcpy(buffer, mapped->file.data + mapped->position, size * count);
+    mapped->position += size * count;
+    return count;
+}
+
+// Assimp only reads through this file system, so writing and flushing do nothing
+static size_t WriteAssimpFile(aiFile*, const char*, size_t, size_t)
+{
+    return 0;
+}
+
+static size_t GetAssimpFilePosition(aiFile* file)
+{
+    return ((AssimpMappedFile*)file->UserData)->position;
+}
+
+static size_t GetAssimpFileSize(aiFile* file)
+{
+    return (size_t)((AssimpMappedFile*)file->UserData)->file.size;
+}
+
+static aiReturn SeekAssimpFile(aiFile* file, size_t offset, aiOrigin origin)
+{
+    AssimpMappedFile* mapped = (AssimpMappedFile*)file->UserData;
+    size_t base = origin == aiOrigin_CUR ? mapped->position : origin == aiOrigin_END ? (size_t)mapped->file.size : 0;
+    if (base + offset > mapped->file.size)
+        return aiReturn_FAILURE;
+
+    mapped->position = base + offset;
+    return aiReturn_SUCCESS;
+}
+
+static void FlushAssimpFile(aiFile*)
+{
+}
+
+static aiFile* OpenAssimpFile(aiFileIO*, const char* filename, const char* mode)
+{
+    if (strchr(mode, 'w') || strchr(mode, 'a'))
+        return NULL;
+
+    MappedFile file = MapFile(filename);
+    if (file.data == NULL)
+        return NULL;
+
+    AssimpMappedFile* mapped = new AssimpMappedFile();
+    mapped->file = file;
+    mapped->position = 0;
+
+    aiFile* result = new aiFile();
+    result->ReadProc = ReadAssimpFile;
+    result->WriteProc = WriteAssimpFile;
+    result->TellProc = GetAssimpFilePosition;
+    result->FileSizeProc = GetAssimpFileSize;
+    result->SeekProc = SeekAssimpFile;
+    result->FlushProc = FlushAssimpFile;
+    result->UserData = (aiUserData)mapped;
+    return result;
+}
+
+static void CloseAssimpFile(aiFileIO*, aiFile* file)
+{
+    AssimpMappedFile* mapped = (AssimpMappedFile*)file->UserData;
+    UnmapFile(mapped->file);
+    delete mapped;
+    delete file;
+}
+
+static bool ImportAssimpModel(const char* filename, ImportedModel& imported)
+{
+    aiFileIO fileIO = { OpenAssimpFile, CloseAssimpFile, NULL };
+    const aiScene* scene = aiImportFileEx(filename, AssimpImportFlags, &fileIO);
+
+    if (!scene)
     {
-        material->GetTexture(aiTextureType_SPECULAR, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.specularTextureIdx = LoadTexture2D(app, filepath.str);
+        ELOG("Error loading mesh %s: %s", filename, aiGetErrorString());
+        return false;
     }
-    if (material->GetTextureCount(aiTextureType_NORMALS) > 0)
+
+    // Create a list of materials
+    std::string directory = GetDirectoryOf(filename);
+    imported.materials.resize(scene->mNumMaterials);
+    for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
     {
-        material->GetTexture(aiTextureType_NORMALS, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.normalsTextureIdx = LoadTexture2D(app, filepath.str);
+        ProcessAssimpMaterial(scene->mMaterials[i], i, directory, imported);
     }
-    if (material->GetTextureCount(aiTextureType_HEIGHT) > 0)
+
+    // Flatten the node tree into a list of meshes to convert
+    std::vector<aiMesh*> assimpMeshes;
+    FlattenAssimpNode(scene, scene->mRootNode, assimpMeshes);
+
+    imported.submeshes.resize(assimpMeshes.size());
+    for (u32 i = 0; i < assimpMeshes.size(); ++i)
     {
-        material->GetTexture(aiTextureType_HEIGHT, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.bumpTextureIdx = LoadTexture2D(app, filepath.str);
+        // store the proper (previously processed) material for this mesh
+        imported.submeshMaterials.push_back(assimpMeshes[i]->mMaterialIndex);
     }
 
-    //myMaterial.createNormalFromBump();
+    // Convert the meshes on the worker threads
+    ParallelFor(assimpMeshes.size(), [&](u32 i) {
+        ProcessAssimpMesh(assimpMeshes[i], imported.submeshes[i]);
+    });
+
+    aiReleaseImport(scene);
+
+    return true;
 }
 
-void ProcessAssimpNode(const aiScene* scene, aiNode* node, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices)
+u64 HashSubmeshGeometry(const Submesh& submesh, const u8* vertices, u32 verticesSize, const u32* indices, u32 indexCount)
 {
-    // process all the node's meshes (if any)
-    for (unsigned int i = 0; i < node->mNumMeshes; i++)
+    const VertexBufferLayout& layout = submesh.vertexBufferLayout;
+    u64 hash = HashBytes(&layout.stride, sizeof(layout.stride));
+    for (u32 i = 0; i < layout.attributes.size(); ++i)
     {
-        aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        ProcessAssimpMesh(scene, mesh, myMesh, baseMeshMaterialIndex, submeshMaterialIndices);
+        const VertexBufferAttribute& attribute = layout.attributes[i];
+        u32 fields[] = { attribute.location, attribute.componentCount, attribute.offset, attribute.type, attribute.normalized };
+        hash = HashBytes(fields, sizeof(fields), hash);
     }
 
-    // then do the same for each of its children
-    for (unsigned int i = 0; i < node->mNumChildren; i++)
+    hash = HashBytes(&submesh.indexType, sizeof(submesh.indexType), hash);
+    hash = HashBytes(vertices, verticesSize, hash);
+    hash = HashBytes(indices, indexCount * sizeof(u32), hash);
+    for (u32 i = 0; i < submesh.lods.size(); ++i)
     {
-        ProcessAssimpNode(scene, node->mChildren[i], myMesh, baseMeshMaterialIndex, submeshMaterialIndices);
+        u32 range[] = { submesh.lods[i].firstIndex, submesh.lods[i].indexCount };
+        hash = HashBytes(range, sizeof(range), hash);
     }
+
+    return hash != 0 ? hash : 1; // 0 means unknown
 }
 
-u32 LoadModel(App* app, const char* filename)
+static bool HasExtension(const char* filename, const char* extension)
 {
-    const aiScene* scene = aiImportFile(filename,
-        aiProcess_Triangulate |
-        aiProcess_GenSmoothNormals |
-        aiProcess_CalcTangentSpace |
-        aiProcess_JoinIdenticalVertices |
-        aiProcess_PreTransformVertices |
-        aiProcess_ImproveCacheLocality |
-        aiProcess_OptimizeMeshes |
-        aiProcess_SortByPType);
+    size_t length = strlen(filename);
+    size_t extensionLength = strlen(extension);
+    if (length <= extensionLength)
+        return false;
+
+    for (size_t i = 0; i < extensionLength; ++i)
+        if (tolower(filename[length - extensionLength + i]) != extension[i])
+            return false;
+    return true;
+}
 
-    if (!scene)
+// Paid once, the processed data is what lands in the mesh cache
+static void ProcessImportedModel(const char* filename, ImportedModel& imported)
+{
+    // Submeshes that are drawn straight from the file data have nothing to process
+    if (!imported.vertexRanges.empty())
+        return;
+
+    ParallelFor(imported.submeshes.size(), [&](u32 i) {
+        Submesh& submesh = imported.submeshes[i];
+
+        if (imported.importOptions & MeshImportOption_OptimizeMeshes)
+        {
+            char name[256];
+            snprintf(name, sizeof(name), "%s[%u]", filename, i);
+            OptimizeSubmesh(submesh, name);
+        }
+
+        if (imported.importOptions & MeshImportOption_GenerateLods)
+            GenerateSubmeshLods(submesh, MESH_LOD_COUNT);
+
+        if (imported.importOptions & MeshImportOption_BuildMeshlets)
+            BuildSubmeshMeshlets(submesh);
+
+        submesh.uvDensity = ComputeSubmeshUvDensity(submesh);
+
+        if (imported.importOptions & MeshImportOption_QuantizeVertices)
+            QuantizeSubmesh(submesh);
+
+        submesh.vertexCount = submesh.vertexBufferLayout.stride ? (u32)submesh.vertices.size() / submesh.vertexBufferLayout.stride : 0;
+        submesh.geometryHash = HashSubmeshGeometry(submesh, submesh.vertices.data(), (u32)submesh.vertices.size(), submesh.indices.data(), (u32)submesh.indices.size());
+    });
+}
+
+// Reads the mesh cache or runs the native importers. Returns false if the model is left to Assimp,
+// with the import flags and options it uses
+static bool ImportModelWithoutAssimp(const char* filename, bool flipTextures, ImportedModel& imported, MappedFile* meshCache)
+{
+    imported = ImportedModel{};
+    imported.filename = filename;
+    imported.flipTextures = flipTextures;
+
+    // Wavefront OBJ and glTF binary files have their own importers, the rest go through Assimp
+    bool nativeObj = HasExtension(filename, ".obj");
+    bool nativeGltf = HasExtension(filename, ".glb");
+    imported.importFlags = nativeObj || nativeGltf ? 0 : AssimpImportFlags;
+    imported.importOptions = MeshImportOptions;
+    if (nativeObj)
+        imported.importOptions |= MeshImportOption_NativeObj;
+    if (nativeGltf)
+        imported.importOptions |= MeshImportOption_NativeGltf;
+
+    // Warm start: skip the importers entirely if there is an up-to-date cache (the embedded images
+    // of glTF binaries only live in the file, see LoadGltfEmbeddedImages())
+    if (meshCache)
     {
-        ELOG("Error loading mesh %s: %s", filename, aiGetErrorString());
-        return UINT32_MAX;
+        if (ReadMeshCacheFile(filename, imported.importFlags, imported.importOptions, *meshCache, imported))
+            return true;
+        UnmapFile(*meshCache);
+    }
+    else if (ReadMeshCache(filename, imported.importFlags, imported.importOptions, imported))
+    {
+        return true;
     }
 
-    app->meshes.push_back(Mesh{});
-    Mesh& mesh = app->meshes.back();
-    u32 meshIdx = (u32)app->meshes.size() - 1u;
+    bool success = false;
+    if (nativeObj)
+    {
+        success = ImportObjModel(filename, imported);
+        if (!success)
+        {
+            ELOG("Falling back to Assimp to load %s", filename);
+            imported.importFlags = AssimpImportFlags;
+            imported.importOptions = MeshImportOptions;
+        }
+    }
+    else if (nativeGltf)
+    {
+        success = ImportGltfModel(filename, imported);
+        if (!success)
+        {
+            ELOG("Falling back to Assimp to load %s", filename);
+            imported.importFlags = AssimpImportFlags;
+            imported.importOptions = MeshImportOptions;
+        }
+    }
+
+    if (success)
+        ProcessImportedModel(filename, imported);
+    return success;
+}
 
-    app->models.push_back(Model{});
-    Model& model = app->models.back();
-    model.meshIdx = meshIdx;
-    u32 modelIdx = (u32)app->models.size() - 1u;
+bool ImportModel(const char* filename, bool flipTextures, ImportedModel& imported, MappedFile* meshCache)
+{
+    if (ImportModelWithoutAssimp(filename, flipTextures, imported, meshCache))
+        return true;
 
-    String directory = GetDirectoryPart(MakeString(filename));
+    // With a pool of import workers Assimp runs out of process, and the mesh cache it writes is what we get
+    if (IsImportWorkerPoolRunning())
+        return ImportModelInWorker(filename, imported.importFlags, imported.importOptions, imported);
 
-    // Create a list of materials
-    u32 baseMeshMaterialIndex = (u32)app->materials.size();
-    for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
+    if (!ImportAssimpModel(filename, imported))
+        return false;
+
+    ProcessImportedModel(filename, imported);
+    return true;
+}
+
+void ImportModelAsync(const char* filename, bool flipTextures, MappedFile* meshCache, const ImportModelCallback& callback)
+{
+    ImportedModel imported;
+    bool success = ImportModelWithoutAssimp(filename, flipTextures, imported, meshCache);
+
+    // The calling worker does not wait for the import worker, a new job reads the mesh cache it writes
+    if (!success && IsImportWorkerPoolRunning())
     {
-        app->materials.push_back(Material{});
-        Material& material = app->materials.back();
-        ProcessAssimpMaterial(app, scene->mMaterials[i], material, directory);
+        const std::string path = filename;
+        const u32 importFlags = imported.importFlags;
+        const u32 importOptions = imported.importOptions;
+        ImportModelInWorkerAsync(filename, [=](bool workerSuccess) {
+            PushJob([=]() {
+                ImportedModel imported;
+                imported.filename = path;
+                imported.flipTextures = flipTextures;
+                imported.importFlags = importFlags;
+                imported.importOptions = importOptions;
+
+                bool success = workerSuccess && ReadMeshCache(path.c_str(), importFlags, importOptions, imported);
+                if (workerSuccess && !success)
+                    ELOG("Import worker did not write a usable mesh cache for %s", path.c_str());
+                callback(success, imported);
+            });
+        });
+        return;
     }
 
-    ProcessAssimpNode(scene, scene->mRootNode, &mesh, baseMeshMaterialIndex, model.materialIdx);
+    if (!success)
+    {
+        success = ImportAssimpModel(filename, imported);
+        if (success)
+            ProcessImportedModel(filename, imported);
+    }
+    callback(success, imported);
+}
 
-    aiReleaseImport(scene);
+void ReleaseImportedModel(ImportedModel& imported)
+{
+    for (u32 i = 0; i < imported.images.size(); ++i)
+        if (imported.images[i].pixels)
+            FreeImage(imported.images[i]);
+
+    UnmapFile(imported.mappedFile);
+
+    imported = ImportedModel{};
+}
 
-    u32 vertexBufferSize = 0;
-    u32 indexBufferSize = 0;
+// Data of a buffer range that contains [offset, offset + size), or NULL
+static const u8* FindRangeData(const std::vector<ImportedBufferRange>& ranges, u32 offset, u32 size)
+{
+    for (u32 i = 0; i < ranges.size(); ++i)
+        if (offset >= ranges[i].offset && offset + size <= ranges[i].offset + ranges[i].size)
+            return ranges[i].data + (offset - ranges[i].offset);
+    return NULL;
+}
+
+// Allocates the submeshes in the geometry pool and uploads them (some imported submeshes may be left out of the mesh, see CreateModel())
+static void UploadMesh(App* app, u32 meshIdx, ImportedModel& imported)
+{
+    Mesh& mesh = app->meshes[meshIdx];
+    mesh.vertexBufferSize = 0;
+    mesh.indexBufferSize = 0;
 
+    std::vector<u8> indices;
     for (u32 i = 0; i < mesh.submeshes.size(); ++i)
     {
-        vertexBufferSize += mesh.submeshes[i].vertices.size() * sizeof(float);
-        indexBufferSize += mesh.submeshes[i].indices.size() * sizeof(u32);
+        Submesh& submesh = mesh.submeshes[i];
+        const ModelSubmesh owner = { meshIdx, i };
+
+        if (!imported.vertexRanges.empty())
+        {
+            // Decoded mesh caches and mapped glTF buffer views already have the final GPU layout, so they go straight to the driver
+            const u32 verticesSize = submesh.vertexCount * submesh.vertexBufferLayout.stride;
+            const u32 indicesSize = submesh.indexCount * GetIndexSize(submesh.indexType);
+            const u8* verticesData = FindRangeData(imported.vertexRanges, submesh.vertexOffset, verticesSize);
+            const u8* indicesData = FindRangeData(imported.indexRanges, submesh.indexOffset, indicesSize);
+            ASSERT(verticesData && indicesData, "Submesh data outside of the imported buffer ranges");
+
+            AllocateSubmeshGeometry(submesh, owner, verticesData, indicesData);
+        }
+        else
+        {
+            // 16-bit indices are narrowed here
+            submesh.vertexCount = submesh.vertexBufferLayout.stride ? (u32)submesh.vertices.size() / submesh.vertexBufferLayout.stride : 0;
+            submesh.indexCount = (u32)submesh.indices.size();
+            indices.resize(submesh.indexCount * GetIndexSize(submesh.indexType));
+            WriteSubmeshIndices(submesh, indices.data());
+
+            AllocateSubmeshGeometry(submesh, owner, submesh.vertices.data(), indices.data());
+
+            // The GPU has its copy now (an evicted mesh is reloaded from its cache)
+            std::vector<u8>().swap(submesh.vertices);
+            std::vector<u32>().swap(submesh.indices);
+        }
+
+        mesh.vertexBufferSize += submesh.vertexCount * submesh.vertexBufferLayout.stride;
+        mesh.indexBufferSize += Align(submesh.indexCount * GetIndexSize(submesh.indexType), sizeof(u32));
     }
 
-    glGenBuffers(1, &mesh.vertexBufferHandle);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
-    glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, NULL, GL_STATIC_DRAW);
+    mesh.resident = true;
+}
 
-    glGenBuffers(1, &mesh.indexBufferHandle);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, NULL, GL_STATIC_DRAW);
+static u32 GetPlaceholderTexture(App* app, MaterialTexture texture)
+{
+    switch (texture)
+    {
+        case MaterialTexture_Albedo:  return app->whiteTexIdx;
+        case MaterialTexture_Normals: return app->normalTexIdx;
+        default:                      return app->blackTexIdx;
+    }
+}
 
-    u32 indicesOffset = 0;
-    u32 verticesOffset = 0;
+// Bump maps keep every channel, since OBJ files often reference normal maps through map_Bump
+TextureUsage GetTextureUsage(MaterialTexture texture)
+{
+    switch (texture)
+    {
+        case MaterialTexture_Specular: return TextureUsage_Mask;
+        case MaterialTexture_Normals:  return TextureUsage_Normals;
+        default:                       return TextureUsage_Color;
+    }
+}
 
-    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+u32 CreateModel(App* app, ImportedModel& imported, u32 modelIdx)
+{
+    // Submeshes drawn from the model file have nothing to cache
+    if (!imported.fromCache && imported.vertexRanges.empty())
+        WriteMeshCache(imported.filename.c_str(), imported.importFlags, imported.importOptions, imported);
+
+    // Materials (texture indices are resolved on copies, so identical ones from other files are found)
+    std::vector<Material> materials = imported.materials;
+
+    // Textures stream in: images the importer decoded (embedded ones) are cooked on the workers, the
+    // rest are read from their texture cache or cooked there. Until then, they sample a neutral texture for their slot
+    for (u32 i = 0; i < imported.texturePaths.size(); ++i)
     {
-        const void* verticesData = mesh.submeshes[i].vertices.data();
-        const u32   verticesSize = mesh.submeshes[i].vertices.size() * sizeof(float);
-        glBufferSubData(GL_ARRAY_BUFFER, verticesOffset, verticesSize, verticesData);
-        mesh.submeshes[i].vertexOffset = verticesOffset;
-        verticesOffset += verticesSize;
+        u32 slot = imported.textureSlots[i];
+        Material& material = materials[slot / MaterialTexture_Count];
+        u32 placeholderTexIdx = GetPlaceholderTexture(app, (MaterialTexture)(slot % MaterialTexture_Count));
+        TextureUsage usage = GetTextureUsage((MaterialTexture)(slot % MaterialTexture_Count));
 
-        const void* indicesData = mesh.submeshes[i].indices.data();
-        const u32   indicesSize = mesh.submeshes[i].indices.size() * sizeof(u32);
-        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indicesOffset, indicesSize, indicesData);
-        mesh.submeshes[i].indexOffset = indicesOffset;
-        indicesOffset += indicesSize;
+        if (i < imported.images.size() && imported.images[i].pixels)
+        {
+            *material.GetTextureIdx(slot % MaterialTexture_Count) = RequestTexture2DFromImage(app, imported.texturePaths[i].c_str(), imported.images[i], placeholderTexIdx, usage);
+            imported.images[i].pixels = NULL; // Owned by the texture streamer now
+        }
+        else
+        {
+            *material.GetTextureIdx(slot % MaterialTexture_Count) = RequestTexture2D(app, imported.texturePaths[i].c_str(), placeholderTexIdx, imported.flipTextures, usage);
+        }
     }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    Model model;
+    for (u32 i = 0; i < imported.submeshMaterials.size(); ++i)
+        model.materialIdx.push_back(FindOrAddSharedMaterial(app, materials[imported.submeshMaterials[i]]));
+
+    // Submeshes already resident (loaded by another file, or repeated in this one) are not uploaded again
+    std::vector<Submesh> newSubmeshes;
+    std::unordered_map<u64, u32> newSubmeshIndexes;
+
+    for (u32 i = 0; i < imported.submeshes.size(); ++i)
+    {
+        Submesh& submesh = imported.submeshes[i];
+
+        ModelSubmesh location;
+        if (FindSharedSubmesh(submesh.geometryHash, location))
+        {
+            model.submeshes.push_back(location);
+            continue;
+        }
+
+        if (submesh.geometryHash != 0)
+        {
+            std::unordered_map<u64, u32>::iterator it = newSubmeshIndexes.find(submesh.geometryHash);
+            if (it != newSubmeshIndexes.end())
+            {
+                model.submeshes.push_back(ModelSubmesh{ UINT32_MAX, it->second });
+                continue;
+            }
+            newSubmeshIndexes[submesh.geometryHash] = (u32)newSubmeshes.size();
+        }
+
+        model.submeshes.push_back(ModelSubmesh{ UINT32_MAX, (u32)newSubmeshes.size() });
+        newSubmeshes.push_back(std::move(submesh));
+    }
+
+    // Mesh with the new submeshes
+    if (!newSubmeshes.empty())
+    {
+        u32 meshIdx = CreateSharedMesh(app);
+        Mesh& mesh = app->meshes[meshIdx];
+
+        mesh.submeshes.swap(newSubmeshes);
+        mesh.source = imported.filename;
+        UploadMesh(app, meshIdx, imported);
+        ShareMeshSubmeshes(app, meshIdx);
+        TrackMesh(app, meshIdx);
+
+        for (u32 i = 0; i < model.submeshes.size(); ++i)
+            if (model.submeshes[i].meshIdx == UINT32_MAX)
+                model.submeshes[i].meshIdx = meshIdx;
+    }
+
+    // Model (an existing one, like a streaming placeholder, is replaced in place)
+    if (modelIdx == UINT32_MAX)
+    {
+        app->models.push_back(Model{});
+        modelIdx = (u32)app->models.size() - 1u;
+    }
+
+    SetModelContents(app, modelIdx, model);
+
+    ReleaseImportedModel(imported);
 
     return modelIdx;
-}
\ No newline at end of file
+}
+
+bool RestoreMesh(App* app, u32 meshIdx, ImportedModel& imported)
+{
+    Mesh& mesh = app->meshes[meshIdx];
+
+    // Submeshes are found again by their geometry hash, the ones without one by their position
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    {
+        Submesh& submesh = mesh.submeshes[i];
+
+        u32 match = UINT32_MAX;
+        for (u32 j = 0; j < imported.submeshes.size() && match == UINT32_MAX; ++j)
+            if (submesh.geometryHash != 0 ? imported.submeshes[j].geometryHash == submesh.geometryHash : i == j)
+                match = j;
+        if (match == UINT32_MAX)
+            return false;
+
+        Submesh& source = imported.submeshes[match];
+        submesh.vertexOffset = source.vertexOffset;
+        submesh.vertexCount = source.vertexCount;
+        submesh.indexOffset = source.indexOffset;
+        submesh.indexCount = source.indexCount;
+        submesh.vertices.swap(source.vertices);
+        submesh.indices.swap(source.indices);
+    }
+
+    UploadMesh(app, meshIdx, imported);
+    TrackMesh(app, meshIdx);
+    return true;
+}
+
+u32 LoadModel(App* app, const char* filename, bool flipTextures)
+{
+    u32 modelIdx = AcquireLoadedModel(filename, flipTextures);
+    if (modelIdx != UINT32_MAX)
+        return modelIdx;
+
+    ImportedModel imported;
+    if (!ImportModel(filename, flipTextures, imported))
+        return UINT32_MAX;
+
+    LoadGltfEmbeddedImages(filename, imported);
+    modelIdx = CreateModel(app, imported);
+    RegisterLoadedModel(filename, flipTextures, modelIdx);
+    return modelIdx;
+}
@@ -5,11 +5,65 @@
 #include <assimp/postprocess.h>
 
 #include "engine.h"
+#include "texture_compression.h"
 
-void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices);
+#include <functional>
 
-void ProcessAssimpMaterial(App* app, aiMaterial* material, Material& myMaterial, String directory);
+/**
+ * Float vertex format every importer produces before the submesh is post-processed: position,
+ * normal and, if present, uvs, tangent and bitangent.
+ */
+VertexBufferLayout CreateImportVertexLayout(bool hasTexCoords, bool hasTangentSpace);
 
-void ProcessAssimpNode(const aiScene* scene, aiNode* node, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices);
+std::string GetDirectoryOf(const std::string& path);
 
-u32 LoadModel(App* app, const char* filename);
\ No newline at end of file
+void ProcessAssimpMesh(aiMesh* mesh, Submesh& submesh);
+
+void ProcessAssimpMaterial(aiMaterial* material, u32 materialIdx, const std::string& directory, ImportedModel& imported);
+
+void FlattenAssimpNode(const aiScene* scene, aiNode* node, std::vector<aiMesh*>& meshes);
+
+/**
+ * Identifies the GPU data of a submesh, whichever file it comes from: its layout, index type and
+ * LOD ranges, and the vertices (in the final layout) and indices it is uploaded from. Never 0,
+ * which means unknown.
+ */
+u64 HashSubmeshGeometry(const Submesh& submesh, const u8* vertices, u32 verticesSize, const u32* indices, u32 indexCount);
+
+/**
+ * Imports a model into CPU memory, from its mesh cache if it is up to date or through the OBJ
+ * and glTF binary importers or Assimp otherwise. It does not touch OpenGL nor the App, so it can run on any thread.
+ * If the mesh cache was read already (see ReadFileAsync()), it is passed in meshCache and the import takes it.
+ */
+bool ImportModel(const char* filename, bool flipTextures, ImportedModel& imported, MappedFile* meshCache = NULL);
+
+typedef std::function<void(bool success, ImportedModel& imported)> ImportModelCallback;
+
+/**
+ * ImportModel() for the workers of the job system, which it does not hold while an import worker
+ * process runs (see import_workers.h): callback is then called from a new job once the process
+ * exits, and before ImportModelAsync() returns otherwise. imported is the callback's to keep or release.
+ */
+void ImportModelAsync(const char* filename, bool flipTextures, MappedFile* meshCache, const ImportModelCallback& callback);
+
+void ReleaseImportedModel(ImportedModel& imported);
+
+/** How the textures of a material slot are cooked */
+TextureUsage GetTextureUsage(MaterialTexture texture);
+
+/**
+ * Creates the materials, GL buffers and streamed textures of an imported model (writing its mesh cache
+ * if it was imported from a source asset other than a .glb) and releases the imported data. Submeshes and materials
+ * identical to resident ones are shared instead (see model_registry.h). If modelIdx is given, that
+ * model is replaced in place; otherwise, a new one is added. Returns the index of the model.
+ */
+u32 CreateModel(App* app, ImportedModel& imported, u32 modelIdx = UINT32_MAX);
+
+/**
+ * Uploads the submeshes of an evicted mesh again, from its source imported anew. Returns false if
+ * the source no longer has them. The imported data is not released.
+ */
+bool RestoreMesh(App* app, u32 meshIdx, ImportedModel& imported);
+
+/** Returns the model of a file, which is imported and created only the first time (see ReleaseModel()) */
+u32 LoadModel(App* app, const char* filename, bool flipTextures = false);
\ No newline at end of file
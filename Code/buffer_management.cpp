@@ -24,6 +24,193 @@ Buffer CreateBuffer(u32 size, GLenum type, GLenum usage)
     return buffer;
 }
 
+Buffer CreatePersistentBuffer(u32 size, GLenum type)
+{
+    static PFNGLBUFFERSTORAGEPROC glBufferStorage = (PFNGLBUFFERSTORAGEPROC)glfwGetProcAddress("glBufferStorage");
+
+    Buffer buffer = {};
+    if (!glBufferStorage)
+    {
+        ELOG("glBufferStorage is not supported, persistent buffers are not available");
+        return buffer;
+    }
+
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    buffer.size = size;
+    buffer.type = type;
+
+    glGenBuffers(1, &buffer.handle);
+    glBindBuffer(type, buffer.handle);
+    glBufferStorage(type, size, NULL, flags);
+    buffer.data = glMapBufferRange(type, 0, size, flags);
+    glBindBuffer(type, 0);
+
+    if (!buffer.data)
+    {
+        ELOG("Could not map a persistent buffer of %u bytes", size);
+        glDeleteBuffers(1, &buffer.handle);
+        buffer = Buffer{};
+    }
+
+    return buffer;
+}
+
+void DestroyPersistentBuffer(Buffer& buffer)
+{
+    if (buffer.handle == 0)
+        return;
+
+    glBindBuffer(buffer.type, buffer.handle);
+    glUnmapBuffer(buffer.type);
+    glBindBuffer(buffer.type, 0);
+    glDeleteBuffers(1, &buffer.handle);
+    buffer = Buffer{};
+}
+
+RingBuffer CreateRingBuffer(u32 regionSize, u32 regionCount, GLenum type)
+{
+    ASSERT(regionCount > 0 && regionCount <= RING_BUFFER_MAX_REGIONS, "Unsupported number of ring buffer regions");
+
+    RingBuffer ring = {};
+    ring.regionSize = regionSize;
+    ring.regionCount = regionCount;
+    ring.region = regionCount - 1; // So the first frame writes the first region
+    ring.buffer = CreatePersistentBuffer(regionSize * regionCount, type);
+    ring.persistent = ring.buffer.handle != 0;
+
+    if (!ring.persistent)
+    {
+        ILOG("Ring buffer regions are mapped every frame instead");
+        ring.buffer = CreateBuffer(regionSize * regionCount, type, GL_STREAM_DRAW);
+    }
+
+    return ring;
+}
+
+void DestroyRingBuffer(RingBuffer& ring)
+{
+    for (u32 i = 0; i < ring.regionCount; ++i)
+        if (ring.fences[i])
+            glDeleteSync(ring.fences[i]);
+
+    if (ring.persistent)
+    {
+        DestroyPersistentBuffer(ring.buffer);
+    }
+    else
+    {
+        glDeleteBuffers(1, &ring.buffer.handle);
+    }
+    ring = RingBuffer{};
+}
+
+// Reallocates the regions, bigger. The old buffer is only freed by GL once the frames reading it are done
+static void GrowRingBuffer(RingBuffer& ring, u32 size)
+{
+    u32 regionSize = ring.regionSize;
+    while (regionSize < size)
+        regionSize *= 2;
+
+    RingBuffer grown = CreateRingBuffer(regionSize, ring.regionCount, ring.buffer.type);
+    grown.region = ring.region;
+    grown.peakBytes = ring.peakBytes;
+    grown.growCount = ring.growCount + 1;
+    grown.overflowCount = ring.overflowCount;
+    grown.frameCount = ring.frameCount;
+    grown.blockedFrameCount = ring.blockedFrameCount;
+    grown.blockedSeconds = ring.blockedSeconds;
+
+    DestroyRingBuffer(ring);
+    ring = grown;
+    ILOG("Ring buffer regions grown to %u KB", regionSize / KB(1));
+}
+
+void MapRingBufferRegion(RingBuffer& ring, u32 minSize)
+{
+    if (glm::max(minSize, ring.peakBytes) > ring.regionSize)
+        GrowRingBuffer(ring, glm::max(minSize, ring.peakBytes));
+
+    ring.region = (ring.region + 1) % ring.regionCount;
+    ring.overflowBytes = 0;
+    ring.frameCount++;
+
+    const f64 start = glfwGetTime();
+    GLsync& fence = ring.fences[ring.region];
+    if (fence)
+    {
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+        {
+            ring.blockedFrameCount++;
+            do
+            {
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000); // 1 s
+            } while (status == GL_TIMEOUT_EXPIRED);
+        }
+        if (status == GL_WAIT_FAILED)
+            ELOG("Waiting for ring buffer region %u failed", ring.region);
+
+        glDeleteSync(fence);
+        fence = 0;
+    }
+
+    const u32 regionOffset = ring.region * ring.regionSize;
+    if (!ring.persistent)
+    {
+        // The whole buffer is mapped so the head stays an offset in it, but only this region is written
+        glBindBuffer(ring.buffer.type, ring.buffer.handle);
+        ring.buffer.data = glMapBufferRange(ring.buffer.type, 0, ring.buffer.size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        glBindBuffer(ring.buffer.type, 0);
+    }
+    ring.buffer.head = regionOffset;
+
+    ring.lastBlockedSeconds = glfwGetTime() - start;
+    ring.blockedSeconds += ring.lastBlockedSeconds;
+}
+
+bool ReserveRingBufferSpace(RingBuffer& ring, u32 size, u32 alignment)
+{
+    ASSERT(IsPowerOf2(alignment), "The alignment must be a power of 2");
+    const u32 regionEnd = (ring.region + 1) * ring.regionSize;
+    const u32 head = Align(ring.buffer.head, alignment);
+    if ((u64)head + size <= regionEnd)
+    {
+        ring.buffer.head = head;
+        return true;
+    }
+
+    // The skipped reservations are laid out past the end of the region, as if it were big enough
+    const u32 overflowHead = ring.overflowBytes > 0 ? Align(regionEnd + ring.overflowBytes, alignment) : head;
+    ring.overflowBytes = overflowHead + size - regionEnd;
+    ring.overflowCount++;
+    return false;
+}
+
+void UnmapRingBufferRegion(RingBuffer& ring)
+{
+    ASSERT(ring.buffer.head <= (ring.region + 1) * ring.regionSize, "Ring buffer region overflow");
+    ring.usedBytes = ring.buffer.head - ring.region * ring.regionSize;
+    ring.peakBytes = glm::max(ring.peakBytes, ring.overflowBytes > 0 ? ring.regionSize + ring.overflowBytes : ring.usedBytes);
+    if (ring.overflowBytes > 0)
+        ELOG("%u bytes did not fit in the ring buffer this frame, its regions grow next frame", ring.overflowBytes);
+
+    if (!ring.persistent)
+    {
+        glBindBuffer(ring.buffer.type, ring.buffer.handle);
+        glUnmapBuffer(ring.buffer.type);
+        glBindBuffer(ring.buffer.type, 0);
+        ring.buffer.data = NULL;
+    }
+}
+
+void FenceRingBufferRegion(RingBuffer& ring)
+{
+    GLsync& fence = ring.fences[ring.region];
+    if (fence)
+        glDeleteSync(fence);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
 void BindBuffer(const Buffer& buffer)
 {
     glBindBuffer(buffer.type, buffer.handle);
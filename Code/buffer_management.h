@@ -11,6 +11,53 @@ u32 Align(u32 value, u32 alignment);
 
 Buffer CreateBuffer(u32 size, GLenum type, GLenum usage);
 
+// glBufferStorage (GL 4.4 or ARB_buffer_storage) is not part of the GL 4.3 loader, so it is fetched by hand
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT   0x0080
+#endif
+
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+/**
+ * Creates a buffer with immutable storage that stays mapped (persistent and coherent) for its
+ * whole life, so buffer.data can be written from any thread. Synchronizing with the GPU is up
+ * to the caller. Returns a buffer with a 0 handle if the driver lacks glBufferStorage.
+ */
+Buffer CreatePersistentBuffer(u32 size, GLenum type);
+
+void DestroyPersistentBuffer(Buffer& buffer);
+
+/**
+ * Creates a ring of regionCount regions of regionSize bytes (a multiple of the alignment the
+ * buffer is bound with). It is persistently mapped when the driver allows it, so writing a frame
+ * never maps anything; otherwise each region is mapped unsynchronized, as the fences already
+ * guarantee the GPU is done with it.
+ */
+RingBuffer CreateRingBuffer(u32 regionSize, u32 regionCount, GLenum type);
+
+void DestroyRingBuffer(RingBuffer& ring);
+
+/**
+ * Moves to the next region, waiting for the GPU to finish the frame that read it last, and
+ * leaves buffer.head at its start, ready for the Push* functions. The regions grow (doubling)
+ * until they fit minSize bytes, which the caller writes without reserving them, and the peak
+ * the previous frames needed (overflow included).
+ */
+void MapRingBufferRegion(RingBuffer& ring, u32 minSize);
+
+/**
+ * Aligns the head and checks that size more bytes fit in the current region. When they do not,
+ * false is returned and the head is left as it was, so the caller skips them this frame; what
+ * they were short of is counted for the next frames to grow the regions.
+ */
+bool ReserveRingBufferSpace(RingBuffer& ring, u32 size, u32 alignment);
+
+void UnmapRingBufferRegion(RingBuffer& ring);
+
+/** Fences the region once every command reading it this frame has been issued */
+void FenceRingBufferRegion(RingBuffer& ring);
+
 #define CreateConstantBuffer(size) CreateBuffer(size, GL_UNIFORM_BUFFER, GL_STREAM_DRAW)
 #define CreateStaticVertexBuffer(size) CreateBuffer(size, GL_ARRAY_BUFFER, GL_STATIC_DRAW)
 #define CreateStaticIndexBuffer(size) CreateBuffer(size, GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW)
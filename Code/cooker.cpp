@@ -0,0 +1,316 @@
+//
+// cooker.cpp: Entry point of the Cooker, a command line tool built from the engine sources with
+// ASSET_COOKER defined (see Cooker.vcxproj). It hashes every source asset under the working
+// directory and cooks, in parallel, the ones whose caches are missing or out of date: models into
+// mesh caches and images into compressed mip chains. The hashes are saved to the asset manifest
+// the engine loads at startup, so neither of them hashes an untouched source again.
+//
+// Usage: Cooker [working directory]
+//        Cooker --import-model <model>  (as an import worker of the engine, see import_workers.h)
+//
+// Import settings that cannot be told from the files themselves are read from cook_settings.txt,
+// one line per path (a file, or a directory ending with '/') followed by its options:
+//   flip_textures  Images, and the textures of models, are flipped vertically
+//   virtual        The image is also cooked as a virtual texture
+//   skip           Not cooked
+//
+
+#include "asset_manifest.h"
+#include "asset_pack.h"
+#include "assimp_model_loading.h"
+#include "import_workers.h"
+#include "job_system.h"
+#include "mesh_cache.h"
+#include "texture_cache.h"
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string.h>
+
+#define COOK_SETTINGS_FILENAME "cook_settings.txt"
+
+enum CookOption
+{
+    CookOption_FlipTextures = 1 << 0,
+    CookOption_Virtual      = 1 << 1,
+    CookOption_Skip         = 1 << 2
+};
+
+struct CookSetting
+{
+    std::string path; // Normalized, a prefix of the paths it applies to
+    u32         options;
+};
+
+struct SourceAsset
+{
+    std::string path;
+    AssetKind   kind;
+    u32         options;
+};
+
+struct TextureCookRequest
+{
+    std::string  path;
+    TextureUsage usage;
+    bool         flipVertically;
+
+    bool operator<(const TextureCookRequest& other) const
+    {
+        if (path != other.path)
+            return path < other.path;
+        if (usage != other.usage)
+            return usage < other.usage;
+        return flipVertically < other.flipVertically;
+    }
+};
+
+static const char* ModelExtensions[] = { ".obj", ".glb", ".gltf", ".fbx", ".dae", ".3ds", ".ply", ".stl" };
+static const char* ImageExtensions[] = { ".png", ".jpg", ".jpeg", ".tga", ".bmp" };
+static const char* ShaderExtensions[] = { ".glsl" };
+
+static bool HasAnyExtension(const std::string& path, const char** extensions, u32 extensionCount)
+{
+    for (u32 i = 0; i < extensionCount; ++i)
+    {
+        size_t length = strlen(extensions[i]);
+        if (path.size() > length && path.compare(path.size() - length, length, extensions[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+static std::vector<CookSetting> ReadCookSettings(const char* filepath)
+{
+    std::vector<CookSetting> settings;
+
+    MappedFile file = MapFile(filepath);
+    if (file.data == NULL)
+        return settings;
+
+    std::string text((const char*)file.data, (size_t)file.size);
+    UnmapFile(file);
+
+    size_t lineStart = 0;
+    while (lineStart < text.size())
+    {
+        size_t lineEnd = text.find('\n', lineStart);
+        if (lineEnd == std::string::npos)
+            lineEnd = text.size();
+        std::string line = text.substr(lineStart, lineEnd - lineStart);
+        lineStart = lineEnd + 1;
+
+        char path[256] = {};
+        int optionsStart = 0;
+        if (line.empty() || line[0] == '#' || sscanf(line.c_str(), "%255s %n", path, &optionsStart) != 1)
+            continue;
+
+        CookSetting setting = {};
+        setting.path = NormalizeAssetPath(path);
+        if (path[strlen(path) - 1] == '/')
+            setting.path += '/';
+
+        char option[64];
+        int optionLength = 0;
+        for (const char* c = line.c_str() + optionsStart; sscanf(c, "%63s%n", option, &optionLength) == 1; c += optionLength)
+        {
+            if (strcmp(option, "flip_textures") == 0)
+                setting.options |= CookOption_FlipTextures;
+            else if (strcmp(option, "virtual") == 0)
+                setting.options |= CookOption_Virtual;
+            else if (strcmp(option, "skip") == 0)
+                setting.options |= CookOption_Skip;
+            else
+                ELOG("%s: unknown option %s for %s", filepath, option, path);
+        }
+        settings.push_back(setting);
+    }
+
+    return settings;
+}
+
+static u32 GetCookOptions(const std::vector<CookSetting>& settings, const std::string& path)
+{
+    u32 options = 0;
+    for (u32 i = 0; i < settings.size(); ++i)
+        if (path.compare(0, settings[i].path.size(), settings[i].path) == 0)
+            options |= settings[i].options;
+    return options;
+}
+
+// Imports the model, from its mesh cache if it is up to date, and lists the textures its materials use
+static bool CookModel(const SourceAsset& asset, bool& cooked, std::vector<TextureCookRequest>& textures)
+{
+    bool flipTextures = (asset.options & CookOption_FlipTextures) != 0;
+
+    ImportedModel imported;
+    if (!ImportModel(asset.path.c_str(), flipTextures, imported))
+        return false;
+
+    // glTF binaries drawn from the file data have nothing to cache
+    bool success = true;
+    cooked = !imported.fromCache && imported.vertexRanges.empty();
+    if (cooked)
+        success = WriteMeshCache(asset.path.c_str(), imported.importFlags, imported.importOptions, imported);
+
+    for (u32 i = 0; i < imported.texturePaths.size(); ++i)
+    {
+        if (i < imported.images.size() && imported.images[i].pixels)
+            continue;
+
+        TextureCookRequest texture;
+        texture.path = imported.texturePaths[i];
+        texture.usage = GetTextureUsage((MaterialTexture)(imported.textureSlots[i] % MaterialTexture_Count));
+        texture.flipVertically = flipTextures;
+        textures.push_back(texture);
+    }
+
+    ReleaseImportedModel(imported);
+    return success;
+}
+
+static bool CookTextureRequest(const TextureCookRequest& request, bool& cooked)
+{
+    CookedTexture texture = {};
+    cooked = !ReadTextureCache(request.path.c_str(), request.flipVertically, request.usage, texture);
+
+    bool success = !cooked || LoadCookedTexture(request.path.c_str(), request.flipVertically, request.usage, texture);
+    ReleaseCookedTexture(texture);
+    return success;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 3 && strcmp(argv[1], IMPORT_WORKER_ARGUMENT) == 0)
+        return RunImportWorker(argv[2]);
+
+    const char* workingDirectory = argc > 1 ? argv[1] : ".";
+    if (!SetWorkingDirectory(workingDirectory))
+    {
+        ELOG("Cannot open the working directory %s", workingDirectory);
+        return 1;
+    }
+
+    InitJobSystem();
+
+    // Cooked for the GPUs the engine targets, which support S3TC (the engine cooks again if not)
+    App app = {};
+    app.openglInfo.extensions.push_back("GL_EXT_texture_compression_s3tc");
+    InitTextureCompression(&app);
+
+    LoadAssetManifest(ASSET_MANIFEST_FILENAME);
+    std::vector<CookSetting> settings = ReadCookSettings(COOK_SETTINGS_FILENAME);
+
+    std::vector<SourceAsset> assets;
+    std::vector<std::string> filepaths = ListFiles(".");
+    for (u32 i = 0; i < filepaths.size(); ++i)
+    {
+        std::string path = NormalizeAssetPath(filepaths[i].c_str());
+
+        SourceAsset asset;
+        asset.path = filepaths[i];
+        asset.options = GetCookOptions(settings, path);
+        if (HasAnyExtension(path, ModelExtensions, ARRAY_COUNT(ModelExtensions)))
+            asset.kind = AssetKind_Model;
+        else if (HasAnyExtension(path, ImageExtensions, ARRAY_COUNT(ImageExtensions)))
+            asset.kind = AssetKind_Texture;
+        else if (HasAnyExtension(path, ShaderExtensions, ARRAY_COUNT(ShaderExtensions)))
+            asset.kind = AssetKind_Shader;
+        else
+            continue;
+
+        if (!(asset.options & CookOption_Skip))
+            assets.push_back(asset);
+    }
+
+    // Untouched sources take their hash from the manifest, the rest are read and hashed
+    std::atomic<u32> failedCount(0);
+    std::vector<AssetManifestEntry> manifest(assets.size());
+    ParallelFor(assets.size(), [&](u32 i) {
+        AssetManifestEntry& entry = manifest[i];
+        entry.path = assets[i].path;
+        entry.kind = assets[i].kind;
+        entry.timestamp = GetFileLastWriteTimestamp(entry.path.c_str());
+        entry.hash = GetAssetHash(entry.path.c_str());
+        if (entry.hash == 0)
+        {
+            ELOG("Cannot read %s", entry.path.c_str());
+            failedCount++;
+        }
+    });
+
+    std::vector<u32> models;
+    for (u32 i = 0; i < assets.size(); ++i)
+        if (assets[i].kind == AssetKind_Model)
+            models.push_back(i);
+
+    // Models first, the textures they reference are cooked for the usage of their material slot
+    std::atomic<u32> cookedCount(0);
+    std::atomic<u32> upToDateCount(0);
+    std::mutex texturesMutex;
+    std::set<TextureCookRequest> textures;
+    ParallelFor(models.size(), [&](u32 i) {
+        const SourceAsset& asset = assets[models[i]];
+
+        bool cooked = false;
+        std::vector<TextureCookRequest> modelTextures;
+        if (!CookModel(asset, cooked, modelTextures))
+        {
+            ELOG("Failed cooking model %s", asset.path.c_str());
+            failedCount++;
+            return;
+        }
+        (cooked ? cookedCount : upToDateCount)++;
+
+        std::lock_guard<std::mutex> lock(texturesMutex);
+        textures.insert(modelTextures.begin(), modelTextures.end());
+    });
+
+    // Images no model references are cooked as color textures
+    std::set<std::string> referencedImages;
+    for (std::set<TextureCookRequest>::const_iterator it = textures.begin(); it != textures.end(); ++it)
+        referencedImages.insert(NormalizeAssetPath(it->path.c_str()));
+
+    std::vector<TextureCookRequest> textureRequests(textures.begin(), textures.end());
+    for (u32 i = 0; i < assets.size(); ++i)
+    {
+        const SourceAsset& asset = assets[i];
+        if (asset.kind != AssetKind_Texture)
+            continue;
+
+        TextureCookRequest request;
+        request.path = asset.path;
+        request.flipVertically = (asset.options & CookOption_FlipTextures) != 0;
+        if (referencedImages.find(NormalizeAssetPath(asset.path.c_str())) == referencedImages.end())
+        {
+            request.usage = TextureUsage_Color;
+            textureRequests.push_back(request);
+        }
+        if (asset.options & CookOption_Virtual)
+        {
+            request.usage = TextureUsage_Virtual;
+            textureRequests.push_back(request);
+        }
+    }
+
+    ParallelFor(textureRequests.size(), [&](u32 i) {
+        bool cooked = false;
+        if (!CookTextureRequest(textureRequests[i], cooked))
+        {
+            ELOG("Failed cooking texture %s", textureRequests[i].path.c_str());
+            failedCount++;
+            return;
+        }
+        (cooked ? cookedCount : upToDateCount)++;
+    });
+
+    // Shaders have no cooking step (there are no includes to resolve), they are only hashed
+    if (!WriteAssetManifest(ASSET_MANIFEST_FILENAME, manifest))
+        failedCount++;
+
+    ILOG("%u sources: %u cooked, %u up to date, %u failed", (u32)assets.size(), (u32)cookedCount, (u32)upToDateCount, (u32)failedCount);
+
+    ShutdownJobSystem();
+    return failedCount > 0 ? 1 : 0;
+}
@@ -10,12 +10,31 @@
 #include <stb_image.h>
 #include <stb_image_write.h>
 
+#include "asset_manifest.h"
+#include "asset_pack.h"
 #include "assimp_model_loading.h"
 #include "buffer_management.h"
+#include "geometry_pool.h"
+#include "import_workers.h"
+#include "job_system.h"
 #include "material.h"
+#include "meshlets.h"
+#include "model_registry.h"
+#include "model_streaming.h"
+#include "residency.h"
+#include "texture_atlas.h"
+#include "texture_streaming.h"
+#include "texture_compression.h"
+#include "vertex_quantization.h"
+#include "virtual_texture.h"
 
 #define BINDING(b) b
 
+// Bytes pushed to the uniform buffer for the GlobalParams block (camera position and light count,
+// then each light) and the LocalParams block of each entity, with the std140 layout of shaders.glsl
+#define GLOBAL_PARAMS_SIZE(lightCount) (sizeof(vec4) + (lightCount) * 8 * sizeof(vec4))
+#define LOCAL_PARAMS_SIZE (2 * sizeof(mat4))
+
 GLuint CreateProgramFromSource(String programSource, const char* shaderName)
 {
     GLchar  infoLogBuffer[1024] = {};
@@ -23,7 +42,11 @@ GLuint CreateProgramFromSource(String programSource, const char* shaderName)
     GLsizei infoLogSize;
     GLint   success;
 
+#if QUANTIZED_VERTICES
+    char versionString[] = "#version 430\n#define QUANTIZED_VERTICES\n";
+#else
     char versionString[] = "#version 430\n";
+#endif
     char shaderNameDefine[128];
     sprintf(shaderNameDefine, "#define %s\n", shaderName);
     char vertexShaderDefine[] = "#define VERTEX\n";
@@ -95,6 +118,16 @@ GLuint CreateProgramFromSource(String programSource, const char* shaderName)
     return programHandle;
 }
 
+// Looked up once per program rather than per draw
+static void FindTextureAtlasUniforms(Program& program)
+{
+    program.programUniformTextureAtlas = glGetUniformLocation(program.handle, "uTextureAtlas");
+    program.programUniformDiffuseAtlasRect = glGetUniformLocation(program.handle, "uDiffuseAtlasRect");
+    program.programUniformDiffuseAtlasLayer = glGetUniformLocation(program.handle, "uDiffuseAtlasLayer");
+    program.programUniformSpecularAtlasRect = glGetUniformLocation(program.handle, "uSpecularAtlasRect");
+    program.programUniformSpecularAtlasLayer = glGetUniformLocation(program.handle, "uSpecularAtlasLayer");
+}
+
 u32 LoadProgram(App* app, const char* filepath, const char* programName)
 {
     String programSource = ReadTextFile(filepath);
@@ -104,6 +137,8 @@ u32 LoadProgram(App* app, const char* filepath, const char* programName)
     program.filepath = filepath;
     program.programName = programName;
     program.lastWriteTimestamp = GetFileLastWriteTimestamp(filepath);
+    FindTextureAtlasUniforms(program);
+    FindVirtualTextureUniforms(program);
 
     // Fill input vertex shader layout automatically
     GLint attributeCount, attributeNameMaxLength;
@@ -136,11 +171,14 @@ u32 LoadProgram(App* app, const char* filepath, const char* programName)
     return app->programs.size() - 1;
 }
 
-Image LoadImage(const char* filename)
+Image LoadImage(const char* filename, bool flipVertically)
 {
     Image img = {};
-    //stbi_set_flip_vertically_on_load(true);
-    img.pixels = stbi_load(filename, &img.size.x, &img.size.y, &img.nchannels, 0);
+    MappedFile file = MapFile(filename); // Through the platform layer, so it can come from the asset pack
+    stbi_set_flip_vertically_on_load_thread(flipVertically); // Per thread, since images are decoded on several threads
+    if (file.data)
+        img.pixels = stbi_load_from_memory(file.data, (int)file.size, &img.size.x, &img.size.y, &img.nchannels, 0);
+    UnmapFile(file);
     if (img.pixels)
     {
         img.stride = img.size.x * img.nchannels;
@@ -152,56 +190,141 @@ Image LoadImage(const char* filename)
     return img;
 }
 
+Image LoadImageFromMemory(const u8* data, u32 size, bool flipVertically)
+{
+    Image img = {};
+    stbi_set_flip_vertically_on_load_thread(flipVertically);
+    img.pixels = stbi_load_from_memory(data, (int)size, &img.size.x, &img.size.y, &img.nchannels, 0);
+    if (img.pixels)
+    {
+        img.stride = img.size.x * img.nchannels;
+    }
+    else
+    {
+        ELOG("Could not decode image from memory: %s", stbi_failure_reason());
+    }
+    return img;
+}
+
 void FreeImage(Image image)
 {
     stbi_image_free(image.pixels);
 }
 
-GLuint CreateTexture2DFromImage(Image image)
+GLuint CreateTexture2DFromPixels(ivec2 size, i32 nchannels, const void* pixels)
+{
+    const u32 levelOffset = 0;
+    return CreateTexture2DFromLevels(size, nchannels, 1, (const u8*)pixels, &levelOffset);
+}
+
+GLuint CreateTexture2DFromLevels(ivec2 size, i32 nchannels, u32 levelCount, const u8* data, const u32* levelOffsets)
 {
     GLenum internalFormat = GL_RGB8;
     GLenum dataFormat     = GL_RGB;
     GLenum dataType       = GL_UNSIGNED_BYTE;
 
-    switch (image.nchannels)
+    switch (nchannels)
     {
         case 1: dataFormat = GL_RED; internalFormat = GL_R8; break;
+        case 2: dataFormat = GL_RG; internalFormat = GL_RG8; break;
         case 3: dataFormat = GL_RGB; internalFormat = GL_RGB8; break;
         case 4: dataFormat = GL_RGBA; internalFormat = GL_RGBA8; break;
-        default: ELOG("LoadTexture2D() - Unsupported number of channels");
+        default: ELOG("CreateTexture2DFromLevels() - Unsupported number of channels");
     }
 
+    // Immutable storage for the whole mip chain, then the given levels (rows are tightly packed)
+    GLsizei storageLevelCount = 1;
+    while ((glm::max(size.x, size.y) >> storageLevelCount) > 0)
+        storageLevelCount++;
+
     GLuint texHandle;
     glGenTextures(1, &texHandle);
     glBindTexture(GL_TEXTURE_2D, texHandle);
-    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.size.x, image.size.y, 0, dataFormat, dataType, image.pixels);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexStorage2D(GL_TEXTURE_2D, storageLevelCount, internalFormat, size.x, size.y);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (u32 level = 0; level < levelCount && level < (u32)storageLevelCount; ++level)
+    {
+        ivec2 levelSize = glm::max(size >> (i32)level, ivec2(1));
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, levelSize.x, levelSize.y, dataFormat, dataType, data + levelOffsets[level]);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    if (levelCount == 1)
+        glGenerateMipmap(GL_TEXTURE_2D);
+    else if (levelCount < (u32)storageLevelCount)
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
     glBindTexture(GL_TEXTURE_2D, 0);
 
     return texHandle;
 }
 
-u32 LoadTexture2D(App* app, const char* filepath)
+GLuint CreateTexture2DFromImage(Image image)
+{
+    return CreateTexture2DFromPixels(image.size, image.nchannels, image.pixels);
+}
+
+// Memory of the whole mip chain (three channel textures are padded to four by the drivers)
+static u64 GetTextureStorageBytes(ivec2 size, i32 nchannels)
+{
+    u64 bytes = 0;
+    for (ivec2 levelSize = size; ; levelSize = glm::max(levelSize / 2, ivec2(1)))
+    {
+        bytes += (u64)levelSize.x * levelSize.y * (nchannels == 3 ? 4 : nchannels);
+        if (levelSize.x == 1 && levelSize.y == 1)
+            break;
+    }
+    return bytes;
+}
+
+u32 FindTexture2D(App* app, const char* filepath)
+{
+    std::unordered_map<std::string, u32>::const_iterator it = app->textureIndexes.find(filepath);
+    return it != app->textureIndexes.end() ? it->second : UINT32_MAX;
+}
+
+u32 AddTexture2D(App* app, const char* filepath, GLuint handle)
+{
+    Texture tex = {};
+    tex.handle = handle;
+    tex.filepath = filepath;
+    tex.atlasLayer = -1;
+
+    u32 texIdx = app->textures.size();
+    app->textures.push_back(tex);
+    app->textureIndexes[tex.filepath] = texIdx;
+
+    return texIdx;
+}
+
+u32 CreateTexture2D(App* app, const char* filepath, Image image)
 {
-    for (u32 texIdx = 0; texIdx < app->textures.size(); ++texIdx)
-        if (app->textures[texIdx].filepath == filepath)
-            return texIdx;
+    u32 texIdx = FindTexture2D(app, filepath);
+    if (texIdx != UINT32_MAX)
+        return texIdx;
 
-    Image image = LoadImage(filepath);
+    texIdx = AddTexture2D(app, filepath, CreateTexture2DFromImage(image));
+    SetResidentBytes(ResidencyCategory_Textures, texIdx, filepath, GetTextureStorageBytes(image.size, image.nchannels));
+    if (CanAtlasTexture(image.size))
+        AddTextureToAtlas(app->textures[texIdx], image);
+
+    return texIdx;
+}
+
+u32 LoadTexture2D(App* app, const char* filepath, bool flipVertically)
+{
+    u32 texIdx = FindTexture2D(app, filepath);
+    if (texIdx != UINT32_MAX)
+        return texIdx;
+
+    Image image = LoadImage(filepath, flipVertically);
 
     if (image.pixels)
     {
-        Texture tex = {};
-        tex.handle = CreateTexture2DFromImage(image);
-        tex.filepath = filepath;
-
-        u32 texIdx = app->textures.size();
-        app->textures.push_back(tex);
+        texIdx = CreateTexture2D(app, filepath, image);
 
         FreeImage(image);
         return texIdx;
@@ -268,59 +391,6 @@ MessageCallback(GLenum source,
             type, severity, message);
 }
 
-GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program)
-{
-    Submesh& submesh = mesh.submeshes[submeshIndex];
-
-    // Try finding a vao for this submesh/program
-    for (u32 i = 0; i < (u32)submesh.vaos.size(); ++i)
-        if (submesh.vaos[i].programHandle == program.handle)
-            return submesh.vaos[i].handle;
-
-    GLuint vaoHandle = 0;
-
-    // Create a new vao for this submesh/program
-    {
-        glGenVertexArrays(1, &vaoHandle);
-        glBindVertexArray(vaoHandle);
-
-        glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
-
-        // We have to link all vertex inputs attributes to attributes in the vertex buffer
-        for (u32 i = 0; i < program.vertexInputLayout.attributes.size(); ++i)
-        {
-            bool attributeWasLinked = false;
-
-            for (u32 j = 0; j < submesh.vertexBufferLayout.attributes.size(); ++j)
-            {
-                if (program.vertexInputLayout.attributes[i].location == submesh.vertexBufferLayout.attributes[j].location)
-                {
-                    const u32 index = submesh.vertexBufferLayout.attributes[j].location;
-                    const u32 ncomp = submesh.vertexBufferLayout.attributes[j].componentCount;
-                    const u32 offset = submesh.vertexBufferLayout.attributes[j].offset + submesh.vertexOffset; // attribute offset + vertex offset
-                    const u32 stride = submesh.vertexBufferLayout.stride;
-                    glVertexAttribPointer(index, ncomp, GL_FLOAT, GL_FALSE, stride, (void*)(u64)offset);
-                    glEnableVertexAttribArray(index);
-
-                    attributeWasLinked = true;
-                    break;
-                }
-            }
-
-            assert(attributeWasLinked); // The submesh should provide an attribute for each vertex inputs
-        }
-
-        glBindVertexArray(0);
-    }
-
-    // Store it in the list of vaos for this submesh
-    Vao vao = { vaoHandle, program.handle };
-    submesh.vaos.push_back(vao);
-
-    return vaoHandle;
-}
-
 void RenderQuad(App* app)
 {
     if (app->embeddedVertices == 0)
@@ -348,6 +418,15 @@ void RenderQuad(App* app)
     glBindVertexArray(0);
 }
 
+// Materials may lack some textures (e.g. placeholders of streamed models), those sample a fallback one
+GLuint GetTextureHandle(App* app, u32 textureIdx, u32 fallbackTextureIdx)
+{
+    if (textureIdx >= app->textures.size())
+        textureIdx = fallbackTextureIdx;
+
+    return app->textures[textureIdx].handle;
+}
+
 mat4 TransformScale(const vec3& scaleFactors)
 {
     mat4 transform = scale(scaleFactors);
@@ -411,6 +490,13 @@ void GenerateFramebuffer(App* app)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glBindTexture(GL_TEXTURE_2D, 0);
 
+    // Accounting of the attachments (24-bit depth is stored in 32 bits)
+    const u64 pixelCount = (u64)app->displaySize.x * app->displaySize.y;
+    SetResidentBytes(ResidencyCategory_RenderTargets, app->framebufferHandles.gPosition,   "G-buffer positions", pixelCount * 8);
+    SetResidentBytes(ResidencyCategory_RenderTargets, app->framebufferHandles.gNormal,     "G-buffer normals",   pixelCount * 8);
+    SetResidentBytes(ResidencyCategory_RenderTargets, app->framebufferHandles.gAlbedoSpec, "G-buffer albedo",    pixelCount * 4);
+    SetResidentBytes(ResidencyCategory_RenderTargets, app->framebufferHandles.gDepth,      "G-buffer depth",     pixelCount * 4);
+
     // Creation and configuration of a framebuffer object
     glGenFramebuffers(1, &app->gBuffer.handle);
     glBindFramebuffer(GL_FRAMEBUFFER, app->gBuffer.handle);
@@ -444,14 +530,37 @@ void GenerateFramebuffer(App* app)
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+// Deletion of the g-buffer attachments and framebuffer object, and of their accounting
+void DestroyFramebuffer(App* app)
+{
+    SetResidentBytes(ResidencyCategory_RenderTargets, app->framebufferHandles.gPosition,   NULL, 0);
+    SetResidentBytes(ResidencyCategory_RenderTargets, app->framebufferHandles.gNormal,     NULL, 0);
+    SetResidentBytes(ResidencyCategory_RenderTargets, app->framebufferHandles.gAlbedoSpec, NULL, 0);
+    SetResidentBytes(ResidencyCategory_RenderTargets, app->framebufferHandles.gDepth,      NULL, 0);
+
+    glDeleteFramebuffers(1, &app->gBuffer.handle);
+    glDeleteTextures(1, &app->framebufferHandles.gPosition);
+    glDeleteTextures(1, &app->framebufferHandles.gNormal);
+    glDeleteTextures(1, &app->framebufferHandles.gAlbedoSpec);
+    glDeleteTextures(1, &app->framebufferHandles.gDepth);
+
+    app->gBuffer.handle = 0;
+    app->framebufferHandles = {};
+}
+
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 void FramebufferSizeCallback(App* app, GLFWwindow* window, int width, int height)
 {
+    // A minimized window has no size, keep the g-buffer until it is restored
+    if (width == 0 || height == 0)
+        return;
+
     // make sure the viewport matches the new window dimensions; note that width and 
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
 
-    // Recalculate frame buffer
+    // Recalculate frame buffer, releasing the one of the previous size
+    DestroyFramebuffer(app);
     GenerateFramebuffer(app);
 }
 
@@ -573,21 +682,34 @@ void Init(App* app)
     app->mode = Mode_Deferred;
     app->renderMode = RenderMode_FinalRender;
 
+    InitJobSystem();
+    InitAsyncFileIO();
+    InitImportWorkers();
+    MountAssetPack(ASSET_PACK_FILENAME); // Without one, the files are read loose from the working directory
+    LoadAssetManifest(ASSET_MANIFEST_FILENAME); // Hashes of the sources the cooker saw, so they are not hashed again
+    InitResidency();
+    InitGeometryPool();
+    InitModelStreaming();
+    InitTextureCompression(app);
+    InitTextureStreaming();
+    InitVirtualTexturing();
+
     SetupDefaultMaterials(app);
 
     // Creating uniform buffers
     glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &app->maxUniformBufferSize);
     glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &app->uniformBlockAlignment);
 
-    glGenBuffers(1, &app->cbuffer.handle);
-    glBindBuffer(GL_UNIFORM_BUFFER, app->cbuffer.handle);
-    glBufferData(GL_UNIFORM_BUFFER, app->maxUniformBufferSize, NULL, GL_STREAM_DRAW);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    // One region per frame in flight, so filling a frame never waits for the GPU to read the last one
+    app->cbuffer = CreateRingBuffer(Align(app->maxUniformBufferSize, app->uniformBlockAlignment), UNIFORM_RING_FRAMES, GL_UNIFORM_BUFFER);
 
     GenerateFramebuffer(app);
 
     // Camera setup
     app->camera = Camera(glm::vec3(0.0f, 0.0f, 10.0f));
+    app->lodErrorThreshold = 1.0f;
+    app->textureBudgetMB = 512;
+    app->geometryBudgetMB = 256;
 
     u32 texturedMeshProgramIdx = LoadProgram(app, "shaders.glsl", "TEXTURED_GEOMETRY");
     app->programIndexes.insert(std::make_pair("shaders", texturedMeshProgramIdx));
@@ -616,6 +738,9 @@ void Init(App* app)
     gBufferProgram.programUniformTexture = glGetUniformLocation(gBufferProgram.handle, "uMaterial.diffuse");
     gBufferProgram.programUniformSpecularMap = glGetUniformLocation(gBufferProgram.handle, "uMaterial.specular");
 
+    u32 feedbackProgramIdx = LoadProgram(app, "g_buffer.glsl", "VIRTUAL_TEXTURE_FEEDBACK");
+    app->programIndexes.insert(std::make_pair("virtual texture feedback", feedbackProgramIdx));
+
     u32 deferredShadingProgramIdx = LoadProgram(app, "deferred_shading.glsl", "DEFERRED_SHADING");
     app->programIndexes.insert(std::make_pair("deferred shading", deferredShadingProgramIdx));
     Program& deferredShadingProgram = app->programs[deferredShadingProgramIdx];
@@ -632,28 +757,27 @@ void Init(App* app)
     app->magentaTexIdx = LoadTexture2D(app, "color_magenta.png");
 
     Material sciFiWallMaterial;
-    sciFiWallMaterial.albedoTextureIdx = LoadTexture2D(app, "Materials/Sci-fi_Wall_011_SD/Sci-fi_Wall_011_basecolor.jpg");
-    sciFiWallMaterial.emissiveTextureIdx = LoadTexture2D(app, "Materials/Sci-fi_Wall_011_SD/Sci-fi_Wall_011_emissive.jpg");
+    sciFiWallMaterial.virtualTextureIdx = LoadVirtualTexture("Materials/Sci-fi_Wall_011_SD/Sci-fi_Wall_011_basecolor.jpg");
+    sciFiWallMaterial.emissiveTextureIdx = RequestTexture2D(app, "Materials/Sci-fi_Wall_011_SD/Sci-fi_Wall_011_emissive.jpg", app->blackTexIdx);
     sciFiWallMaterial.specular = vec3(1.0f);
     sciFiWallMaterial.shininess = 0.5f * 128.0f;
     app->materials.push_back(sciFiWallMaterial);
     app->materialIndexes.insert(std::make_pair("sci-fi wall", app->materials.size() - 1));
 
     // Load models
-    stbi_set_flip_vertically_on_load(true);
-    u32 patrickModelIndex = LoadModel(app, "Patrick/Patrick.obj");
-    app->modelIndexes.insert(std::make_pair("patrick", patrickModelIndex));
-
-    stbi_set_flip_vertically_on_load(false);
-    u32 backpackModelIndex = LoadModel(app, "backpack/backpack.obj");
-    app->modelIndexes.insert(std::make_pair("backpack", backpackModelIndex));
-
+    // The primitives are loaded right away, since they are also the placeholders of streamed models
     u32 cubeModelIndex = LoadModel(app, "Primitives/cube.obj");
     app->modelIndexes.insert(std::make_pair("cube", cubeModelIndex));
 
     u32 sphereModelIndex = LoadModel(app, "Primitives/sphere.obj");
     app->modelIndexes.insert(std::make_pair("sphere", sphereModelIndex));
 
+    u32 patrickModelIndex = RequestModel(app, "Patrick/Patrick.obj", cubeModelIndex, true);
+    app->modelIndexes.insert(std::make_pair("patrick", patrickModelIndex));
+
+    u32 backpackModelIndex = RequestModel(app, "backpack/backpack.obj", cubeModelIndex);
+    app->modelIndexes.insert(std::make_pair("backpack", backpackModelIndex));
+
     // Scene setup
     //CreateEntity(app, TexturedMesh(app->modelIndexes["patrick"], app->programIndexes["shaders"], vec3(0.0f, 0.0f, 0.0f)));
     //CreateEntity(app, TexturedMesh(app->modelIndexes["patrick"], app->programIndexes["shaders"], vec3(-5.0f, 0.0f, -5.0f)));
@@ -676,12 +800,96 @@ void Init(App* app)
     CreateLightSource(app, Light(LightType_Directional, vec3(1.0f, 0.65f, 0.0f), vec3(1.0f), vec3(-5.0f), vec3(0.2f), vec3(1.0f, 0.65f, 0.0f), vec3(1.0f)));
     CreateLightSource(app, Light(LightType_Directional, vec3(0.25f, 0.88f, 0.82f), vec3(-1.0f), vec3(5.0f), vec3(0.2f), vec3(0.25f, 0.88f, 0.82f), vec3(1.0f)));
     CreateLightSource(app, Light(LightType_Flash, vec3(1.0f), vec3(0.0f), vec3(0.0f), vec3(0.2f), vec3(1.0f), vec3(1.0f)));
+
+    // Floor under the backpacks, its albedo is paged in from a virtual texture
+    CreateEntity(app, Primitive(app->materialIndexes["sci-fi wall"], app->modelIndexes["cube"], app->programIndexes["g buffer"], vec3(0.0f, -2.5f, 0.0f), vec3(glm::radians(-90.0f), 0.0f, 0.0f), vec3(1.0f, 1.0f, 0.005f)));
+}
+
+void Shutdown(App* app)
+{
+    ShutdownModelStreaming();
+    WaitForMeshReloads();
+    ShutdownAsyncFileIO();
+    ShutdownJobSystem();
+    ShutdownImportWorkers();
+    DestroyFramebuffer(app);
+    ShutdownResidency();
+    ShutdownGeometryPool();
+    DestroyRingBuffer(app->cbuffer);
+    ShutdownTextureStreaming();
+    ShutdownVirtualTexturing();
+    ShutdownTextureAtlas();
+    UnmountAssetPack();
 }
 
 void Gui(App* app)
 {
     ImGui::Begin("Info");
     ImGui::Text("FPS: %f", 1.0f/app->deltaTime);
+    ImGui::Text("Streaming models: %u", GetPendingModelCount());
+    ImGui::Text("Loaded models: %u files, %u unique submeshes, %u shared materials", GetLoadedModelCount(), GetSharedSubmeshCount(), GetSharedMaterialCount());
+    ImGui::Text("Streaming textures: %u", GetPendingTextureCount());
+    ImGui::Text("File reads: %u (%s)", GetPendingFileReadCount(), GetAsyncFileIOBackendName());
+    ImGui::Text("Import workers: %u", GetRunningImportWorkerCount());
+    ImGui::Text("Resident texture mips: %.1f / %d MB", GetResidentTextureBytes() / (f64)MB(1), app->textureBudgetMB);
+    ImGui::Text("Virtual texture pages: %u / %u", GetResidentVirtualPageCount(), VIRTUAL_TEXTURE_ATLAS_PAGES * VIRTUAL_TEXTURE_ATLAS_PAGES);
+    ImGui::Text("Meshlets: %u drawn, %u culled", app->drawnMeshlets, app->culledMeshlets);
+    ImGui::Text("Texture binds: %u (atlas layers: %u)", app->textureBinds, GetTextureAtlasLayerCount());
+    ImGui::Text("Uniform ring (%s): %llu / %llu frames blocked, %.3f ms last frame, %.1f ms total", app->cbuffer.persistent ? "persistent" : "mapped",
+        app->cbuffer.blockedFrameCount, app->cbuffer.frameCount, app->cbuffer.lastBlockedSeconds * 1000.0, app->cbuffer.blockedSeconds * 1000.0);
+    ImGui::Text("Uniforms: %.1f / %.1f KB per frame (peak %.1f KB), %u grows, %llu overflows", app->cbuffer.usedBytes / (f64)KB(1),
+        app->cbuffer.regionSize / (f64)KB(1), app->cbuffer.peakBytes / (f64)KB(1), app->cbuffer.growCount, app->cbuffer.overflowCount);
+    ImGui::End();
+
+    // Memory by category, and the assets holding the most of it
+    ImGui::Begin("Memory");
+    for (u32 i = 0; i < ResidencyCategory_Count; ++i)
+    {
+        ResidencyCategory category = (ResidencyCategory)i;
+        u64 budget = GetResidencyBudget(app, category);
+        if (budget > 0)
+        {
+            ImGui::Text("%s: %.1f / %.0f MB", GetResidencyCategoryName(category), GetResidentBytes(category) / (f64)MB(1), budget / (f64)MB(1));
+        }
+        else
+        {
+            ImGui::Text("%s: %.1f MB", GetResidencyCategoryName(category), GetResidentBytes(category) / (f64)MB(1));
+        }
+    }
+    ImGui::Text("Evicted meshes: %u", GetEvictedMeshCount());
+
+    GeometryPoolStats geometryPool;
+    GetGeometryPoolStats(geometryPool);
+    ImGui::Text("Geometry pool: %u submeshes in %u arenas", geometryPool.submeshCount, geometryPool.arenaCount);
+    ImGui::Text("  Vertices: %.1f / %.1f MB, indices: %.1f / %.1f MB", geometryPool.usedVertexBytes / (f64)MB(1), geometryPool.vertexBytes / (f64)MB(1),
+        geometryPool.usedIndexBytes / (f64)MB(1), geometryPool.indexBytes / (f64)MB(1));
+    ImGui::Text("  Holes: %.1f MB, defragmented: %.1f MB", geometryPool.freeHoleBytes / (f64)MB(1), geometryPool.movedBytes / (f64)MB(1));
+
+    if (ImGui::CollapsingHeader("Assets") && ImGui::BeginTable("Assets", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_ScrollY, ImVec2(0.0f, 300.0f)))
+    {
+        std::vector<ResidencyEntry> entries;
+        GetResidencyEntries(entries);
+
+        ImGui::TableSetupColumn("Asset");
+        ImGui::TableSetupColumn("Category");
+        ImGui::TableSetupColumn("KB");
+        ImGui::TableSetupColumn("Last used (s)");
+        ImGui::TableHeadersRow();
+        for (u32 i = 0; i < entries.size(); ++i)
+        {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(entries[i].name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(GetResidencyCategoryName(entries[i].category));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", entries[i].bytes / (f64)KB(1));
+            ImGui::TableNextColumn();
+            if (entries[i].lastUsed >= 0.0)
+                ImGui::Text("%.1f", entries[i].lastUsed);
+        }
+        ImGui::EndTable();
+    }
     ImGui::End();
 
     // Show Menu Bar
@@ -712,6 +920,17 @@ void Gui(App* app)
                 }
                 ImGui::EndMenu();
             }
+            if (ImGui::BeginMenu("Asset Pack"))
+            {
+                // The pack holds the files this run accessed, it is used from the next run on
+                std::vector<std::string> accessedFiles = GetAccessedFiles();
+                if (IsAssetPackMounted())
+                    ImGui::Text("%s is mounted", ASSET_PACK_FILENAME);
+                else if (ImGui::MenuItem("Write asset pack", NULL, false, !accessedFiles.empty()))
+                    WriteAssetPack(ASSET_PACK_FILENAME, accessedFiles, true);
+                ImGui::Text("Files accessed: %u", (u32)accessedFiles.size());
+                ImGui::EndMenu();
+            }
             ImGui::EndMenu();
         }
         // Show Edit Menu
@@ -723,12 +942,74 @@ void Gui(App* app)
         if (ImGui::BeginMenu("View"))
         {
             ImGui::Combo("Render Mode", reinterpret_cast<int*>(&app->renderMode), "Final Render\0Normals\0Albedo\0Positions\0Specular\0Depth");
+            ImGui::SliderFloat("LOD error (pixels)", &app->lodErrorThreshold, 0.0f, 16.0f);
+            ImGui::SliderInt("Texture budget (MB)", &app->textureBudgetMB, 16, 4096);
+            ImGui::SliderInt("Geometry budget (MB)", &app->geometryBudgetMB, 16, 4096);
             ImGui::EndMenu();
         }
         ImGui::EndMainMenuBar();
     }
 }
 
+// Pixels covered on screen by one object space unit of the entity, at its distance from the camera
+static f32 GetEntityPixelsPerUnit(App* app, const Entity& entity)
+{
+    f32 scale = glm::max(glm::length(vec3(entity.worldMatrix[0])), glm::max(glm::length(vec3(entity.worldMatrix[1])), glm::length(vec3(entity.worldMatrix[2]))));
+    if (app->camera.cameraProjectionMode == CameraProjectionMode_Orthographic)
+        return scale;
+
+    f32 distance = glm::max(glm::length(vec3(entity.worldMatrix[3]) - app->camera.position), 0.1f);
+    f32 pixelsPerUnitAtOne = app->displaySize.y / (2.0f * glm::tan(glm::radians(app->camera.zoom) * 0.5f));
+    return scale * pixelsPerUnitAtOne / distance;
+}
+
+// Marks the mip level each texture of the entity is sampled at as needed
+static void RequestEntityTextures(App* app, const Entity& entity)
+{
+    const Model& model = app->models[entity.modelIndex];
+    f32 pixelsPerUnit = GetEntityPixelsPerUnit(app, entity);
+
+    for (u32 i = 0; i < model.submeshes.size() && i < model.materialIdx.size(); ++i)
+    {
+        const Submesh& submesh = app->meshes[model.submeshes[i].meshIdx].submeshes[model.submeshes[i].submeshIdx];
+
+        // Without a known density, the texture is assumed to span one object space unit
+        f32 uvDensity = submesh.uvDensity > 0.0f ? submesh.uvDensity : 1.0f;
+
+        Material& material = app->materials[entity.type == EntityType_Primitive ? entity.materialIndex : model.materialIdx[i]];
+        for (u32 j = 0; j < MaterialTexture_Count; ++j)
+        {
+            u32 texIdx = *material.GetTextureIdx(j);
+            if (texIdx != UINT32_MAX)
+            {
+                RequestTextureDensity(app, texIdx, uvDensity / pixelsPerUnit);
+                MarkResourceUsed(ResidencyCategory_Textures, texIdx);
+            }
+        }
+    }
+}
+
+// Marks the meshes with submeshes of the entity in view as needed (reloading the evicted ones).
+// The submesh sphere bounds whichever LOD gets drawn, the meshlets are only culled when drawing
+static void RequestEntityMeshes(App* app, const Entity& entity)
+{
+    if (entity.modelIndex >= app->models.size())
+        return;
+
+    const Model& model = app->models[entity.modelIndex];
+    vec4 frustumPlanes[6];
+    GetFrustumPlanes(entity.worldViewProjectionMatrix, frustumPlanes);
+
+    for (u32 i = 0; i < model.submeshes.size(); ++i)
+    {
+        const Submesh& submesh = app->meshes[model.submeshes[i].meshIdx].submeshes[model.submeshes[i].submeshIdx];
+
+        bool visible = submesh.boundsRadius <= 0.0f || !IsSphereCulled(submesh.boundsCenter, submesh.boundsRadius, frustumPlanes);
+        if (visible)
+            RequestMeshResidency(app, model.submeshes[i].meshIdx);
+    }
+}
+
 void Update(App* app)
 {
     // In Update() -> check timestamp / reload
@@ -744,12 +1025,21 @@ void Update(App* app)
             const char* programName = program.programName.c_str();
             program.handle = CreateProgramFromSource(programSource, programName);
             program.lastWriteTimestamp = currentTimestamp;
+            FindTextureAtlasUniforms(program);
+            FindVirtualTextureUniforms(program);
         }
     }
 
     // You can handle app->input keyboard/mouse here
     ProcessInput(app, glfwGetCurrentContext());
 
+    // Swap in the models and textures that finished loading in the background
+    UpdateModelStreaming(app);
+    UpdateTextureStreaming(app);
+    UpdateVirtualTexturing();
+    UpdateResidency(app);
+    DefragmentGeometryPool(app);
+
     // Move the light source around the scene over time
     app->lights[0].position.x = sin(glfwGetTime()) * 5.0f;
     app->lights[0].position.y = sin(glfwGetTime() / 2) * 5.0f;
@@ -800,69 +1090,171 @@ void Update(App* app)
         break;
     }
 
-    // Filling uniform buffers
-    glBindBuffer(GL_UNIFORM_BUFFER, app->cbuffer.handle);
-    app->cbuffer.data = (u8*)glMapBuffer(GL_UNIFORM_BUFFER, GL_WRITE_ONLY);
-    app->cbuffer.head = 0;
+    // Filling uniform buffers, in regions sized by the frames before. Entities that do not fit are
+    // skipped this frame, and the regions grow for the next one
+    MapRingBufferRegion(app->cbuffer, GLOBAL_PARAMS_SIZE((u32)app->lights.size()));
 
     // Pushing values for the GlobalParams block into the uniform buffer
-    // -- Global params
-    app->globalParamsOffset = app->cbuffer.head;
+    // -- Global params (first in the region, which is at least as big as requested, so they always fit)
+    app->globalParamsOffset = app->cbuffer.buffer.head;
 
-    PushVec3(app->cbuffer, app->camera.position);
+    PushVec3(app->cbuffer.buffer, app->camera.position);
 
-    PushUInt(app->cbuffer, app->lights.size());
+    PushUInt(app->cbuffer.buffer, app->lights.size());
 
     for (u32 i = 0; i < app->lights.size(); ++i)
     {
-        AlignHead(app->cbuffer, sizeof(vec4));
+        AlignHead(app->cbuffer.buffer, sizeof(vec4));
 
         Light& light = app->lights[i];
-        PushUInt(app->cbuffer, light.type);
-        PushVec3(app->cbuffer, light.color);
+        PushUInt(app->cbuffer.buffer, light.type);
+        PushVec3(app->cbuffer.buffer, light.color);
         if (light.type == LightType_Flash)
         {
-            PushVec3(app->cbuffer, app->camera.front);
-            PushVec3(app->cbuffer, app->camera.position);
+            PushVec3(app->cbuffer.buffer, app->camera.front);
+            PushVec3(app->cbuffer.buffer, app->camera.position);
         }
         else
         {
-            PushVec3(app->cbuffer, light.direction);
-            PushVec3(app->cbuffer, light.position);
+            PushVec3(app->cbuffer.buffer, light.direction);
+            PushVec3(app->cbuffer.buffer, light.position);
         }
 
-        PushVec3(app->cbuffer, light.ambient);
-        PushVec3(app->cbuffer, light.diffuse);
-        PushVec3(app->cbuffer, light.specular);
+        PushVec3(app->cbuffer.buffer, light.ambient);
+        PushVec3(app->cbuffer.buffer, light.diffuse);
+        PushVec3(app->cbuffer.buffer, light.specular);
 
-        PushFloat(app->cbuffer, light.constant);
-        PushFloat(app->cbuffer, light.linear);
-        PushFloat(app->cbuffer, light.quadratic);
+        PushFloat(app->cbuffer.buffer, light.constant);
+        PushFloat(app->cbuffer.buffer, light.linear);
+        PushFloat(app->cbuffer.buffer, light.quadratic);
 
-        PushFloat(app->cbuffer, glm::cos(glm::radians(light.cutOff)));
-        PushFloat(app->cbuffer, glm::cos(glm::radians(light.outerCutOff)));
+        PushFloat(app->cbuffer.buffer, glm::cos(glm::radians(light.cutOff)));
+        PushFloat(app->cbuffer.buffer, glm::cos(glm::radians(light.outerCutOff)));
     }
 
-    app->globalParamsSize = app->cbuffer.head - app->globalParamsOffset;
+    app->globalParamsSize = app->cbuffer.buffer.head - app->globalParamsOffset;
 
     // Pushing values for the LocalParams block into the uniform buffer 
     // -- Local params
     for (u32 i = 0; i < app->entities.size(); ++i)
     {
-        AlignHead(app->cbuffer, app->uniformBlockAlignment);
-
         Entity& entity = app->entities[i];
         mat4    world = entity.worldMatrix;
         mat4    worldViewProjection = projection * view * world; // note that we read the multiplication from right to left
 
-        entity.localParamsOffset = app->cbuffer.head;
-        PushMat4(app->cbuffer, world);
-        PushMat4(app->cbuffer, worldViewProjection);
-        entity.localParamsSize = app->cbuffer.head - entity.localParamsOffset;
+        entity.worldViewProjectionMatrix = worldViewProjection;
+        entity.localParamsSize = 0; // Not drawn this frame if its block does not fit
+        if (ReserveRingBufferSpace(app->cbuffer, LOCAL_PARAMS_SIZE, app->uniformBlockAlignment))
+        {
+            entity.localParamsOffset = app->cbuffer.buffer.head;
+            PushMat4(app->cbuffer.buffer, world);
+            PushMat4(app->cbuffer.buffer, worldViewProjection);
+            entity.localParamsSize = app->cbuffer.buffer.head - entity.localParamsOffset;
+        }
+
+        // Texture mips are streamed for the texel density the entity is seen at
+        if (entity.type != EntityType_LightSource)
+            RequestEntityTextures(app, entity);
+        RequestEntityMeshes(app, entity);
     }
 
-    glUnmapBuffer(GL_UNIFORM_BUFFER);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    UnmapRingBufferRegion(app->cbuffer);
+}
+
+// The coarsest LOD whose error stays under the threshold once projected
+static u32 SelectSubmeshLod(const Submesh& submesh, f32 pixelsPerUnit, f32 errorThreshold)
+{
+    u32 lodIdx = 0;
+    while (lodIdx + 1 < submesh.lods.size() && submesh.lods[lodIdx + 1].error * pixelsPerUnit <= errorThreshold)
+        ++lodIdx;
+    return lodIdx;
+}
+
+static void DrawSubmesh(const Submesh& submesh, u32 lodIdx)
+{
+    if (lodIdx < submesh.lods.size())
+    {
+        const SubmeshLod& lod = submesh.lods[lodIdx];
+        u64 offset = submesh.indexOffset + (u64)lod.firstIndex * GetIndexSize(submesh.indexType);
+        glDrawElementsBaseVertex(GL_TRIANGLES, lod.indexCount, submesh.indexType, (void*)offset, submesh.baseVertex);
+    }
+    else
+    {
+        glDrawElementsBaseVertex(GL_TRIANGLES, submesh.indexCount, submesh.indexType, (void*)(u64)submesh.indexOffset, submesh.baseVertex);
+    }
+}
+
+// Draws the visible meshlets of the full resolution LOD, merging consecutive ones into a single draw call
+static void DrawSubmeshMeshlets(App* app, const Submesh& submesh, const Entity& entity)
+{
+    vec4 frustumPlanes[6];
+    GetFrustumPlanes(entity.worldViewProjectionMatrix, frustumPlanes);
+    vec3 eye = vec3(glm::inverse(entity.worldMatrix) * vec4(app->camera.position, 1.0f));
+
+    const u32 indexSize = GetIndexSize(submesh.indexType);
+    u32 rangeFirstIndex = 0;
+    u32 rangeIndexCount = 0;
+
+    for (u32 i = 0; i < submesh.meshlets.size(); ++i)
+    {
+        const Meshlet& meshlet = submesh.meshlets[i];
+        if (IsMeshletCulled(meshlet, frustumPlanes, eye))
+        {
+            app->culledMeshlets++;
+            continue;
+        }
+
+        app->drawnMeshlets++;
+        if (rangeIndexCount > 0 && rangeFirstIndex + rangeIndexCount == meshlet.firstIndex)
+        {
+            rangeIndexCount += meshlet.indexCount;
+            continue;
+        }
+
+        if (rangeIndexCount > 0)
+            glDrawElementsBaseVertex(GL_TRIANGLES, rangeIndexCount, submesh.indexType, (void*)(submesh.indexOffset + (u64)rangeFirstIndex * indexSize), submesh.baseVertex);
+
+        rangeFirstIndex = meshlet.firstIndex;
+        rangeIndexCount = meshlet.indexCount;
+    }
+
+    if (rangeIndexCount > 0)
+        glDrawElementsBaseVertex(GL_TRIANGLES, rangeIndexCount, submesh.indexType, (void*)(submesh.indexOffset + (u64)rangeFirstIndex * indexSize), submesh.baseVertex);
+}
+
+// Model entities go through LOD selection and meshlet culling
+static void DrawEntitySubmesh(App* app, const Entity& entity, const Submesh& submesh, f32 pixelsPerUnit)
+{
+    u32 lodIdx = SelectSubmeshLod(submesh, pixelsPerUnit, app->lodErrorThreshold);
+    if (lodIdx == 0 && !submesh.meshlets.empty())
+        DrawSubmeshMeshlets(app, submesh, entity);
+    else
+        DrawSubmesh(submesh, lodIdx);
+}
+
+// Atlased textures only need their rect set, the others are bound unless already bound to the unit
+static void BindMaterialTexture(App* app, GLint samplerLocation, GLint atlasRectLocation, GLint atlasLayerLocation, u32 unit, u32 textureIdx, u32 fallbackTextureIdx, GLuint* boundTextures)
+{
+    if (textureIdx >= app->textures.size())
+        textureIdx = fallbackTextureIdx;
+    const Texture& texture = app->textures[textureIdx];
+
+    glUniform1i(samplerLocation, unit);
+    if (texture.atlasLayer >= 0)
+    {
+        glUniform4fv(atlasRectLocation, 1, glm::value_ptr(texture.atlasRect));
+        glUniform1i(atlasLayerLocation, texture.atlasLayer);
+        return;
+    }
+
+    glUniform4fv(atlasRectLocation, 1, glm::value_ptr(vec4(0.0f)));
+    if (boundTextures[unit] != texture.handle)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, texture.handle);
+        boundTextures[unit] = texture.handle;
+        app->textureBinds++;
+    }
 }
 
 void Render(App* app)
@@ -870,6 +1262,10 @@ void Render(App* app)
     // NOT IN USE
     //OpenGLErrorGuard guard("RENDER");
 
+    app->drawnMeshlets = 0;
+    app->culledMeshlets = 0;
+    app->textureBinds = 0;
+
     switch (app->mode)
     {
         case Mode_TexturedQuad:
@@ -913,14 +1309,16 @@ void Render(App* app)
                 glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
                 // Bind the buffer range with the global parameters (camera position, lights...) to the GlobalParams block in the shader
-                glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), app->cbuffer.handle, app->globalParamsOffset, app->globalParamsSize);
+                glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), app->cbuffer.buffer.handle, app->globalParamsOffset, app->globalParamsSize);
 
-                for (u16 i = 0; i < app->entities.size(); ++i)
+                for (u32 i = 0; i < app->entities.size(); ++i)
                 {
                     Entity entity = app->entities.at(i);
+                    if (entity.localParamsSize == 0)
+                        continue; // Its uniforms did not fit this frame
 
                     // Binding buffer ranges to uniform blocks
-                    glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(1), app->cbuffer.handle, entity.localParamsOffset, entity.localParamsSize);
+                    glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(1), app->cbuffer.buffer.handle, entity.localParamsOffset, entity.localParamsSize);
 
                     /*Program& texturedMeshProgram = app->programs[app->texturedMeshProgramIdx];*/
                     Program texturedMeshProgram;
@@ -934,11 +1332,16 @@ void Render(App* app)
                     glUseProgram(texturedMeshProgram.handle);
 
                     Model& model = app->models[entity.modelIndex];
-                    Mesh& mesh = app->meshes[model.meshIdx];
+                    f32 pixelsPerUnit = GetEntityPixelsPerUnit(app, entity);
 
-                    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+                    for (u32 i = 0; i < model.submeshes.size(); ++i)
                     {
-                        GLuint vao = FindVAO(mesh, i, texturedMeshProgram);
+                        Mesh& mesh = app->meshes[model.submeshes[i].meshIdx];
+                        u32 submeshIdx = model.submeshes[i].submeshIdx;
+                        if (!mesh.resident)
+                            continue; // Evicted, until it is reloaded
+
+                        GLuint vao = FindGeometryVAO(mesh.submeshes[submeshIdx], texturedMeshProgram);
                         glBindVertexArray(vao);
 
                         u32 submeshMaterialIdx = model.materialIdx[i];
@@ -990,7 +1393,7 @@ void Render(App* app)
                                 if (texturedMeshProgram.handle == app->programs[app->programIndexes["shaders"]].handle)
                                 {
                                     glActiveTexture(GL_TEXTURE0);
-                                    glBindTexture(GL_TEXTURE_2D, app->textures[submeshMaterial.albedoTextureIdx].handle);
+                                    glBindTexture(GL_TEXTURE_2D, GetTextureHandle(app, submeshMaterial.albedoTextureIdx, app->whiteTexIdx));
                                     glUniform1i(texturedMeshProgram.programUniformTexture, 0);
 
                                     glUniform3fv(glGetUniformLocation(texturedMeshProgram.handle, "uMaterial.specular"), 1, glm::value_ptr(submeshMaterial.specular));
@@ -999,11 +1402,11 @@ void Render(App* app)
                                 else if (texturedMeshProgram.handle == app->programs[app->programIndexes["shaders2"]].handle)
                                 {
                                     glActiveTexture(GL_TEXTURE0);
-                                    glBindTexture(GL_TEXTURE_2D, app->textures[submeshMaterial.albedoTextureIdx].handle);
+                                    glBindTexture(GL_TEXTURE_2D, GetTextureHandle(app, submeshMaterial.albedoTextureIdx, app->whiteTexIdx));
                                     glUniform1i(texturedMeshProgram.programUniformTexture, 0);
 
                                     glActiveTexture(GL_TEXTURE1);
-                                    glBindTexture(GL_TEXTURE_2D, app->textures[submeshMaterial.specularTextureIdx].handle);
+                                    glBindTexture(GL_TEXTURE_2D, GetTextureHandle(app, submeshMaterial.specularTextureIdx, app->blackTexIdx));
                                     glUniform1i(texturedMeshProgram.programUniformSpecularMap, 1);
 
                                     glUniform1f(glGetUniformLocation(texturedMeshProgram.handle, "uMaterial.shininess"), submeshMaterial.shininess);
@@ -1014,8 +1417,8 @@ void Render(App* app)
                             break;
                         }
 
-                        Submesh& submesh = mesh.submeshes[i];
-                        glDrawElements(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT, (void*)(u64)submesh.indexOffset);
+                        Submesh& submesh = mesh.submeshes[submeshIdx];
+                        DrawEntitySubmesh(app, entity, submesh, pixelsPerUnit);
                     }
                 }
             }
@@ -1026,7 +1429,45 @@ void Render(App* app)
                 glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
                 // Bind the buffer range with the global parameters (camera position, lights...) to the GlobalParams block in the shader
-                glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), app->cbuffer.handle, app->globalParamsOffset, app->globalParamsSize);
+                glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), app->cbuffer.buffer.handle, app->globalParamsOffset, app->globalParamsSize);
+
+                // 0. virtual texture feedback: the pages the visible surfaces sample, at a low resolution
+                if (GetVirtualTextureCount() > 0)
+                {
+                    Program& feedbackProgram = app->programs[app->programIndexes["virtual texture feedback"]];
+                    BeginVirtualTextureFeedback(app, feedbackProgram);
+
+                    // Every surface is drawn, the ones without virtual textures only occlude
+                    for (u32 i = 0; i < app->entities.size(); ++i)
+                    {
+                        const Entity& entity = app->entities[i];
+                        if (entity.type == EntityType_LightSource || entity.localParamsSize == 0)
+                            continue;
+
+                        glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(1), app->cbuffer.buffer.handle, entity.localParamsOffset, entity.localParamsSize);
+
+                        Model& model = app->models[entity.modelIndex];
+                        f32 pixelsPerUnit = GetEntityPixelsPerUnit(app, entity);
+
+                        for (u32 i = 0; i < model.submeshes.size(); ++i)
+                        {
+                            Mesh& mesh = app->meshes[model.submeshes[i].meshIdx];
+                            u32 submeshIdx = model.submeshes[i].submeshIdx;
+                            if (!mesh.resident)
+                                continue; // Evicted, until it is reloaded
+
+                            glBindVertexArray(FindGeometryVAO(mesh.submeshes[submeshIdx], feedbackProgram));
+
+                            const Material& submeshMaterial = app->materials[entity.type == EntityType_Primitive ? entity.materialIndex : model.materialIdx[i]];
+                            BindVirtualTexture(feedbackProgram, submeshMaterial.virtualTextureIdx);
+
+                            Submesh& submesh = mesh.submeshes[submeshIdx];
+                            DrawSubmesh(submesh, SelectSubmeshLod(submesh, pixelsPerUnit, app->lodErrorThreshold));
+                        }
+                    }
+
+                    EndVirtualTextureFeedback(app);
+                }
 
                 // 1. geometry pass: render scene's geometry/color data into gbuffer
 
@@ -1042,46 +1483,57 @@ void Render(App* app)
                 //glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
                 glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+                // Small material textures are all sampled from the atlas, bound once for the whole pass
+                glActiveTexture(GL_TEXTURE4);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, GetTextureAtlasHandle());
+                GLuint boundTextures[2] = {};
+
                 // Render code loops
                 // - Bind programs
                 // - Bind buffers
                 // - Set states
                 // - Draw calls
-                for (u16 i = 0; i < app->entities.size(); ++i)
+                for (u32 i = 0; i < app->entities.size(); ++i)
                 {
                     Entity entity = app->entities.at(i);
 
-                    if (entity.type == EntityType_Model)
+                    if ((entity.type == EntityType_Model || entity.type == EntityType_Primitive) && entity.localParamsSize > 0)
                     {
                         // Binding buffer ranges to uniform blocks
-                        glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(1), app->cbuffer.handle, entity.localParamsOffset, entity.localParamsSize);
+                        glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(1), app->cbuffer.buffer.handle, entity.localParamsOffset, entity.localParamsSize);
 
                         Program& gBufferProgram = app->programs[entity.programIndex];
                         glUseProgram(gBufferProgram.handle);
+                        glUniform1i(gBufferProgram.programUniformTextureAtlas, 4);
 
                         Model& model = app->models[entity.modelIndex];
-                        Mesh& mesh = app->meshes[model.meshIdx];
+                        f32 pixelsPerUnit = GetEntityPixelsPerUnit(app, entity);
 
-                        for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+                        for (u32 i = 0; i < model.submeshes.size(); ++i)
                         {
-                            GLuint vao = FindVAO(mesh, i, gBufferProgram);
+                            Mesh& mesh = app->meshes[model.submeshes[i].meshIdx];
+                            u32 submeshIdx = model.submeshes[i].submeshIdx;
+                            if (!mesh.resident)
+                                continue; // Evicted, until it is reloaded
+
+                            GLuint vao = FindGeometryVAO(mesh.submeshes[submeshIdx], gBufferProgram);
                             glBindVertexArray(vao);
 
-                            u32 submeshMaterialIdx = model.materialIdx[i];
+                            // Primitives use the material of the entity
+                            u32 submeshMaterialIdx = entity.type == EntityType_Primitive ? entity.materialIndex : model.materialIdx[i];
                             Material& submeshMaterial = app->materials[submeshMaterialIdx];
 
-                            glActiveTexture(GL_TEXTURE0);
-                            glBindTexture(GL_TEXTURE_2D, app->textures[submeshMaterial.albedoTextureIdx].handle);
-                            glUniform1i(gBufferProgram.programUniformTexture, 0);
+                            BindMaterialTexture(app, gBufferProgram.programUniformTexture, gBufferProgram.programUniformDiffuseAtlasRect,
+                                gBufferProgram.programUniformDiffuseAtlasLayer, 0, submeshMaterial.albedoTextureIdx, app->whiteTexIdx, boundTextures);
+                            BindMaterialTexture(app, gBufferProgram.programUniformSpecularMap, gBufferProgram.programUniformSpecularAtlasRect,
+                                gBufferProgram.programUniformSpecularAtlasLayer, 1, submeshMaterial.specularTextureIdx, app->blackTexIdx, boundTextures);
 
-                            glActiveTexture(GL_TEXTURE1);
-                            glBindTexture(GL_TEXTURE_2D, app->textures[submeshMaterial.specularTextureIdx].handle);
-                            glUniform1i(gBufferProgram.programUniformSpecularMap, 1);
+                            BindVirtualTexture(gBufferProgram, submeshMaterial.virtualTextureIdx);
 
                             //glUniform1f(glGetUniformLocation(texturedMeshProgram.handle, "uMaterial.shininess"), submeshMaterial.shininess);
 
-                            Submesh& submesh = mesh.submeshes[i];
-                            glDrawElements(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT, (void*)(u64)submesh.indexOffset);
+                            Submesh& submesh = mesh.submeshes[submeshIdx];
+                            DrawEntitySubmesh(app, entity, submesh, pixelsPerUnit);
                         }
                     }
                 }
@@ -1114,37 +1566,46 @@ void Render(App* app)
                 glBindFramebuffer(GL_FRAMEBUFFER, 0);
                 // now render all light entitiesaa with forward rendering as we'd normally do
                 u32 lightIndex = 0;
-                for (u16 i = 0; i < app->entities.size(); ++i)
+                for (u32 i = 0; i < app->entities.size(); ++i)
                 {
                     Entity entity = app->entities.at(i);
 
                     if (entity.type == EntityType_LightSource)
                     {
+                        const Light& light = app->lights[lightIndex++];
+                        if (entity.localParamsSize == 0)
+                            continue;
+
                         // Binding buffer ranges to uniform blocks
-                        glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(1), app->cbuffer.handle, entity.localParamsOffset, entity.localParamsSize);
+                        glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(1), app->cbuffer.buffer.handle, entity.localParamsOffset, entity.localParamsSize);
 
                         Program& lightSourceProgram = app->programs[app->programIndexes["light source"]];
                         glUseProgram(lightSourceProgram.handle);
 
                         Model& model = app->models[entity.modelIndex];
-                        Mesh& mesh = app->meshes[model.meshIdx];
 
-                        for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+                        for (u32 i = 0; i < model.submeshes.size(); ++i)
                         {
-                            GLuint vao = FindVAO(mesh, i, lightSourceProgram);
+                            Mesh& mesh = app->meshes[model.submeshes[i].meshIdx];
+                            u32 submeshIdx = model.submeshes[i].submeshIdx;
+                            if (!mesh.resident)
+                                continue; // Evicted, until it is reloaded
+
+                            GLuint vao = FindGeometryVAO(mesh.submeshes[submeshIdx], lightSourceProgram);
                             glBindVertexArray(vao);
 
-                            glUniform3fv(glGetUniformLocation(lightSourceProgram.handle, "uLightColor"), 1, glm::value_ptr(app->lights[lightIndex].color));
+                            glUniform3fv(glGetUniformLocation(lightSourceProgram.handle, "uLightColor"), 1, glm::value_ptr(light.color));
 
-                            Submesh& submesh = mesh.submeshes[i];
-                            glDrawElements(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT, (void*)(u64)submesh.indexOffset);
+                            Submesh& submesh = mesh.submeshes[submeshIdx];
+                            DrawSubmesh(submesh, 0);
                         }
-
-                        ++lightIndex;
                     }
                 }
             }
             break;
         default:;
     }
+
+    // The uniforms of this frame can be overwritten once the GPU is past its commands
+    FenceRingBufferRegion(app->cbuffer);
 }
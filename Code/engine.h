@@ -11,6 +11,7 @@
 #include "camera.h"
 
 #include <map>
+#include <unordered_map>
 
 typedef glm::vec2  vec2;
 typedef glm::vec3  vec3;
@@ -33,13 +34,47 @@ struct Texture
 {
     GLuint      handle;
     std::string filepath;
+    ivec2       size;          // Of the finest mip level (streamed textures only, once loaded)
+    u32         levelCount;
+    u32         residentLevel; // Finest mip level in video memory
+    i32         atlasLayer;    // Layer of the texture atlas it was copied to, -1 if not atlased
+    vec4        atlasRect;     // Scale (xy) and offset (zw) of its UVs in the atlas layer
+};
+
+// When enabled, imported meshes use compact vertex formats (half float positions, octahedral
+// SNORM16 normals and tangents, 16-bit UVs and 16-bit indices when possible), and the shaders
+// are compiled with QUANTIZED_VERTICES defined so they decode them.
+#define QUANTIZED_VERTICES 1
+
+// Levels of detail generated for every imported submesh, including the full resolution one
+// (1 disables the generation)
+#define MESH_LOD_COUNT 4
+
+// When enabled, imported submeshes are split into meshlets that are frustum and backface
+// culled one by one when the full resolution LOD is drawn
+#define MESHLET_CULLING 1
+
+// Frames whose uniforms can be in flight at once, each written to its own region of app->cbuffer
+#define UNIFORM_RING_FRAMES 3
+
+// Processing done on top of the Assimp import, stored in the mesh cache key
+enum MeshImportOption
+{
+    MeshImportOption_QuantizeVertices = 1 << 0,
+    MeshImportOption_OptimizeMeshes   = 1 << 1,
+    MeshImportOption_GenerateLods     = 1 << 2,
+    MeshImportOption_BuildMeshlets    = 1 << 3,
+    MeshImportOption_NativeObj        = 1 << 4, // Imported by the OBJ importer instead of Assimp
+    MeshImportOption_NativeGltf       = 1 << 5, // Imported by the glTF binary importer (cached unless drawn from the file)
 };
 
 struct VertexBufferAttribute
 {
-    u8 location;
-    u8 componentCount;
-    u8 offset;
+    u8        location;
+    u8        componentCount;
+    u8        offset;
+    GLenum    type;       // GL_FLOAT, GL_HALF_FLOAT, GL_SHORT, GL_UNSIGNED_SHORT...
+    GLboolean normalized; // Whether integer components are mapped to [-1, 1] or [0, 1]
 };
 
 struct VertexBufferLayout
@@ -77,6 +112,16 @@ struct Program
     GLuint programUniformTexture;     // Location of the texture uniform in the shader
     GLuint programUniformSpecularMap; // Location of the specular map uniform in the shader
     GLuint programUniformEmissionMap; // Location of the emission map uniform in the shader
+
+    GLint programUniformTextureAtlas;       // Locations of the texture atlas uniforms (see texture_atlas.h), -1 if unused
+    GLint programUniformDiffuseAtlasRect;
+    GLint programUniformDiffuseAtlasLayer;
+    GLint programUniformSpecularAtlasRect;
+    GLint programUniformSpecularAtlasLayer;
+
+    GLint programUniformVirtualTexture;     // Locations of the virtual texture uniforms (see virtual_texture.h), -1 if unused
+    GLint programUniformPageAtlas;
+    GLint programUniformIndirection;
 };
 
 enum Mode
@@ -104,42 +149,117 @@ struct VertexV3V2
     glm::vec2 uv;
 };
 
+// Submesh of a model, in the mesh holding its data (shared by every model with the same geometry)
+struct ModelSubmesh
+{
+    u32 meshIdx;
+    u32 submeshIdx;
+};
+
 struct Model
 {
-    u32              meshIdx;
-    std::vector<u32> materialIdx;
+    std::vector<ModelSubmesh> submeshes;
+    std::vector<u32>          materialIdx;
 };
 
-struct Submesh
+struct SubmeshLod
 {
-    VertexBufferLayout vertexBufferLayout;
-    std::vector<float> vertices;
-    std::vector<u32>   indices;
-    u32                vertexOffset;
-    u32                indexOffset;
+    u32 firstIndex; // Relative to the first index of the submesh
+    u32 indexCount;
+    f32 error;      // Maximum deviation from the full resolution surface, in object space
+};
 
-    std::vector<Vao>   vaos;
+struct Meshlet
+{
+    vec3 center;     // Bounding sphere, in object space
+    f32  radius;
+    vec3 coneAxis;   // Normal cone (culled when the view direction is within the cone)
+    f32  coneCutoff;
+    u32  firstIndex; // Relative to the first index of the submesh
+    u32  indexCount;
+};
+
+struct Submesh
+{
+    VertexBufferLayout      vertexBufferLayout;
+    std::vector<u8>         vertices; // Interleaved, as described by vertexBufferLayout
+    std::vector<u32>        indices;
+    GLenum                  indexType; // Type of the indices in the GPU buffer (GL_UNSIGNED_INT, GL_UNSIGNED_SHORT or GL_UNSIGNED_BYTE)
+    u32                     vertexOffset; // In bytes, in the imported data until uploaded, then in the arena buffers
+    u32                     vertexCount;
+    u32                     indexOffset;
+    u32                     indexCount;
+    u32                     arenaIdx = UINT32_MAX; // Geometry pool arena holding its data (see geometry_pool.h), UINT32_MAX if not resident
+    u32                     vertexBlock; // Allocations in the arena
+    u32                     indexBlock;
+    u32                     baseVertex; // First vertex in the arena vertex buffer, added to every index
+    u64                     geometryHash; // Of the layout, vertices and indices (0 if unknown), identical submeshes are uploaded once
+    std::vector<SubmeshLod> lods; // All LODs share the vertices, their indices are stored back to back
+    std::vector<Meshlet>    meshlets; // Clusters of the full resolution LOD
+    vec3                    boundsCenter; // Bounding sphere of every LOD, in object space
+    f32                     boundsRadius = 0.0f; // 0 if unknown
+    f32                     uvDensity; // UV units per object space unit, drives texture mip streaming (0 if unknown)
 };
 
 struct Mesh
 {
     std::vector<Submesh> submeshes;
-    GLuint               vertexBufferHandle;
-    GLuint               indexBufferHandle;
+    bool                 resident; // False while evicted (see residency.h)
+    u32                  vertexBufferSize; // Bytes of its submeshes in the geometry pool
+    u32                  indexBufferSize;
+    std::string          source; // Model file the submeshes were imported from, read again to reload them
+};
+
+enum MaterialTexture
+{
+    MaterialTexture_Albedo,
+    MaterialTexture_Emissive,
+    MaterialTexture_Specular,
+    MaterialTexture_Normals,
+    MaterialTexture_Bump,
+    MaterialTexture_Count
 };
 
 struct Material
 {
-    Material() {}
+    Material()
+    {
+        this->ClearTextures();
+    }
 
     Material(vec3 ambient, vec3 diffuse, vec3 specular, f32 shininess)
     {
+        this->ClearTextures();
+
         this->ambient = ambient;
         this->diffuse = diffuse;
         this->specular = specular;
         this->shininess = shininess * 128.0f;
     }
 
+    void ClearTextures()
+    {
+        this->albedoTextureIdx   = UINT32_MAX;
+        this->emissiveTextureIdx = UINT32_MAX;
+        this->specularTextureIdx = UINT32_MAX;
+        this->normalsTextureIdx  = UINT32_MAX;
+        this->bumpTextureIdx     = UINT32_MAX;
+        this->virtualTextureIdx  = UINT32_MAX;
+    }
+
+    u32* GetTextureIdx(u32 texture)
+    {
+        switch (texture)
+        {
+        case MaterialTexture_Albedo:   return &this->albedoTextureIdx;
+        case MaterialTexture_Emissive: return &this->emissiveTextureIdx;
+        case MaterialTexture_Specular: return &this->specularTextureIdx;
+        case MaterialTexture_Normals:  return &this->normalsTextureIdx;
+        case MaterialTexture_Bump:     return &this->bumpTextureIdx;
+        default:                       return NULL;
+        }
+    }
+
     std::string name;
     vec3        albedo;
     vec3        emissive;
@@ -149,6 +269,7 @@ struct Material
     u32         specularTextureIdx;
     u32         normalsTextureIdx;
     u32         bumpTextureIdx;
+    u32         virtualTextureIdx; // Albedo paged in from a virtual texture instead, in the deferred pipeline
 
     vec3        ambient;
     vec3        diffuse;
@@ -156,6 +277,37 @@ struct Material
     f32         shininess;
 };
 
+// Data inside imported.mappedFile that is uploaded without any staging, at the given buffer offset
+struct ImportedBufferRange
+{
+    const u8* data;
+    u32       size;
+    u32       offset;
+};
+
+// CPU-side result of importing a model. It is produced by ImportModel() (on any thread)
+// and turned into GL resources by CreateModel() (on the main thread).
+struct ImportedModel
+{
+    std::string              filename;
+    bool                     flipTextures;
+    bool                     fromCache;
+    u32                      importFlags;      // Assimp flags and MeshImportOption bits used (mesh cache key)
+    u32                      importOptions;
+
+    std::vector<Submesh>     submeshes;
+    std::vector<u32>         submeshMaterials; // Relative to the first material of the model
+    std::vector<Material>    materials;        // Texture indices are resolved by CreateModel()
+
+    std::vector<std::string> texturePaths;     // Textures used by the materials...
+    std::vector<u32>         textureSlots;     // ...and where they go (materialIdx * MaterialTexture_Count + MaterialTexture)
+    std::vector<Image>       images;           // Decoded by the importer (parallel to texturePaths), if embedded in the model file
+
+    MappedFile               mappedFile;       // Decoded mesh cache or mapped model file, if the ranges below point into it
+    std::vector<ImportedBufferRange> vertexRanges; // GPU-ready data uploaded as is, instead of the submesh vectors
+    std::vector<ImportedBufferRange> indexRanges;  // (the submesh offsets already refer to where it lands)
+};
+
 enum EntityType
 {
     EntityType_Primitive,
@@ -236,6 +388,7 @@ struct Entity
     inline void Scale(vec3 scale) { this->worldMatrix = glm::scale(mat4(1.0f), scale) * worldMatrix; }
 
     glm::mat4  worldMatrix;
+    glm::mat4  worldViewProjectionMatrix; // Updated every frame, used for culling
     u32        modelIndex;
     u32        localParamsOffset;
     u32        localParamsSize;
@@ -287,6 +440,31 @@ struct Buffer
     void* data; // mapped data
 };
 
+#define RING_BUFFER_MAX_REGIONS 4
+
+// Buffer split in regions the CPU writes in turns, one per frame in flight. The head of buffer is
+// an offset in the whole buffer, so it can be bound with glBindBufferRange as is
+struct RingBuffer
+{
+    Buffer buffer;
+    bool   persistent;                      // Mapped for its whole life, else each region is mapped unsynchronized
+    u32    regionSize;
+    u32    regionCount;
+    u32    region;                          // Being written this frame
+    GLsync fences[RING_BUFFER_MAX_REGIONS]; // Signaled once the GPU is done reading each region
+    u32    overflowBytes;                   // Missing this frame at the end of the region for the reservations skipped
+
+    // Counters
+    u32    usedBytes;                       // Written in the last frame
+    u32    peakBytes;                       // Most bytes a frame has needed, overflow included
+    u32    growCount;                       // Times the regions were reallocated bigger
+    u64    overflowCount;                   // Reservations skipped because the region was full
+    u64    frameCount;
+    u64    blockedFrameCount;               // Frames whose region was still in use by the GPU
+    f64    blockedSeconds;                  // CPU time spent waiting for a region or mapping it, overall
+    f64    lastBlockedSeconds;              // ... in the last frame
+};
+
 enum LightType
 {
     LightType_Directional,
@@ -371,6 +549,7 @@ struct App
 
     // Resources
     std::vector<Texture>  textures;
+    std::unordered_map<std::string, u32> textureIndexes; // Texture of each file path
     std::vector<Material> materials;
     std::vector<Mesh>     meshes;
     std::vector<Model>    models;
@@ -420,7 +599,7 @@ struct App
     GLint maxUniformBufferSize;
     GLint uniformBlockAlignment;
 
-    Buffer cbuffer;
+    RingBuffer cbuffer;
     Buffer gBuffer;
 
     // Global params
@@ -430,6 +609,22 @@ struct App
     // Camera
     Camera camera;
 
+    // Coarsest LOD allowed is the one whose error projects to less than these pixels
+    f32 lodErrorThreshold;
+
+    // Streamed texture mips that have not been needed lately are evicted above this budget
+    i32 textureBudgetMB;
+
+    // Mesh buffers that have not been needed lately are evicted above this budget
+    i32 geometryBudgetMB;
+
+    // Meshlet culling stats of the last frame
+    u32 drawnMeshlets;
+    u32 culledMeshlets;
+
+    // Material textures bound by the geometry pass of the last frame (the atlased ones need none)
+    u32 textureBinds;
+
     // Last mouse positions (initialized in the center of the screen)
     float lastX = displaySize.x / 2.0f;
     float lastY = displaySize.y / 2.0f;
@@ -455,7 +650,40 @@ void Update(App* app);
 
 void Render(App* app);
 
-u32 LoadTexture2D(App* app, const char* filepath);
+void Shutdown(App* app);
+
+Image LoadImage(const char* filename, bool flipVertically = false); // Thread safe
+
+Image LoadImageFromMemory(const u8* data, u32 size, bool flipVertically = false); // Thread safe, for images embedded in other files
+
+void FreeImage(Image image);
+
+/**
+ * Creates a texture with its whole mip chain from tightly packed 8-bit pixels. If a
+ * GL_PIXEL_UNPACK_BUFFER is bound, pixels is an offset into it.
+ */
+GLuint CreateTexture2DFromPixels(ivec2 size, i32 nchannels, const void* pixels);
+
+/**
+ * Same as CreateTexture2DFromPixels() for pixels that already have their mip levels (each one at
+ * data + levelOffsets[level]). With a single level, the rest of the chain is generated.
+ */
+GLuint CreateTexture2DFromLevels(ivec2 size, i32 nchannels, u32 levelCount, const u8* data, const u32* levelOffsets);
+
+u32 FindTexture2D(App* app, const char* filepath);
+
+/**
+ * Registers a GL texture under a path (the path must not be in use) and returns its index.
+ */
+u32 AddTexture2D(App* app, const char* filepath, GLuint handle);
+
+/**
+ * Creates a texture from an already decoded image, unless a texture with the same path is loaded.
+ * The image is not freed.
+ */
+u32 CreateTexture2D(App* app, const char* filepath, Image image);
+
+u32 LoadTexture2D(App* app, const char* filepath, bool flipVertically = false);
 
 void FramebufferSizeCallback(App* app, GLFWwindow* window, int width, int height); // Window resize
 
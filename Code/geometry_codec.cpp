@@ -0,0 +1,698 @@
+#include "geometry_codec.h"
+#include "buffer_management.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define GEOMETRY_CODEC_SSE2
+#include <emmintrin.h>
+#endif
+
+#define GEOMETRY_VERTEX_BLOCK_SIZE 256 // Vertices whose deltas are unpacked together, a multiple of 16
+#define GEOMETRY_EDGE_FIFO_SIZE    16
+#define GEOMETRY_VERTEX_FIFO_SIZE  16
+
+enum GeometryStreamKind
+{
+    GeometryStream_Vertices,
+    GeometryStream_Indices
+};
+
+// Stream layout: [GeometryStreamHeader][GeometryStreamChunk x chunkCount][chunk data]
+struct GeometryStreamHeader
+{
+    u8  kind;
+    u8  encoded;      // Raw copy of the elements otherwise
+    u16 elementSize;  // Vertex stride or index size
+    u32 elementCount;
+    u32 vertexCount;  // Decoded indices must be below it
+    u32 chunkCount;
+};
+
+struct GeometryStreamChunk
+{
+    u32 offset;       // From the start of the stream
+    u32 size;
+    u32 baseVertex;   // First new vertex the triangles of an index chunk are expected to use
+};
+
+// Bits per delta of a group of 16, by the 2-bit mode stored in the block headers
+static const u32 GroupBits[4] = { 0, 2, 4, 8 };
+
+// Recently seen edges and vertices, the same on both sides of the codec
+struct TriangleCodecState
+{
+    u32 edges[GEOMETRY_EDGE_FIFO_SIZE][2];
+    u32 edgeOffset;
+    u32 vertices[GEOMETRY_VERTEX_FIFO_SIZE];
+    u32 vertexOffset;
+    u32 next; // Vertices are mostly used for the first time in order, those cost no extra data
+    u32 last; // Explicit vertices are stored as deltas to the last one
+};
+
+static u8 ZigzagByte(u8 value)
+{
+    return (u8)((value << 1) ^ (u8)((i8)value >> 7));
+}
+
+static u32 Zigzag(u32 value)
+{
+    return (value << 1) ^ (u32)((i32)value >> 31);
+}
+
+static u32 Unzigzag(u32 value)
+{
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+static void WriteVarint(std::vector<u8>& out, u32 value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back((u8)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((u8)value);
+}
+
+static bool ReadVarint(const u8*& data, const u8* end, u32& value)
+{
+    value = 0;
+    for (u32 shift = 0; shift < 35; shift += 7)
+    {
+        if (data == end)
+            return false;
+        u8 byte = *data++;
+        value |= (u32)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static void WriteIndex(u8* dst, u32 i, u32 value, u32 indexSize)
+{
+    if (indexSize == 4)
+    {
+        memcpy(dst + i * 4, &value, 4);
+    }
+    else if (indexSize == 2)
+    {
+        u16 value16 = (u16)value;
+        memcpy(dst + i * 2, &value16, 2);
+    }
+    else
+    {
+        dst[i] = (u8)value;
+    }
+}
+
+static void InitTriangleCodecState(TriangleCodecState& state, u32 baseVertex)
+{
+    memset(state.edges, 0xff, sizeof(state.edges));
+    memset(state.vertices, 0xff, sizeof(state.vertices));
+    state.edgeOffset = 0;
+    state.vertexOffset = 0;
+    state.next = baseVertex;
+    state.last = baseVertex;
+}
+
+static void PushEdge(TriangleCodecState& state, u32 a, u32 b)
+{
+    u32* edge = state.edges[state.edgeOffset++ % GEOMETRY_EDGE_FIFO_SIZE];
+    edge[0] = a;
+    edge[1] = b;
+}
+
+static void PushVertex(TriangleCodecState& state, u32 v)
+{
+    state.vertices[state.vertexOffset++ % GEOMETRY_VERTEX_FIFO_SIZE] = v;
+}
+
+// Distance (0 is the newest) of the edge in the FIFO, or -1. Distance 15 is reserved for the codes without edge.
+static i32 FindEdge(const TriangleCodecState& state, u32 a, u32 b)
+{
+    for (u32 i = 0; i < GEOMETRY_EDGE_FIFO_SIZE - 1; ++i)
+    {
+        const u32* edge = state.edges[(state.edgeOffset - 1 - i) % GEOMETRY_EDGE_FIFO_SIZE];
+        if (edge[0] == a && edge[1] == b)
+            return (i32)i;
+    }
+    return -1;
+}
+
+// Distance of the vertex in the FIFO, or -1. The codes 1-14 refer to distances 0-13.
+static i32 FindVertex(const TriangleCodecState& state, u32 v)
+{
+    for (u32 i = 0; i < GEOMETRY_VERTEX_FIFO_SIZE - 2; ++i)
+        if (state.vertices[(state.vertexOffset - 1 - i) % GEOMETRY_VERTEX_FIFO_SIZE] == v)
+            return (i32)i;
+    return -1;
+}
+
+static void EncodeVertexGroup(std::vector<u8>& out, const u8* deltas, u32 bits)
+{
+    if (bits == 8)
+    {
+        out.insert(out.end(), deltas, deltas + 16);
+        return;
+    }
+
+    u8 packed[8] = {};
+    u32 perByte = 8 / (bits ? bits : 8);
+    for (u32 i = 0; i < 16 && bits; ++i)
+        packed[i / perByte] |= (u8)(deltas[i] << ((i % perByte) * bits));
+    out.insert(out.end(), packed, packed + bits * 2);
+}
+
+// Every byte of the vertex is encoded on its own: the deltas with the same byte of the previous
+// vertex, zigzagged so small negative ones stay small, are bit-packed in groups of 16 vertices
+static void EncodeVertexChunk(std::vector<u8>& out, const u8* vertices, u32 vertexCount, u32 stride)
+{
+    u8 prev[GEOMETRY_MAX_VERTEX_STRIDE] = {};
+    u8 deltas[GEOMETRY_VERTEX_BLOCK_SIZE];
+
+    for (u32 first = 0; first < vertexCount; first += GEOMETRY_VERTEX_BLOCK_SIZE)
+    {
+        u32 count = glm::min((u32)GEOMETRY_VERTEX_BLOCK_SIZE, vertexCount - first);
+        u32 groupCount = (count + 15) / 16;
+
+        for (u32 k = 0; k < stride; ++k)
+        {
+            memset(deltas, 0, sizeof(deltas));
+            for (u32 v = 0; v < count; ++v)
+            {
+                u8 value = vertices[(first + v) * stride + k];
+                deltas[v] = ZigzagByte((u8)(value - prev[k]));
+                prev[k] = value;
+            }
+
+            size_t modes = out.size();
+            out.resize(modes + (groupCount + 3) / 4, 0);
+            for (u32 g = 0; g < groupCount; ++g)
+            {
+                const u8* group = deltas + g * 16;
+
+                u8 maxDelta = 0;
+                for (u32 i = 0; i < 16; ++i)
+                    maxDelta = glm::max(maxDelta, group[i]);
+
+                u32 mode = maxDelta == 0 ? 0 : maxDelta < 4 ? 1 : maxDelta < 16 ? 2 : 3;
+                out[modes + g / 4] |= (u8)(mode << ((g % 4) * 2));
+                EncodeVertexGroup(out, group, GroupBits[mode]);
+            }
+        }
+    }
+}
+
+static const u8* DecodeVertexGroup(const u8* data, const u8* end, u32 bits, u8* deltas)
+{
+    if ((u32)(end - data) < bits * 2)
+        return NULL;
+
+#ifdef GEOMETRY_CODEC_SSE2
+    __m128i result;
+    if (bits == 0)
+    {
+        result = _mm_setzero_si128();
+    }
+    else if (bits == 2)
+    {
+        u32 packed;
+        memcpy(&packed, data, sizeof(packed));
+        const __m128i mask = _mm_set1_epi8(3);
+        __m128i x = _mm_cvtsi32_si128((int)packed);
+        __m128i a0 = _mm_and_si128(x, mask);
+        __m128i a1 = _mm_and_si128(_mm_srli_epi16(x, 2), mask);
+        __m128i a2 = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+        __m128i a3 = _mm_and_si128(_mm_srli_epi16(x, 6), mask);
+        result = _mm_unpacklo_epi16(_mm_unpacklo_epi8(a0, a1), _mm_unpacklo_epi8(a2, a3));
+    }
+    else if (bits == 4)
+    {
+        const __m128i mask = _mm_set1_epi8(15);
+        __m128i x = _mm_loadl_epi64((const __m128i*)data);
+        result = _mm_unpacklo_epi8(_mm_and_si128(x, mask), _mm_and_si128(_mm_srli_epi16(x, 4), mask));
+    }
+    else
+    {
+        result = _mm_loadu_si128((const __m128i*)data);
+    }
+    _mm_store_si128((__m128i*)deltas, result);
+#else
+    if (bits == 8)
+    {
+        memcpy(deltas, data, 16);
+    }
+    else
+    {
+        u32 perByte = 8 / (bits ? bits : 8);
+        u8 mask = (u8)((1u << bits) - 1);
+        for (u32 i = 0; i < 16; ++i)
+            deltas[i] = bits ? (u8)((data[i / perByte] >> ((i % perByte) * bits)) & mask) : 0;
+    }
+#endif
+
+    return data + bits * 2;
+}
+
+#ifdef GEOMETRY_CODEC_SSE2
+static __m128i UnzigzagBytes(__m128i value)
+{
+    __m128i half = _mm_and_si128(_mm_srli_epi16(value, 1), _mm_set1_epi8(0x7f));
+    __m128i sign = _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(value, _mm_set1_epi8(1)));
+    return _mm_xor_si128(half, sign);
+}
+
+// Interleaving rows i and i + 8 rotates the bits of the (row, column) byte index by one,
+// so four passes swap them
+static void Transpose16x16(__m128i* rows)
+{
+    __m128i tmp[16];
+    for (u32 pass = 0; pass < 4; ++pass)
+    {
+        for (u32 i = 0; i < 8; ++i)
+        {
+            tmp[2 * i + 0] = _mm_unpacklo_epi8(rows[i], rows[i + 8]);
+            tmp[2 * i + 1] = _mm_unpackhi_epi8(rows[i], rows[i + 8]);
+        }
+        for (u32 i = 0; i < 16; ++i)
+            rows[i] = tmp[i];
+    }
+}
+#else
+static u8 UnzigzagByte(u8 value)
+{
+    return (u8)((value >> 1) ^ (u8)(0u - (value & 1)));
+}
+#endif
+
+static bool DecodeVertexChunk(u8* dst, u32 vertexCount, u32 stride, const u8* data, const u8* end)
+{
+    // Deltas are unpacked byte plane by byte plane, and summed up vertex by vertex
+    alignas(16) u8 planes[GEOMETRY_MAX_VERTEX_STRIDE][GEOMETRY_VERTEX_BLOCK_SIZE];
+    alignas(16) u8 prev[GEOMETRY_MAX_VERTEX_STRIDE] = {};
+
+#ifdef GEOMETRY_CODEC_SSE2
+    alignas(16) u8 rows[GEOMETRY_VERTEX_BLOCK_SIZE][GEOMETRY_MAX_VERTEX_STRIDE];
+    u32 pitch = Align(stride, 16);
+    memset(planes[stride], 0, (pitch - stride) * GEOMETRY_VERTEX_BLOCK_SIZE);
+#endif
+
+    for (u32 first = 0; first < vertexCount; first += GEOMETRY_VERTEX_BLOCK_SIZE)
+    {
+        u32 count = glm::min((u32)GEOMETRY_VERTEX_BLOCK_SIZE, vertexCount - first);
+        u32 groupCount = (count + 15) / 16;
+
+        for (u32 k = 0; k < stride; ++k)
+        {
+            const u8* modes = data;
+            data += (groupCount + 3) / 4;
+            if (data > end)
+                return false;
+
+            for (u32 g = 0; g < groupCount; ++g)
+            {
+                u32 mode = (modes[g / 4] >> ((g % 4) * 2)) & 3;
+                data = DecodeVertexGroup(data, end, GroupBits[mode], planes[k] + g * 16);
+                if (!data)
+                    return false;
+            }
+        }
+
+#ifdef GEOMETRY_CODEC_SSE2
+        // Blocks of 16 bytes of 16 vertices are transposed back to vertex order and accumulated
+        for (u32 k = 0; k < pitch; k += 16)
+        {
+            __m128i acc = _mm_load_si128((const __m128i*)(prev + k));
+            for (u32 g = 0; g < groupCount; ++g)
+            {
+                __m128i block[16];
+                for (u32 i = 0; i < 16; ++i)
+                    block[i] = _mm_load_si128((const __m128i*)(planes[k + i] + g * 16));
+                Transpose16x16(block);
+
+                u32 groupSize = glm::min(16u, count - g * 16);
+                for (u32 i = 0; i < groupSize; ++i)
+                {
+                    acc = _mm_add_epi8(acc, UnzigzagBytes(block[i]));
+                    _mm_store_si128((__m128i*)(rows[g * 16 + i] + k), acc);
+                }
+            }
+            _mm_store_si128((__m128i*)(prev + k), acc);
+        }
+
+        for (u32 v = 0; v < count; ++v)
+            memcpy(dst + (first + v) * stride, rows[v], stride);
+#else
+        for (u32 v = 0; v < count; ++v)
+        {
+            u8* vertex = dst + (first + v) * stride;
+            for (u32 k = 0; k < stride; ++k)
+            {
+                prev[k] = (u8)(prev[k] + UnzigzagByte(planes[k][v]));
+                vertex[k] = prev[k];
+            }
+        }
+#endif
+    }
+
+    return data == end;
+}
+
+// One code byte per triangle. The high nibble is the edge it shares with a recent triangle and
+// the low one where its third vertex comes from: 0 the next new vertex, 1-14 the vertex FIFO,
+// 15 an explicit delta. Triangles without a known edge use 0xF0, flagging which of their
+// vertices are the next new ones, and the others follow as explicit deltas.
+static u32 EncodeTriangleChunk(std::vector<u8>& out, const u32* indices, u32 triangleCount, u32 baseVertex)
+{
+    TriangleCodecState state;
+    InitTriangleCodecState(state, baseVertex);
+
+    for (u32 t = 0; t < triangleCount; ++t)
+    {
+        const u32* triangle = indices + t * 3;
+
+        // Rotated (keeping the winding) so its first edge is the one already known
+        i32 edge = -1;
+        u32 x = 0, y = 0, z = 0;
+        for (u32 r = 0; r < 3 && edge < 0; ++r)
+        {
+            x = triangle[r];
+            y = triangle[(r + 1) % 3];
+            z = triangle[(r + 2) % 3];
+            edge = FindEdge(state, x, y);
+        }
+
+        if (edge >= 0)
+        {
+            i32 fifoVertex = FindVertex(state, z);
+            if (z == state.next)
+            {
+                out.push_back((u8)(edge << 4));
+                state.next++;
+                PushVertex(state, z);
+            }
+            else if (fifoVertex >= 0)
+            {
+                out.push_back((u8)((edge << 4) | (fifoVertex + 1)));
+            }
+            else
+            {
+                out.push_back((u8)((edge << 4) | 15));
+                WriteVarint(out, Zigzag(z - state.last));
+                state.last = z;
+                PushVertex(state, z);
+            }
+
+            PushEdge(state, z, y);
+            PushEdge(state, x, z);
+        }
+        else
+        {
+            size_t code = out.size();
+            out.push_back(0xf0);
+            for (u32 j = 0; j < 3; ++j)
+            {
+                if (triangle[j] == state.next)
+                {
+                    out[code] |= (u8)(1 << j);
+                    state.next++;
+                }
+                else
+                {
+                    WriteVarint(out, Zigzag(triangle[j] - state.last));
+                    state.last = triangle[j];
+                }
+                PushVertex(state, triangle[j]);
+            }
+
+            PushEdge(state, triangle[1], triangle[0]);
+            PushEdge(state, triangle[2], triangle[1]);
+            PushEdge(state, triangle[0], triangle[2]);
+        }
+    }
+
+    return state.next;
+}
+
+static bool DecodeTriangleChunk(u8* dst, u32 triangleCount, u32 indexSize, u32 vertexCount, u32 baseVertex, const u8* data, const u8* end)
+{
+    TriangleCodecState state;
+    InitTriangleCodecState(state, baseVertex);
+
+    for (u32 t = 0; t < triangleCount; ++t)
+    {
+        if (data == end)
+            return false;
+
+        u8 code = *data++;
+        u32 triangle[3];
+
+        if (code < 0xf0)
+        {
+            const u32* edge = state.edges[(state.edgeOffset - 1 - (code >> 4)) % GEOMETRY_EDGE_FIFO_SIZE];
+            u32 x = edge[0];
+            u32 y = edge[1];
+            u32 z;
+
+            u32 third = code & 15;
+            if (third == 0)
+            {
+                z = state.next++;
+                PushVertex(state, z);
+            }
+            else if (third < 15)
+            {
+                z = state.vertices[(state.vertexOffset - third) % GEOMETRY_VERTEX_FIFO_SIZE];
+            }
+            else
+            {
+                u32 delta;
+                if (!ReadVarint(data, end, delta))
+                    return false;
+                z = state.last + Unzigzag(delta);
+                state.last = z;
+                PushVertex(state, z);
+            }
+
+            PushEdge(state, z, y);
+            PushEdge(state, x, z);
+
+            triangle[0] = x;
+            triangle[1] = y;
+            triangle[2] = z;
+        }
+        else if (code <= 0xf7)
+        {
+            for (u32 j = 0; j < 3; ++j)
+            {
+                if (code & (1 << j))
+                {
+                    triangle[j] = state.next++;
+                }
+                else
+                {
+                    u32 delta;
+                    if (!ReadVarint(data, end, delta))
+                        return false;
+                    triangle[j] = state.last + Unzigzag(delta);
+                    state.last = triangle[j];
+                }
+                PushVertex(state, triangle[j]);
+            }
+
+            PushEdge(state, triangle[1], triangle[0]);
+            PushEdge(state, triangle[2], triangle[1]);
+            PushEdge(state, triangle[0], triangle[2]);
+        }
+        else
+        {
+            return false;
+        }
+
+        for (u32 j = 0; j < 3; ++j)
+        {
+            if (triangle[j] >= vertexCount)
+                return false;
+            WriteIndex(dst, t * 3 + j, triangle[j], indexSize);
+        }
+    }
+
+    return data == end;
+}
+
+static u32 GetChunkElementCount(u32 kind)
+{
+    return kind == GeometryStream_Vertices ? GEOMETRY_VERTEX_CHUNK_SIZE : GEOMETRY_TRIANGLE_CHUNK_SIZE * 3;
+}
+
+// Appends the header, the chunk table (offsets relative to the data) and the data, 4-byte aligned
+static void WriteStream(std::vector<u8>& stream, const GeometryStreamHeader& header, std::vector<GeometryStreamChunk>& chunks, const std::vector<u8>& data)
+{
+    u32 dataOffset = sizeof(GeometryStreamHeader) + (u32)(chunks.size() * sizeof(GeometryStreamChunk));
+    for (u32 i = 0; i < chunks.size(); ++i)
+        chunks[i].offset += dataOffset;
+
+    const u8* headerBytes = (const u8*)&header;
+    const u8* chunkBytes = (const u8*)chunks.data();
+    stream.insert(stream.end(), headerBytes, headerBytes + sizeof(header));
+    stream.insert(stream.end(), chunkBytes, chunkBytes + chunks.size() * sizeof(GeometryStreamChunk));
+    stream.insert(stream.end(), data.begin(), data.end());
+    stream.resize(Align((u32)stream.size(), sizeof(u32)), 0);
+}
+
+void EncodeVertexStream(std::vector<u8>& stream, const u8* vertices, u32 vertexCount, u32 stride)
+{
+    GeometryStreamHeader header = {};
+    header.kind = GeometryStream_Vertices;
+    header.elementSize = (u16)stride;
+    header.elementCount = vertexCount;
+    header.vertexCount = vertexCount;
+    header.chunkCount = (vertexCount + GEOMETRY_VERTEX_CHUNK_SIZE - 1) / GEOMETRY_VERTEX_CHUNK_SIZE;
+
+    std::vector<GeometryStreamChunk> chunks(header.chunkCount);
+    std::vector<u8> data;
+
+    if (stride > 0 && stride <= GEOMETRY_MAX_VERTEX_STRIDE)
+    {
+        header.encoded = 1;
+        for (u32 i = 0; i < header.chunkCount; ++i)
+        {
+            u32 first = i * GEOMETRY_VERTEX_CHUNK_SIZE;
+            chunks[i].offset = (u32)data.size();
+            EncodeVertexChunk(data, vertices + first * stride, glm::min((u32)GEOMETRY_VERTEX_CHUNK_SIZE, vertexCount - first), stride);
+            chunks[i].size = (u32)data.size() - chunks[i].offset;
+        }
+    }
+
+    // Data that does not compress (e.g. noise-like floats) is kept as is
+    u32 rawSize = vertexCount * stride;
+    if (!header.encoded || data.size() >= rawSize)
+    {
+        header.encoded = 0;
+        data.assign(vertices, vertices + rawSize);
+        for (u32 i = 0; i < header.chunkCount; ++i)
+        {
+            u32 first = i * GEOMETRY_VERTEX_CHUNK_SIZE;
+            chunks[i].offset = first * stride;
+            chunks[i].size = glm::min((u32)GEOMETRY_VERTEX_CHUNK_SIZE, vertexCount - first) * stride;
+        }
+    }
+
+    WriteStream(stream, header, chunks, data);
+}
+
+void EncodeIndexStream(std::vector<u8>& stream, const u32* indices, u32 indexCount, u32 indexSize, u32 vertexCount)
+{
+    GeometryStreamHeader header = {};
+    header.kind = GeometryStream_Indices;
+    header.elementSize = (u16)indexSize;
+    header.elementCount = indexCount;
+    header.vertexCount = vertexCount;
+    header.chunkCount = (indexCount + GEOMETRY_TRIANGLE_CHUNK_SIZE * 3 - 1) / (GEOMETRY_TRIANGLE_CHUNK_SIZE * 3);
+
+    std::vector<GeometryStreamChunk> chunks(header.chunkCount);
+    std::vector<u8> data;
+
+    bool encodable = indexCount % 3 == 0;
+    for (u32 i = 0; i < indexCount && encodable; ++i)
+        encodable = indices[i] < vertexCount;
+
+    if (encodable)
+    {
+        header.encoded = 1;
+        u32 next = 0;
+        for (u32 i = 0; i < header.chunkCount; ++i)
+        {
+            u32 firstTriangle = i * GEOMETRY_TRIANGLE_CHUNK_SIZE;
+            chunks[i].offset = (u32)data.size();
+            chunks[i].baseVertex = next;
+            next = EncodeTriangleChunk(data, indices + firstTriangle * 3, glm::min((u32)GEOMETRY_TRIANGLE_CHUNK_SIZE, indexCount / 3 - firstTriangle), next);
+            chunks[i].size = (u32)data.size() - chunks[i].offset;
+        }
+    }
+
+    u32 rawSize = indexCount * indexSize;
+    if (!header.encoded || data.size() >= rawSize)
+    {
+        header.encoded = 0;
+        data.resize(rawSize);
+        for (u32 i = 0; i < indexCount; ++i)
+            WriteIndex(data.data(), i, indices[i], indexSize);
+        for (u32 i = 0; i < header.chunkCount; ++i)
+        {
+            u32 first = i * GEOMETRY_TRIANGLE_CHUNK_SIZE * 3;
+            chunks[i].offset = first * indexSize;
+            chunks[i].size = glm::min((u32)GEOMETRY_TRIANGLE_CHUNK_SIZE * 3, indexCount - first) * indexSize;
+            chunks[i].baseVertex = 0;
+        }
+    }
+
+    WriteStream(stream, header, chunks, data);
+}
+
+static bool ReadStreamHeader(const u8* stream, u32 streamSize, GeometryStreamHeader& header)
+{
+    if (streamSize < sizeof(header))
+        return false;
+    memcpy(&header, stream, sizeof(header));
+
+    if (header.kind == GeometryStream_Vertices)
+    {
+        if (header.elementSize == 0 || (header.encoded && header.elementSize > GEOMETRY_MAX_VERTEX_STRIDE))
+            return false;
+    }
+    else if (header.kind == GeometryStream_Indices)
+    {
+        if ((header.elementSize != 1 && header.elementSize != 2 && header.elementSize != 4) || (header.encoded && header.elementCount % 3 != 0))
+            return false;
+    }
+    else
+    {
+        return false;
+    }
+
+    u32 chunkElementCount = GetChunkElementCount(header.kind);
+    return header.chunkCount == (header.elementCount + chunkElementCount - 1) / chunkElementCount &&
+        sizeof(header) + (u64)header.chunkCount * sizeof(GeometryStreamChunk) <= streamSize;
+}
+
+u32 GetGeometryStreamChunkCount(const u8* stream, u32 streamSize, u32 dstSize)
+{
+    GeometryStreamHeader header;
+    if (!ReadStreamHeader(stream, streamSize, header) || (u64)header.elementCount * header.elementSize != dstSize)
+        return 0;
+    return header.chunkCount;
+}
+
+bool DecodeGeometryStreamChunk(void* dst, const u8* stream, u32 streamSize, u32 chunk)
+{
+    GeometryStreamHeader header;
+    if (!ReadStreamHeader(stream, streamSize, header) || chunk >= header.chunkCount)
+        return false;
+
+    GeometryStreamChunk entry;
+    memcpy(&entry, stream + sizeof(header) + chunk * sizeof(GeometryStreamChunk), sizeof(entry));
+    if ((u64)entry.offset + entry.size > streamSize)
+        return false;
+
+    u32 chunkElementCount = GetChunkElementCount(header.kind);
+    u32 first = chunk * chunkElementCount;
+    u32 count = glm::min(chunkElementCount, header.elementCount - first);
+
+    u8* out = (u8*)dst + (size_t)first * header.elementSize;
+    const u8* data = stream + entry.offset;
+    const u8* end = data + entry.size;
+
+    if (!header.encoded)
+    {
+        if (entry.size != count * header.elementSize)
+            return false;
+        memcpy(out, data, entry.size);
+        return true;
+    }
+
+    if (header.kind == GeometryStream_Vertices)
+        return DecodeVertexChunk(out, count, header.elementSize, data, end);
+    else
+        return DecodeTriangleChunk(out, count / 3, header.elementSize, header.vertexCount, entry.baseVertex, data, end);
+}
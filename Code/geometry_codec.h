@@ -0,0 +1,38 @@
+//
+// geometry_codec.h: Lossless compression of the vertex and index data of the mesh caches.
+// Vertices are delta encoded byte by byte against the previous vertex and the deltas bit-packed
+// in groups of 16, so the quantized attributes (whose neighbours differ in their low bits only)
+// shrink the most. Triangles are encoded as one code byte each, telling which recently seen edge
+// and vertex they reuse. Streams are split in chunks that decode independently, in parallel.
+//
+
+#pragma once
+
+#include "platform.h"
+
+#define GEOMETRY_VERTEX_CHUNK_SIZE   8192 // Vertices per chunk
+#define GEOMETRY_TRIANGLE_CHUNK_SIZE 8192 // Triangles per chunk
+#define GEOMETRY_MAX_VERTEX_STRIDE   64   // Larger vertices are stored raw
+
+/**
+ * Appends a stream with the encoded vertices, or a raw copy of them if they do not compress.
+ */
+void EncodeVertexStream(std::vector<u8>& stream, const u8* vertices, u32 vertexCount, u32 stride);
+
+/**
+ * Appends a stream with the encoded triangle list. It decodes into indices of indexSize bytes
+ * (1, 2 or 4), with the vertices of each triangle possibly rotated (but never its winding).
+ */
+void EncodeIndexStream(std::vector<u8>& stream, const u32* indices, u32 indexCount, u32 indexSize, u32 vertexCount);
+
+/**
+ * Returns the number of chunks of a stream, or 0 if it is not a valid stream decoding into
+ * exactly dstSize bytes.
+ */
+u32 GetGeometryStreamChunkCount(const u8* stream, u32 streamSize, u32 dstSize);
+
+/**
+ * Decodes one chunk of a stream (see GetGeometryStreamChunkCount()) into its range of dst.
+ * Different chunks can be decoded at the same time. Returns false if the data is corrupt.
+ */
+bool DecodeGeometryStreamChunk(void* dst, const u8* stream, u32 streamSize, u32 chunk);
@@ -0,0 +1,388 @@
+#include "geometry_pool.h"
+#include "buffer_management.h"
+#include "tlsf_allocator.h"
+#include "vertex_quantization.h"
+
+#define GEOMETRY_INDEX_UNIT_SIZE 4 // Bytes, so the 16 and 32-bit indices of every submesh stay aligned
+
+struct GeometryArena
+{
+    VertexBufferLayout        layout;
+    GLuint                    vertexBufferHandle;
+    GLuint                    indexBufferHandle;
+    u32                       indexUnitSize; // Bytes per unit of the index allocator
+    TlsfAllocator             vertices;      // In vertices of layout.stride, so offsets are base vertices
+    TlsfAllocator             indices;       // In units of indexUnitSize, whatever the index type of the submeshes
+    std::vector<ModelSubmesh> vertexOwners;  // Submesh of each allocated block, by block index
+    std::vector<ModelSubmesh> indexOwners;
+    std::vector<Vao>          vaos;          // One per program
+};
+
+struct GeometryPool
+{
+    std::vector<GeometryArena> arenas;
+    GLuint                     scratchBufferHandle; // Staging of the blocks that slide over themselves
+    u32                        scratchBufferSize;
+    u64                        movedBytes;
+};
+
+static GeometryPool GlobalGeometryPool;
+
+static bool LayoutsMatch(const VertexBufferLayout& a, const VertexBufferLayout& b)
+{
+    if (a.stride != b.stride || a.attributes.size() != b.attributes.size())
+        return false;
+
+    for (u32 i = 0; i < a.attributes.size(); ++i)
+    {
+        const VertexBufferAttribute& attributeA = a.attributes[i];
+        const VertexBufferAttribute& attributeB = b.attributes[i];
+        if (attributeA.location != attributeB.location || attributeA.componentCount != attributeB.componentCount ||
+            attributeA.offset != attributeB.offset || attributeA.type != attributeB.type || attributeA.normalized != attributeB.normalized)
+            return false;
+    }
+    return true;
+}
+
+static u32 GetLayoutStride(const VertexBufferLayout& layout)
+{
+    return glm::max((u32)layout.stride, 1u);
+}
+
+// Creates buffers big enough for at least vertexCount vertices and indexUnits units of indices.
+// The GL_COPY_WRITE_BUFFER target is used to fill them, as binding GL_ELEMENT_ARRAY_BUFFER would
+// change the bound VAO
+static u32 CreateArena(const VertexBufferLayout& layout, u32 vertexCount, u32 indexUnits)
+{
+    // TLSF rounds requests up to their size class, a sixteenth at most
+    const u32 stride = GetLayoutStride(layout);
+    const u32 vertexCapacity = glm::max(GEOMETRY_ARENA_VERTEX_SIZE / stride, vertexCount + vertexCount / TLSF_SL_COUNT + 1);
+    const u32 indexCapacity = glm::max((u32)(GEOMETRY_ARENA_INDEX_SIZE / GEOMETRY_INDEX_UNIT_SIZE), indexUnits + indexUnits / TLSF_SL_COUNT + 1);
+
+    GeometryPool& pool = GlobalGeometryPool;
+    pool.arenas.push_back(GeometryArena{});
+    GeometryArena& arena = pool.arenas.back();
+    arena.layout = layout;
+    arena.indexUnitSize = GEOMETRY_INDEX_UNIT_SIZE;
+    InitTlsfAllocator(arena.vertices, vertexCapacity);
+    InitTlsfAllocator(arena.indices, indexCapacity);
+
+    glGenBuffers(1, &arena.vertexBufferHandle);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, arena.vertexBufferHandle);
+    glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)vertexCapacity * stride, NULL, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &arena.indexBufferHandle);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, arena.indexBufferHandle);
+    glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)indexCapacity * arena.indexUnitSize, NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    ILOG("Geometry arena %u created: %u-byte vertices, %.1f MB of vertices and %.1f MB of indices", (u32)pool.arenas.size() - 1u,
+        stride, (f64)vertexCapacity * stride / MB(1), (f64)indexCapacity * arena.indexUnitSize / MB(1));
+    return (u32)pool.arenas.size() - 1u;
+}
+
+// Points the submesh that owns a block at its new place
+static void SetBlockMoved(App* app, GeometryArena& arena, bool vertexBuffer, u32 blockIdx, u32 oldBlockIdx)
+{
+    TlsfAllocator& allocator = vertexBuffer ? arena.vertices : arena.indices;
+    std::vector<ModelSubmesh>& owners = vertexBuffer ? arena.vertexOwners : arena.indexOwners;
+
+    owners.resize(allocator.blocks.size());
+    owners[blockIdx] = owners[oldBlockIdx];
+
+    const u32 offset = allocator.blocks[blockIdx].offset;
+    Submesh& submesh = app->meshes[owners[blockIdx].meshIdx].submeshes[owners[blockIdx].submeshIdx];
+    if (vertexBuffer)
+    {
+        submesh.vertexBlock = blockIdx;
+        submesh.baseVertex = offset;
+        submesh.vertexOffset = offset * GetLayoutStride(arena.layout);
+    }
+    else
+    {
+        submesh.indexBlock = blockIdx;
+        submesh.indexOffset = offset * arena.indexUnitSize;
+    }
+}
+
+// Copies size bytes within a buffer, through the scratch buffer if the ranges overlap
+static void CopyWithinBuffer(GLuint bufferHandle, u32 srcOffset, u32 dstOffset, u32 size)
+{
+    GeometryPool& pool = GlobalGeometryPool;
+    if (srcOffset >= dstOffset + size || dstOffset >= srcOffset + size)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, bufferHandle);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, bufferHandle);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, srcOffset, dstOffset, size);
+        return;
+    }
+
+    if (pool.scratchBufferSize < size)
+    {
+        if (pool.scratchBufferHandle == 0)
+            glGenBuffers(1, &pool.scratchBufferHandle);
+        pool.scratchBufferSize = glm::max(size, pool.scratchBufferSize * 2);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, pool.scratchBufferHandle);
+        glBufferData(GL_COPY_WRITE_BUFFER, pool.scratchBufferSize, NULL, GL_STREAM_COPY);
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, bufferHandle);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, pool.scratchBufferHandle);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, srcOffset, 0, size);
+    glBindBuffer(GL_COPY_READ_BUFFER, pool.scratchBufferHandle);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, bufferHandle);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, dstOffset, size);
+}
+
+// Closes the holes of a buffer of the arena, returns the bytes copied. The blocks at the end are
+// first moved into the holes below them that fit them, then the blocks above the lowest hole
+// slide down, so the free space ends up in one piece after the last block
+static u64 CompactArenaBuffer(App* app, GeometryArena& arena, bool vertexBuffer, u64 budget)
+{
+    TlsfAllocator& allocator = vertexBuffer ? arena.vertices : arena.indices;
+    const GLuint bufferHandle = vertexBuffer ? arena.vertexBufferHandle : arena.indexBufferHandle;
+    const u32 unitSize = vertexBuffer ? GetLayoutStride(arena.layout) : arena.indexUnitSize;
+
+    // Nothing to do if the free space is in one piece
+    if (allocator.size - allocator.usedSize <= GetTlsfLargestFreeSize(allocator))
+        return 0;
+
+    u64 movedBytes = 0;
+    u32 blockIdx = allocator.lastBlock;
+    while (blockIdx != TLSF_INVALID_BLOCK && movedBytes < budget)
+    {
+        const TlsfBlock block = allocator.blocks[blockIdx];
+        if (block.free)
+        {
+            blockIdx = block.prevPhysical;
+            continue;
+        }
+
+        // Both copies are allocated during the copy, so the ranges never overlap
+        const u32 movedIdx = TlsfAllocate(allocator, block.size);
+        if (movedIdx == TLSF_INVALID_BLOCK)
+            break;
+        if (allocator.blocks[movedIdx].offset > block.offset)
+        {
+            TlsfFree(allocator, movedIdx); // No hole below fits it
+            break;
+        }
+
+        CopyWithinBuffer(bufferHandle, block.offset * unitSize, allocator.blocks[movedIdx].offset * unitSize, block.size * unitSize);
+        SetBlockMoved(app, arena, vertexBuffer, movedIdx, blockIdx);
+        movedBytes += (u64)block.size * unitSize;
+
+        // The walk goes on below the hole the block leaves (merged with a free block before it),
+        // as the block it had before may now be its copy
+        const u32 prevIdx = allocator.blocks[blockIdx].prevPhysical;
+        const bool mergedDown = prevIdx != TLSF_INVALID_BLOCK && allocator.blocks[prevIdx].free;
+        TlsfFree(allocator, blockIdx);
+        const u32 holeIdx = mergedDown ? prevIdx : blockIdx;
+        blockIdx = allocator.blocks[holeIdx].prevPhysical;
+        if (blockIdx == movedIdx)
+            blockIdx = allocator.blocks[movedIdx].prevPhysical;
+    }
+
+    // Blocks keep their index when they slide
+    blockIdx = allocator.firstBlock;
+    while (blockIdx != TLSF_INVALID_BLOCK && movedBytes < budget)
+    {
+        const TlsfBlock block = allocator.blocks[blockIdx];
+        if (block.free || !TlsfMoveBlockDown(allocator, blockIdx))
+        {
+            blockIdx = block.nextPhysical;
+            continue;
+        }
+
+        CopyWithinBuffer(bufferHandle, block.offset * unitSize, allocator.blocks[blockIdx].offset * unitSize, block.size * unitSize);
+        SetBlockMoved(app, arena, vertexBuffer, blockIdx, blockIdx);
+        movedBytes += (u64)block.size * unitSize;
+        blockIdx = allocator.blocks[allocator.blocks[blockIdx].nextPhysical].nextPhysical; // Past the hole that now follows it
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return movedBytes;
+}
+
+void InitGeometryPool()
+{
+    GlobalGeometryPool.arenas.clear();
+    GlobalGeometryPool.movedBytes = 0;
+}
+
+void ShutdownGeometryPool()
+{
+    GeometryPool& pool = GlobalGeometryPool;
+    for (u32 i = 0; i < pool.arenas.size(); ++i)
+    {
+        GeometryArena& arena = pool.arenas[i];
+        for (u32 j = 0; j < arena.vaos.size(); ++j)
+            glDeleteVertexArrays(1, &arena.vaos[j].handle);
+        glDeleteBuffers(1, &arena.vertexBufferHandle);
+        glDeleteBuffers(1, &arena.indexBufferHandle);
+    }
+    pool.arenas.clear();
+
+    glDeleteBuffers(1, &pool.scratchBufferHandle);
+    pool.scratchBufferHandle = 0;
+    pool.scratchBufferSize = 0;
+}
+
+void AllocateSubmeshGeometry(Submesh& submesh, ModelSubmesh owner, const void* vertices, const void* indices)
+{
+    GeometryPool& pool = GlobalGeometryPool;
+    const u32 stride = GetLayoutStride(submesh.vertexBufferLayout);
+    const u32 indicesSize = submesh.indexCount * GetIndexSize(submesh.indexType);
+    const u32 indexUnits = Align(indicesSize, GEOMETRY_INDEX_UNIT_SIZE) / GEOMETRY_INDEX_UNIT_SIZE;
+
+    // The first arena of the format with room for both
+    u32 arenaIdx = UINT32_MAX;
+    u32 vertexBlock = TLSF_INVALID_BLOCK;
+    u32 indexBlock = TLSF_INVALID_BLOCK;
+    for (u32 i = 0; i < pool.arenas.size() && arenaIdx == UINT32_MAX; ++i)
+    {
+        GeometryArena& arena = pool.arenas[i];
+        if (!LayoutsMatch(arena.layout, submesh.vertexBufferLayout))
+            continue;
+
+        vertexBlock = TlsfAllocate(arena.vertices, submesh.vertexCount);
+        if (vertexBlock == TLSF_INVALID_BLOCK)
+            continue;
+
+        indexBlock = TlsfAllocate(arena.indices, indexUnits);
+        if (indexBlock == TLSF_INVALID_BLOCK)
+        {
+            TlsfFree(arena.vertices, vertexBlock);
+            continue;
+        }
+        arenaIdx = i;
+    }
+
+    if (arenaIdx == UINT32_MAX)
+    {
+        arenaIdx = CreateArena(submesh.vertexBufferLayout, submesh.vertexCount, indexUnits);
+        vertexBlock = TlsfAllocate(pool.arenas[arenaIdx].vertices, submesh.vertexCount);
+        indexBlock = TlsfAllocate(pool.arenas[arenaIdx].indices, indexUnits);
+    }
+
+    GeometryArena& arena = pool.arenas[arenaIdx];
+    arena.vertexOwners.resize(arena.vertices.blocks.size());
+    arena.vertexOwners[vertexBlock] = owner;
+    arena.indexOwners.resize(arena.indices.blocks.size());
+    arena.indexOwners[indexBlock] = owner;
+
+    submesh.arenaIdx = arenaIdx;
+    submesh.vertexBlock = vertexBlock;
+    submesh.indexBlock = indexBlock;
+    submesh.baseVertex = arena.vertices.blocks[vertexBlock].offset;
+    submesh.vertexOffset = submesh.baseVertex * stride;
+    submesh.indexOffset = arena.indices.blocks[indexBlock].offset * arena.indexUnitSize;
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, arena.vertexBufferHandle);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, submesh.vertexOffset, submesh.vertexCount * submesh.vertexBufferLayout.stride, vertices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, arena.indexBufferHandle);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, submesh.indexOffset, indicesSize, indices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void FreeSubmeshGeometry(Submesh& submesh)
+{
+    if (submesh.arenaIdx == UINT32_MAX)
+        return;
+
+    GeometryArena& arena = GlobalGeometryPool.arenas[submesh.arenaIdx];
+    TlsfFree(arena.vertices, submesh.vertexBlock);
+    TlsfFree(arena.indices, submesh.indexBlock);
+    submesh.arenaIdx = UINT32_MAX;
+}
+
+GLuint FindGeometryVAO(const Submesh& submesh, const Program& program)
+{
+    GeometryArena& arena = GlobalGeometryPool.arenas[submesh.arenaIdx];
+
+    // Try finding a vao for this arena/program
+    for (u32 i = 0; i < (u32)arena.vaos.size(); ++i)
+        if (arena.vaos[i].programHandle == program.handle)
+            return arena.vaos[i].handle;
+
+    GLuint vaoHandle = 0;
+
+    // Create a new vao for this arena/program, the draws pick their vertices with a base vertex
+    {
+        glGenVertexArrays(1, &vaoHandle);
+        glBindVertexArray(vaoHandle);
+
+        glBindBuffer(GL_ARRAY_BUFFER, arena.vertexBufferHandle);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.indexBufferHandle);
+
+        // We have to link all vertex inputs attributes to attributes in the vertex buffer
+        for (u32 i = 0; i < program.vertexInputLayout.attributes.size(); ++i)
+        {
+            bool attributeWasLinked = false;
+
+            for (u32 j = 0; j < arena.layout.attributes.size(); ++j)
+            {
+                if (program.vertexInputLayout.attributes[i].location == arena.layout.attributes[j].location)
+                {
+                    const u32 index = arena.layout.attributes[j].location;
+                    const u32 ncomp = arena.layout.attributes[j].componentCount;
+                    const u32 offset = arena.layout.attributes[j].offset;
+                    const u32 stride = arena.layout.stride;
+                    const GLenum type = arena.layout.attributes[j].type;
+                    const GLboolean normalized = arena.layout.attributes[j].normalized;
+                    glVertexAttribPointer(index, ncomp, type, normalized, stride, (void*)(u64)offset);
+                    glEnableVertexAttribArray(index);
+
+                    attributeWasLinked = true;
+                    break;
+                }
+            }
+
+            assert(attributeWasLinked); // The submesh should provide an attribute for each vertex inputs
+        }
+
+        glBindVertexArray(0);
+    }
+
+    // Store it in the list of vaos for this arena
+    Vao vao = { vaoHandle, program.handle };
+    arena.vaos.push_back(vao);
+
+    return vaoHandle;
+}
+
+void DefragmentGeometryPool(App* app)
+{
+    GeometryPool& pool = GlobalGeometryPool;
+
+    u64 movedBytes = 0;
+    for (u32 i = 0; i < pool.arenas.size() && movedBytes < GEOMETRY_DEFRAG_BYTES_PER_FRAME; ++i)
+    {
+        movedBytes += CompactArenaBuffer(app, pool.arenas[i], true, GEOMETRY_DEFRAG_BYTES_PER_FRAME - movedBytes);
+        if (movedBytes < GEOMETRY_DEFRAG_BYTES_PER_FRAME)
+            movedBytes += CompactArenaBuffer(app, pool.arenas[i], false, GEOMETRY_DEFRAG_BYTES_PER_FRAME - movedBytes);
+    }
+    pool.movedBytes += movedBytes;
+}
+
+void GetGeometryPoolStats(GeometryPoolStats& stats)
+{
+    const GeometryPool& pool = GlobalGeometryPool;
+
+    stats = GeometryPoolStats{};
+    stats.arenaCount = (u32)pool.arenas.size();
+    stats.movedBytes = pool.movedBytes;
+    for (u32 i = 0; i < pool.arenas.size(); ++i)
+    {
+        const GeometryArena& arena = pool.arenas[i];
+        const u32 stride = GetLayoutStride(arena.layout);
+        stats.submeshCount += arena.vertices.allocationCount;
+        stats.vertexBytes += (u64)arena.vertices.size * stride;
+        stats.indexBytes += (u64)arena.indices.size * arena.indexUnitSize;
+        stats.usedVertexBytes += (u64)arena.vertices.usedSize * stride;
+        stats.usedIndexBytes += (u64)arena.indices.usedSize * arena.indexUnitSize;
+        stats.freeHoleBytes += (u64)(arena.vertices.size - arena.vertices.usedSize - GetTlsfLargestFreeSize(arena.vertices)) * stride;
+        stats.freeHoleBytes += (u64)(arena.indices.size - arena.indices.usedSize - GetTlsfLargestFreeSize(arena.indices)) * arena.indexUnitSize;
+    }
+}
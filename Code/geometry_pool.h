@@ -0,0 +1,55 @@
+//
+// geometry_pool.h: Vertex and index data of every resident submesh, packed into a few large GL
+// buffers per vertex format (arenas) suballocated with tlsf_allocator.h. Submeshes of an arena
+// share its VAOs and are drawn with glDrawElementsBaseVertex, so drawing different models does
+// not switch buffers. Streaming meshes in and out leaves holes, which a defragmentation pass
+// closes a few megabytes per frame. Main thread only.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define GEOMETRY_ARENA_VERTEX_SIZE MB(32)      // Bytes of the vertex buffer of an arena (more if a submesh needs it)
+#define GEOMETRY_ARENA_INDEX_SIZE MB(16)       // Bytes of its index buffer
+#define GEOMETRY_DEFRAG_BYTES_PER_FRAME MB(4)  // Copied by DefragmentGeometryPool() at most each frame
+
+struct GeometryPoolStats
+{
+    u32 arenaCount;
+    u32 submeshCount;
+    u64 vertexBytes;     // Of the arena buffers
+    u64 indexBytes;
+    u64 usedVertexBytes; // Allocated to submeshes
+    u64 usedIndexBytes;
+    u64 freeHoleBytes;   // Free, but outside of the largest free block of each buffer
+    u64 movedBytes;      // Copied by defragmentation so far
+};
+
+void InitGeometryPool();
+
+void ShutdownGeometryPool();
+
+/**
+ * Allocates the vertices and indices of a submesh in an arena of its vertex format (a new one if
+ * none has room), uploads them, and sets submesh.arenaIdx, baseVertex, vertexOffset and
+ * indexOffset. indices are already in submesh.indexType. owner is where the submesh lives, as it
+ * is updated when defragmentation moves the data.
+ */
+void AllocateSubmeshGeometry(Submesh& submesh, ModelSubmesh owner, const void* vertices, const void* indices);
+
+/** Frees the data of a submesh, which is left with no arena */
+void FreeSubmeshGeometry(Submesh& submesh);
+
+/**
+ * Returns the VAO of the arena of a submesh for a program, created on first use.
+ */
+GLuint FindGeometryVAO(const Submesh& submesh, const Program& program);
+
+/**
+ * Called once per frame. Moves the submeshes at the end of fragmented buffers into the holes
+ * below them, up to GEOMETRY_DEFRAG_BYTES_PER_FRAME.
+ */
+void DefragmentGeometryPool(App* app);
+
+void GetGeometryPoolStats(GeometryPoolStats& stats);
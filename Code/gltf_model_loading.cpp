@@ -0,0 +1,827 @@
+#include "gltf_model_loading.h"
+#include "assimp_model_loading.h"
+#include "job_system.h"
+#include "json.h"
+
+#include <glm/gtc/quaternion.hpp>
+
+#define GLB_MAGIC      0x46546C67 // "glTF"
+#define GLB_CHUNK_JSON 0x4E4F534A // "JSON"
+#define GLB_CHUNK_BIN  0x004E4942 // "BIN\0"
+
+#define GLTF_MAX_NODE_DEPTH 64
+
+#define GLTF_EMBEDDED_IMAGE_TAG "#image" // Texture paths of embedded images are the file name, this and the image index
+
+struct GltfDocument
+{
+    JsonValue json;
+    const u8* bin;     // BIN chunk, inside the mapped file
+    u32       binSize;
+};
+
+struct GltfAccessor
+{
+    const u8* data;           // First element, inside the BIN chunk
+    const u8* viewData;       // Whole buffer view the accessor reads from
+    u32       viewSize;
+    u32       bufferView;
+    u32       viewOffset;     // Of the first element, from the start of the buffer view
+    u32       stride;         // Between elements (the element size if the buffer view has no byteStride)
+    bool      viewHasStride;
+    u32       count;
+    u32       componentCount;
+    GLenum    componentType;  // glTF component types are the GL enums
+    bool      normalized;
+};
+
+struct GltfPrimitiveInstance
+{
+    const JsonValue* primitive;
+    mat4             worldMatrix;
+};
+
+// Vertex attributes the shaders read, and where
+static const struct { const char* semantic; u8 location; } GltfAttributes[] =
+{
+    { "POSITION",   0 },
+    { "NORMAL",     1 },
+    { "TEXCOORD_0", 2 },
+    { "TANGENT",    3 },
+};
+
+static u32 GetComponentSize(GLenum componentType)
+{
+    switch (componentType)
+    {
+        case GL_BYTE:           return 1;
+        case GL_UNSIGNED_BYTE:  return 1;
+        case GL_SHORT:          return 2;
+        case GL_UNSIGNED_SHORT: return 2;
+        case GL_UNSIGNED_INT:   return 4;
+        case GL_FLOAT:          return 4;
+        default:                return 0;
+    }
+}
+
+static u32 GetComponentCount(const char* type)
+{
+    if (strcmp(type, "SCALAR") == 0) return 1;
+    if (strcmp(type, "VEC2") == 0)   return 2;
+    if (strcmp(type, "VEC3") == 0)   return 3;
+    if (strcmp(type, "VEC4") == 0)   return 4;
+    return 0; // Matrices are never used by mesh attributes
+}
+
+static bool ParseGlb(const MappedFile& file, GltfDocument& document)
+{
+    u32 header[3]; // magic, version, length
+    if (file.size < sizeof(header))
+        return false;
+
+    memcpy(header, file.data, sizeof(header));
+    if (header[0] != GLB_MAGIC || header[1] != 2 || header[2] > file.size)
+    {
+        ELOG("Not a glTF 2.0 binary file");
+        return false;
+    }
+
+    bool hasJson = false;
+    u64 offset = sizeof(header);
+    while (offset + 8 <= header[2])
+    {
+        u32 chunk[2]; // length, type
+        memcpy(chunk, file.data + offset, sizeof(chunk));
+        offset += sizeof(chunk);
+
+        if (offset + chunk[0] > header[2])
+            return false;
+
+        if (chunk[1] == GLB_CHUNK_JSON && !hasJson)
+        {
+            if (!ParseJson((const char*)file.data + offset, chunk[0], document.json))
+                return false;
+            hasJson = true;
+        }
+        else if (chunk[1] == GLB_CHUNK_BIN && !document.bin)
+        {
+            document.bin = file.data + offset;
+            document.binSize = chunk[0];
+        }
+
+        // Chunks are padded to 4 bytes, unknown ones are skipped
+        offset += ((u64)chunk[0] + 3) & ~3ull;
+    }
+
+    return hasJson;
+}
+
+static bool GetAccessor(const GltfDocument& document, const JsonValue* accessorIdx, GltfAccessor& accessor)
+{
+    const JsonValue* json = JsonAt(JsonFind(&document.json, "accessors"), JsonGetU32(accessorIdx, UINT32_MAX));
+    if (!json)
+        return false;
+
+    if (JsonFind(json, "sparse"))
+    {
+        ELOG("Sparse glTF accessors are not supported");
+        return false;
+    }
+
+    accessor = GltfAccessor{};
+    accessor.bufferView     = JsonGetU32(JsonFind(json, "bufferView"), UINT32_MAX);
+    accessor.viewOffset     = JsonGetU32(JsonFind(json, "byteOffset"), 0);
+    accessor.count          = JsonGetU32(JsonFind(json, "count"), 0);
+    accessor.componentCount = GetComponentCount(JsonGetString(JsonFind(json, "type"), ""));
+    accessor.componentType  = JsonGetU32(JsonFind(json, "componentType"), 0);
+    accessor.normalized     = JsonGetBool(JsonFind(json, "normalized"), false);
+
+    const u32 elementSize = GetComponentSize(accessor.componentType) * accessor.componentCount;
+    if (elementSize == 0)
+        return false;
+
+    // Accessors without a buffer view are all zeros, which is of no use for a mesh
+    const JsonValue* view = JsonAt(JsonFind(&document.json, "bufferViews"), accessor.bufferView);
+    if (!view)
+        return false;
+
+    const JsonValue* buffer = JsonAt(JsonFind(&document.json, "buffers"), JsonGetU32(JsonFind(view, "buffer"), UINT32_MAX));
+    if (!buffer || JsonFind(buffer, "uri") || !document.bin)
+    {
+        ELOG("Only the buffer embedded in .glb files is supported");
+        return false;
+    }
+
+    const u32 viewOffset = JsonGetU32(JsonFind(view, "byteOffset"), 0);
+    const u32 viewStride = JsonGetU32(JsonFind(view, "byteStride"), 0);
+    accessor.viewSize      = JsonGetU32(JsonFind(view, "byteLength"), 0);
+    accessor.viewHasStride = viewStride != 0;
+    accessor.stride        = viewStride != 0 ? viewStride : elementSize;
+
+    // The elements must lie inside the view, and the view inside the BIN chunk
+    u64 end = accessor.count > 0 ? accessor.viewOffset + (u64)accessor.stride * (accessor.count - 1) + elementSize : 0;
+    if ((u64)viewOffset + accessor.viewSize > document.binSize || end > accessor.viewSize)
+    {
+        ELOG("glTF accessor out of the bounds of its buffer");
+        return false;
+    }
+
+    accessor.viewData = document.bin + viewOffset;
+    accessor.data = accessor.viewData + accessor.viewOffset;
+    return true;
+}
+
+// Returns false if the attribute is present but unusable
+static bool GetAttribute(const GltfDocument& document, const JsonValue* attributes, const char* semantic, u32 minComponentCount, GltfAccessor& accessor, bool& present)
+{
+    const JsonValue* accessorIdx = JsonFind(attributes, semantic);
+    present = accessorIdx != NULL;
+    if (!present)
+        return true;
+
+    if (!GetAccessor(document, accessorIdx, accessor) || accessor.componentCount < minComponentCount)
+    {
+        ELOG("Invalid glTF %s attribute", semantic);
+        return false;
+    }
+    return true;
+}
+
+static void ReadElement(const GltfAccessor& accessor, u32 element, f32* values, u32 valueCount)
+{
+    const u8* src = accessor.data + (u64)element * accessor.stride;
+    for (u32 i = 0; i < valueCount && i < accessor.componentCount; ++i)
+    {
+        switch (accessor.componentType)
+        {
+            case GL_FLOAT:          { f32 v; memcpy(&v, src + i * 4, 4); values[i] = v; break; }
+            case GL_UNSIGNED_INT:   { u32 v; memcpy(&v, src + i * 4, 4); values[i] = (f32)v; break; }
+            case GL_UNSIGNED_SHORT: { u16 v; memcpy(&v, src + i * 2, 2); values[i] = accessor.normalized ? v / 65535.0f : v; break; }
+            case GL_SHORT:          { i16 v; memcpy(&v, src + i * 2, 2); values[i] = accessor.normalized ? glm::max(v / 32767.0f, -1.0f) : v; break; }
+            case GL_UNSIGNED_BYTE:  { u8 v = src[i];                     values[i] = accessor.normalized ? v / 255.0f : v; break; }
+            case GL_BYTE:           { i8 v = (i8)src[i];                 values[i] = accessor.normalized ? glm::max(v / 127.0f, -1.0f) : v; break; }
+        }
+    }
+}
+
+static u32 ReadIndex(const GltfAccessor& accessor, u32 element)
+{
+    const u8* src = accessor.data + (u64)element * accessor.stride;
+    switch (accessor.componentType)
+    {
+        case GL_UNSIGNED_BYTE:  return src[0];
+        case GL_UNSIGNED_SHORT: { u16 v; memcpy(&v, src, sizeof(v)); return v; }
+        default:                { u32 v; memcpy(&v, src, sizeof(v)); return v; }
+    }
+}
+
+static bool IsIndexAccessor(const GltfAccessor& accessor)
+{
+    return accessor.componentCount == 1 &&
+        (accessor.componentType == GL_UNSIGNED_BYTE || accessor.componentType == GL_UNSIGNED_SHORT || accessor.componentType == GL_UNSIGNED_INT);
+}
+
+static vec4 GetNumbers(const JsonValue* array, vec4 defaultValue)
+{
+    vec4 numbers = defaultValue;
+    for (u32 i = 0; i < 4 && i < JsonCount(array); ++i)
+        numbers[i] = (f32)JsonGetNumber(JsonAt(array, i), defaultValue[i]);
+    return numbers;
+}
+
+static mat4 GetNodeMatrix(const JsonValue* node)
+{
+    const JsonValue* matrix = JsonFind(node, "matrix");
+    if (JsonCount(matrix) == 16)
+    {
+        mat4 m;
+        for (u32 i = 0; i < 16; ++i)
+            glm::value_ptr(m)[i] = (f32)JsonGetNumber(JsonAt(matrix, i), 0.0); // Column major, like glm
+        return m;
+    }
+
+    vec3 translation = vec3(GetNumbers(JsonFind(node, "translation"), vec4(0.0f)));
+    vec4 rotation = GetNumbers(JsonFind(node, "rotation"), vec4(0.0f, 0.0f, 0.0f, 1.0f)); // x, y, z, w
+    vec3 scale = vec3(GetNumbers(JsonFind(node, "scale"), vec4(1.0f)));
+    return glm::translate(translation) * glm::mat4_cast(glm::quat(rotation.w, rotation.x, rotation.y, rotation.z)) * glm::scale(scale);
+}
+
+static void GatherNode(const GltfDocument& document, u32 nodeIdx, const mat4& parentMatrix, u32 depth, std::vector<GltfPrimitiveInstance>& instances)
+{
+    const JsonValue* node = JsonAt(JsonFind(&document.json, "nodes"), nodeIdx);
+    if (!node || depth > GLTF_MAX_NODE_DEPTH)
+        return;
+
+    mat4 worldMatrix = parentMatrix * GetNodeMatrix(node);
+
+    // Only triangle lists are drawn, points and lines are skipped like aiProcess_SortByPType does
+    const JsonValue* mesh = JsonAt(JsonFind(&document.json, "meshes"), JsonGetU32(JsonFind(node, "mesh"), UINT32_MAX));
+    const JsonValue* primitives = JsonFind(mesh, "primitives");
+    for (u32 i = 0; i < JsonCount(primitives); ++i)
+    {
+        const JsonValue* primitive = JsonAt(primitives, i);
+        if (JsonGetU32(JsonFind(primitive, "mode"), GL_TRIANGLES) == GL_TRIANGLES)
+            instances.push_back(GltfPrimitiveInstance{ primitive, worldMatrix });
+    }
+
+    const JsonValue* children = JsonFind(node, "children");
+    for (u32 i = 0; i < JsonCount(children); ++i)
+        GatherNode(document, JsonGetU32(JsonAt(children, i), UINT32_MAX), worldMatrix, depth + 1, instances);
+}
+
+static void GatherScene(const GltfDocument& document, std::vector<GltfPrimitiveInstance>& instances)
+{
+    const JsonValue* scene = JsonAt(JsonFind(&document.json, "scenes"), JsonGetU32(JsonFind(&document.json, "scene"), 0));
+    if (scene)
+    {
+        const JsonValue* roots = JsonFind(scene, "nodes");
+        for (u32 i = 0; i < JsonCount(roots); ++i)
+            GatherNode(document, JsonGetU32(JsonAt(roots, i), UINT32_MAX), mat4(1.0f), 0, instances);
+        return;
+    }
+
+    // Without scenes, every node that is not a child of another one is a root
+    const JsonValue* nodes = JsonFind(&document.json, "nodes");
+    std::vector<bool> isChild(JsonCount(nodes), false);
+    for (u32 i = 0; i < isChild.size(); ++i)
+    {
+        const JsonValue* children = JsonFind(JsonAt(nodes, i), "children");
+        for (u32 j = 0; j < JsonCount(children); ++j)
+        {
+            u32 child = JsonGetU32(JsonAt(children, j), UINT32_MAX);
+            if (child < isChild.size())
+                isChild[child] = true;
+        }
+    }
+
+    for (u32 i = 0; i < isChild.size(); ++i)
+        if (!isChild[i])
+            GatherNode(document, i, mat4(1.0f), 0, instances);
+}
+
+// Fills the layout and index range of a primitive whose file data can be drawn as it is, with the
+// vertex and index offsets relative to their buffer views. Returns false if it can't.
+static bool GetDirectSubmesh(const GltfDocument& document, const GltfPrimitiveInstance& instance, Submesh& submesh, GltfAccessor& vertexView, GltfAccessor& indexView)
+{
+    if (instance.worldMatrix != mat4(1.0f))
+        return false;
+
+    const JsonValue* attributes = JsonFind(instance.primitive, "attributes");
+    if (!JsonFind(attributes, "POSITION") || !JsonFind(attributes, "NORMAL"))
+        return false;
+
+    GltfAccessor accessors[ARRAY_COUNT(GltfAttributes)];
+    u32 accessorCount = 0;
+    u32 minOffset = UINT32_MAX;
+    u32 maxEnd = 0;
+    for (u32 i = 0; i < ARRAY_COUNT(GltfAttributes); ++i)
+    {
+        const JsonValue* accessorIdx = JsonFind(attributes, GltfAttributes[i].semantic);
+        if (!accessorIdx)
+            continue;
+
+        GltfAccessor& accessor = accessors[accessorCount];
+        if (!GetAccessor(document, accessorIdx, accessor))
+            return false;
+
+        // Interleaved means one buffer view with a stride, and all the attributes within each stride
+        if (!accessor.viewHasStride || accessor.stride > UINT8_MAX || accessor.bufferView != accessors[0].bufferView || accessor.count != accessors[0].count)
+            return false;
+
+        minOffset = glm::min(minOffset, accessor.viewOffset);
+        maxEnd = glm::max(maxEnd, accessor.viewOffset + GetComponentSize(accessor.componentType) * accessor.componentCount);
+        accessorCount++;
+    }
+
+    // Whole strides are uploaded, so the last one must be inside the buffer view too
+    const u32 vertexCount = accessors[0].count;
+    if (maxEnd - minOffset > accessors[0].stride || vertexCount == 0 || minOffset + (u64)vertexCount * accessors[0].stride > accessors[0].viewSize)
+        return false;
+
+    GltfAccessor indices;
+    if (!GetAccessor(document, JsonFind(instance.primitive, "indices"), indices) || !IsIndexAccessor(indices) || indices.viewHasStride)
+        return false;
+
+    // Out of range indices are reported by DecodeSubmesh()
+    const u32 indexCount = indices.count - indices.count % 3;
+    std::vector<u32> indexValues(indexCount);
+    for (u32 i = 0; i < indexCount; ++i)
+    {
+        indexValues[i] = ReadIndex(indices, i);
+        if (indexValues[i] >= vertexCount)
+            return false;
+    }
+
+    submesh.vertexBufferLayout = VertexBufferLayout{};
+    submesh.vertexBufferLayout.stride = (u8)accessors[0].stride;
+    for (u32 i = 0, j = 0; i < ARRAY_COUNT(GltfAttributes); ++i)
+    {
+        if (!JsonFind(attributes, GltfAttributes[i].semantic))
+            continue;
+
+        const GltfAccessor& accessor = accessors[j++];
+        submesh.vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ GltfAttributes[i].location, (u8)accessor.componentCount, (u8)(accessor.viewOffset - minOffset), accessor.componentType, accessor.normalized ? (GLboolean)GL_TRUE : (GLboolean)GL_FALSE });
+    }
+
+    submesh.vertexOffset = minOffset;
+    submesh.vertexCount  = vertexCount;
+    submesh.indexOffset  = indices.viewOffset;
+    submesh.indexCount   = indexCount;
+    submesh.indexType    = indices.componentType;
+
+    // Hashed like the decoded submeshes, so identical primitives of other files share it
+    submesh.geometryHash = HashSubmeshGeometry(submesh, accessors[0].viewData + minOffset, vertexCount * submesh.vertexBufferLayout.stride, indexValues.data(), indexCount);
+
+    vertexView = accessors[0];
+    indexView = indices;
+    return true;
+}
+
+// Decodes a primitive into the float import layout, with its node transform applied
+static bool DecodeSubmesh(const GltfDocument& document, const GltfPrimitiveInstance& instance, Submesh& submesh)
+{
+    const JsonValue* attributes = JsonFind(instance.primitive, "attributes");
+
+    GltfAccessor positions, normals, texCoords, tangents;
+    bool hasPositions, hasNormals, hasTexCoords, hasTangents;
+    if (!GetAttribute(document, attributes, "POSITION", 3, positions, hasPositions) ||
+        !GetAttribute(document, attributes, "NORMAL", 3, normals, hasNormals) ||
+        !GetAttribute(document, attributes, "TEXCOORD_0", 2, texCoords, hasTexCoords) ||
+        !GetAttribute(document, attributes, "TANGENT", 4, tangents, hasTangents))
+        return false;
+
+    const u32 vertexCount = hasPositions ? positions.count : 0;
+    if (vertexCount == 0 ||
+        (hasNormals && normals.count != vertexCount) ||
+        (hasTexCoords && texCoords.count != vertexCount) ||
+        (hasTangents && tangents.count != vertexCount))
+    {
+        ELOG("Invalid glTF primitive vertex count");
+        return false;
+    }
+
+    // Indices, or an implicit triangle list
+    std::vector<u32> indices;
+    const JsonValue* indicesIdx = JsonFind(instance.primitive, "indices");
+    if (indicesIdx)
+    {
+        GltfAccessor indexAccessor;
+        if (!GetAccessor(document, indicesIdx, indexAccessor) || !IsIndexAccessor(indexAccessor))
+            return false;
+
+        indices.resize(indexAccessor.count - indexAccessor.count % 3);
+        for (u32 i = 0; i < indices.size(); ++i)
+        {
+            indices[i] = ReadIndex(indexAccessor, i);
+            if (indices[i] >= vertexCount)
+            {
+                ELOG("glTF index out of range");
+                return false;
+            }
+        }
+    }
+    else
+    {
+        indices.resize(vertexCount - vertexCount % 3);
+        for (u32 i = 0; i < indices.size(); ++i)
+            indices[i] = i;
+    }
+
+    // Mirroring transforms flip the winding, which is restored here
+    const glm::mat3 linearMatrix = glm::mat3(instance.worldMatrix);
+    const glm::mat3 normalMatrix = glm::transpose(glm::inverse(linearMatrix));
+    if (glm::determinant(linearMatrix) < 0.0f)
+        for (u32 i = 0; i < indices.size(); i += 3)
+            std::swap(indices[i + 1], indices[i + 2]);
+
+    // The tangent space needs the normals of the file, and its bitangents are rebuilt from the tangent w sign
+    const bool hasTangentSpace = hasNormals && hasTangents;
+    VertexBufferLayout vertexBufferLayout = CreateImportVertexLayout(hasTexCoords, hasTangentSpace);
+    const u32 floatStride = vertexBufferLayout.stride / sizeof(f32);
+
+    std::vector<u8> vertices(vertexCount * vertexBufferLayout.stride);
+    f32* vertex = (f32*)vertices.data();
+    for (u32 i = 0; i < vertexCount; ++i)
+    {
+        vec4 value = vec4(0.0f);
+        ReadElement(positions, i, glm::value_ptr(value), 3);
+        vec3 position = vec3(instance.worldMatrix * vec4(vec3(value), 1.0f));
+
+        vec3 normal = vec3(0.0f); // Generated below if missing
+        if (hasNormals)
+        {
+            ReadElement(normals, i, glm::value_ptr(value), 3);
+            normal = normalMatrix * vec3(value);
+            f32 length = glm::length(normal);
+            normal = length > 0.0f ? normal / length : vec3(0.0f, 0.0f, 1.0f);
+        }
+
+        *vertex++ = position.x;
+        *vertex++ = position.y;
+        *vertex++ = position.z;
+        *vertex++ = normal.x;
+        *vertex++ = normal.y;
+        *vertex++ = normal.z;
+
+        if (hasTexCoords)
+        {
+            ReadElement(texCoords, i, glm::value_ptr(value), 2);
+            *vertex++ = value.x;
+            *vertex++ = value.y;
+        }
+
+        if (hasTangentSpace)
+        {
+            ReadElement(tangents, i, glm::value_ptr(value), 4);
+            vec3 tangent = linearMatrix * vec3(value);
+            f32 length = glm::length(tangent);
+            tangent = length > 0.0f ? tangent / length : vec3(1.0f, 0.0f, 0.0f);
+            vec3 bitangent = glm::cross(normal, tangent) * (value.w < 0.0f ? -1.0f : 1.0f);
+
+            *vertex++ = tangent.x;
+            *vertex++ = tangent.y;
+            *vertex++ = tangent.z;
+            *vertex++ = bitangent.x;
+            *vertex++ = bitangent.y;
+            *vertex++ = bitangent.z;
+        }
+    }
+
+    // Smooth normals, like aiProcess_GenSmoothNormals, when the file has none
+    if (!hasNormals)
+    {
+        f32* data = (f32*)vertices.data();
+        for (u32 i = 0; i < indices.size(); i += 3)
+        {
+            vec3 p0 = glm::make_vec3(&data[indices[i + 0] * floatStride]);
+            vec3 p1 = glm::make_vec3(&data[indices[i + 1] * floatStride]);
+            vec3 p2 = glm::make_vec3(&data[indices[i + 2] * floatStride]);
+            vec3 faceNormal = glm::cross(p1 - p0, p2 - p0); // Area weighted
+            for (u32 j = 0; j < 3; ++j)
+            {
+                f32* normal = &data[indices[i + j] * floatStride + 3];
+                normal[0] += faceNormal.x;
+                normal[1] += faceNormal.y;
+                normal[2] += faceNormal.z;
+            }
+        }
+
+        for (u32 i = 0; i < vertexCount; ++i)
+        {
+            f32* normal = &data[i * floatStride + 3];
+            vec3 n = glm::make_vec3(normal);
+            f32 length = glm::length(n);
+            n = length > 0.0f ? n / length : vec3(0.0f, 0.0f, 1.0f);
+            normal[0] = n.x;
+            normal[1] = n.y;
+            normal[2] = n.z;
+        }
+    }
+
+    submesh.vertexBufferLayout = vertexBufferLayout;
+    submesh.vertices.swap(vertices);
+    submesh.indices.swap(indices);
+    submesh.indexType = GL_UNSIGNED_INT;
+    return true;
+}
+
+static std::string DecodeUri(const char* uri)
+{
+    std::string path;
+    for (const char* c = uri; *c; ++c)
+    {
+        u32 value;
+        if (c[0] == '%' && c[1] && c[2] && sscanf(c + 1, "%2x", &value) == 1)
+        {
+            path += (char)value;
+            c += 2;
+        }
+        else
+        {
+            path += *c;
+        }
+    }
+    return path;
+}
+
+// Not a real path, but unique enough for the engine to share the texture
+static std::string GetEmbeddedImagePath(const char* filename, u32 imageIdx)
+{
+    return std::string(filename) + GLTF_EMBEDDED_IMAGE_TAG + std::to_string(imageIdx);
+}
+
+static bool GetEmbeddedImageView(const GltfDocument& document, u32 imageIdx, GltfAccessor& imageView)
+{
+    const JsonValue* image = JsonAt(JsonFind(&document.json, "images"), imageIdx);
+    const JsonValue* view = JsonAt(JsonFind(&document.json, "bufferViews"), JsonGetU32(JsonFind(image, "bufferView"), UINT32_MAX));
+    if (!view || !document.bin)
+        return false;
+
+    u32 offset = JsonGetU32(JsonFind(view, "byteOffset"), 0);
+    u32 size = JsonGetU32(JsonFind(view, "byteLength"), 0);
+    if ((u64)offset + size > document.binSize)
+        return false;
+
+    imageView.viewData = document.bin + offset;
+    imageView.viewSize = size;
+    return true;
+}
+
+static void AddTexture(const GltfDocument& document, const JsonValue* textureInfo, u32 materialIdx, MaterialTexture texture, const std::vector<std::string>& imagePaths, std::vector<u32>& textureImages, ImportedModel& result)
+{
+    const JsonValue* json = JsonAt(JsonFind(&document.json, "textures"), JsonGetU32(JsonFind(textureInfo, "index"), UINT32_MAX));
+    u32 imageIdx = JsonGetU32(JsonFind(json, "source"), UINT32_MAX);
+    if (imageIdx < imagePaths.size() && !imagePaths[imageIdx].empty())
+    {
+        result.texturePaths.push_back(imagePaths[imageIdx]);
+        result.textureSlots.push_back(materialIdx * MaterialTexture_Count + texture);
+        textureImages.push_back(imageIdx);
+    }
+}
+
+static void ProcessMaterials(const GltfDocument& document, const std::vector<std::string>& imagePaths, std::vector<u32>& textureImages, ImportedModel& result)
+{
+    const JsonValue* materials = JsonFind(&document.json, "materials");
+    result.materials.resize(JsonCount(materials));
+    for (u32 i = 0; i < result.materials.size(); ++i)
+    {
+        const JsonValue* json = JsonAt(materials, i);
+        const JsonValue* pbr = JsonFind(json, "pbrMetallicRoughness");
+
+        // Metallic roughness mapped onto the engine's specular model
+        vec4 baseColor = GetNumbers(JsonFind(pbr, "baseColorFactor"), vec4(1.0f));
+        f32 metallic = (f32)JsonGetNumber(JsonFind(pbr, "metallicFactor"), 1.0);
+        f32 roughness = (f32)JsonGetNumber(JsonFind(pbr, "roughnessFactor"), 1.0);
+
+        Material& material = result.materials[i];
+        material.name = JsonGetString(JsonFind(json, "name"), "");
+        material.albedo = vec3(baseColor);
+        material.emissive = vec3(GetNumbers(JsonFind(json, "emissiveFactor"), vec4(0.0f)));
+        material.specular = glm::mix(vec3(0.04f), vec3(baseColor), metallic);
+        material.smoothness = 1.0f - roughness;
+        material.shininess = material.smoothness * 256.0f;
+
+        AddTexture(document, JsonFind(pbr, "baseColorTexture"), i, MaterialTexture_Albedo, imagePaths, textureImages, result);
+        AddTexture(document, JsonFind(json, "emissiveTexture"), i, MaterialTexture_Emissive, imagePaths, textureImages, result);
+        AddTexture(document, JsonFind(json, "normalTexture"), i, MaterialTexture_Normals, imagePaths, textureImages, result);
+    }
+}
+
+bool ImportGltfModel(const char* filename, ImportedModel& imported)
+{
+    MappedFile file = MapFile(filename);
+    if (!file.data)
+    {
+        ELOG("Could not open file %s", filename);
+        return false;
+    }
+
+    GltfDocument document = {};
+    std::vector<GltfPrimitiveInstance> instances;
+    if (ParseGlb(file, document))
+        GatherScene(document, instances);
+
+    if (instances.empty())
+    {
+        ELOG("No triangle meshes found in %s", filename);
+        UnmapFile(file);
+        return false;
+    }
+
+    // Images are referenced by path (relative to the model) or embedded in a buffer view
+    const JsonValue* images = JsonFind(&document.json, "images");
+    std::vector<std::string> imagePaths(JsonCount(images));
+    std::vector<GltfAccessor> imageViews(imagePaths.size(), GltfAccessor{});
+    const std::string directory = GetDirectoryOf(filename);
+    for (u32 i = 0; i < imagePaths.size(); ++i)
+    {
+        const JsonValue* image = JsonAt(images, i);
+        const char* uri = JsonGetString(JsonFind(image, "uri"), NULL);
+
+        if (uri && strncmp(uri, "data:", 5) != 0)
+        {
+            imagePaths[i] = directory + "/" + DecodeUri(uri);
+        }
+        else if (GetEmbeddedImageView(document, i, imageViews[i]))
+        {
+            imagePaths[i] = GetEmbeddedImagePath(filename, i);
+        }
+        else
+        {
+            ELOG("Unsupported glTF image %u in %s", i, filename);
+        }
+    }
+
+    ImportedModel result;
+    std::vector<u32> textureImages; // Image of each texture path
+    ProcessMaterials(document, imagePaths, textureImages, result);
+
+    // Primitives without a (valid) material get a default one
+    const u32 defaultMaterialIdx = (u32)result.materials.size();
+    bool usesDefaultMaterial = false;
+    for (u32 i = 0; i < instances.size(); ++i)
+    {
+        u32 materialIdx = JsonGetU32(JsonFind(instances[i].primitive, "material"), UINT32_MAX);
+        if (materialIdx >= defaultMaterialIdx)
+        {
+            materialIdx = defaultMaterialIdx;
+            usesDefaultMaterial = true;
+        }
+        result.submeshMaterials.push_back(materialIdx);
+    }
+
+    if (usesDefaultMaterial)
+    {
+        Material material;
+        material.name = "DefaultMaterial";
+        material.albedo = vec3(1.0f);
+        material.emissive = vec3(0.0f);
+        material.specular = vec3(0.04f);
+        material.shininess = 0.0f;
+        material.smoothness = 0.0f;
+        result.materials.push_back(material);
+    }
+
+    // Zero-copy path: the buffer views used by the primitives go to the GPU as they are. Quantized
+    // shaders expect octahedral normals, so then the vertices are always decoded and re-encoded
+    result.submeshes.resize(instances.size());
+    bool direct = !(imported.importOptions & MeshImportOption_QuantizeVertices);
+    std::vector<GltfAccessor> vertexViews(instances.size());
+    std::vector<GltfAccessor> indexViews(instances.size());
+    for (u32 i = 0; i < instances.size() && direct; ++i)
+        direct = GetDirectSubmesh(document, instances[i], result.submeshes[i], vertexViews[i], indexViews[i]);
+
+    if (direct)
+    {
+        // Each buffer view is mapped into the imported ranges once, even if several primitives (or
+        // instances) use it; every submesh then uploads its own part of it
+        const u32 viewCount = JsonCount(JsonFind(&document.json, "bufferViews"));
+        std::vector<u32> vertexViewOffsets(viewCount, UINT32_MAX);
+        std::vector<u32> indexViewOffsets(viewCount, UINT32_MAX);
+        u32 vertexBufferSize = 0;
+        u32 indexBufferSize = 0;
+
+        for (u32 i = 0; i < instances.size(); ++i)
+        {
+            const GltfAccessor& vertexView = vertexViews[i];
+            if (vertexViewOffsets[vertexView.bufferView] == UINT32_MAX)
+            {
+                vertexViewOffsets[vertexView.bufferView] = vertexBufferSize;
+                result.vertexRanges.push_back(ImportedBufferRange{ vertexView.viewData, vertexView.viewSize, vertexBufferSize });
+                vertexBufferSize = (vertexBufferSize + vertexView.viewSize + 15u) & ~15u;
+            }
+
+            const GltfAccessor& indexView = indexViews[i];
+            if (indexViewOffsets[indexView.bufferView] == UINT32_MAX)
+            {
+                indexViewOffsets[indexView.bufferView] = indexBufferSize;
+                result.indexRanges.push_back(ImportedBufferRange{ indexView.viewData, indexView.viewSize, indexBufferSize });
+                indexBufferSize = (indexBufferSize + indexView.viewSize + 15u) & ~15u;
+            }
+
+            result.submeshes[i].vertexOffset += vertexViewOffsets[vertexView.bufferView];
+            result.submeshes[i].indexOffset += indexViewOffsets[indexView.bufferView];
+        }
+    }
+    else
+    {
+        result.submeshes.assign(instances.size(), Submesh{});
+        std::vector<u8> decoded(instances.size(), 0);
+        ParallelFor(instances.size(), [&](u32 i) {
+            decoded[i] = DecodeSubmesh(document, instances[i], result.submeshes[i]);
+        });
+
+        for (u32 i = 0; i < decoded.size(); ++i)
+        {
+            if (!decoded[i])
+            {
+                ELOG("Could not decode the meshes of %s", filename);
+                UnmapFile(file);
+                return false;
+            }
+        }
+    }
+
+    // Embedded images only exist in the file, so they are decoded now (once per image)
+    result.images.assign(result.texturePaths.size(), Image{});
+    std::vector<u32> embeddedUses;
+    for (u32 i = 0; i < textureImages.size(); ++i)
+    {
+        u32 j = 0;
+        while (textureImages[j] != textureImages[i]) ++j;
+        if (j == i && imageViews[textureImages[i]].viewData)
+            embeddedUses.push_back(i);
+    }
+
+    ParallelFor(embeddedUses.size(), [&](u32 i) {
+        const GltfAccessor& imageView = imageViews[textureImages[embeddedUses[i]]];
+        result.images[embeddedUses[i]] = LoadImageFromMemory(imageView.viewData, imageView.viewSize, imported.flipTextures);
+    });
+
+    imported.submeshes.swap(result.submeshes);
+    imported.submeshMaterials.swap(result.submeshMaterials);
+    imported.materials.swap(result.materials);
+    imported.texturePaths.swap(result.texturePaths);
+    imported.textureSlots.swap(result.textureSlots);
+    imported.images.swap(result.images);
+
+    // The file must outlive the upload of the ranges that point into it
+    if (direct)
+    {
+        imported.mappedFile = file;
+        imported.vertexRanges.swap(result.vertexRanges);
+        imported.indexRanges.swap(result.indexRanges);
+    }
+    else
+    {
+        UnmapFile(file);
+    }
+
+    return true;
+}
+
+void LoadGltfEmbeddedImages(const char* filename, ImportedModel& imported)
+{
+    if (!imported.fromCache || !(imported.importOptions & MeshImportOption_NativeGltf))
+        return;
+
+    // First use of each embedded image, and its index in the file
+    const std::string prefix = std::string(filename) + GLTF_EMBEDDED_IMAGE_TAG;
+    std::vector<u32> embeddedUses;
+    std::vector<u32> imageIndices;
+    for (u32 i = 0; i < imported.texturePaths.size(); ++i)
+    {
+        const std::string& path = imported.texturePaths[i];
+        if (path.compare(0, prefix.size(), prefix) != 0)
+            continue;
+
+        u32 j = 0;
+        while (imported.texturePaths[j] != path) ++j;
+        if (j == i)
+        {
+            embeddedUses.push_back(i);
+            imageIndices.push_back((u32)strtoul(path.c_str() + prefix.size(), NULL, 10));
+        }
+    }
+
+    if (embeddedUses.empty())
+        return;
+
+    MappedFile file = MapFile(filename);
+    GltfDocument document = {};
+    if (!file.data || !ParseGlb(file, document))
+    {
+        ELOG("Could not read the embedded images of %s", filename);
+        UnmapFile(file);
+        return;
+    }
+
+    imported.images.resize(imported.texturePaths.size(), Image{});
+    ParallelFor(embeddedUses.size(), [&](u32 i) {
+        GltfAccessor imageView = {};
+        if (GetEmbeddedImageView(document, imageIndices[i], imageView))
+            imported.images[embeddedUses[i]] = LoadImageFromMemory(imageView.viewData, imageView.viewSize, imported.flipTextures);
+    });
+
+    UnmapFile(file);
+}
@@ -0,0 +1,34 @@
+//
+// gltf_model_loading.h: Native glTF 2.0 binary (.glb) importer. The file is memory-mapped and
+// its buffer views are either uploaded to the GL buffers as they are (zero-copy) or decoded
+// once into the float layout of CreateImportVertexLayout().
+//
+
+#pragma once
+
+#include "engine.h"
+
+/**
+ * Imports the default scene of a .glb file, with node transforms applied like Assimp's
+ * PreTransformVertices. Each triangle primitive becomes a submesh and each material keeps its
+ * base color, emissive and normal textures (embedded images are decoded here).
+ *
+ * When every primitive already has interleaved vertices the shaders can read (one buffer view
+ * with a byteStride, identity transforms, and vertex quantization disabled), the submeshes only
+ * describe the file data: the file stays mapped in imported.mappedFile and the buffer views go to
+ * the GPU through imported.vertexRanges/indexRanges. Otherwise, the accessors are decoded into
+ * CPU-side submeshes that go through the usual post-processing, and the result is mesh cached.
+ * The quantized layouts (octahedral normals, half positions) are never in the files, so with
+ * QUANTIZED_VERTICES the vertices are always decoded.
+ *
+ * Sparse accessors, external buffers and data URIs are not supported. Leaves imported untouched
+ * on failure. Can run on any thread.
+ */
+bool ImportGltfModel(const char* filename, ImportedModel& imported);
+
+/**
+ * Decodes the images embedded in a .glb file that imported.texturePaths refer to, which the mesh
+ * cache does not hold. Does nothing unless imported comes from the mesh cache of a .glb file.
+ * Can run on any thread.
+ */
+void LoadGltfEmbeddedImages(const char* filename, ImportedModel& imported);
@@ -0,0 +1,202 @@
+#include "import_workers.h"
+#include "asset_manifest.h"
+#include "asset_pack.h"
+#include "assimp_model_loading.h"
+#include "job_system.h"
+#include "mesh_cache.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+struct ImportWorkerPool
+{
+    std::string              executable;       // Empty if there is no pool
+    std::vector<std::thread> threads;          // One per process running at once, each waits on its own
+    std::mutex               mutex;
+    std::condition_variable  requestAvailable;
+    std::deque<std::string>  requests;         // Models waiting for a process
+    std::unordered_map<std::string, std::vector<ImportWorkerCallback>> callbacks; // Of each model queued or importing
+    u32                      runningProcesses;
+    bool                     quit;
+};
+
+static ImportWorkerPool GlobalImportWorkerPool;
+
+// Imports a model in a new process, returns whether it wrote the mesh cache
+static bool RunImportWorkerProcess(const std::string& filename)
+{
+    std::vector<std::string> arguments;
+    arguments.push_back(IMPORT_WORKER_ARGUMENT);
+    arguments.push_back(filename);
+
+    Process process;
+    if (!StartProcess(GlobalImportWorkerPool.executable.c_str(), arguments, process))
+    {
+        ELOG("Could not start the import worker for %s", filename.c_str());
+        return false;
+    }
+
+    i32 exitCode = WaitForProcess(process, IMPORT_WORKER_TIMEOUT);
+    if (exitCode != 0)
+    {
+        ELOG("Import worker failed on %s (exit code %d)", filename.c_str(), exitCode);
+        return false;
+    }
+
+    return true;
+}
+
+// Runs on the threads of the pool, which only ever wait on the processes. The requests left at
+// shutdown are still imported, as their callers wait for them
+static void ImportWorkerLoop()
+{
+    ImportWorkerPool& pool = GlobalImportWorkerPool;
+    for (;;)
+    {
+        std::string filename;
+        {
+            std::unique_lock<std::mutex> lock(pool.mutex);
+            pool.requestAvailable.wait(lock, [&pool] { return pool.quit || !pool.requests.empty(); });
+            if (pool.requests.empty())
+                return;
+
+            filename = pool.requests.front();
+            pool.requests.pop_front();
+            pool.runningProcesses++;
+        }
+
+        const bool success = RunImportWorkerProcess(filename);
+
+        std::vector<ImportWorkerCallback> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            pool.runningProcesses--;
+            callbacks.swap(pool.callbacks[filename]);
+            pool.callbacks.erase(filename);
+        }
+
+        for (u32 i = 0; i < callbacks.size(); ++i)
+            callbacks[i](success);
+    }
+}
+
+void InitImportWorkers(u32 maxProcesses)
+{
+    ImportWorkerPool& pool = GlobalImportWorkerPool;
+
+    if (maxProcesses == 0)
+        maxProcesses = glm::max(std::thread::hardware_concurrency() / 2, 1u);
+
+    pool.runningProcesses = 0;
+    pool.quit = false;
+    pool.executable = GetExecutableDirectory() + IMPORT_WORKER_EXECUTABLE;
+
+    // Checked directly, the executable is not an asset
+    FILE* file = fopen(pool.executable.c_str(), "rb");
+    if (!file)
+    {
+        ILOG("No import worker at %s, models are imported in process", pool.executable.c_str());
+        pool.executable.clear();
+        return;
+    }
+    fclose(file);
+
+    for (u32 i = 0; i < maxProcesses; ++i)
+        pool.threads.push_back(std::thread(ImportWorkerLoop));
+
+    ILOG("Up to %u import workers at %s", maxProcesses, pool.executable.c_str());
+}
+
+void ShutdownImportWorkers()
+{
+    ImportWorkerPool& pool = GlobalImportWorkerPool;
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.quit = true;
+    }
+    pool.requestAvailable.notify_all();
+
+    for (u32 i = 0; i < pool.threads.size(); ++i)
+        pool.threads[i].join();
+    pool.threads.clear();
+    pool.executable.clear();
+}
+
+bool IsImportWorkerPoolRunning()
+{
+    return !GlobalImportWorkerPool.executable.empty();
+}
+
+void ImportModelInWorkerAsync(const char* filename, const ImportWorkerCallback& callback)
+{
+    ImportWorkerPool& pool = GlobalImportWorkerPool;
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        std::vector<ImportWorkerCallback>& callbacks = pool.callbacks[filename];
+        callbacks.push_back(callback);
+        if (callbacks.size() > 1)
+            return; // Already queued or importing, the mesh cache it writes is the same
+        pool.requests.push_back(filename);
+    }
+    pool.requestAvailable.notify_one();
+}
+
+bool ImportModelInWorker(const char* filename, u32 importFlags, u32 importOptions, ImportedModel& imported)
+{
+    std::mutex mutex;
+    std::condition_variable processFinished;
+    bool finished = false;
+    bool success = false;
+
+    // Notified under the lock, as the condition variable goes away as soon as the wait returns
+    ImportModelInWorkerAsync(filename, [&](bool workerSuccess) {
+        std::lock_guard<std::mutex> lock(mutex);
+        success = workerSuccess;
+        finished = true;
+        processFinished.notify_one();
+    });
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        processFinished.wait(lock, [&finished] { return finished; });
+    }
+
+    if (!success)
+        return false;
+
+    if (!ReadMeshCache(filename, importFlags, importOptions, imported))
+    {
+        ELOG("Import worker did not write a usable mesh cache for %s", filename);
+        return false;
+    }
+
+    return true;
+}
+
+u32 GetRunningImportWorkerCount()
+{
+    ImportWorkerPool& pool = GlobalImportWorkerPool;
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    return pool.runningProcesses;
+}
+
+int RunImportWorker(const char* filename)
+{
+    InitJobSystem();
+    MountAssetPack(ASSET_PACK_FILENAME);
+    LoadAssetManifest(ASSET_MANIFEST_FILENAME);
+
+    // There is no pool in the worker, so the import runs here
+    ImportedModel imported;
+    bool success = ImportModel(filename, false, imported);
+    if (success && !imported.fromCache)
+        success = WriteMeshCache(filename, imported.importFlags, imported.importOptions, imported);
+    ReleaseImportedModel(imported);
+
+    ShutdownJobSystem();
+    UnmountAssetPack();
+    return success ? 0 : 1;
+}
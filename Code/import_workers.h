@@ -0,0 +1,58 @@
+//
+// import_workers.h: Out of process model imports. Assimp runs in worker processes (the Cooker
+// executable, started with IMPORT_WORKER_ARGUMENT), one per import and several at once. Each
+// worker imports and processes its model and writes the mesh cache, which the engine then maps:
+// the pages the worker wrote are the ones the engine reads, and a file that crashes or hangs
+// Assimp only takes its worker down. The processes are waited on by threads of their own, so the
+// job system workers are never held by them.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#include <functional>
+
+#define IMPORT_WORKER_ARGUMENT "--import-model"
+#define IMPORT_WORKER_TIMEOUT  300 // Seconds before a worker is considered hung and killed
+
+#ifdef _WIN32
+#define IMPORT_WORKER_EXECUTABLE "Cooker.exe"
+#else
+#define IMPORT_WORKER_EXECUTABLE "Cooker"
+#endif
+
+typedef std::function<void(bool success)> ImportWorkerCallback;
+
+/**
+ * Looks for the worker executable next to the engine one, and starts the threads that wait on up
+ * to maxProcesses workers at once. Without it, models are imported in process as before.
+ */
+void InitImportWorkers(u32 maxProcesses = 0);
+
+/** Waits for the queued and running imports, and joins the threads */
+void ShutdownImportWorkers();
+
+bool IsImportWorkerPoolRunning();
+
+/**
+ * Queues the import of a model through Assimp in a worker process, which writes its mesh cache.
+ * A model already queued or importing is not imported twice, the request shares its result.
+ * callback is called with whether the worker succeeded, from a thread of the pool: it should only
+ * hand the result over (e.g. with PushJob()).
+ */
+void ImportModelInWorkerAsync(const char* filename, const ImportWorkerCallback& callback);
+
+/**
+ * Imports a model in a worker process and reads the mesh cache it writes. Blocks the calling
+ * thread, see ImportModelAsync() for the job system workers.
+ */
+bool ImportModelInWorker(const char* filename, u32 importFlags, u32 importOptions, ImportedModel& imported);
+
+u32 GetRunningImportWorkerCount();
+
+/**
+ * Entry point of a worker process: imports the model in process and writes its mesh cache.
+ * Returns the exit code of the process.
+ */
+int RunImportWorker(const char* filename);
@@ -0,0 +1,132 @@
+#include "job_system.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+struct JobSystem
+{
+    std::vector<std::thread> workers;
+    std::deque<Job>          jobs;
+    std::mutex               mutex;
+    std::condition_variable  jobAvailable;
+    bool                     quit;
+};
+
+static JobSystem GlobalJobSystem;
+
+static void WorkerLoop()
+{
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(GlobalJobSystem.mutex);
+            GlobalJobSystem.jobAvailable.wait(lock, [] { return GlobalJobSystem.quit || !GlobalJobSystem.jobs.empty(); });
+
+            if (GlobalJobSystem.jobs.empty())
+                return; // quit requested and nothing left to do
+
+            job = std::move(GlobalJobSystem.jobs.front());
+            GlobalJobSystem.jobs.pop_front();
+        }
+        job();
+    }
+}
+
+void InitJobSystem(u32 workerCount)
+{
+    ASSERT(GlobalJobSystem.workers.empty(), "The job system is already running");
+
+    if (workerCount == 0)
+    {
+        u32 hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    GlobalJobSystem.quit = false;
+    for (u32 i = 0; i < workerCount; ++i)
+        GlobalJobSystem.workers.push_back(std::thread(WorkerLoop));
+
+    ILOG("Job system started with %u worker threads", workerCount);
+}
+
+void ShutdownJobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(GlobalJobSystem.mutex);
+        GlobalJobSystem.quit = true;
+    }
+    GlobalJobSystem.jobAvailable.notify_all();
+
+    for (u32 i = 0; i < GlobalJobSystem.workers.size(); ++i)
+        GlobalJobSystem.workers[i].join();
+    GlobalJobSystem.workers.clear();
+}
+
+u32 GetJobWorkerCount()
+{
+    return (u32)GlobalJobSystem.workers.size();
+}
+
+void PushJob(const Job& job)
+{
+    if (GlobalJobSystem.workers.empty())
+    {
+        job();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(GlobalJobSystem.mutex);
+        GlobalJobSystem.jobs.push_back(job);
+    }
+    GlobalJobSystem.jobAvailable.notify_one();
+}
+
+struct ParallelForState
+{
+    std::atomic<u32>        nextItem;
+    std::atomic<u32>        finishedItems;
+    u32                     count;
+    std::mutex              mutex;
+    std::condition_variable finished;
+};
+
+static void RunParallelForItems(ParallelForState& state, const std::function<void(u32)>& func)
+{
+    for (u32 i = state.nextItem++; i < state.count; i = state.nextItem++)
+    {
+        func(i);
+
+        if (++state.finishedItems == state.count)
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.finished.notify_all();
+        }
+    }
+}
+
+void ParallelFor(u32 count, const std::function<void(u32)>& func)
+{
+    if (count == 0)
+        return;
+
+    // Items are pulled one at a time, so expensive and cheap items balance out among workers
+    std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+    state->nextItem = 0;
+    state->finishedItems = 0;
+    state->count = count;
+
+    u32 helperCount = GetJobWorkerCount() < count - 1 ? GetJobWorkerCount() : count - 1;
+    for (u32 i = 0; i < helperCount; ++i)
+        PushJob([state, &func]() { RunParallelForItems(*state, func); });
+
+    RunParallelForItems(*state, func);
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&state] { return state->finishedItems == state->count; });
+}
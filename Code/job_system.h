@@ -0,0 +1,35 @@
+//
+// job_system.h: A small pool of worker threads shared by the whole engine. Jobs must not
+// touch OpenGL nor the frame arena (MakeString, MakePath...), which belong to the main thread.
+//
+
+#pragma once
+
+#include "platform.h"
+
+#include <functional>
+
+typedef std::function<void()> Job;
+
+/**
+ * Starts the worker threads. By default, one worker per hardware thread except the main one.
+ */
+void InitJobSystem(u32 workerCount = 0);
+
+/**
+ * Finishes the pending jobs and joins all the worker threads.
+ */
+void ShutdownJobSystem();
+
+u32 GetJobWorkerCount();
+
+/**
+ * Queues a job to be run by any worker thread. It runs inline if the job system is not running.
+ */
+void PushJob(const Job& job);
+
+/**
+ * Calls func(i) for every i in [0, count) spread across the workers. The calling thread also
+ * processes items, and the function returns once all of them have finished.
+ */
+void ParallelFor(u32 count, const std::function<void(u32)>& func);
@@ -0,0 +1,310 @@
+#include "json.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#define JSON_MAX_DEPTH 64
+
+struct JsonParser
+{
+    const char* text;
+    u32         size;
+    u32         offset;
+    u32         depth;
+};
+
+static void SkipWhitespace(JsonParser& parser)
+{
+    while (parser.offset < parser.size)
+    {
+        char c = parser.text[parser.offset];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+            break;
+        parser.offset++;
+    }
+}
+
+static bool Consume(JsonParser& parser, const char* token)
+{
+    u32 length = (u32)strlen(token);
+    if (parser.size - parser.offset < length || memcmp(parser.text + parser.offset, token, length) != 0)
+        return false;
+    parser.offset += length;
+    return true;
+}
+
+static bool ParseHex4(JsonParser& parser, u32& codepoint)
+{
+    if (parser.size - parser.offset < 4)
+        return false;
+
+    codepoint = 0;
+    for (u32 i = 0; i < 4; ++i)
+    {
+        char c = parser.text[parser.offset++];
+        codepoint <<= 4;
+        if      (c >= '0' && c <= '9') codepoint |= c - '0';
+        else if (c >= 'a' && c <= 'f') codepoint |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') codepoint |= c - 'A' + 10;
+        else return false;
+    }
+    return true;
+}
+
+static void AppendUtf8(std::string& string, u32 codepoint)
+{
+    if (codepoint < 0x80)
+    {
+        string += (char)codepoint;
+    }
+    else if (codepoint < 0x800)
+    {
+        string += (char)(0xC0 | (codepoint >> 6));
+        string += (char)(0x80 | (codepoint & 0x3F));
+    }
+    else if (codepoint < 0x10000)
+    {
+        string += (char)(0xE0 | (codepoint >> 12));
+        string += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        string += (char)(0x80 | (codepoint & 0x3F));
+    }
+    else
+    {
+        string += (char)(0xF0 | (codepoint >> 18));
+        string += (char)(0x80 | ((codepoint >> 12) & 0x3F));
+        string += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        string += (char)(0x80 | (codepoint & 0x3F));
+    }
+}
+
+static bool ParseString(JsonParser& parser, std::string& string)
+{
+    if (!Consume(parser, "\""))
+        return false;
+
+    while (parser.offset < parser.size)
+    {
+        // Copy the run of plain characters at once
+        u32 runStart = parser.offset;
+        while (parser.offset < parser.size && parser.text[parser.offset] != '"' && parser.text[parser.offset] != '\\')
+            parser.offset++;
+        string.append(parser.text + runStart, parser.offset - runStart);
+
+        if (parser.offset == parser.size)
+            break;
+
+        if (parser.text[parser.offset++] == '"')
+            return true;
+
+        if (parser.offset == parser.size)
+            break;
+
+        char escaped = parser.text[parser.offset++];
+        switch (escaped)
+        {
+            case '"':  string += '"';  break;
+            case '\\': string += '\\'; break;
+            case '/':  string += '/';  break;
+            case 'b':  string += '\b'; break;
+            case 'f':  string += '\f'; break;
+            case 'n':  string += '\n'; break;
+            case 'r':  string += '\r'; break;
+            case 't':  string += '\t'; break;
+            case 'u':
+            {
+                u32 codepoint;
+                if (!ParseHex4(parser, codepoint))
+                    return false;
+
+                // Surrogate pairs encode the codepoints above the basic plane
+                if (codepoint >= 0xD800 && codepoint < 0xDC00)
+                {
+                    u32 low;
+                    if (!Consume(parser, "\\u") || !ParseHex4(parser, low) || low < 0xDC00 || low >= 0xE000)
+                        return false;
+                    codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                }
+                AppendUtf8(string, codepoint);
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+
+    return false;
+}
+
+static bool ParseNumber(JsonParser& parser, f64& number)
+{
+    // strtod() needs a null terminated string, and numbers are short
+    char buffer[64];
+    u32 length = 0;
+    while (parser.offset + length < parser.size && length < sizeof(buffer) - 1)
+    {
+        char c = parser.text[parser.offset + length];
+        if (!((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E'))
+            break;
+        buffer[length++] = c;
+    }
+    buffer[length] = '\0';
+
+    char* end;
+    number = strtod(buffer, &end);
+    if (end == buffer)
+        return false;
+
+    parser.offset += (u32)(end - buffer);
+    return true;
+}
+
+static bool ParseValue(JsonParser& parser, JsonValue& value)
+{
+    SkipWhitespace(parser);
+    if (parser.offset == parser.size)
+        return false;
+
+    value = JsonValue{};
+
+    char c = parser.text[parser.offset];
+    if (c == '{' || c == '[')
+    {
+        if (++parser.depth > JSON_MAX_DEPTH)
+            return false;
+
+        bool isObject = c == '{';
+        char closing = isObject ? '}' : ']';
+        value.type = isObject ? JsonType_Object : JsonType_Array;
+        parser.offset++;
+
+        SkipWhitespace(parser);
+        if (Consume(parser, isObject ? "}" : "]"))
+        {
+            parser.depth--;
+            return true;
+        }
+
+        for (;;)
+        {
+            if (isObject)
+            {
+                SkipWhitespace(parser);
+                value.keys.push_back(std::string());
+                if (!ParseString(parser, value.keys.back()))
+                    return false;
+
+                SkipWhitespace(parser);
+                if (!Consume(parser, ":"))
+                    return false;
+            }
+
+            value.elements.push_back(JsonValue{});
+            if (!ParseValue(parser, value.elements.back()))
+                return false;
+
+            SkipWhitespace(parser);
+            if (parser.offset == parser.size)
+                return false;
+
+            char separator = parser.text[parser.offset++];
+            if (separator == closing)
+                break;
+            if (separator != ',')
+                return false;
+        }
+
+        parser.depth--;
+        return true;
+    }
+    else if (c == '"')
+    {
+        value.type = JsonType_String;
+        return ParseString(parser, value.string);
+    }
+    else if (Consume(parser, "true"))
+    {
+        value.type = JsonType_Bool;
+        value.boolean = true;
+        return true;
+    }
+    else if (Consume(parser, "false"))
+    {
+        value.type = JsonType_Bool;
+        return true;
+    }
+    else if (Consume(parser, "null"))
+    {
+        value.type = JsonType_Null;
+        return true;
+    }
+
+    value.type = JsonType_Number;
+    return ParseNumber(parser, value.number);
+}
+
+bool ParseJson(const char* text, u32 size, JsonValue& root)
+{
+    JsonParser parser = { text, size, 0, 0 };
+
+    // Skip the UTF-8 byte order mark, if any
+    Consume(parser, "\xEF\xBB\xBF");
+
+    bool success = ParseValue(parser, root);
+    if (success)
+    {
+        SkipWhitespace(parser);
+        success = parser.offset == parser.size || parser.text[parser.offset] == '\0';
+    }
+
+    if (!success)
+    {
+        ELOG("Invalid JSON document (error near offset %u)", parser.offset);
+        root = JsonValue{};
+    }
+    return success;
+}
+
+const JsonValue* JsonFind(const JsonValue* object, const char* key)
+{
+    if (!object || object->type != JsonType_Object)
+        return NULL;
+
+    for (u32 i = 0; i < object->keys.size(); ++i)
+        if (object->keys[i] == key)
+            return &object->elements[i];
+
+    return NULL;
+}
+
+const JsonValue* JsonAt(const JsonValue* array, u32 index)
+{
+    if (!array || array->type != JsonType_Array || index >= array->elements.size())
+        return NULL;
+
+    return &array->elements[index];
+}
+
+u32 JsonCount(const JsonValue* array)
+{
+    return array && array->type == JsonType_Array ? (u32)array->elements.size() : 0;
+}
+
+f64 JsonGetNumber(const JsonValue* value, f64 defaultValue)
+{
+    return value && value->type == JsonType_Number ? value->number : defaultValue;
+}
+
+u32 JsonGetU32(const JsonValue* value, u32 defaultValue)
+{
+    return value && value->type == JsonType_Number && value->number >= 0.0 && value->number <= (f64)UINT32_MAX ? (u32)value->number : defaultValue;
+}
+
+bool JsonGetBool(const JsonValue* value, bool defaultValue)
+{
+    return value && value->type == JsonType_Bool ? value->boolean : defaultValue;
+}
+
+const char* JsonGetString(const JsonValue* value, const char* defaultValue)
+{
+    return value && value->type == JsonType_String ? value->string.c_str() : defaultValue;
+}
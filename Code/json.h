@@ -0,0 +1,54 @@
+//
+// json.h: Minimal JSON reader, enough for the small documents of asset formats like glTF.
+// The whole document is parsed into a tree of values; numbers are kept as doubles.
+//
+
+#pragma once
+
+#include "platform.h"
+
+enum JsonType
+{
+    JsonType_Null,
+    JsonType_Bool,
+    JsonType_Number,
+    JsonType_String,
+    JsonType_Array,
+    JsonType_Object
+};
+
+struct JsonValue
+{
+    JsonType                 type;
+    bool                     boolean;
+    f64                      number;
+    std::string              string;
+    std::vector<JsonValue>   elements; // Array elements or object members...
+    std::vector<std::string> keys;     // ...and, for objects, their keys (parallel to elements)
+};
+
+/**
+ * Parses a JSON document (UTF-8, not null terminated). \uXXXX escapes outside of the ASCII range
+ * are encoded as UTF-8. Returns false and logs the offset of the error if the document is invalid.
+ */
+bool ParseJson(const char* text, u32 size, JsonValue& root);
+
+/**
+ * Returns the member of an object with the given key, or NULL if there is none or value is not an object.
+ */
+const JsonValue* JsonFind(const JsonValue* object, const char* key);
+
+/**
+ * Returns the element of an array, or NULL if it is out of range or value is not an array.
+ */
+const JsonValue* JsonAt(const JsonValue* array, u32 index);
+
+u32 JsonCount(const JsonValue* array);
+
+f64 JsonGetNumber(const JsonValue* value, f64 defaultValue);
+
+u32 JsonGetU32(const JsonValue* value, u32 defaultValue);
+
+bool JsonGetBool(const JsonValue* value, bool defaultValue);
+
+const char* JsonGetString(const JsonValue* value, const char* defaultValue);
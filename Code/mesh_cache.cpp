@@ -0,0 +1,351 @@
+#include "mesh_cache.h"
+#include "asset_manifest.h"
+#include "buffer_management.h"
+#include "geometry_codec.h"
+#include "job_system.h"
+#include "meshlets.h"
+#include "vertex_quantization.h"
+
+#include <atomic>
+
+// One chunk of a geometry stream, and where it is decoded to
+struct GeometryDecodeJob
+{
+    u8*       dst;
+    const u8* stream;
+    u32       streamSize;
+    u32       chunk;
+};
+
+std::string GetMeshCachePath(const char* filename)
+{
+    return std::string(filename) + MESH_CACHE_EXTENSION;
+}
+
+static void CopyCacheString(char* dst, u32 dstSize, const std::string& src)
+{
+    u32 len = (u32)src.size() < dstSize - 1 ? (u32)src.size() : dstSize - 1;
+    memcpy(dst, src.c_str(), len);
+    dst[len] = '\0';
+}
+
+static bool IsValidMeshCache(const MappedFile& file, const char* filename, u32 importFlags, u32 importOptions, u64 sourceHash)
+{
+    if (file.size < sizeof(MeshCacheHeader))
+        return false;
+
+    const MeshCacheHeader* header = (const MeshCacheHeader*)file.data;
+    if (header->magic != MESH_CACHE_MAGIC || header->version != MESH_CACHE_VERSION)
+        return false;
+
+    if (header->sourceHash != sourceHash || header->importFlags != importFlags || header->importOptions != importOptions)
+        return false;
+
+    if (strncmp(header->sourcePath, filename, MESH_CACHE_MAX_PATH) != 0)
+        return false;
+
+    const u64 tablesSize = sizeof(MeshCacheHeader) +
+        (u64)header->submeshCount * sizeof(MeshCacheSubmesh) +
+        (u64)header->materialCount * sizeof(MeshCacheMaterial);
+
+    return tablesSize <= file.size &&
+        (u64)header->streamDataOffset + header->streamDataSize <= file.size &&
+        (u64)header->meshletDataOffset + (u64)header->meshletCount * sizeof(Meshlet) <= file.size;
+}
+
+bool ReadMeshCache(const char* filename, u32 importFlags, u32 importOptions, ImportedModel& imported)
+{
+    if (GetAssetHash(filename) == 0)
+        return false;
+
+    MappedFile file = MapFile(GetMeshCachePath(filename).c_str());
+    return ReadMeshCacheFile(filename, importFlags, importOptions, file, imported);
+}
+
+// Lists the chunks of a stream decoding into [dstOffset, dstOffset + dstSize) of the decoded data
+static bool AddGeometryDecodeJobs(std::vector<GeometryDecodeJob>& jobs, u8* decoded, u32 decodedSize, u32 dstOffset, u32 dstSize,
+                                  const u8* streams, u32 streamsSize, u32 streamOffset, u32 streamSize)
+{
+    if ((u64)dstOffset + dstSize > decodedSize || (u64)streamOffset + streamSize > streamsSize)
+        return false;
+
+    u32 chunkCount = GetGeometryStreamChunkCount(streams + streamOffset, streamSize, dstSize);
+    if (chunkCount == 0 && dstSize > 0)
+        return false;
+
+    for (u32 i = 0; i < chunkCount; ++i)
+        jobs.push_back(GeometryDecodeJob{ decoded + dstOffset, streams + streamOffset, streamSize, i });
+    return true;
+}
+
+// Decodes the vertex data followed by the index data, each chunk of each submesh on its own job
+static bool DecodeMeshCacheGeometry(const MappedFile& file, MappedFile& decodedFile)
+{
+    const MeshCacheHeader*  header    = (const MeshCacheHeader*)file.data;
+    const MeshCacheSubmesh* submeshes = (const MeshCacheSubmesh*)(header + 1);
+    const u8*               streams   = file.data + header->streamDataOffset;
+
+    u32 decodedSize = header->vertexDataSize + header->indexDataSize;
+    u8* decoded = (u8*)malloc(decodedSize ? decodedSize : 1);
+    if (!decoded)
+        return false;
+
+    bool valid = (u64)header->vertexDataSize + header->indexDataSize < 0xffffffffu;
+    std::vector<GeometryDecodeJob> jobs;
+    for (u32 i = 0; i < header->submeshCount && valid; ++i)
+    {
+        const MeshCacheSubmesh& submesh = submeshes[i];
+        u32 indicesSize = submesh.indexCount * GetIndexSize(submesh.indexType);
+        u32 indicesOffset = header->vertexDataSize + submesh.indexOffset;
+
+        valid = (u64)submesh.indexCount * GetIndexSize(submesh.indexType) <= header->indexDataSize &&
+            submesh.vertexOffset + (u64)submesh.vertexSize <= header->vertexDataSize &&
+            submesh.indexOffset + (u64)Align(indicesSize, sizeof(u32)) <= header->indexDataSize &&
+            AddGeometryDecodeJobs(jobs, decoded, decodedSize, submesh.vertexOffset, submesh.vertexSize,
+                                  streams, header->streamDataSize, submesh.vertexStreamOffset, submesh.vertexStreamSize) &&
+            AddGeometryDecodeJobs(jobs, decoded, decodedSize, indicesOffset, indicesSize,
+                                  streams, header->streamDataSize, submesh.indexStreamOffset, submesh.indexStreamSize);
+
+        // The padding UploadMesh() leaves between the index ranges of the submeshes
+        if (valid)
+            memset(decoded + indicesOffset + indicesSize, 0, Align(indicesSize, sizeof(u32)) - indicesSize);
+    }
+
+    std::atomic<bool> failed(!valid);
+    if (valid)
+    {
+        ParallelFor(jobs.size(), [&](u32 i) {
+            const GeometryDecodeJob& job = jobs[i];
+            if (!DecodeGeometryStreamChunk(job.dst, job.stream, job.streamSize, job.chunk))
+                failed = true;
+        });
+    }
+
+    if (failed)
+    {
+        free(decoded);
+        return false;
+    }
+
+    decodedFile = {};
+    decodedFile.data = decoded;
+    decodedFile.size = decodedSize;
+    decodedFile.owned = true;
+    return true;
+}
+
+bool ReadMeshCacheFile(const char* filename, u32 importFlags, u32 importOptions, MappedFile& file, ImportedModel& imported)
+{
+    if (file.data == NULL)
+        return false;
+
+    u64 sourceHash = GetAssetHash(filename);
+    if (sourceHash == 0 || !IsValidMeshCache(file, filename, importFlags, importOptions, sourceHash))
+    {
+        ILOG("Mesh cache %s is out of date", GetMeshCachePath(filename).c_str());
+        UnmapFile(file);
+        return false;
+    }
+
+    MappedFile decodedFile;
+    if (!DecodeMeshCacheGeometry(file, decodedFile))
+    {
+        ELOG("Mesh cache %s is corrupt", GetMeshCachePath(filename).c_str());
+        UnmapFile(file);
+        return false;
+    }
+
+    const MeshCacheHeader*   header    = (const MeshCacheHeader*)file.data;
+    const MeshCacheSubmesh*  submeshes = (const MeshCacheSubmesh*)(header + 1);
+    const MeshCacheMaterial* materials = (const MeshCacheMaterial*)(submeshes + header->submeshCount);
+    const Meshlet*           meshlets  = (const Meshlet*)(file.data + header->meshletDataOffset);
+    // Material table (textures are resolved by path when the model is created)
+    imported.materials.resize(header->materialCount);
+    for (u32 i = 0; i < header->materialCount; ++i)
+    {
+        const MeshCacheMaterial& cachedMaterial = materials[i];
+
+        Material& material  = imported.materials[i];
+        material.name       = cachedMaterial.name;
+        material.albedo     = cachedMaterial.albedo;
+        material.emissive   = cachedMaterial.emissive;
+        material.specular   = cachedMaterial.specular;
+        material.smoothness = cachedMaterial.smoothness;
+        material.shininess  = cachedMaterial.shininess;
+
+        for (u32 j = 0; j < MaterialTexture_Count; ++j)
+        {
+            if (cachedMaterial.textures[j][0] != '\0')
+            {
+                imported.texturePaths.push_back(cachedMaterial.textures[j]);
+                imported.textureSlots.push_back(i * MaterialTexture_Count + j);
+            }
+        }
+    }
+
+    // Submeshes only keep their layout and ranges, the data itself is in the decoded buffer
+    imported.submeshes.resize(header->submeshCount);
+    for (u32 i = 0; i < header->submeshCount; ++i)
+    {
+        const MeshCacheSubmesh& cachedSubmesh = submeshes[i];
+
+        Submesh& submesh = imported.submeshes[i];
+        submesh.vertexBufferLayout.stride = cachedSubmesh.stride;
+        for (u32 j = 0; j < cachedSubmesh.attributeCount && j < MESH_CACHE_MAX_ATTRIBUTES; ++j)
+        {
+            const MeshCacheAttribute& attribute = cachedSubmesh.attributes[j];
+            submesh.vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ attribute.location, attribute.componentCount, attribute.offset, (GLenum)attribute.type, (GLboolean)attribute.normalized });
+        }
+        submesh.vertexOffset = cachedSubmesh.vertexOffset;
+        submesh.vertexCount  = cachedSubmesh.stride ? cachedSubmesh.vertexSize / cachedSubmesh.stride : 0;
+        submesh.indexOffset  = cachedSubmesh.indexOffset;
+        submesh.indexCount   = cachedSubmesh.indexCount;
+        submesh.indexType    = cachedSubmesh.indexType;
+        submesh.uvDensity    = cachedSubmesh.uvDensity;
+        submesh.geometryHash = cachedSubmesh.geometryHash;
+        for (u32 j = 0; j < cachedSubmesh.lodCount && j < MESH_CACHE_MAX_LODS; ++j)
+            submesh.lods.push_back(SubmeshLod{ cachedSubmesh.lods[j].firstIndex, cachedSubmesh.lods[j].indexCount, cachedSubmesh.lods[j].error });
+        if ((u64)cachedSubmesh.firstMeshlet + cachedSubmesh.meshletCount <= header->meshletCount)
+            submesh.meshlets.assign(meshlets + cachedSubmesh.firstMeshlet, meshlets + cachedSubmesh.firstMeshlet + cachedSubmesh.meshletCount);
+        ComputeSubmeshBounds(submesh);
+
+        imported.submeshMaterials.push_back(cachedSubmesh.materialIdx);
+    }
+
+    imported.fromCache  = true;
+    imported.mappedFile = decodedFile;
+    imported.vertexRanges.push_back(ImportedBufferRange{ decodedFile.data, header->vertexDataSize, 0 });
+    imported.indexRanges.push_back(ImportedBufferRange{ decodedFile.data + header->vertexDataSize, header->indexDataSize, 0 });
+
+    UnmapFile(file);
+
+    return true;
+}
+
+bool WriteMeshCache(const char* filename, u32 importFlags, u32 importOptions, const ImportedModel& imported)
+{
+    MeshCacheHeader header = {};
+    header.magic           = MESH_CACHE_MAGIC;
+    header.version         = MESH_CACHE_VERSION;
+    header.sourceHash = GetAssetHash(filename);
+    header.importFlags     = importFlags;
+    header.importOptions   = importOptions;
+    header.submeshCount    = (u32)imported.submeshes.size();
+    header.materialCount   = (u32)imported.materials.size();
+    CopyCacheString(header.sourcePath, MESH_CACHE_MAX_PATH, filename);
+
+    // Each submesh is encoded on its own job
+    std::vector<std::vector<u8>> vertexStreams(imported.submeshes.size());
+    std::vector<std::vector<u8>> indexStreams(imported.submeshes.size());
+    ParallelFor(imported.submeshes.size(), [&](u32 i) {
+        const Submesh& submesh = imported.submeshes[i];
+        u32 stride = submesh.vertexBufferLayout.stride;
+        u32 vertexCount = stride ? (u32)submesh.vertices.size() / stride : 0;
+        EncodeVertexStream(vertexStreams[i], submesh.vertices.data(), vertexCount, stride);
+        EncodeIndexStream(indexStreams[i], submesh.indices.data(), (u32)submesh.indices.size(), GetIndexSize(submesh.indexType), vertexCount);
+    });
+
+    std::vector<MeshCacheSubmesh> submeshes(imported.submeshes.size());
+    for (u32 i = 0; i < imported.submeshes.size(); ++i)
+    {
+        const Submesh& submesh = imported.submeshes[i];
+        ASSERT(submesh.vertexBufferLayout.attributes.size() <= MESH_CACHE_MAX_ATTRIBUTES, "Too many vertex attributes for the mesh cache");
+        ASSERT(submesh.lods.size() <= MESH_CACHE_MAX_LODS, "Too many LODs for the mesh cache");
+
+        MeshCacheSubmesh& cachedSubmesh = submeshes[i];
+        cachedSubmesh.materialIdx    = imported.submeshMaterials[i];
+        cachedSubmesh.vertexOffset   = header.vertexDataSize;
+        cachedSubmesh.vertexSize     = (u32)submesh.vertices.size();
+        cachedSubmesh.indexOffset    = header.indexDataSize;
+        cachedSubmesh.indexCount     = (u32)submesh.indices.size();
+        cachedSubmesh.indexType      = submesh.indexType;
+        cachedSubmesh.vertexStreamOffset = header.streamDataSize;
+        cachedSubmesh.vertexStreamSize   = (u32)vertexStreams[i].size();
+        cachedSubmesh.indexStreamOffset  = cachedSubmesh.vertexStreamOffset + cachedSubmesh.vertexStreamSize;
+        cachedSubmesh.indexStreamSize    = (u32)indexStreams[i].size();
+        cachedSubmesh.geometryHash       = submesh.geometryHash;
+        cachedSubmesh.stride         = submesh.vertexBufferLayout.stride;
+        cachedSubmesh.attributeCount = (u8)submesh.vertexBufferLayout.attributes.size();
+        for (u32 j = 0; j < cachedSubmesh.attributeCount; ++j)
+        {
+            const VertexBufferAttribute& attribute = submesh.vertexBufferLayout.attributes[j];
+            cachedSubmesh.attributes[j] = MeshCacheAttribute{ attribute.location, attribute.componentCount, attribute.offset, attribute.normalized, attribute.type };
+        }
+        cachedSubmesh.firstMeshlet   = header.meshletCount;
+        cachedSubmesh.meshletCount   = (u32)submesh.meshlets.size();
+        cachedSubmesh.uvDensity      = submesh.uvDensity;
+        cachedSubmesh.lodCount       = (u8)submesh.lods.size();
+        for (u32 j = 0; j < cachedSubmesh.lodCount; ++j)
+            cachedSubmesh.lods[j] = MeshCacheLod{ submesh.lods[j].firstIndex, submesh.lods[j].indexCount, submesh.lods[j].error };
+
+        header.vertexDataSize += cachedSubmesh.vertexSize;
+        header.indexDataSize  += Align(cachedSubmesh.indexCount * GetIndexSize(submesh.indexType), sizeof(u32));
+        header.meshletCount   += cachedSubmesh.meshletCount;
+        header.streamDataSize += cachedSubmesh.vertexStreamSize + cachedSubmesh.indexStreamSize;
+    }
+
+    std::vector<MeshCacheMaterial> materials(imported.materials.size());
+    for (u32 i = 0; i < imported.materials.size(); ++i)
+    {
+        const Material&    material       = imported.materials[i];
+        MeshCacheMaterial& cachedMaterial = materials[i];
+        memset(&cachedMaterial, 0, sizeof(cachedMaterial));
+
+        CopyCacheString(cachedMaterial.name, MESH_CACHE_MAX_NAME, material.name);
+        cachedMaterial.albedo     = material.albedo;
+        cachedMaterial.emissive   = material.emissive;
+        cachedMaterial.specular   = material.specular;
+        cachedMaterial.smoothness = material.smoothness;
+        cachedMaterial.shininess  = material.shininess;
+    }
+
+    for (u32 i = 0; i < imported.texturePaths.size(); ++i)
+    {
+        u32 slot = imported.textureSlots[i];
+        CopyCacheString(materials[slot / MaterialTexture_Count].textures[slot % MaterialTexture_Count], MESH_CACHE_MAX_PATH, imported.texturePaths[i]);
+    }
+
+    // Blobs start 16-byte aligned so they can be read in place once mapped
+    u32 tablesSize = sizeof(MeshCacheHeader) + header.submeshCount * sizeof(MeshCacheSubmesh) + header.materialCount * sizeof(MeshCacheMaterial);
+    header.streamDataOffset  = (tablesSize + 15u) & ~15u;
+    header.meshletDataOffset = (header.streamDataOffset + header.streamDataSize + 15u) & ~15u;
+
+    std::string cachePath = GetMeshCachePath(filename);
+    FILE* file = fopen(cachePath.c_str(), "wb");
+    if (!file)
+    {
+        ELOG("fopen() failed writing mesh cache %s", cachePath.c_str());
+        return false;
+    }
+
+    // The header is written last, so an interrupted write never looks like a valid cache
+    const u8 zeros[16] = {};
+    MeshCacheHeader emptyHeader = {};
+    fwrite(&emptyHeader, sizeof(emptyHeader), 1, file);
+    fwrite(submeshes.data(), sizeof(MeshCacheSubmesh), submeshes.size(), file);
+    fwrite(materials.data(), sizeof(MeshCacheMaterial), materials.size(), file);
+    fwrite(zeros, 1, header.streamDataOffset - tablesSize, file);
+
+    for (u32 i = 0; i < imported.submeshes.size(); ++i)
+    {
+        fwrite(vertexStreams[i].data(), 1, vertexStreams[i].size(), file);
+        fwrite(indexStreams[i].data(), 1, indexStreams[i].size(), file);
+    }
+    fwrite(zeros, 1, header.meshletDataOffset - (header.streamDataOffset + header.streamDataSize), file);
+
+    for (u32 i = 0; i < imported.submeshes.size(); ++i)
+        fwrite(imported.submeshes[i].meshlets.data(), sizeof(Meshlet), imported.submeshes[i].meshlets.size(), file);
+
+    fseek(file, 0, SEEK_SET);
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+    success = (ferror(file) == 0) && success;
+    fclose(file);
+
+    if (!success)
+    {
+        ELOG("Error writing mesh cache %s", cachePath.c_str());
+        remove(cachePath.c_str());
+    }
+
+    return success;
+}
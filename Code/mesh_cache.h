@@ -0,0 +1,110 @@
+//
+// mesh_cache.h: Versioned binary cache of imported models. It stores the final interleaved
+// vertex data and the index data, compressed by the geometry codec, the vertex layout of every
+// submesh and the material table, so warm starts only decode (in parallel) what they upload.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define MESH_CACHE_MAGIC          0x48534D47 // "GMSH"
+#define MESH_CACHE_VERSION        9
+#define MESH_CACHE_EXTENSION      ".meshcache"
+#define MESH_CACHE_MAX_PATH       256
+#define MESH_CACHE_MAX_NAME       64
+#define MESH_CACHE_MAX_ATTRIBUTES 8
+#define MESH_CACHE_MAX_LODS       8
+
+// On-disk layout:
+// [MeshCacheHeader][MeshCacheSubmesh x submeshCount][MeshCacheMaterial x materialCount][geometry streams][meshlets]
+struct MeshCacheHeader
+{
+    u32  magic;
+    u32  version;
+    u64  sourceHash;    // GetAssetHash() of the source
+    u32  importFlags;
+    u32  importOptions; // MeshImportOption bits
+    u32  submeshCount;
+    u32  materialCount;
+    u32  vertexDataSize;    // Decoded, as uploaded
+    u32  indexDataSize;
+    u32  streamDataOffset;  // Vertex and index streams of every submesh (see geometry_codec.h)
+    u32  streamDataSize;
+    u32  meshletDataOffset;
+    u32  meshletCount;
+    char sourcePath[MESH_CACHE_MAX_PATH];
+};
+
+struct MeshCacheAttribute
+{
+    u8  location;
+    u8  componentCount;
+    u8  offset;
+    u8  normalized;
+    u32 type;
+};
+
+struct MeshCacheLod
+{
+    u32 firstIndex;
+    u32 indexCount;
+    f32 error;
+};
+
+struct MeshCacheSubmesh
+{
+    u32                materialIdx;  // Relative to the first material of the model
+    u32                vertexOffset; // In bytes, relative to the decoded vertex data
+    u32                vertexSize;
+    u32                indexOffset;  // In bytes, relative to the decoded index data
+    u32                indexCount;
+    u32                indexType;
+    u32                vertexStreamOffset; // In bytes, relative to the stream data
+    u32                vertexStreamSize;
+    u32                indexStreamOffset;
+    u32                indexStreamSize;
+    u64                geometryHash; // See Submesh::geometryHash
+    u32                firstMeshlet;
+    u32                meshletCount;
+    f32                uvDensity;
+    u8                 stride;
+    u8                 attributeCount;
+    u8                 lodCount;
+    u8                 padding;
+    MeshCacheAttribute attributes[MESH_CACHE_MAX_ATTRIBUTES];
+    MeshCacheLod       lods[MESH_CACHE_MAX_LODS];
+};
+
+struct MeshCacheMaterial
+{
+    char name[MESH_CACHE_MAX_NAME];
+    vec3 albedo;
+    vec3 emissive;
+    vec3 specular;
+    f32  smoothness;
+    f32  shininess;
+    char textures[MaterialTexture_Count][MESH_CACHE_MAX_PATH]; // Empty string when the slot is unused
+};
+
+/**
+ * Tries to read a model from the cache file next to the given source asset. The cache is only
+ * used if it was written for the same source path and contents, import flags and options. On success,
+ * the geometry is decoded into memory owned by imported.mappedFile and the vertex/index ranges
+ * point into it. It does not touch OpenGL nor the App, so it can run on any thread.
+ */
+bool ReadMeshCache(const char* filename, u32 importFlags, u32 importOptions, ImportedModel& imported);
+
+/**
+ * Same as ReadMeshCache() for a cache file read already (see ReadFileAsync()). The file is
+ * released once decoded.
+ */
+bool ReadMeshCacheFile(const char* filename, u32 importFlags, u32 importOptions, MappedFile& file, ImportedModel& imported);
+
+std::string GetMeshCachePath(const char* filename);
+
+/**
+ * Writes the cache file of a model that has just been imported through Assimp. The submeshes
+ * must hold their CPU-side vertices and indices.
+ */
+bool WriteMeshCache(const char* filename, u32 importFlags, u32 importOptions, const ImportedModel& imported);
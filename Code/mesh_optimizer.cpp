@@ -0,0 +1,288 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+
+VertexCacheStats AnalyzeVertexCache(const u32* indices, u32 indexCount, u32 vertexCount, u32 cacheSize)
+{
+    VertexCacheStats stats = {};
+    if (indexCount == 0 || vertexCount == 0)
+        return stats;
+
+    // FIFO cache: a vertex is a hit if it was transformed less than cacheSize misses ago
+    std::vector<u32> cacheTimestamps(vertexCount, 0);
+    u32 timestamp = cacheSize + 1;
+    u32 misses = 0;
+
+    for (u32 i = 0; i < indexCount; ++i)
+    {
+        u32 index = indices[i];
+        ASSERT(index < vertexCount, "Index out of range");
+
+        if (timestamp - cacheTimestamps[index] > cacheSize)
+        {
+            cacheTimestamps[index] = timestamp++;
+            misses++;
+        }
+    }
+
+    stats.acmr = (f32)misses / (f32)(indexCount / 3);
+    stats.atvr = (f32)misses / (f32)vertexCount;
+    return stats;
+}
+
+// Vertex to triangle adjacency, in compressed rows: the triangles of vertex v are
+// triangles[offsets[v]] .. triangles[offsets[v] + counts[v]]
+struct TriangleAdjacency
+{
+    std::vector<u32> counts;
+    std::vector<u32> offsets;
+    std::vector<u32> triangles;
+};
+
+static void BuildTriangleAdjacency(TriangleAdjacency& adjacency, const u32* indices, u32 indexCount, u32 vertexCount)
+{
+    adjacency.counts.assign(vertexCount, 0);
+    adjacency.offsets.assign(vertexCount, 0);
+    adjacency.triangles.resize(indexCount);
+
+    for (u32 i = 0; i < indexCount; ++i)
+        adjacency.counts[indices[i]]++;
+
+    u32 offset = 0;
+    for (u32 v = 0; v < vertexCount; ++v)
+    {
+        adjacency.offsets[v] = offset;
+        offset += adjacency.counts[v];
+    }
+
+    std::vector<u32> fill(adjacency.offsets);
+    for (u32 i = 0; i < indexCount; ++i)
+        adjacency.triangles[fill[indices[i]]++] = i / 3;
+}
+
+// Tipsify (Sander, Nehab and Barczak 2007): triangles are emitted as fans around a vertex, and the
+// next fanning vertex is the candidate that will still be in the cache after its fan is emitted
+void OptimizeVertexCache(u32* dst, const u32* indices, u32 indexCount, u32 vertexCount, std::vector<u32>* clusters, u32 cacheSize)
+{
+    ASSERT(dst != indices, "The vertex cache optimization cannot be done in place");
+    if (clusters)
+        clusters->clear();
+    if (indexCount == 0)
+        return;
+
+    TriangleAdjacency adjacency;
+    BuildTriangleAdjacency(adjacency, indices, indexCount, vertexCount);
+
+    std::vector<u32>  liveTriangles(adjacency.counts);
+    std::vector<u32>  cacheTimestamps(vertexCount, 0);
+    std::vector<bool> emitted(indexCount / 3, false);
+    std::vector<u32>  deadEnds;
+    std::vector<u32>  candidates;
+
+    u32 timestamp = cacheSize + 1;
+    u32 cursor = 0;
+    u32 outputTriangle = 0;
+    i32 fanningVertex = 0;
+
+    if (clusters)
+        clusters->push_back(0);
+
+    while (fanningVertex >= 0)
+    {
+        candidates.clear();
+
+        const u32* fan = &adjacency.triangles[adjacency.offsets[fanningVertex]];
+        for (u32 i = 0; i < adjacency.counts[fanningVertex]; ++i)
+        {
+            u32 triangle = fan[i];
+            if (emitted[triangle])
+                continue;
+
+            for (u32 j = 0; j < 3; ++j)
+            {
+                u32 v = indices[triangle * 3 + j];
+                dst[outputTriangle * 3 + j] = v;
+
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+
+                if (timestamp - cacheTimestamps[v] > cacheSize)
+                    cacheTimestamps[v] = timestamp++;
+            }
+
+            emitted[triangle] = true;
+            outputTriangle++;
+        }
+
+        // Best candidate: the one that stays longer in the cache, as long as its fan fits in it
+        i32 nextVertex = -1;
+        i32 bestPriority = -1;
+        for (u32 i = 0; i < candidates.size(); ++i)
+        {
+            u32 v = candidates[i];
+            if (liveTriangles[v] == 0)
+                continue;
+
+            i32 priority = 0;
+            if (timestamp - cacheTimestamps[v] + 2 * liveTriangles[v] <= cacheSize)
+                priority = timestamp - cacheTimestamps[v];
+
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                nextVertex = v;
+            }
+        }
+
+        if (nextVertex == -1)
+        {
+            // Dead end: go back to a recently used vertex or, failing that, to the next unprocessed one
+            while (!deadEnds.empty() && nextVertex == -1)
+            {
+                u32 v = deadEnds.back();
+                deadEnds.pop_back();
+                if (liveTriangles[v] > 0)
+                    nextVertex = v;
+            }
+
+            while (cursor < vertexCount && nextVertex == -1)
+            {
+                if (liveTriangles[cursor] > 0)
+                    nextVertex = cursor;
+                cursor++;
+            }
+
+            // Nothing cached is reused from here on, so a new cluster starts
+            if (clusters && nextVertex != -1 && outputTriangle != clusters->back())
+                clusters->push_back(outputTriangle);
+        }
+
+        fanningVertex = nextVertex;
+    }
+
+    ASSERT(outputTriangle == indexCount / 3, "Some triangles were not emitted");
+}
+
+struct OverdrawCluster
+{
+    u32 firstTriangle;
+    u32 triangleCount;
+    f32 sortKey;
+};
+
+void OptimizeOverdraw(u32* indices, u32 indexCount, const std::vector<u32>& clusters, const u8* vertices, u32 vertexStride)
+{
+    const u32 triangleCount = indexCount / 3;
+    if (clusters.size() < 2)
+        return;
+
+    // Area weighted centroid and normal of every cluster, and the centroid of the whole mesh
+    std::vector<OverdrawCluster> sortedClusters(clusters.size());
+    std::vector<vec3> clusterCentroids(clusters.size());
+    std::vector<vec3> clusterNormals(clusters.size());
+    vec3 meshCentroid = vec3(0.0f);
+    f32 meshArea = 0.0f;
+
+    for (u32 i = 0; i < clusters.size(); ++i)
+    {
+        u32 begin = clusters[i];
+        u32 end = i + 1 < clusters.size() ? clusters[i + 1] : triangleCount;
+
+        vec3 centroid = vec3(0.0f);
+        vec3 normal = vec3(0.0f);
+        f32 area = 0.0f;
+
+        for (u32 t = begin; t < end; ++t)
+        {
+            vec3 p[3];
+            for (u32 j = 0; j < 3; ++j)
+                memcpy(&p[j], vertices + indices[t * 3 + j] * vertexStride, sizeof(vec3));
+
+            vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+            f32 triangleArea = glm::length(n);
+
+            centroid += (p[0] + p[1] + p[2]) * (triangleArea / 3.0f);
+            normal += n;
+            area += triangleArea;
+        }
+
+        meshCentroid += centroid;
+        meshArea += area;
+
+        clusterCentroids[i] = area > 0.0f ? centroid / area : centroid;
+        clusterNormals[i] = glm::length(normal) > 0.0f ? glm::normalize(normal) : normal;
+
+        sortedClusters[i].firstTriangle = begin;
+        sortedClusters[i].triangleCount = end - begin;
+    }
+
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    // Clusters far out along their own normal occlude the rest, so they go first
+    for (u32 i = 0; i < sortedClusters.size(); ++i)
+        sortedClusters[i].sortKey = glm::dot(clusterCentroids[i] - meshCentroid, clusterNormals[i]);
+
+    std::stable_sort(sortedClusters.begin(), sortedClusters.end(), [](const OverdrawCluster& a, const OverdrawCluster& b) { return a.sortKey > b.sortKey; });
+
+    std::vector<u32> sortedIndices;
+    sortedIndices.reserve(indexCount);
+    for (u32 i = 0; i < sortedClusters.size(); ++i)
+    {
+        const u32* begin = indices + sortedClusters[i].firstTriangle * 3;
+        sortedIndices.insert(sortedIndices.end(), begin, begin + sortedClusters[i].triangleCount * 3);
+    }
+
+    memcpy(indices, sortedIndices.data(), indexCount * sizeof(u32));
+}
+
+u32 OptimizeVertexFetch(Submesh& submesh)
+{
+    const u32 stride = submesh.vertexBufferLayout.stride;
+    const u32 vertexCount = (u32)submesh.vertices.size() / stride;
+
+    std::vector<u32> remap(vertexCount, UINT32_MAX);
+    std::vector<u8> vertices(submesh.vertices.size());
+    u32 nextVertex = 0;
+
+    for (u32 i = 0; i < submesh.indices.size(); ++i)
+    {
+        u32& index = submesh.indices[i];
+        if (remap[index] == UINT32_MAX)
+        {
+            memcpy(&vertices[nextVertex * stride], &submesh.vertices[index * stride], stride);
+            remap[index] = nextVertex++;
+        }
+        index = remap[index];
+    }
+
+    vertices.resize(nextVertex * stride);
+    submesh.vertices.swap(vertices);
+
+    return nextVertex;
+}
+
+void OptimizeSubmesh(Submesh& submesh, const char* name)
+{
+    const u32 stride = submesh.vertexBufferLayout.stride;
+    const u32 indexCount = (u32)submesh.indices.size();
+    u32 vertexCount = (u32)submesh.vertices.size() / stride;
+    if (indexCount == 0)
+        return;
+
+    VertexCacheStats before = AnalyzeVertexCache(submesh.indices.data(), indexCount, vertexCount);
+
+    std::vector<u32> indices(indexCount);
+    std::vector<u32> clusters;
+    OptimizeVertexCache(indices.data(), submesh.indices.data(), indexCount, vertexCount, &clusters);
+    OptimizeOverdraw(indices.data(), indexCount, clusters, submesh.vertices.data(), stride);
+    submesh.indices.swap(indices);
+
+    vertexCount = OptimizeVertexFetch(submesh);
+
+    VertexCacheStats after = AnalyzeVertexCache(submesh.indices.data(), indexCount, vertexCount);
+
+    ILOG("Optimized mesh %s (%u vertices, %u triangles, %u clusters): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f",
+         name, vertexCount, indexCount / 3, (u32)clusters.size(), before.acmr, after.acmr, before.atvr, after.atvr);
+}
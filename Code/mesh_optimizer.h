@@ -0,0 +1,48 @@
+//
+// mesh_optimizer.h: Index and vertex reordering of imported submeshes. Triangles are reordered
+// for the post-transform vertex cache (Tipsify), their clusters are sorted to reduce overdraw,
+// and vertices are remapped in the order they are first used so fetches are sequential.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define VERTEX_CACHE_SIZE 16
+
+struct VertexCacheStats
+{
+    f32 acmr; // Average cache miss ratio: transformed vertices per triangle (0.5 is the ideal, 3 the worst)
+    f32 atvr; // Average transform to vertex ratio: transformed vertices per vertex (1 is the ideal)
+};
+
+/**
+ * Simulates a FIFO post-transform cache of the given size over an index buffer.
+ */
+VertexCacheStats AnalyzeVertexCache(const u32* indices, u32 indexCount, u32 vertexCount, u32 cacheSize = VERTEX_CACHE_SIZE);
+
+/**
+ * Reorders the triangles of an index buffer for a vertex cache of the given size. If clusters
+ * is given, it receives the index of the first triangle of each run that starts from a cache
+ * flush; those runs can be reordered freely without hurting the cache hit rate.
+ */
+void OptimizeVertexCache(u32* dst, const u32* indices, u32 indexCount, u32 vertexCount, std::vector<u32>* clusters = NULL, u32 cacheSize = VERTEX_CACHE_SIZE);
+
+/**
+ * Sorts the clusters of an index buffer optimized by OptimizeVertexCache so the ones facing
+ * outwards from the center of the mesh are drawn first, which lets early-z reject more pixels.
+ * Positions are three floats at the start of each vertex.
+ */
+void OptimizeOverdraw(u32* indices, u32 indexCount, const std::vector<u32>& clusters, const u8* vertices, u32 vertexStride);
+
+/**
+ * Remaps the vertices of a submesh in the order the index buffer first uses them, dropping the
+ * unused ones. Works on any vertex layout. Returns the new vertex count.
+ */
+u32 OptimizeVertexFetch(Submesh& submesh);
+
+/**
+ * Runs all the passes above on a submesh imported with float positions and logs the vertex
+ * cache stats before and after.
+ */
+void OptimizeSubmesh(Submesh& submesh, const char* name);
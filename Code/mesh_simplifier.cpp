@@ -0,0 +1,337 @@
+#include "mesh_simplifier.h"
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <unordered_map>
+
+// Symmetric 4x4 matrix of the sum of squared distances to a set of planes, weighted by area
+struct Quadric
+{
+    f32 a00, a11, a22;
+    f32 a10, a20, a21;
+    f32 b0, b1, b2;
+    f32 c;
+    f32 w;
+};
+
+static Quadric MakePlaneQuadric(vec3 n, f32 d, f32 weight)
+{
+    Quadric q;
+    q.a00 = n.x * n.x * weight;
+    q.a11 = n.y * n.y * weight;
+    q.a22 = n.z * n.z * weight;
+    q.a10 = n.y * n.x * weight;
+    q.a20 = n.z * n.x * weight;
+    q.a21 = n.z * n.y * weight;
+    q.b0  = n.x * d * weight;
+    q.b1  = n.y * d * weight;
+    q.b2  = n.z * d * weight;
+    q.c   = d * d * weight;
+    q.w   = weight;
+    return q;
+}
+
+static void AddQuadric(Quadric& q, const Quadric& other)
+{
+    q.a00 += other.a00; q.a11 += other.a11; q.a22 += other.a22;
+    q.a10 += other.a10; q.a20 += other.a20; q.a21 += other.a21;
+    q.b0  += other.b0;  q.b1  += other.b1;  q.b2  += other.b2;
+    q.c   += other.c;
+    q.w   += other.w;
+}
+
+// Mean squared distance from p to the planes of the quadric
+static f32 QuadricError(const Quadric& q, vec3 p)
+{
+    f32 rx = q.a00 * p.x + q.a10 * p.y + q.a20 * p.z + q.b0;
+    f32 ry = q.a10 * p.x + q.a11 * p.y + q.a21 * p.z + q.b1;
+    f32 rz = q.a20 * p.x + q.a21 * p.y + q.a22 * p.z + q.b2;
+    f32 r = rx * p.x + ry * p.y + rz * p.z + q.b0 * p.x + q.b1 * p.y + q.b2 * p.z + q.c;
+    return q.w > 0.0f ? glm::abs(r) / q.w : 0.0f;
+}
+
+static vec3 GetPosition(const u8* vertices, u32 vertexStride, u32 vertex)
+{
+    vec3 position;
+    memcpy(&position, vertices + vertex * vertexStride, sizeof(position));
+    return position;
+}
+
+struct PositionHash
+{
+    size_t operator()(const vec3& p) const
+    {
+        u32 h[3];
+        memcpy(h, &p, sizeof(h));
+        return (h[0] * 73856093u) ^ (h[1] * 19349663u) ^ (h[2] * 83492791u);
+    }
+};
+
+// Vertices on a border of the mesh, or sharing their position with other vertices (uv or normal
+// seams), can't move without tearing the surface open
+static void FindLockedVertices(std::vector<bool>& locked, const u32* indices, u32 indexCount, const u8* vertices, u32 vertexCount, u32 vertexStride)
+{
+    locked.assign(vertexCount, false);
+
+    std::vector<u32> positionIds(vertexCount);
+    std::unordered_map<vec3, u32, PositionHash> firstVertexAt;
+    for (u32 v = 0; v < vertexCount; ++v)
+    {
+        std::pair<std::unordered_map<vec3, u32, PositionHash>::iterator, bool> result = firstVertexAt.insert(std::make_pair(GetPosition(vertices, vertexStride, v), v));
+        positionIds[v] = result.first->second;
+        if (!result.second)
+        {
+            locked[v] = true;
+            locked[result.first->second] = true;
+        }
+    }
+
+    // Border edges belong to a single triangle
+    std::unordered_map<u64, u32> edgeCounts;
+    for (u32 i = 0; i < indexCount; i += 3)
+    {
+        for (u32 j = 0; j < 3; ++j)
+        {
+            u32 a = positionIds[indices[i + j]];
+            u32 b = positionIds[indices[i + (j + 1) % 3]];
+            u64 key = a < b ? ((u64)a << 32 | b) : ((u64)b << 32 | a);
+            edgeCounts[key]++;
+        }
+    }
+
+    for (u32 i = 0; i < indexCount; i += 3)
+    {
+        for (u32 j = 0; j < 3; ++j)
+        {
+            u32 a = indices[i + j];
+            u32 b = indices[i + (j + 1) % 3];
+            u32 pa = positionIds[a];
+            u32 pb = positionIds[b];
+            u64 key = pa < pb ? ((u64)pa << 32 | pb) : ((u64)pb << 32 | pa);
+            if (edgeCounts[key] == 1)
+            {
+                locked[a] = true;
+                locked[b] = true;
+            }
+        }
+    }
+}
+
+struct Collapse
+{
+    u32 from;
+    u32 to;
+    f32 error;
+};
+
+// Collapsing from onto to must not turn any of the remaining triangles of from around
+static bool CollapseFlipsTriangles(const std::vector<u32>& triangles, const u32* indices, const u8* vertices, u32 vertexStride, u32 from, u32 to)
+{
+    vec3 target = GetPosition(vertices, vertexStride, to);
+
+    for (u32 i = 0; i < triangles.size(); ++i)
+    {
+        const u32* triangle = indices + triangles[i] * 3;
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+            continue; // it disappears with the collapse
+
+        vec3 p[3];
+        vec3 q[3];
+        for (u32 j = 0; j < 3; ++j)
+        {
+            p[j] = GetPosition(vertices, vertexStride, triangle[j]);
+            q[j] = triangle[j] == from ? target : p[j];
+        }
+
+        vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+        vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+        if (glm::dot(before, after) <= 0.0f)
+            return true;
+    }
+
+    return false;
+}
+
+u32 SimplifyMesh(u32* dst, const u32* indices, u32 indexCount, const u8* vertices, u32 vertexCount, u32 vertexStride,
+                 u32 targetIndexCount, f32 targetError, f32* resultError)
+{
+    std::vector<u32> result(indices, indices + indexCount);
+    f32 maxError = 0.0f;
+
+    std::vector<bool> locked;
+    FindLockedVertices(locked, indices, indexCount, vertices, vertexCount, vertexStride);
+
+    // Vertex quadrics from the planes of their triangles
+    std::vector<Quadric> quadrics(vertexCount, Quadric{});
+    for (u32 i = 0; i < indexCount; i += 3)
+    {
+        vec3 p0 = GetPosition(vertices, vertexStride, indices[i + 0]);
+        vec3 p1 = GetPosition(vertices, vertexStride, indices[i + 1]);
+        vec3 p2 = GetPosition(vertices, vertexStride, indices[i + 2]);
+
+        vec3 n = glm::cross(p1 - p0, p2 - p0);
+        f32 area = glm::length(n);
+        if (area == 0.0f)
+            continue;
+
+        n /= area;
+        Quadric q = MakePlaneQuadric(n, -glm::dot(n, p0), area);
+        for (u32 j = 0; j < 3; ++j)
+            AddQuadric(quadrics[indices[i + j]], q);
+    }
+
+    const f32 maxCollapseError = targetError * targetError;
+
+    std::vector<Collapse> collapses;
+    std::vector<u32> remap(vertexCount);
+    std::vector<bool> touched(vertexCount);
+    std::vector<std::vector<u32> > vertexTriangles(vertexCount);
+
+    // Every pass collapses a batch of independent edges, cheapest first
+    while (result.size() > targetIndexCount)
+    {
+        const u32 triangleCount = (u32)result.size() / 3;
+
+        for (u32 v = 0; v < vertexCount; ++v)
+            vertexTriangles[v].clear();
+        for (u32 t = 0; t < triangleCount; ++t)
+            for (u32 j = 0; j < 3; ++j)
+                vertexTriangles[result[t * 3 + j]].push_back(t);
+
+        collapses.clear();
+        for (u32 t = 0; t < triangleCount; ++t)
+        {
+            for (u32 j = 0; j < 3; ++j)
+            {
+                u32 a = result[t * 3 + j];
+                u32 b = result[t * 3 + (j + 1) % 3];
+
+                if (!locked[a])
+                    collapses.push_back(Collapse{ a, b, QuadricError(quadrics[a], GetPosition(vertices, vertexStride, b)) });
+                if (!locked[b])
+                    collapses.push_back(Collapse{ b, a, QuadricError(quadrics[b], GetPosition(vertices, vertexStride, a)) });
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.error < y.error; });
+
+        for (u32 v = 0; v < vertexCount; ++v)
+        {
+            remap[v] = v;
+            touched[v] = false;
+        }
+
+        u32 removedTriangles = 0;
+        u32 collapseCount = 0;
+        for (u32 i = 0; i < collapses.size(); ++i)
+        {
+            const Collapse& collapse = collapses[i];
+            if (collapse.error > maxCollapseError)
+                break;
+
+            if (touched[collapse.from] || touched[collapse.to])
+                continue;
+
+            const std::vector<u32>& triangles = vertexTriangles[collapse.from];
+            if (CollapseFlipsTriangles(triangles, result.data(), vertices, vertexStride, collapse.from, collapse.to))
+                continue;
+
+            // The neighbourhood of the collapse is frozen until the next pass
+            for (u32 j = 0; j < triangles.size(); ++j)
+                for (u32 k = 0; k < 3; ++k)
+                    touched[result[triangles[j] * 3 + k]] = true;
+
+            for (u32 j = 0; j < triangles.size(); ++j)
+            {
+                const u32* triangle = &result[triangles[j] * 3];
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                    removedTriangles++;
+            }
+
+            remap[collapse.from] = collapse.to;
+            AddQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+            maxError = glm::max(maxError, collapse.error);
+            collapseCount++;
+
+            if (result.size() - removedTriangles * 3 <= targetIndexCount)
+                break;
+        }
+
+        if (collapseCount == 0)
+            break;
+
+        // Apply the collapses and drop the triangles that became degenerate
+        u32 writeIdx = 0;
+        for (u32 t = 0; t < triangleCount; ++t)
+        {
+            u32 a = remap[result[t * 3 + 0]];
+            u32 b = remap[result[t * 3 + 1]];
+            u32 c = remap[result[t * 3 + 2]];
+            if (a != b && b != c && c != a)
+            {
+                result[writeIdx++] = a;
+                result[writeIdx++] = b;
+                result[writeIdx++] = c;
+            }
+        }
+        result.resize(writeIdx);
+    }
+
+    memcpy(dst, result.data(), result.size() * sizeof(u32));
+    if (resultError)
+        *resultError = glm::sqrt(maxError);
+
+    return (u32)result.size();
+}
+
+void GenerateSubmeshLods(Submesh& submesh, u32 lodCount)
+{
+    const u32 stride = submesh.vertexBufferLayout.stride;
+    const u32 vertexCount = (u32)submesh.vertices.size() / stride;
+    const u8* vertices = submesh.vertices.data();
+
+    submesh.lods.clear();
+    submesh.lods.push_back(SubmeshLod{ 0, (u32)submesh.indices.size(), 0.0f });
+
+    // Errors are relative to the size of the submesh
+    vec3 boundsMin = vec3(FLT_MAX);
+    vec3 boundsMax = vec3(-FLT_MAX);
+    for (u32 v = 0; v < vertexCount; ++v)
+    {
+        vec3 p = GetPosition(vertices, stride, v);
+        boundsMin = glm::min(boundsMin, p);
+        boundsMax = glm::max(boundsMax, p);
+    }
+    const f32 radius = vertexCount > 0 ? glm::length(boundsMax - boundsMin) * 0.5f : 0.0f;
+
+    std::vector<u32> lodIndices;
+    std::vector<u32> optimizedIndices;
+
+    for (u32 i = 1; i < lodCount; ++i)
+    {
+        const SubmeshLod previousLod = submesh.lods.back();
+        const u32 targetIndexCount = (u32)(previousLod.indexCount / 3 * MESH_LOD_REDUCTION) * 3;
+        const f32 targetError = radius * MESH_LOD_BASE_ERROR * (f32)(1 << (i - 1));
+
+        // Each level is simplified from the previous one
+        lodIndices.resize(previousLod.indexCount);
+        f32 error = 0.0f;
+        u32 indexCount = SimplifyMesh(lodIndices.data(), &submesh.indices[previousLod.firstIndex], previousLod.indexCount,
+                                      vertices, vertexCount, stride, targetIndexCount, targetError, &error);
+
+        // Not worth another range of indices
+        if (indexCount == 0 || indexCount > previousLod.indexCount * 0.9f)
+            break;
+
+        optimizedIndices.resize(indexCount);
+        OptimizeVertexCache(optimizedIndices.data(), lodIndices.data(), indexCount, vertexCount);
+
+        SubmeshLod lod = {};
+        lod.firstIndex = (u32)submesh.indices.size();
+        lod.indexCount = indexCount;
+        lod.error      = previousLod.error + error; // Measured against the previous level, so the deviations add up
+        submesh.indices.insert(submesh.indices.end(), optimizedIndices.begin(), optimizedIndices.end());
+        submesh.lods.push_back(lod);
+    }
+}
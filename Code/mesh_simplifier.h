@@ -0,0 +1,27 @@
+//
+// mesh_simplifier.h: Quadric error metric simplification (Garland and Heckbert) by edge
+// collapse. Vertices are collapsed onto existing ones, so every level of detail of a submesh
+// shares its vertex buffer and only adds a new range of indices.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define MESH_LOD_REDUCTION  0.5f   // Each LOD aims at this fraction of the triangles of the previous one
+#define MESH_LOD_BASE_ERROR 0.005f // Error allowed in the first LOD, relative to the submesh radius; it doubles with each LOD
+
+/**
+ * Simplifies an index buffer down to targetIndexCount indices, without deviating more than
+ * targetError (in object space units) from the original surface. Positions are three floats at
+ * the start of each vertex. Vertices on borders and on attribute seams are never moved.
+ * Returns the number of indices written to dst, and the error reached in resultError.
+ */
+u32 SimplifyMesh(u32* dst, const u32* indices, u32 indexCount, const u8* vertices, u32 vertexCount, u32 vertexStride,
+                 u32 targetIndexCount, f32 targetError, f32* resultError);
+
+/**
+ * Appends up to lodCount - 1 simplified levels to the indices of a submesh imported with float
+ * positions and fills submesh.lods. Stops early when a level cannot remove enough triangles.
+ */
+void GenerateSubmeshLods(Submesh& submesh, u32 lodCount);
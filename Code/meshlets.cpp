@@ -0,0 +1,168 @@
+#include "meshlets.h"
+
+#include <cfloat>
+
+static vec3 GetPosition(const Submesh& submesh, u32 vertex)
+{
+    vec3 position;
+    memcpy(&position, &submesh.vertices[vertex * submesh.vertexBufferLayout.stride], sizeof(position));
+    return position;
+}
+
+static Meshlet ComputeMeshletBounds(const Submesh& submesh, u32 firstIndex, u32 indexCount)
+{
+    const u32* indices = &submesh.indices[firstIndex];
+
+    Meshlet meshlet = {};
+    meshlet.firstIndex = firstIndex;
+    meshlet.indexCount = indexCount;
+
+    // Bounding sphere around the center of the bounding box
+    vec3 boundsMin = vec3(FLT_MAX);
+    vec3 boundsMax = vec3(-FLT_MAX);
+    for (u32 i = 0; i < indexCount; ++i)
+    {
+        vec3 p = GetPosition(submesh, indices[i]);
+        boundsMin = glm::min(boundsMin, p);
+        boundsMax = glm::max(boundsMax, p);
+    }
+
+    meshlet.center = (boundsMin + boundsMax) * 0.5f;
+    for (u32 i = 0; i < indexCount; ++i)
+        meshlet.radius = glm::max(meshlet.radius, glm::length(GetPosition(submesh, indices[i]) - meshlet.center));
+
+    // Normal cone: the average face normal, and the widest angle between it and any face normal
+    std::vector<vec3> normals(indexCount / 3);
+    vec3 axis = vec3(0.0f);
+    for (u32 t = 0; t < normals.size(); ++t)
+    {
+        vec3 p0 = GetPosition(submesh, indices[t * 3 + 0]);
+        vec3 p1 = GetPosition(submesh, indices[t * 3 + 1]);
+        vec3 p2 = GetPosition(submesh, indices[t * 3 + 2]);
+
+        vec3 n = glm::cross(p1 - p0, p2 - p0);
+        f32 length = glm::length(n);
+        normals[t] = length > 0.0f ? n / length : vec3(0.0f);
+        axis += normals[t];
+    }
+
+    f32 axisLength = glm::length(axis);
+    meshlet.coneAxis = axisLength > 0.0f ? axis / axisLength : vec3(0.0f, 0.0f, 1.0f);
+
+    f32 minDot = axisLength > 0.0f ? 1.0f : -1.0f;
+    for (u32 t = 0; t < normals.size(); ++t)
+        if (normals[t] != vec3(0.0f))
+            minDot = glm::min(minDot, glm::dot(normals[t], meshlet.coneAxis));
+
+    // The cluster is backfacing when the view direction is within 90 - spread degrees of the
+    // axis, so the cutoff is the sine of the spread; a spread over 90 degrees never culls
+    meshlet.coneCutoff = minDot > 0.0f ? glm::sqrt(1.0f - minDot * minDot) : 1.0f;
+    if (minDot <= 0.0f)
+        meshlet.coneAxis = vec3(0.0f);
+
+    return meshlet;
+}
+
+void BuildSubmeshMeshlets(Submesh& submesh)
+{
+    submesh.meshlets.clear();
+
+    const u32 vertexCount = (u32)submesh.vertices.size() / submesh.vertexBufferLayout.stride;
+    const u32 indexCount = submesh.lods.empty() ? (u32)submesh.indices.size() : submesh.lods[0].indexCount;
+
+    // The index buffer is already ordered for the vertex cache, so consecutive triangles share
+    // vertices; a meshlet is closed as soon as the next triangle doesn't fit anymore
+    std::vector<u32> meshletStamps(vertexCount, UINT32_MAX);
+    u32 meshletIdx = 0;
+    u32 meshletFirstIndex = 0;
+    u32 meshletVertexCount = 0;
+
+    for (u32 i = 0; i < indexCount; i += 3)
+    {
+        u32 newVertices = 0;
+        for (u32 j = 0; j < 3; ++j)
+        {
+            u32 v = submesh.indices[i + j];
+            bool repeated = (j > 0 && submesh.indices[i] == v) || (j > 1 && submesh.indices[i + 1] == v);
+            if (meshletStamps[v] != meshletIdx && !repeated)
+                newVertices++;
+        }
+
+        u32 meshletTriangleCount = (i - meshletFirstIndex) / 3;
+        if (meshletVertexCount + newVertices > MESHLET_MAX_VERTICES || meshletTriangleCount + 1 > MESHLET_MAX_TRIANGLES)
+        {
+            submesh.meshlets.push_back(ComputeMeshletBounds(submesh, meshletFirstIndex, i - meshletFirstIndex));
+            meshletIdx++;
+            meshletFirstIndex = i;
+            meshletVertexCount = 0;
+        }
+
+        for (u32 j = 0; j < 3; ++j)
+        {
+            u32 v = submesh.indices[i + j];
+            if (meshletStamps[v] != meshletIdx)
+            {
+                meshletStamps[v] = meshletIdx;
+                meshletVertexCount++;
+            }
+        }
+    }
+
+    if (meshletFirstIndex < indexCount)
+        submesh.meshlets.push_back(ComputeMeshletBounds(submesh, meshletFirstIndex, indexCount - meshletFirstIndex));
+
+    ComputeSubmeshBounds(submesh);
+}
+
+void ComputeSubmeshBounds(Submesh& submesh)
+{
+    submesh.boundsCenter = vec3(0.0f);
+    submesh.boundsRadius = 0.0f;
+    if (submesh.meshlets.empty())
+        return;
+
+    // Same as for the meshlets, around the center of the box that holds their spheres
+    vec3 boundsMin = vec3(FLT_MAX);
+    vec3 boundsMax = vec3(-FLT_MAX);
+    for (const Meshlet& meshlet : submesh.meshlets)
+    {
+        boundsMin = glm::min(boundsMin, meshlet.center - vec3(meshlet.radius));
+        boundsMax = glm::max(boundsMax, meshlet.center + vec3(meshlet.radius));
+    }
+
+    submesh.boundsCenter = (boundsMin + boundsMax) * 0.5f;
+    for (const Meshlet& meshlet : submesh.meshlets)
+        submesh.boundsRadius = glm::max(submesh.boundsRadius, glm::length(meshlet.center - submesh.boundsCenter) + meshlet.radius);
+}
+
+void GetFrustumPlanes(const mat4& viewProjection, vec4 planes[6])
+{
+    // Gribb and Hartmann: each plane is the sum or difference of the last row and another row
+    const mat4 m = glm::transpose(viewProjection);
+    planes[0] = m[3] + m[0]; // left
+    planes[1] = m[3] - m[0]; // right
+    planes[2] = m[3] + m[1]; // bottom
+    planes[3] = m[3] - m[1]; // top
+    planes[4] = m[3] + m[2]; // near
+    planes[5] = m[3] - m[2]; // far
+
+    for (u32 i = 0; i < 6; ++i)
+        planes[i] /= glm::length(vec3(planes[i]));
+}
+
+bool IsSphereCulled(vec3 center, f32 radius, const vec4 frustumPlanes[6])
+{
+    for (u32 i = 0; i < 6; ++i)
+        if (glm::dot(vec3(frustumPlanes[i]), center) + frustumPlanes[i].w < -radius)
+            return true;
+    return false;
+}
+
+bool IsMeshletCulled(const Meshlet& meshlet, const vec4 frustumPlanes[6], vec3 eye)
+{
+    if (IsSphereCulled(meshlet.center, meshlet.radius, frustumPlanes))
+        return true;
+
+    vec3 toCenter = meshlet.center - eye;
+    return glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+}
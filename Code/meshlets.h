@@ -0,0 +1,41 @@
+//
+// meshlets.h: Splits submeshes into small clusters of triangles (meshlets), each with a bounding
+// sphere and a normal cone, so whole clusters can be rejected before their index ranges are drawn.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define MESHLET_MAX_VERTICES  64
+#define MESHLET_MAX_TRIANGLES 124
+
+/**
+ * Groups the full resolution triangles of a submesh imported with float positions into
+ * meshlets, following the order of its (cache optimized) index buffer, and computes their
+ * culling data. Each meshlet is a contiguous range of indices.
+ */
+void BuildSubmeshMeshlets(Submesh& submesh);
+
+/**
+ * Bounds the meshlet spheres of a submesh with a single sphere. The coarser LODs index the same
+ * vertices as the full resolution one, so it bounds them too.
+ */
+void ComputeSubmeshBounds(Submesh& submesh);
+
+/**
+ * Extracts the six planes of the frustum of a view projection matrix. Given a world view
+ * projection matrix, the planes are in object space.
+ */
+void GetFrustumPlanes(const mat4& viewProjection, vec4 planes[6]);
+
+/**
+ * Whether a bounding sphere is outside the frustum. The planes must be in the space of the sphere.
+ */
+bool IsSphereCulled(vec3 center, f32 radius, const vec4 frustumPlanes[6]);
+
+/**
+ * Whether a meshlet is outside the frustum or all its triangles face away from the eye.
+ * The planes and the eye position must be in the same space as the meshlet (object space).
+ */
+bool IsMeshletCulled(const Meshlet& meshlet, const vec4 frustumPlanes[6], vec3 eye);
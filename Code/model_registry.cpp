@@ -0,0 +1,253 @@
+#include "model_registry.h"
+#include "asset_manifest.h"
+#include "asset_pack.h"
+#include "geometry_pool.h"
+#include "residency.h"
+
+#include <unordered_map>
+
+struct SharedMaterial
+{
+    u64 hash;
+    u32 refCount;
+};
+
+struct ModelRegistry
+{
+    std::unordered_map<std::string, u32>    modelIndexes;    // Model of each file, by path and texture flip
+    std::unordered_map<u32, u32>            modelRefCounts;  // Of the models in modelIndexes
+    std::unordered_map<u64, ModelSubmesh>   submeshes;       // Resident submesh of each geometry hash
+    std::vector<u32>                        meshRefCounts;   // Model submeshes in each mesh
+    std::unordered_map<u64, u32>            materialIndexes; // Material of each parameters hash
+    std::unordered_map<u32, SharedMaterial> materials;       // Materials created by FindOrAddSharedMaterial()
+    std::vector<u32>                        freeMeshes;      // Slots of deleted meshes and materials, reused first
+    std::vector<u32>                        freeMaterials;
+};
+
+static ModelRegistry GlobalModelRegistry;
+
+static std::string GetModelKey(const char* filename, bool flipTextures)
+{
+    return NormalizeAssetPath(filename) + (flipTextures ? "|flip" : "");
+}
+
+static u64 HashMaterial(const Material& material)
+{
+    f32 parameters[] = {
+        material.albedo.x, material.albedo.y, material.albedo.z,
+        material.emissive.x, material.emissive.y, material.emissive.z,
+        material.specular.x, material.specular.y, material.specular.z,
+        material.smoothness, material.shininess
+    };
+    u32 textures[] = {
+        material.albedoTextureIdx, material.emissiveTextureIdx, material.specularTextureIdx,
+        material.normalsTextureIdx, material.bumpTextureIdx, material.virtualTextureIdx
+    };
+    return HashBytes(textures, sizeof(textures), HashBytes(parameters, sizeof(parameters)));
+}
+
+static bool MaterialsMatch(const Material& a, const Material& b)
+{
+    return a.albedo == b.albedo && a.emissive == b.emissive && a.specular == b.specular &&
+        a.smoothness == b.smoothness && a.shininess == b.shininess &&
+        a.albedoTextureIdx == b.albedoTextureIdx && a.emissiveTextureIdx == b.emissiveTextureIdx &&
+        a.specularTextureIdx == b.specularTextureIdx && a.normalsTextureIdx == b.normalsTextureIdx &&
+        a.bumpTextureIdx == b.bumpTextureIdx && a.virtualTextureIdx == b.virtualTextureIdx;
+}
+
+static void DeleteMesh(App* app, u32 meshIdx)
+{
+    Mesh& mesh = app->meshes[meshIdx];
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    {
+        Submesh& submesh = mesh.submeshes[i];
+        FreeSubmeshGeometry(submesh);
+
+        std::unordered_map<u64, ModelSubmesh>::iterator it = GlobalModelRegistry.submeshes.find(submesh.geometryHash);
+        if (it != GlobalModelRegistry.submeshes.end() && it->second.meshIdx == meshIdx)
+            GlobalModelRegistry.submeshes.erase(it);
+    }
+
+    UntrackMesh(meshIdx);
+
+    mesh = Mesh{};
+    GlobalModelRegistry.freeMeshes.push_back(meshIdx);
+}
+
+static void DeleteMaterial(App* app, u32 materialIdx)
+{
+    std::unordered_map<u32, SharedMaterial>::iterator material = GlobalModelRegistry.materials.find(materialIdx);
+
+    std::unordered_map<u64, u32>::iterator it = GlobalModelRegistry.materialIndexes.find(material->second.hash);
+    if (it != GlobalModelRegistry.materialIndexes.end() && it->second == materialIdx)
+        GlobalModelRegistry.materialIndexes.erase(it);
+    GlobalModelRegistry.materials.erase(material);
+
+    app->materials[materialIdx] = Material{};
+    GlobalModelRegistry.freeMaterials.push_back(materialIdx);
+}
+
+static void AddModelReferences(App* app, const Model& model)
+{
+    GlobalModelRegistry.meshRefCounts.resize(app->meshes.size(), 0);
+    for (u32 i = 0; i < model.submeshes.size(); ++i)
+        GlobalModelRegistry.meshRefCounts[model.submeshes[i].meshIdx]++;
+
+    // Materials that are not shared (created by hand, like the ones of primitives) are never deleted
+    for (u32 i = 0; i < model.materialIdx.size(); ++i)
+    {
+        std::unordered_map<u32, SharedMaterial>::iterator it = GlobalModelRegistry.materials.find(model.materialIdx[i]);
+        if (it != GlobalModelRegistry.materials.end())
+            it->second.refCount++;
+    }
+}
+
+static void ReleaseModelReferences(App* app, const Model& model)
+{
+    for (u32 i = 0; i < model.submeshes.size(); ++i)
+    {
+        u32 meshIdx = model.submeshes[i].meshIdx;
+        ASSERT(GlobalModelRegistry.meshRefCounts[meshIdx] > 0, "Mesh released more times than referenced");
+        if (--GlobalModelRegistry.meshRefCounts[meshIdx] == 0)
+            DeleteMesh(app, meshIdx);
+    }
+
+    for (u32 i = 0; i < model.materialIdx.size(); ++i)
+    {
+        std::unordered_map<u32, SharedMaterial>::iterator it = GlobalModelRegistry.materials.find(model.materialIdx[i]);
+        if (it != GlobalModelRegistry.materials.end() && --it->second.refCount == 0)
+            DeleteMaterial(app, model.materialIdx[i]);
+    }
+}
+
+u32 AcquireLoadedModel(const char* filename, bool flipTextures)
+{
+    std::unordered_map<std::string, u32>::iterator it = GlobalModelRegistry.modelIndexes.find(GetModelKey(filename, flipTextures));
+    if (it == GlobalModelRegistry.modelIndexes.end())
+        return UINT32_MAX;
+
+    GlobalModelRegistry.modelRefCounts[it->second]++;
+    return it->second;
+}
+
+void RegisterLoadedModel(const char* filename, bool flipTextures, u32 modelIdx)
+{
+    GlobalModelRegistry.modelIndexes[GetModelKey(filename, flipTextures)] = modelIdx;
+    GlobalModelRegistry.modelRefCounts[modelIdx] = 1;
+}
+
+void ReleaseModel(App* app, u32 modelIdx)
+{
+    std::unordered_map<u32, u32>::iterator refCount = GlobalModelRegistry.modelRefCounts.find(modelIdx);
+    if (refCount == GlobalModelRegistry.modelRefCounts.end())
+    {
+        ELOG("Model %u is not loaded from a file, or it was released already", modelIdx);
+        return;
+    }
+
+    if (--refCount->second > 0)
+        return;
+
+    GlobalModelRegistry.modelRefCounts.erase(refCount);
+    for (std::unordered_map<std::string, u32>::iterator it = GlobalModelRegistry.modelIndexes.begin(); it != GlobalModelRegistry.modelIndexes.end(); ++it)
+    {
+        if (it->second == modelIdx)
+        {
+            GlobalModelRegistry.modelIndexes.erase(it);
+            break;
+        }
+    }
+
+    SetModelContents(app, modelIdx, Model{});
+}
+
+bool IsModelLoaded(u32 modelIdx)
+{
+    return GlobalModelRegistry.modelRefCounts.find(modelIdx) != GlobalModelRegistry.modelRefCounts.end();
+}
+
+bool FindSharedSubmesh(u64 geometryHash, ModelSubmesh& location)
+{
+    std::unordered_map<u64, ModelSubmesh>::iterator it = GlobalModelRegistry.submeshes.find(geometryHash);
+    if (geometryHash == 0 || it == GlobalModelRegistry.submeshes.end())
+        return false;
+
+    location = it->second;
+    return true;
+}
+
+u32 CreateSharedMesh(App* app)
+{
+    if (!GlobalModelRegistry.freeMeshes.empty())
+    {
+        u32 meshIdx = GlobalModelRegistry.freeMeshes.back();
+        GlobalModelRegistry.freeMeshes.pop_back();
+        return meshIdx;
+    }
+
+    app->meshes.push_back(Mesh{});
+    return (u32)app->meshes.size() - 1u;
+}
+
+void ShareMeshSubmeshes(App* app, u32 meshIdx)
+{
+    const Mesh& mesh = app->meshes[meshIdx];
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+        if (mesh.submeshes[i].geometryHash != 0)
+            GlobalModelRegistry.submeshes.insert(std::make_pair(mesh.submeshes[i].geometryHash, ModelSubmesh{ meshIdx, i }));
+}
+
+u32 FindOrAddSharedMaterial(App* app, const Material& material)
+{
+    u64 hash = HashMaterial(material);
+    std::unordered_map<u64, u32>::iterator it = GlobalModelRegistry.materialIndexes.find(hash);
+    if (it != GlobalModelRegistry.materialIndexes.end() && MaterialsMatch(app->materials[it->second], material))
+        return it->second;
+
+    u32 materialIdx;
+    if (!GlobalModelRegistry.freeMaterials.empty())
+    {
+        materialIdx = GlobalModelRegistry.freeMaterials.back();
+        GlobalModelRegistry.freeMaterials.pop_back();
+        app->materials[materialIdx] = material;
+    }
+    else
+    {
+        app->materials.push_back(material);
+        materialIdx = (u32)app->materials.size() - 1u;
+    }
+
+    // A hash collision leaves the new material unshared, but it is still deleted when unused
+    GlobalModelRegistry.materialIndexes.insert(std::make_pair(hash, materialIdx));
+    GlobalModelRegistry.materials[materialIdx] = SharedMaterial{ hash, 0 };
+    return materialIdx;
+}
+
+void SetModelContents(App* app, u32 modelIdx, const Model& contents)
+{
+    // References are taken first, so whatever the old and new contents have in common survives
+    Model model = contents;
+    AddModelReferences(app, model);
+
+    Model previous;
+    previous.submeshes.swap(app->models[modelIdx].submeshes);
+    previous.materialIdx.swap(app->models[modelIdx].materialIdx);
+    app->models[modelIdx] = model;
+
+    ReleaseModelReferences(app, previous);
+}
+
+u32 GetLoadedModelCount()
+{
+    return (u32)GlobalModelRegistry.modelRefCounts.size();
+}
+
+u32 GetSharedSubmeshCount()
+{
+    return (u32)GlobalModelRegistry.submeshes.size();
+}
+
+u32 GetSharedMaterialCount()
+{
+    return (u32)GlobalModelRegistry.materials.size();
+}
@@ -0,0 +1,61 @@
+//
+// model_registry.h: Sharing of what loaded models have in common. Each file is loaded once and its
+// model reference counted; submeshes with the same geometry hash are uploaded once, whichever file
+// they come from, and materials with the same parameters and textures are created once. The
+// meshes and materials nothing refers to anymore are deleted. Main thread only.
+//
+
+#pragma once
+
+#include "engine.h"
+
+/**
+ * Returns the model of a file that is loaded or requested already (with the same flipTextures),
+ * adding a reference to it, or UINT32_MAX.
+ */
+u32 AcquireLoadedModel(const char* filename, bool flipTextures);
+
+/**
+ * Registers the model just created or requested for a file, with one reference.
+ */
+void RegisterLoadedModel(const char* filename, bool flipTextures, u32 modelIdx);
+
+/**
+ * Drops a reference to the model of a file. The last one releases its submeshes and materials,
+ * and the model index must not be used anymore.
+ */
+void ReleaseModel(App* app, u32 modelIdx);
+
+/** Whether the model is registered for a file and has not been released */
+bool IsModelLoaded(u32 modelIdx);
+
+/**
+ * Finds where the submesh with the given geometry hash is resident, if it is.
+ */
+bool FindSharedSubmesh(u64 geometryHash, ModelSubmesh& location);
+
+/**
+ * Returns a new empty mesh, reusing the slot of a deleted one. Once its submeshes are uploaded,
+ * ShareMeshSubmeshes() makes them available to other models.
+ */
+u32 CreateSharedMesh(App* app);
+
+void ShareMeshSubmeshes(App* app, u32 meshIdx);
+
+/**
+ * Returns the index of a material with the same parameters and textures as the given one,
+ * adding it if there is none. Only the parameters the importers set are compared.
+ */
+u32 FindOrAddSharedMaterial(App* app, const Material& material);
+
+/**
+ * Sets the submeshes and materials of a model, taking references to them and dropping the ones
+ * the model had (like those of its streaming placeholder).
+ */
+void SetModelContents(App* app, u32 modelIdx, const Model& contents);
+
+u32 GetLoadedModelCount();
+
+u32 GetSharedSubmeshCount();
+
+u32 GetSharedMaterialCount();
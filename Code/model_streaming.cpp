@@ -0,0 +1,229 @@
+#include "model_streaming.h"
+#include "assimp_model_loading.h"
+#include "gltf_model_loading.h"
+#include "mesh_cache.h"
+#include "model_registry.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define MAX_MODEL_UPLOADS_PER_FRAME 1
+#define MAX_MODEL_IMPORTS_IN_FLIGHT 4 // Their caches are read together, and the closest models still start first
+
+struct ModelRequest
+{
+    u32         modelIdx;
+    std::string filename;
+    bool        flipTextures;
+    f32         priority; // Distance to the camera, the closest model loads first
+};
+
+struct ModelRequestCompare
+{
+    bool operator()(const ModelRequest& a, const ModelRequest& b) const { return a.priority > b.priority; }
+};
+
+struct StreamedModel
+{
+    u32           modelIdx;
+    bool          success;
+    ImportedModel imported;
+};
+
+struct ModelStreamer
+{
+    std::thread                thread;
+    std::mutex                 mutex;
+    std::condition_variable    requestAvailable;
+    std::vector<ModelRequest>  requests;      // Binary heap ordered by ModelRequestCompare
+    std::vector<StreamedModel> streamed;      // Imported in the background, waiting to be uploaded
+    std::vector<u32>           pendingModels; // Requested and not uploaded yet (main thread only)
+    u32                        importsInFlight;
+    bool                       quit;
+};
+
+static ModelStreamer GlobalModelStreamer;
+
+// Runs on the worker the mesh cache read completes on, and finishes there unless the model goes
+// to an import worker process, in which case a job takes over once it exits
+static void ImportStreamedModel(const ModelRequest& request, MappedFile& meshCache)
+{
+    // Everything but the GPU upload happens here (mesh conversion uses the job system, textures are streamed on their own)
+    ImportModelAsync(request.filename.c_str(), request.flipTextures, &meshCache, [request](bool success, ImportedModel& imported) {
+        StreamedModel streamedModel;
+        streamedModel.modelIdx = request.modelIdx;
+        streamedModel.success = success;
+        streamedModel.imported = std::move(imported);
+        if (streamedModel.success)
+            LoadGltfEmbeddedImages(request.filename.c_str(), streamedModel.imported);
+
+        {
+            std::lock_guard<std::mutex> lock(GlobalModelStreamer.mutex);
+            GlobalModelStreamer.streamed.push_back(std::move(streamedModel));
+            GlobalModelStreamer.importsInFlight--;
+        }
+        GlobalModelStreamer.requestAvailable.notify_all();
+    });
+}
+
+static void ModelStreamingLoop()
+{
+    for (;;)
+    {
+        ModelRequest request;
+        {
+            std::unique_lock<std::mutex> lock(GlobalModelStreamer.mutex);
+            GlobalModelStreamer.requestAvailable.wait(lock, [] {
+                return GlobalModelStreamer.quit || (!GlobalModelStreamer.requests.empty() && GlobalModelStreamer.importsInFlight < MAX_MODEL_IMPORTS_IN_FLIGHT);
+            });
+
+            if (GlobalModelStreamer.quit)
+                return;
+
+            std::pop_heap(GlobalModelStreamer.requests.begin(), GlobalModelStreamer.requests.end(), ModelRequestCompare());
+            request = GlobalModelStreamer.requests.back();
+            GlobalModelStreamer.requests.pop_back();
+            GlobalModelStreamer.importsInFlight++;
+        }
+
+        ReadFileAsync(GetMeshCachePath(request.filename.c_str()).c_str(), [request](MappedFile& meshCache) {
+            ImportStreamedModel(request, meshCache);
+        });
+    }
+}
+
+void InitModelStreaming()
+{
+    GlobalModelStreamer.quit = false;
+    GlobalModelStreamer.importsInFlight = 0;
+    GlobalModelStreamer.thread = std::thread(ModelStreamingLoop);
+}
+
+void ShutdownModelStreaming()
+{
+    {
+        std::lock_guard<std::mutex> lock(GlobalModelStreamer.mutex);
+        GlobalModelStreamer.quit = true;
+    }
+    GlobalModelStreamer.requestAvailable.notify_all();
+
+    if (GlobalModelStreamer.thread.joinable())
+        GlobalModelStreamer.thread.join();
+
+    // The imports that started finish on the workers
+    {
+        std::unique_lock<std::mutex> lock(GlobalModelStreamer.mutex);
+        GlobalModelStreamer.requestAvailable.wait(lock, [] { return GlobalModelStreamer.importsInFlight == 0; });
+    }
+
+    for (u32 i = 0; i < GlobalModelStreamer.streamed.size(); ++i)
+        ReleaseImportedModel(GlobalModelStreamer.streamed[i].imported);
+
+    GlobalModelStreamer.requests.clear();
+    GlobalModelStreamer.streamed.clear();
+    GlobalModelStreamer.pendingModels.clear();
+}
+
+u32 RequestModel(App* app, const char* filename, u32 placeholderModelIdx, bool flipTextures)
+{
+    ASSERT(placeholderModelIdx < app->models.size(), "The placeholder model must be loaded already");
+
+    // A file requested or loaded already is not imported again
+    u32 modelIdx = AcquireLoadedModel(filename, flipTextures);
+    if (modelIdx != UINT32_MAX)
+        return modelIdx;
+
+    // The new model shares the placeholder's submeshes and materials until the real ones are uploaded
+    Model placeholder = app->models[placeholderModelIdx];
+    app->models.push_back(Model{});
+    modelIdx = (u32)app->models.size() - 1u;
+    SetModelContents(app, modelIdx, placeholder);
+    RegisterLoadedModel(filename, flipTextures, modelIdx);
+
+    ModelRequest request = {};
+    request.modelIdx = modelIdx;
+    request.filename = filename;
+    request.flipTextures = flipTextures;
+    request.priority = FLT_MAX;
+
+    {
+        std::lock_guard<std::mutex> lock(GlobalModelStreamer.mutex);
+        GlobalModelStreamer.requests.push_back(request);
+        std::push_heap(GlobalModelStreamer.requests.begin(), GlobalModelStreamer.requests.end(), ModelRequestCompare());
+    }
+    GlobalModelStreamer.requestAvailable.notify_one();
+
+    GlobalModelStreamer.pendingModels.push_back(modelIdx);
+
+    return modelIdx;
+}
+
+void UpdateModelStreaming(App* app)
+{
+    if (GlobalModelStreamer.pendingModels.empty())
+        return;
+
+    // Closest entity to the camera for each model
+    std::vector<f32> modelDistances(app->models.size(), FLT_MAX);
+    for (u32 i = 0; i < app->entities.size(); ++i)
+    {
+        const Entity& entity = app->entities[i];
+        if (entity.modelIndex < modelDistances.size())
+        {
+            f32 distance = glm::length(vec3(entity.worldMatrix[3]) - app->camera.position);
+            modelDistances[entity.modelIndex] = glm::min(modelDistances[entity.modelIndex], distance);
+        }
+    }
+
+    std::vector<StreamedModel> streamed;
+    {
+        std::lock_guard<std::mutex> lock(GlobalModelStreamer.mutex);
+
+        std::vector<ModelRequest>& requests = GlobalModelStreamer.requests;
+        for (u32 i = 0; i < requests.size(); ++i)
+            requests[i].priority = modelDistances[requests[i].modelIdx];
+        std::make_heap(requests.begin(), requests.end(), ModelRequestCompare());
+
+        // Take a few finished models, uploading all of them at once could cause a hitch
+        u32 uploadCount = glm::min((u32)GlobalModelStreamer.streamed.size(), (u32)MAX_MODEL_UPLOADS_PER_FRAME);
+        for (u32 i = 0; i < uploadCount; ++i)
+            streamed.push_back(std::move(GlobalModelStreamer.streamed[i]));
+        GlobalModelStreamer.streamed.erase(GlobalModelStreamer.streamed.begin(), GlobalModelStreamer.streamed.begin() + uploadCount);
+    }
+
+    for (u32 i = 0; i < streamed.size(); ++i)
+    {
+        StreamedModel& streamedModel = streamed[i];
+        if (!IsModelLoaded(streamedModel.modelIdx))
+        {
+            // Released while it was streaming
+            ReleaseImportedModel(streamedModel.imported);
+        }
+        else if (streamedModel.success)
+        {
+            CreateModel(app, streamedModel.imported, streamedModel.modelIdx);
+        }
+        else
+        {
+            ELOG("Model %u failed to stream, it keeps its placeholder", streamedModel.modelIdx);
+            ReleaseImportedModel(streamedModel.imported);
+        }
+
+        std::vector<u32>& pendingModels = GlobalModelStreamer.pendingModels;
+        pendingModels.erase(std::remove(pendingModels.begin(), pendingModels.end(), streamedModel.modelIdx), pendingModels.end());
+    }
+}
+
+bool IsModelStreaming(u32 modelIdx)
+{
+    const std::vector<u32>& pendingModels = GlobalModelStreamer.pendingModels;
+    return std::find(pendingModels.begin(), pendingModels.end(), modelIdx) != pendingModels.end();
+}
+
+u32 GetPendingModelCount()
+{
+    return (u32)GlobalModelStreamer.pendingModels.size();
+}
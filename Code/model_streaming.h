@@ -0,0 +1,30 @@
+//
+// model_streaming.h: Non-blocking model loading. A requested model is usable right away as a
+// placeholder, while it is imported in the background; the real mesh is swapped in once uploaded.
+// A loader thread starts the closest models first, a few at a time: their mesh caches are read
+// with ReadFileAsync() and imported on the worker each read completes on.
+//
+
+#pragma once
+
+#include "engine.h"
+
+void InitModelStreaming();
+
+void ShutdownModelStreaming();
+
+/**
+ * Returns the index of a model that renders as the placeholder model until the requested file
+ * has been imported in the background and uploaded by UpdateModelStreaming().
+ */
+u32 RequestModel(App* app, const char* filename, u32 placeholderModelIdx, bool flipTextures = false);
+
+/**
+ * Called once per frame on the main thread. Reprioritizes the pending requests, so the models
+ * closest to the camera load first, and uploads the models that finished importing.
+ */
+void UpdateModelStreaming(App* app);
+
+bool IsModelStreaming(u32 modelIdx);
+
+u32 GetPendingModelCount();
@@ -0,0 +1,669 @@
+#include "obj_model_loading.h"
+#include "assimp_model_loading.h"
+#include "job_system.h"
+
+#include <cmath>
+
+#define OBJ_INDEX_MISSING INT32_MIN
+
+struct ObjCorner
+{
+    i32 position;
+    i32 texCoord;
+    i32 normal;
+};
+
+struct ObjMaterialSwitch
+{
+    u32         triangle; // First triangle of the chunk that uses the material
+    std::string name;
+};
+
+// Everything found in a range of lines. Negative (relative) OBJ indices that can't be resolved
+// inside the chunk are fixed up once the element counts of the previous chunks are known.
+struct ObjChunk
+{
+    const char*                    begin;
+    const char*                    end;
+    std::vector<vec3>              positions;
+    std::vector<vec2>              texCoords;
+    std::vector<vec3>              normals;
+    std::vector<ObjCorner>         corners; // 3 per triangle
+    std::vector<u32>               relativeIndices; // corner * 3 + component, relative to the chunk
+    std::vector<ObjMaterialSwitch> materialSwitches;
+    std::vector<std::string>       materialLibraries;
+};
+
+static inline bool IsObjSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool IsObjDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static const char* SkipObjSpaces(const char* s, const char* end)
+{
+    while (s < end && IsObjSpace(*s)) ++s;
+    return s;
+}
+
+static const char* SkipObjToken(const char* s, const char* end)
+{
+    while (s < end && !IsObjSpace(*s)) ++s;
+    return s;
+}
+
+static bool IsObjKeyword(const char* token, const char* tokenEnd, const char* keyword)
+{
+    size_t length = strlen(keyword);
+    return (size_t)(tokenEnd - token) == length && memcmp(token, keyword, length) == 0;
+}
+
+// The rest of the line, without the surrounding spaces
+static std::string GetObjLineArgument(const char* s, const char* end)
+{
+    s = SkipObjSpaces(s, end);
+    while (end > s && IsObjSpace(end[-1])) --end;
+    return std::string(s, end);
+}
+
+// Hand-rolled number parsing: no locale, no allocation, and no strtod scanning past the line
+static const char* ParseObjFloat(const char* s, const char* end, f32& value)
+{
+    static const f64 powersOf10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+                                      1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    s = SkipObjSpaces(s, end);
+
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+'))
+        negative = *s++ == '-';
+
+    u64 mantissa = 0;
+    i32 exponent = 0;
+    u32 digits = 0;
+    bool anyDigit = false;
+
+    for (; s < end && IsObjDigit(*s); ++s, anyDigit = true)
+    {
+        if (digits < 18) { mantissa = mantissa * 10 + (*s - '0'); digits += mantissa > 0; }
+        else             { exponent++; }
+    }
+
+    if (s < end && *s == '.')
+    {
+        for (++s; s < end && IsObjDigit(*s); ++s, anyDigit = true)
+        {
+            if (digits < 18) { mantissa = mantissa * 10 + (*s - '0'); digits += mantissa > 0; exponent--; }
+        }
+    }
+
+    if (!anyDigit)
+        return NULL;
+
+    if (s < end && (*s == 'e' || *s == 'E'))
+    {
+        ++s;
+        bool negativeExponent = false;
+        if (s < end && (*s == '-' || *s == '+'))
+            negativeExponent = *s++ == '-';
+
+        i32 e = 0;
+        for (; s < end && IsObjDigit(*s); ++s)
+            e = e < 10000 ? e * 10 + (*s - '0') : e;
+        exponent += negativeExponent ? -e : e;
+    }
+
+    f64 result = (f64)mantissa;
+    if (exponent < 0)
+        result = exponent >= -22 ? result / powersOf10[-exponent] : result * pow(10.0, exponent);
+    else if (exponent > 0)
+        result = exponent <= 22 ? result * powersOf10[exponent] : result * pow(10.0, exponent);
+
+    value = (f32)(negative ? -result : result);
+    return s;
+}
+
+static const char* ParseObjInt(const char* s, const char* end, i32& value)
+{
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+'))
+        negative = *s++ == '-';
+
+    if (s >= end || !IsObjDigit(*s))
+        return NULL;
+
+    i64 result = 0;
+    for (; s < end && IsObjDigit(*s); ++s)
+        result = result < INT32_MAX ? result * 10 + (*s - '0') : result;
+
+    value = (i32)(negative ? -result : result);
+    return s;
+}
+
+// 1-based indices become 0-based; negative ones count back from the elements seen so far in
+// the chunk, and are flagged so the elements of the previous chunks are added later
+static i32 ResolveObjIndex(i32 index, u32 elementCount, u32 component, u32& relativeComponents)
+{
+    if (index > 0)
+        return index - 1;
+
+    if (index < 0)
+    {
+        relativeComponents |= 1u << component;
+        return (i32)elementCount + index;
+    }
+
+    return OBJ_INDEX_MISSING;
+}
+
+static void ParseObjFace(const char* s, const char* end, ObjChunk& chunk)
+{
+    ObjCorner polygon[64];
+    u32 polygonRelativeComponents[64];
+    u32 cornerCount = 0;
+
+    for (;;)
+    {
+        s = SkipObjSpaces(s, end);
+        if (s >= end || cornerCount == ARRAY_COUNT(polygon))
+            break;
+
+        i32 indices[3] = { 0, 0, 0 };
+        const char* next = ParseObjInt(s, end, indices[0]);
+        if (!next)
+            break;
+        s = next;
+
+        for (u32 i = 1; i < 3 && s < end && *s == '/'; ++i)
+        {
+            next = ParseObjInt(++s, end, indices[i]);
+            if (next)
+                s = next;
+        }
+        s = SkipObjToken(s, end);
+
+        ObjCorner& corner = polygon[cornerCount];
+        u32& relativeComponents = polygonRelativeComponents[cornerCount];
+        relativeComponents = 0;
+        corner.position = ResolveObjIndex(indices[0], (u32)chunk.positions.size(), 0, relativeComponents);
+        corner.texCoord = ResolveObjIndex(indices[1], (u32)chunk.texCoords.size(), 1, relativeComponents);
+        corner.normal   = ResolveObjIndex(indices[2], (u32)chunk.normals.size(), 2, relativeComponents);
+        cornerCount++;
+    }
+
+    // Triangulated as a fan (points and lines are dropped, like SortByPType does)
+    for (u32 i = 2; i < cornerCount; ++i)
+    {
+        const u32 fan[3] = { 0, i - 1, i };
+        for (u32 j = 0; j < 3; ++j)
+        {
+            u32 corner = (u32)chunk.corners.size();
+            for (u32 component = 0; component < 3; ++component)
+                if (polygonRelativeComponents[fan[j]] & (1u << component))
+                    chunk.relativeIndices.push_back(corner * 3 + component);
+
+            chunk.corners.push_back(polygon[fan[j]]);
+        }
+    }
+}
+
+static void ParseObjChunk(ObjChunk& chunk)
+{
+    const char* s = chunk.begin;
+    while (s < chunk.end)
+    {
+        const char* lineEnd = (const char*)memchr(s, '\n', chunk.end - s);
+        if (!lineEnd)
+            lineEnd = chunk.end;
+
+        s = SkipObjSpaces(s, lineEnd);
+        const char* tokenEnd = SkipObjToken(s, lineEnd);
+
+        if (IsObjKeyword(s, tokenEnd, "v"))
+        {
+            vec3 position = vec3(0.0f);
+            const char* p = tokenEnd;
+            for (u32 i = 0; i < 3 && p; ++i)
+                p = ParseObjFloat(p, lineEnd, position[i]);
+            chunk.positions.push_back(position);
+        }
+        else if (IsObjKeyword(s, tokenEnd, "vt"))
+        {
+            vec2 texCoord = vec2(0.0f);
+            const char* p = tokenEnd;
+            for (u32 i = 0; i < 2 && p; ++i)
+                p = ParseObjFloat(p, lineEnd, texCoord[i]);
+            chunk.texCoords.push_back(texCoord);
+        }
+        else if (IsObjKeyword(s, tokenEnd, "vn"))
+        {
+            vec3 normal = vec3(0.0f);
+            const char* p = tokenEnd;
+            for (u32 i = 0; i < 3 && p; ++i)
+                p = ParseObjFloat(p, lineEnd, normal[i]);
+            chunk.normals.push_back(normal);
+        }
+        else if (IsObjKeyword(s, tokenEnd, "f"))
+        {
+            ParseObjFace(tokenEnd, lineEnd, chunk);
+        }
+        else if (IsObjKeyword(s, tokenEnd, "usemtl"))
+        {
+            ObjMaterialSwitch materialSwitch;
+            materialSwitch.triangle = (u32)chunk.corners.size() / 3;
+            materialSwitch.name = GetObjLineArgument(tokenEnd, lineEnd);
+            chunk.materialSwitches.push_back(materialSwitch);
+        }
+        else if (IsObjKeyword(s, tokenEnd, "mtllib"))
+        {
+            chunk.materialLibraries.push_back(GetObjLineArgument(tokenEnd, lineEnd));
+        }
+
+        s = lineEnd + 1;
+    }
+}
+
+static void AddObjTexture(const char* s, const char* end, u32 materialIdx, MaterialTexture texture, const std::string& directory, ImportedModel& imported)
+{
+    // Options (-bm 1.0, -clamp on...) come before the filename, which is the last token
+    while (end > s && IsObjSpace(end[-1])) --end;
+    const char* filename = end;
+    while (filename > s && !IsObjSpace(filename[-1])) --filename;
+
+    if (filename < end)
+    {
+        imported.texturePaths.push_back(directory + "/" + std::string(filename, end));
+        imported.textureSlots.push_back(materialIdx * MaterialTexture_Count + texture);
+    }
+}
+
+static void ParseMtlFile(const std::string& filename, const std::string& directory, std::map<std::string, u32>& materialIndices, ImportedModel& imported)
+{
+    MappedFile file = MapFile(filename.c_str());
+    if (!file.data)
+    {
+        ELOG("Could not open material library %s", filename.c_str());
+        return;
+    }
+
+    const char* s = (const char*)file.data;
+    const char* end = s + file.size;
+    Material* material = NULL;
+    u32 materialIdx = 0;
+
+    while (s < end)
+    {
+        const char* lineEnd = (const char*)memchr(s, '\n', end - s);
+        if (!lineEnd)
+            lineEnd = end;
+
+        s = SkipObjSpaces(s, lineEnd);
+        const char* tokenEnd = SkipObjToken(s, lineEnd);
+
+        if (IsObjKeyword(s, tokenEnd, "newmtl"))
+        {
+            // Same defaults as the Assimp OBJ importer
+            imported.materials.push_back(Material());
+            materialIdx = (u32)imported.materials.size() - 1u;
+            material = &imported.materials.back();
+            material->name = GetObjLineArgument(tokenEnd, lineEnd);
+            material->albedo = vec3(0.6f);
+            material->emissive = vec3(0.0f);
+            material->specular = vec3(0.0f);
+            material->shininess = 0.0f;
+            material->smoothness = 0.0f;
+            materialIndices[material->name] = materialIdx;
+        }
+        else if (material)
+        {
+            vec3* color = IsObjKeyword(s, tokenEnd, "Kd") ? &material->albedo :
+                          IsObjKeyword(s, tokenEnd, "Ke") ? &material->emissive :
+                          IsObjKeyword(s, tokenEnd, "Ks") ? &material->specular : NULL;
+            if (color)
+            {
+                const char* p = tokenEnd;
+                for (u32 i = 0; i < 3 && p; ++i)
+                    p = ParseObjFloat(p, lineEnd, (*color)[i]);
+            }
+            else if (IsObjKeyword(s, tokenEnd, "Ns"))
+            {
+                ParseObjFloat(tokenEnd, lineEnd, material->shininess);
+                material->smoothness = material->shininess / 256.0f;
+            }
+            else if (IsObjKeyword(s, tokenEnd, "map_Kd"))
+                AddObjTexture(tokenEnd, lineEnd, materialIdx, MaterialTexture_Albedo, directory, imported);
+            else if (IsObjKeyword(s, tokenEnd, "map_Ke"))
+                AddObjTexture(tokenEnd, lineEnd, materialIdx, MaterialTexture_Emissive, directory, imported);
+            else if (IsObjKeyword(s, tokenEnd, "map_Ks"))
+                AddObjTexture(tokenEnd, lineEnd, materialIdx, MaterialTexture_Specular, directory, imported);
+            else if (IsObjKeyword(s, tokenEnd, "norm") || IsObjKeyword(s, tokenEnd, "map_Kn"))
+                AddObjTexture(tokenEnd, lineEnd, materialIdx, MaterialTexture_Normals, directory, imported);
+            else if (IsObjKeyword(s, tokenEnd, "map_Bump") || IsObjKeyword(s, tokenEnd, "map_bump") || IsObjKeyword(s, tokenEnd, "bump"))
+                AddObjTexture(tokenEnd, lineEnd, materialIdx, MaterialTexture_Bump, directory, imported);
+        }
+
+        s = lineEnd + 1;
+    }
+
+    UnmapFile(file);
+}
+
+struct ObjCornerTable
+{
+    std::vector<u32> slots; // Open addressing (linear probing), vertex index or UINT32_MAX
+    u32              mask;
+};
+
+static inline u32 HashObjCorner(const ObjCorner& corner)
+{
+    return ((u32)corner.position * 73856093u) ^ ((u32)corner.texCoord * 19349663u) ^ ((u32)corner.normal * 83492791u);
+}
+
+struct ObjModel
+{
+    std::vector<vec3>      positions;
+    std::vector<vec2>      texCoords;
+    std::vector<vec3>      normals;
+    std::vector<vec3>      smoothNormals; // Per position, for the corners without normal
+    std::vector<ObjCorner> corners;
+};
+
+static bool BuildObjSubmesh(const ObjModel& obj, const std::vector<u32>& triangles, Submesh& submesh)
+{
+    bool hasTexCoords = false;
+    for (u32 i = 0; i < triangles.size() && !hasTexCoords; ++i)
+        for (u32 j = 0; j < 3; ++j)
+            hasTexCoords = hasTexCoords || obj.corners[triangles[i] * 3 + j].texCoord != OBJ_INDEX_MISSING;
+
+    // Join identical vertices
+    u32 capacity = 64;
+    while (capacity < triangles.size() * 3 * 2) capacity *= 2;
+
+    ObjCornerTable table;
+    table.slots.assign(capacity, UINT32_MAX);
+    table.mask = capacity - 1;
+
+    std::vector<ObjCorner> uniqueCorners;
+    std::vector<u32> indices(triangles.size() * 3);
+
+    for (u32 i = 0; i < triangles.size(); ++i)
+    {
+        for (u32 j = 0; j < 3; ++j)
+        {
+            const ObjCorner& corner = obj.corners[triangles[i] * 3 + j];
+            if (corner.position < 0 || corner.position >= (i32)obj.positions.size() ||
+                (corner.texCoord != OBJ_INDEX_MISSING && (corner.texCoord < 0 || corner.texCoord >= (i32)obj.texCoords.size())) ||
+                (corner.normal != OBJ_INDEX_MISSING && (corner.normal < 0 || corner.normal >= (i32)obj.normals.size())))
+                return false;
+
+            u32 slot = HashObjCorner(corner) & table.mask;
+            for (;;)
+            {
+                u32 vertex = table.slots[slot];
+                if (vertex == UINT32_MAX)
+                {
+                    vertex = (u32)uniqueCorners.size();
+                    uniqueCorners.push_back(corner);
+                    table.slots[slot] = vertex;
+                }
+
+                const ObjCorner& other = uniqueCorners[vertex];
+                if (other.position == corner.position && other.texCoord == corner.texCoord && other.normal == corner.normal)
+                {
+                    indices[i * 3 + j] = vertex;
+                    break;
+                }
+
+                slot = (slot + 1) & table.mask;
+            }
+        }
+    }
+
+    // Tangent space, like aiProcess_CalcTangentSpace (only with uvs), accumulated per vertex
+    const u32 vertexCount = (u32)uniqueCorners.size();
+    std::vector<vec3> tangents;
+    std::vector<vec3> bitangents;
+    if (hasTexCoords)
+    {
+        tangents.assign(vertexCount, vec3(0.0f));
+        bitangents.assign(vertexCount, vec3(0.0f));
+
+        for (u32 i = 0; i < indices.size(); i += 3)
+        {
+            const ObjCorner* c[3] = { &uniqueCorners[indices[i]], &uniqueCorners[indices[i + 1]], &uniqueCorners[indices[i + 2]] };
+            vec2 uv[3];
+            for (u32 j = 0; j < 3; ++j)
+                uv[j] = c[j]->texCoord != OBJ_INDEX_MISSING ? obj.texCoords[c[j]->texCoord] : vec2(0.0f);
+
+            vec3 edge1 = obj.positions[c[1]->position] - obj.positions[c[0]->position];
+            vec3 edge2 = obj.positions[c[2]->position] - obj.positions[c[0]->position];
+            vec2 deltaUv1 = uv[1] - uv[0];
+            vec2 deltaUv2 = uv[2] - uv[0];
+
+            f32 det = deltaUv1.x * deltaUv2.y - deltaUv2.x * deltaUv1.y;
+            if (det == 0.0f)
+                continue;
+
+            f32 r = 1.0f / det;
+            vec3 tangent = (edge1 * deltaUv2.y - edge2 * deltaUv1.y) * r;
+            vec3 bitangent = (edge2 * deltaUv1.x - edge1 * deltaUv2.x) * r;
+            for (u32 j = 0; j < 3; ++j)
+            {
+                tangents[indices[i + j]] += tangent;
+                bitangents[indices[i + j]] += bitangent;
+            }
+        }
+    }
+
+    // Write the vertices in the import layout
+    submesh.vertexBufferLayout = CreateImportVertexLayout(hasTexCoords, hasTexCoords);
+    submesh.vertices.resize(vertexCount * submesh.vertexBufferLayout.stride);
+    float* vertex = (float*)submesh.vertices.data();
+
+    for (u32 i = 0; i < vertexCount; ++i)
+    {
+        const ObjCorner& corner = uniqueCorners[i];
+        vec3 position = obj.positions[corner.position];
+        vec3 normal = corner.normal != OBJ_INDEX_MISSING ? obj.normals[corner.normal] : obj.smoothNormals[corner.position];
+
+        *vertex++ = position.x;
+        *vertex++ = position.y;
+        *vertex++ = position.z;
+        *vertex++ = normal.x;
+        *vertex++ = normal.y;
+        *vertex++ = normal.z;
+
+        if (hasTexCoords)
+        {
+            vec2 texCoord = corner.texCoord != OBJ_INDEX_MISSING ? obj.texCoords[corner.texCoord] : vec2(0.0f);
+            *vertex++ = texCoord.x;
+            *vertex++ = texCoord.y;
+
+            // Gram-Schmidt against the normal
+            vec3 tangent = tangents[i] - normal * glm::dot(normal, tangents[i]);
+            vec3 bitangent = bitangents[i];
+            tangent = glm::length(tangent) > 0.0f ? glm::normalize(tangent) : vec3(1.0f, 0.0f, 0.0f);
+            bitangent = glm::length(bitangent) > 0.0f ? glm::normalize(bitangent) : glm::cross(normal, tangent);
+
+            *vertex++ = tangent.x;
+            *vertex++ = tangent.y;
+            *vertex++ = tangent.z;
+            *vertex++ = bitangent.x;
+            *vertex++ = bitangent.y;
+            *vertex++ = bitangent.z;
+        }
+    }
+
+    submesh.indices.swap(indices);
+    submesh.indexType = GL_UNSIGNED_INT;
+
+    return true;
+}
+
+bool ImportObjModel(const char* filename, ImportedModel& imported)
+{
+    MappedFile file = MapFile(filename);
+    if (!file.data)
+    {
+        ELOG("Could not open OBJ file %s", filename);
+        return false;
+    }
+
+    // Split the file in chunks of whole lines, one per thread
+    const char* fileBegin = (const char*)file.data;
+    const char* fileEnd = fileBegin + file.size;
+
+    u32 chunkCount = (u32)(file.size / OBJ_MIN_CHUNK_SIZE) + 1u;
+    chunkCount = glm::min(chunkCount, GetJobWorkerCount() + 1u);
+
+    std::vector<ObjChunk> chunks(chunkCount);
+    const char* chunkBegin = fileBegin;
+    for (u32 i = 0; i < chunkCount; ++i)
+    {
+        const char* chunkEnd = i + 1 < chunkCount ? fileBegin + file.size * (i + 1) / chunkCount : fileEnd;
+        if (chunkEnd < chunkBegin)
+            chunkEnd = chunkBegin;
+        const char* newline = (const char*)memchr(chunkEnd, '\n', fileEnd - chunkEnd);
+        chunkEnd = newline ? newline + 1 : fileEnd;
+
+        chunks[i].begin = chunkBegin;
+        chunks[i].end = chunkEnd;
+        chunkBegin = chunkEnd;
+    }
+
+    ParallelFor(chunkCount, [&](u32 i) {
+        ParseObjChunk(chunks[i]);
+    });
+
+    // Merge the chunks, now that their element counts are known
+    ObjModel obj;
+    for (u32 i = 0; i < chunkCount; ++i)
+    {
+        ObjChunk& chunk = chunks[i];
+        const i32 bases[3] = { (i32)obj.positions.size(), (i32)obj.texCoords.size(), (i32)obj.normals.size() };
+        const u32 cornerBase = (u32)obj.corners.size();
+
+        obj.positions.insert(obj.positions.end(), chunk.positions.begin(), chunk.positions.end());
+        obj.texCoords.insert(obj.texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+        obj.normals.insert(obj.normals.end(), chunk.normals.begin(), chunk.normals.end());
+        obj.corners.insert(obj.corners.end(), chunk.corners.begin(), chunk.corners.end());
+
+        for (u32 j = 0; j < chunk.relativeIndices.size(); ++j)
+        {
+            u32 slot = chunk.relativeIndices[j];
+            i32* corner = &obj.corners[cornerBase + slot / 3].position;
+            corner[slot % 3] += bases[slot % 3];
+        }
+    }
+
+    UnmapFile(file);
+
+    if (obj.corners.empty())
+    {
+        ELOG("OBJ file %s has no triangles", filename);
+        return false;
+    }
+
+    // Materials
+    ImportedModel result;
+    std::string directory = GetDirectoryOf(filename);
+    std::map<std::string, u32> materialIndices;
+    for (u32 i = 0; i < chunkCount; ++i)
+        for (u32 j = 0; j < chunks[i].materialLibraries.size(); ++j)
+            ParseMtlFile(directory + "/" + chunks[i].materialLibraries[j], directory, materialIndices, result);
+
+    // Triangles of each material, the last list is for the faces without one
+    const u32 defaultMaterialIdx = (u32)result.materials.size();
+    std::vector<std::vector<u32> > materialTriangles(defaultMaterialIdx + 1);
+    u32 currentMaterialIdx = defaultMaterialIdx;
+    u32 triangle = 0;
+
+    for (u32 i = 0; i < chunkCount; ++i)
+    {
+        const ObjChunk& chunk = chunks[i];
+        const u32 chunkTriangleCount = (u32)chunk.corners.size() / 3;
+        u32 switchIdx = 0;
+
+        // A usemtl after the last face of a chunk has t == chunkTriangleCount, and applies to the next chunks
+        for (u32 t = 0; t <= chunkTriangleCount; ++t)
+        {
+            for (; switchIdx < chunk.materialSwitches.size() && chunk.materialSwitches[switchIdx].triangle == t; ++switchIdx)
+            {
+                std::map<std::string, u32>::const_iterator it = materialIndices.find(chunk.materialSwitches[switchIdx].name);
+                currentMaterialIdx = it != materialIndices.end() ? it->second : defaultMaterialIdx;
+            }
+            if (t < chunkTriangleCount)
+                materialTriangles[currentMaterialIdx].push_back(triangle++);
+        }
+    }
+
+    if (!materialTriangles[defaultMaterialIdx].empty())
+    {
+        Material material;
+        material.name = "DefaultMaterial";
+        material.albedo = vec3(0.6f);
+        material.emissive = vec3(0.0f);
+        material.specular = vec3(0.0f);
+        material.shininess = 0.0f;
+        material.smoothness = 0.0f;
+        result.materials.push_back(material);
+    }
+
+    // Smooth normals, like aiProcess_GenSmoothNormals, if any face comes without them
+    bool missingNormals = false;
+    for (u32 i = 0; i < obj.corners.size() && !missingNormals; ++i)
+        missingNormals = obj.corners[i].normal == OBJ_INDEX_MISSING;
+
+    if (missingNormals)
+    {
+        obj.smoothNormals.assign(obj.positions.size(), vec3(0.0f));
+        for (u32 i = 0; i < obj.corners.size(); i += 3)
+        {
+            i32 p[3] = { obj.corners[i].position, obj.corners[i + 1].position, obj.corners[i + 2].position };
+            if (p[0] < 0 || p[1] < 0 || p[2] < 0 || p[0] >= (i32)obj.positions.size() || p[1] >= (i32)obj.positions.size() || p[2] >= (i32)obj.positions.size())
+                continue; // Reported when the submesh is built
+
+            vec3 normal = glm::cross(obj.positions[p[1]] - obj.positions[p[0]], obj.positions[p[2]] - obj.positions[p[0]]);
+            for (u32 j = 0; j < 3; ++j)
+                obj.smoothNormals[p[j]] += normal;
+        }
+
+        for (u32 i = 0; i < obj.smoothNormals.size(); ++i)
+            obj.smoothNormals[i] = glm::length(obj.smoothNormals[i]) > 0.0f ? glm::normalize(obj.smoothNormals[i]) : vec3(0.0f, 1.0f, 0.0f);
+    }
+
+    // One submesh per material, built on the worker threads
+    std::vector<u32> usedMaterials;
+    for (u32 i = 0; i < materialTriangles.size(); ++i)
+        if (!materialTriangles[i].empty())
+            usedMaterials.push_back(i);
+
+    result.submeshes.resize(usedMaterials.size());
+    result.submeshMaterials = usedMaterials;
+    std::vector<u8> built(usedMaterials.size(), 0);
+
+    ParallelFor(usedMaterials.size(), [&](u32 i) {
+        built[i] = BuildObjSubmesh(obj, materialTriangles[usedMaterials[i]], result.submeshes[i]);
+    });
+
+    for (u32 i = 0; i < built.size(); ++i)
+    {
+        if (!built[i])
+        {
+            ELOG("OBJ file %s has out of range indices", filename);
+            return false;
+        }
+    }
+
+    imported.submeshes.swap(result.submeshes);
+    imported.submeshMaterials.swap(result.submeshMaterials);
+    imported.materials.swap(result.materials);
+    imported.texturePaths.swap(result.texturePaths);
+    imported.textureSlots.swap(result.textureSlots);
+
+    return true;
+}
@@ -0,0 +1,19 @@
+//
+// obj_model_loading.h: Native Wavefront OBJ/MTL importer. The file is memory-mapped and split
+// into chunks of lines that are parsed in parallel; vertices are deduplicated with a hash table
+// and written straight into the float layout of CreateImportVertexLayout().
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define OBJ_MIN_CHUNK_SIZE KB(256) // Smaller files are parsed by fewer threads
+
+/**
+ * Imports an OBJ file and its material libraries with the same result Assimp would give with
+ * the engine's import flags: triangulated faces, joined identical vertices, smooth normals when
+ * the file has none, tangent space when it has uvs, and one submesh per material.
+ * Leaves imported untouched on failure. Can run on any thread.
+ */
+bool ImportObjModel(const char* filename, ImportedModel& imported);
@@ -9,16 +9,46 @@
 #define WIN32_LEAN_AND_MEAN
 #define _CRT_SECURE_NO_WARNINGS
 #include <Windows.h>
+#include <direct.h>
 #else
+#include <dirent.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup)
+#define PLATFORM_IO_URING
+#endif
 #endif
 
 #include "engine.h"
+#include "asset_pack.h"
+#include "job_system.h"
 
 #include <GLFW/glfw3.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stb_image.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
@@ -28,9 +58,15 @@
 #define WINDOW_HEIGHT 600
 
 #define GLOBAL_FRAME_ARENA_SIZE MB(16)
+
+#define ASYNC_IO_QUEUE_DEPTH 64     // Reads in flight at once
+#define ASYNC_IO_READ_SIZE   MB(1)  // Larger files are split into reads that are in flight together
 u8* GlobalFrameArenaMemory = NULL;
 u32 GlobalFrameArenaHead = 0;
 
+// The cooker (cooker.cpp) has an entry point of its own, without a window
+#if !defined(ASSET_COOKER)
+
 void OnGlfwError(int errorCode, const char *errorMessage)
 {
 	fprintf(stderr, "glfw failed with error %d: %s\n", errorCode, errorMessage);
@@ -268,6 +304,8 @@ int main()
         GlobalFrameArenaHead = 0;
     }
 
+    Shutdown(&app);
+
     free(GlobalFrameArenaMemory);
 
     ImGui_ImplOpenGL3_Shutdown();
@@ -280,6 +318,8 @@ int main()
     return 0;
 }
 
+#endif // !ASSET_COOKER
+
 u32 Strlen(const char* string)
 {
     u32 len = 0;
@@ -355,10 +395,148 @@ String GetDirectoryPart(String path)
     return str;
 }
 
+static u64 GetLooseFileLastWriteTimestamp(const char* filepath)
+{
+#ifdef _WIN32
+    union Filetime2u64 {
+        FILETIME filetime;
+        u64      u64time;
+    } conversor;
+
+    WIN32_FILE_ATTRIBUTE_DATA Data;
+    if(GetFileAttributesExA(filepath, GetFileExInfoStandard, &Data)) {
+        conversor.filetime = Data.ftLastWriteTime;
+        return(conversor.u64time);
+    }
+#else
+    // NOTE: This has not been tested in unix-like systems
+    struct stat attrib;
+    if (stat(filepath, &attrib) == 0) {
+        return attrib.st_mtime;
+    }
+#endif
+
+    return 0;
+}
+
+static MappedFile MapLooseFile(const char* filepath)
+{
+    MappedFile file = {};
+
+#ifdef _WIN32
+    HANDLE fileHandle = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return file;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(fileHandle);
+        return file;
+    }
+
+    HANDLE mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mappingHandle == NULL)
+    {
+        CloseHandle(fileHandle);
+        return file;
+    }
+
+    void* view = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL)
+    {
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        return file;
+    }
+
+    file.data = (const u8*)view;
+    file.size = (u64)fileSize.QuadPart;
+    file.fileHandle = fileHandle;
+    file.mappingHandle = mappingHandle;
+#else
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0)
+        return file;
+
+    struct stat attrib;
+    if (fstat(fd, &attrib) != 0 || attrib.st_size == 0)
+    {
+        close(fd);
+        return file;
+    }
+
+    void* view = mmap(NULL, attrib.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps its own reference to the file
+
+    if (view == MAP_FAILED)
+        return file;
+
+    file.data = (const u8*)view;
+    file.size = (u64)attrib.st_size;
+#endif
+
+    return file;
+}
+
+struct AssetPackMount
+{
+    MappedFile             file;
+    const AssetPackEntry*  entries;
+    u32                    entryCount;
+    const char*            paths;
+    std::vector<const u8*> entryData;        // In the mapping, or in the decompressed data for compressed entries
+    u8*                    decompressedData;
+};
+
+struct AccessedFiles
+{
+    std::mutex                      mutex;
+    std::vector<std::string>        filepaths;
+    std::unordered_set<std::string> known;
+};
+
+static AssetPackMount GlobalAssetPack;
+static AccessedFiles  GlobalAccessedFiles;
+
+static const AssetPackEntry* FindAssetPackEntry(const char* filepath)
+{
+    const AssetPackMount& pack = GlobalAssetPack;
+    if (pack.entries == NULL)
+        return NULL;
+
+    std::string path = NormalizeAssetPath(filepath);
+    const AssetPackEntry* end = pack.entries + pack.entryCount;
+    const AssetPackEntry* entry = std::lower_bound(pack.entries, end, path, [&pack](const AssetPackEntry& e, const std::string& p) {
+        return p.compare(0, p.size(), pack.paths + e.pathOffset, e.pathLength) > 0;
+    });
+
+    if (entry != end && path.compare(0, path.size(), pack.paths + entry->pathOffset, entry->pathLength) == 0)
+        return entry;
+    return NULL;
+}
+
+static void RecordAccessedFile(const char* filepath)
+{
+    AccessedFiles& accessed = GlobalAccessedFiles;
+    std::lock_guard<std::mutex> lock(accessed.mutex);
+    if (accessed.known.insert(filepath).second)
+        accessed.filepaths.push_back(filepath);
+}
+
 String ReadTextFile(const char* filepath)
 {
     String fileText = {};
 
+    // Packed entries are followed by a zero byte, the text is served in place
+    const AssetPackEntry* entry = FindAssetPackEntry(filepath);
+    if (entry)
+    {
+        fileText.str = (char*)GlobalAssetPack.entryData[entry - GlobalAssetPack.entries];
+        fileText.len = (u32)entry->size;
+        return fileText;
+    }
+
     FILE* file = fopen(filepath, "rb");
 
     if (file)
@@ -372,6 +550,7 @@ String ReadTextFile(const char* filepath)
         fileText.str[fileText.len] = '\0';
 
         fclose(file);
+        RecordAccessedFile(filepath);
     }
     else
     {
@@ -383,31 +562,750 @@ String ReadTextFile(const char* filepath)
 
 u64 GetFileLastWriteTimestamp(const char* filepath)
 {
-#ifdef _WIN32
-    union Filetime2u64 {
-        FILETIME filetime;
-        u64      u64time;
-    } conversor;
+    const AssetPackEntry* entry = FindAssetPackEntry(filepath);
+    if (entry)
+        return entry->sourceTimestamp;
+
+    u64 timestamp = GetLooseFileLastWriteTimestamp(filepath);
+    if (timestamp != 0)
+        RecordAccessedFile(filepath);
+    return timestamp;
+}
 
-    WIN32_FILE_ATTRIBUTE_DATA Data;
-    if(GetFileAttributesExA(filepath, GetFileExInfoStandard, &Data)) {
-        conversor.filetime = Data.ftLastWriteTime;
-        return(conversor.u64time);
+MappedFile MapFile(const char* filepath)
+{
+    const AssetPackEntry* entry = FindAssetPackEntry(filepath);
+    if (entry)
+    {
+        MappedFile file = {};
+        file.data = GlobalAssetPack.entryData[entry - GlobalAssetPack.entries];
+        file.size = entry->size;
+        file.packed = true;
+        return file;
+    }
+
+    MappedFile file = MapLooseFile(filepath);
+    if (file.data)
+        RecordAccessedFile(filepath);
+    return file;
+}
+
+void UnmapFile(MappedFile& file)
+{
+    if (file.data == NULL || file.packed)
+    {
+        file = {};
+        return;
     }
+
+    if (file.owned)
+    {
+        free((void*)file.data);
+        file = {};
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(file.data);
+    CloseHandle((HANDLE)file.mappingHandle);
+    CloseHandle((HANDLE)file.fileHandle);
 #else
-    // NOTE: This has not been tested in unix-like systems
+    munmap((void*)file.data, file.size);
+#endif
+
+    file = {};
+}
+
+bool MountAssetPack(const char* filepath)
+{
+    UnmountAssetPack();
+
+    MappedFile file = MapLooseFile(filepath);
+    if (file.data == NULL)
+        return false;
+
+    const AssetPackHeader* header = (const AssetPackHeader*)file.data;
+    bool valid = file.size >= sizeof(AssetPackHeader) &&
+        header->magic == ASSET_PACK_MAGIC &&
+        header->version == ASSET_PACK_VERSION &&
+        header->chunkSize > 0 &&
+        header->tocOffset + (u64)header->entryCount * sizeof(AssetPackEntry) <= file.size &&
+        header->pathsOffset + header->pathsSize <= file.size;
+
+    const AssetPackEntry* entries = valid ? (const AssetPackEntry*)(file.data + header->tocOffset) : NULL;
+    u64 decompressedSize = 0;
+    for (u32 i = 0; valid && i < header->entryCount; ++i)
+    {
+        const AssetPackEntry& entry = entries[i];
+        valid = (u64)entry.pathOffset + entry.pathLength <= header->pathsSize &&
+            entry.dataOffset + entry.storedSize < file.size &&
+            (entry.chunkCount == 0 ?
+                entry.storedSize == entry.size :
+                entry.chunkCount == (entry.size + header->chunkSize - 1) / header->chunkSize && (u64)entry.chunkCount * sizeof(u32) <= entry.storedSize);
+
+        if (entry.chunkCount > 0)
+            decompressedSize += entry.size + 1;
+    }
+
+    if (!valid)
+    {
+        ELOG("Asset pack %s is not valid, loose files are used instead", filepath);
+        UnmapFile(file);
+        return false;
+    }
+
+    AssetPackMount& pack = GlobalAssetPack;
+    pack.file = file;
+    pack.entries = entries;
+    pack.entryCount = header->entryCount;
+    pack.paths = (const char*)(file.data + header->pathsOffset);
+    pack.entryData.resize(header->entryCount);
+    pack.decompressedData = decompressedSize > 0 ? (u8*)calloc(decompressedSize, 1) : NULL;
+
+    // Compressed entries are decompressed at once, one chunk per job, with a zero byte after each entry
+    struct Chunk
+    {
+        const u8* source;
+        u32       sourceSize;
+        u8*       destination;
+        u32       size;
+    };
+    std::vector<Chunk> chunks;
+    u8* decompressed = pack.decompressedData;
+    for (u32 i = 0; valid && i < pack.entryCount; ++i)
+    {
+        const AssetPackEntry& entry = entries[i];
+        const u8* data = file.data + entry.dataOffset;
+        if (entry.chunkCount == 0)
+        {
+            pack.entryData[i] = data;
+            continue;
+        }
+
+        pack.entryData[i] = decompressed;
+        const u32* chunkSizes = (const u32*)data;
+        u64 sourceOffset = entry.chunkCount * sizeof(u32);
+        for (u32 chunk = 0; chunk < entry.chunkCount; ++chunk)
+        {
+            u64 begin = (u64)chunk * header->chunkSize;
+            Chunk job = { data + sourceOffset, chunkSizes[chunk], decompressed + begin, (u32)std::min<u64>(header->chunkSize, entry.size - begin) };
+            chunks.push_back(job);
+            sourceOffset += chunkSizes[chunk];
+        }
+        valid = sourceOffset <= entry.storedSize;
+        decompressed += entry.size + 1;
+    }
+
+    std::atomic<bool> failed(!valid);
+    ParallelFor(chunks.size(), [&](u32 i) {
+        const Chunk& chunk = chunks[i];
+        if (!failed && stbi_zlib_decode_buffer((char*)chunk.destination, chunk.size, (const char*)chunk.source, chunk.sourceSize) != (int)chunk.size)
+            failed = true;
+    });
+
+    if (failed)
+    {
+        ELOG("Asset pack %s is corrupt, loose files are used instead", filepath);
+        UnmountAssetPack();
+        return false;
+    }
+
+    ILOG("Asset pack %s mounted with %u files", filepath, pack.entryCount);
+    return true;
+}
+
+void UnmountAssetPack()
+{
+    AssetPackMount& pack = GlobalAssetPack;
+    UnmapFile(pack.file);
+    free(pack.decompressedData);
+    pack.entries = NULL;
+    pack.entryCount = 0;
+    pack.paths = NULL;
+    pack.entryData.clear();
+    pack.decompressedData = NULL;
+}
+
+bool IsAssetPackMounted()
+{
+    return GlobalAssetPack.entries != NULL;
+}
+
+std::vector<std::string> GetAccessedFiles()
+{
+    AccessedFiles& accessed = GlobalAccessedFiles;
+    std::lock_guard<std::mutex> lock(accessed.mutex);
+    return accessed.filepaths;
+}
+
+struct FileReadRequest
+{
+    std::string      filepath;
+    FileReadCallback onRead;
+};
+
+#if defined(PLATFORM_IO_URING)
+struct FileRead;
+
+// A part of a file being read, the ring points to its iovec until the read completes
+struct FileReadPart
+{
+    FileRead* read;
+    iovec     iov;
+    u64       offset;
+};
+
+struct FileRead
+{
+    FileReadRequest           request;
+    int                       fd;
+    MappedFile                file;
+    std::vector<FileReadPart> parts;     // Sized once, the ring holds pointers to them
+    u32                       partsLeft;
+    bool                      failed;
+};
+
+struct IoUring
+{
+    void*         sqRing;
+    size_t        sqRingSize;
+    void*         cqRing;        // The same mapping as the submission ring with IORING_FEAT_SINGLE_MMAP
+    size_t        cqRingSize;
+    io_uring_sqe* sqes;
+    size_t        sqesSize;
+    u32*          sqTail;
+    u32*          sqArray;
+    u32           sqMask;
+    u32*          cqHead;
+    u32*          cqTail;
+    u32           cqMask;
+    io_uring_cqe* cqes;
+    u32           entries;
+    int           fd;
+};
+#endif
+
+struct AsyncFileIO
+{
+    std::thread                  thread;
+    std::mutex                   mutex;
+    std::condition_variable      requestAvailable;
+    std::vector<FileReadRequest> requests;         // Submitted together by the I/O thread
+    std::atomic<u32>             pendingReads;
+    bool                         running;          // There is an I/O thread taking requests
+    bool                         quit;
+#if defined(PLATFORM_IO_URING)
+    IoUring                      ring;
+#endif
+};
+
+static AsyncFileIO GlobalAsyncFileIO;
+
+// Blocking read into memory, followed by a zero byte
+static MappedFile ReadLooseFile(const char* filepath)
+{
+    MappedFile file = {};
+
+    FILE* handle = fopen(filepath, "rb");
+    if (!handle)
+        return file;
+
+    fseek(handle, 0, SEEK_END);
+    long size = ftell(handle);
+    fseek(handle, 0, SEEK_SET);
+
+    u8* data = size >= 0 ? (u8*)malloc(size + 1) : NULL;
+    if (data && fread(data, 1, size, handle) == (size_t)size)
+    {
+        data[size] = 0;
+        file.data = data;
+        file.size = (u64)size;
+        file.owned = true;
+    }
+    else
+    {
+        free(data);
+    }
+
+    fclose(handle);
+    return file;
+}
+
+// Hands the file to the callback on a worker
+static void DispatchFileRead(const FileReadRequest& request, MappedFile file)
+{
+    if (file.data && !file.packed)
+        RecordAccessedFile(request.filepath.c_str());
+
+    PushJob([request, file]() mutable {
+        request.onRead(file);
+        GlobalAsyncFileIO.pendingReads--;
+    });
+}
+
+#if defined(PLATFORM_IO_URING)
+static bool InitIoUring(IoUring& ring, u32 entries)
+{
+    io_uring_params params = {};
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0)
+        return false;
+
+    ring = IoUring{};
+    ring.fd = fd;
+    ring.entries = params.sq_entries;
+    ring.sqRingSize = params.sq_off.array + params.sq_entries * sizeof(u32);
+    ring.cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ring.sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+    bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMapping)
+        ring.sqRingSize = ring.cqRingSize = std::max(ring.sqRingSize, ring.cqRingSize);
+
+    void* sqRing = mmap(NULL, ring.sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    void* cqRing = singleMapping ? sqRing : mmap(NULL, ring.cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    void* sqes = mmap(NULL, ring.sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED)
+    {
+        if (sqes != MAP_FAILED)
+            munmap(sqes, ring.sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing)
+            munmap(cqRing, ring.cqRingSize);
+        if (sqRing != MAP_FAILED)
+            munmap(sqRing, ring.sqRingSize);
+        close(fd);
+        ring = IoUring{};
+        return false;
+    }
+
+    ring.sqRing  = sqRing;
+    ring.cqRing  = cqRing;
+    ring.sqes    = (io_uring_sqe*)sqes;
+    ring.sqTail  = (u32*)((u8*)sqRing + params.sq_off.tail);
+    ring.sqArray = (u32*)((u8*)sqRing + params.sq_off.array);
+    ring.sqMask  = *(u32*)((u8*)sqRing + params.sq_off.ring_mask);
+    ring.cqHead  = (u32*)((u8*)cqRing + params.cq_off.head);
+    ring.cqTail  = (u32*)((u8*)cqRing + params.cq_off.tail);
+    ring.cqMask  = *(u32*)((u8*)cqRing + params.cq_off.ring_mask);
+    ring.cqes    = (io_uring_cqe*)((u8*)cqRing + params.cq_off.cqes);
+    return true;
+}
+
+static void DestroyIoUring(IoUring& ring)
+{
+    munmap(ring.sqes, ring.sqesSize);
+    if (ring.cqRing != ring.sqRing)
+        munmap(ring.cqRing, ring.cqRingSize);
+    munmap(ring.sqRing, ring.sqRingSize);
+    close(ring.fd);
+    ring = IoUring{};
+}
+
+// Only the I/O thread writes the submission tail, the kernel reads it
+static void PushReadSqe(IoUring& ring, FileReadPart* part)
+{
+    u32 tail = *ring.sqTail;
+    u32 index = tail & ring.sqMask;
+
+    io_uring_sqe* sqe = &ring.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode    = IORING_OP_READV;
+    sqe->fd        = part->read->fd;
+    sqe->off       = part->offset;
+    sqe->addr      = (u64)(uintptr_t)&part->iov;
+    sqe->len       = 1;
+    sqe->user_data = (u64)(uintptr_t)part;
+
+    ring.sqArray[index] = index;
+    __atomic_store_n(ring.sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static void FinishFileRead(FileRead* read)
+{
+    close(read->fd);
+    if (read->failed)
+    {
+        ELOG("read() failed reading file %s", read->request.filepath.c_str());
+        UnmapFile(read->file);
+    }
+    DispatchFileRead(read->request, read->file);
+    delete read;
+}
+
+// Opens the file and queues the reads of its parts
+static void StartFileRead(const FileReadRequest& request, std::deque<FileReadPart*>& unsubmitted)
+{
+    int fd = open(request.filepath.c_str(), O_RDONLY | O_CLOEXEC);
     struct stat attrib;
-    if (stat(filepath, &attrib) == 0) {
-        return attrib.st_mtime;
+    u8* data = NULL;
+    if (fd < 0 || fstat(fd, &attrib) != 0 || (data = (u8*)malloc(attrib.st_size + 1)) == NULL)
+    {
+        if (fd >= 0)
+            close(fd);
+        DispatchFileRead(request, MappedFile{});
+        return;
+    }
+
+    const u64 size = (u64)attrib.st_size;
+    data[size] = 0;
+
+    FileRead* read = new FileRead;
+    read->request = request;
+    read->fd = fd;
+    read->file = MappedFile{};
+    read->file.data = data;
+    read->file.size = size;
+    read->file.owned = true;
+    read->failed = false;
+
+    read->partsLeft = (u32)((size + ASYNC_IO_READ_SIZE - 1) / ASYNC_IO_READ_SIZE);
+    read->parts.resize(read->partsLeft);
+    for (u32 i = 0; i < read->parts.size(); ++i)
+    {
+        FileReadPart& part = read->parts[i];
+        part.read = read;
+        part.offset = (u64)i * ASYNC_IO_READ_SIZE;
+        part.iov.iov_base = data + part.offset;
+        part.iov.iov_len = (size_t)std::min<u64>(ASYNC_IO_READ_SIZE, size - part.offset);
+        unsubmitted.push_back(&part);
     }
+
+    if (read->partsLeft == 0)
+        FinishFileRead(read);
+}
+
+// Takes the queued requests, keeps the ring full with the reads of their files and hands the
+// files whose reads completed to the workers
+static void AsyncFileIOLoop()
+{
+    AsyncFileIO& io = GlobalAsyncFileIO;
+    IoUring& ring = io.ring;
+
+    std::deque<FileReadPart*> unsubmitted;
+    u32 queuedSqes = 0; // In the ring, not taken by the kernel yet
+    u32 inFlight = 0;
+
+    for (;;)
+    {
+        std::vector<FileReadRequest> batch;
+        {
+            std::unique_lock<std::mutex> lock(io.mutex);
+            if (unsubmitted.empty() && queuedSqes == 0 && inFlight == 0)
+            {
+                io.requestAvailable.wait(lock, [&io] { return io.quit || !io.requests.empty(); });
+                if (io.requests.empty())
+                {
+                    io.running = false; // Later reads are done on the workers
+                    return;
+                }
+            }
+            batch.swap(io.requests);
+        }
+
+        for (u32 i = 0; i < batch.size(); ++i)
+            StartFileRead(batch[i], unsubmitted);
+
+        while (!unsubmitted.empty() && inFlight + queuedSqes < ring.entries)
+        {
+            PushReadSqe(ring, unsubmitted.front());
+            unsubmitted.pop_front();
+            queuedSqes++;
+        }
+
+        // Submits the batch and waits for at least one read to complete
+        u32 waitCount = inFlight + queuedSqes > 0 ? 1 : 0;
+        int submitted = (int)syscall(__NR_io_uring_enter, ring.fd, queuedSqes, waitCount, waitCount ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (submitted < 0)
+        {
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                ELOG("io_uring_enter() failed with error %d", errno);
+            submitted = 0;
+        }
+        queuedSqes -= (u32)submitted;
+        inFlight += (u32)submitted;
+
+        u32 head = *ring.cqHead;
+        while (head != __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE))
+        {
+            const io_uring_cqe& cqe = ring.cqes[head & ring.cqMask];
+            FileReadPart* part = (FileReadPart*)(uintptr_t)cqe.user_data;
+            i32 result = cqe.res;
+            head++;
+            inFlight--;
+
+            if (result == -EINTR || result == -EAGAIN)
+            {
+                unsubmitted.push_front(part);
+                continue;
+            }
+
+            if (result > 0 && (size_t)result < part->iov.iov_len)
+            {
+                // Short read, the rest of the part goes again
+                part->iov.iov_base = (u8*)part->iov.iov_base + result;
+                part->iov.iov_len -= result;
+                part->offset += result;
+                unsubmitted.push_front(part);
+                continue;
+            }
+
+            FileRead* read = part->read;
+            if (result <= 0)
+                read->failed = true;
+            if (--read->partsLeft == 0)
+                FinishFileRead(read);
+        }
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+    }
+}
 #endif
 
-    return 0;
+void InitAsyncFileIO()
+{
+    AsyncFileIO& io = GlobalAsyncFileIO;
+    io.pendingReads = 0;
+    io.running = false;
+    io.quit = false;
+
+#if defined(PLATFORM_IO_URING)
+    if (InitIoUring(io.ring, ASYNC_IO_QUEUE_DEPTH))
+    {
+        io.running = true;
+        io.thread = std::thread(AsyncFileIOLoop);
+    }
+#endif
+
+    ILOG("Asynchronous file reads through %s", GetAsyncFileIOBackendName());
 }
 
-void LogString(const char* str)
+void ShutdownAsyncFileIO()
+{
+    AsyncFileIO& io = GlobalAsyncFileIO;
+    {
+        std::lock_guard<std::mutex> lock(io.mutex);
+        io.quit = true;
+    }
+    io.requestAvailable.notify_all();
+
+    if (io.thread.joinable())
+        io.thread.join();
+
+#if defined(PLATFORM_IO_URING)
+    if (io.ring.sqRing)
+        DestroyIoUring(io.ring);
+#endif
+}
+
+void ReadFileAsync(const char* filepath, const FileReadCallback& onRead)
+{
+    AsyncFileIO& io = GlobalAsyncFileIO;
+    io.pendingReads++;
+
+    FileReadRequest request;
+    request.filepath = filepath;
+    request.onRead = onRead;
+
+    const AssetPackEntry* entry = FindAssetPackEntry(filepath);
+    if (entry)
+    {
+        MappedFile file = {};
+        file.data = GlobalAssetPack.entryData[entry - GlobalAssetPack.entries];
+        file.size = entry->size;
+        file.packed = true;
+        DispatchFileRead(request, file);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(io.mutex);
+        if (io.running)
+        {
+            io.requests.push_back(request);
+            io.requestAvailable.notify_one();
+            return;
+        }
+    }
+
+    // Without an I/O thread the read blocks a worker, right before the callback
+    PushJob([request]() {
+        MappedFile file = ReadLooseFile(request.filepath.c_str());
+        if (file.data)
+            RecordAccessedFile(request.filepath.c_str());
+        request.onRead(file);
+        GlobalAsyncFileIO.pendingReads--;
+    });
+}
+
+u32 GetPendingFileReadCount()
+{
+    return GlobalAsyncFileIO.pendingReads;
+}
+
+const char* GetAsyncFileIOBackendName()
+{
+    return GlobalAsyncFileIO.running ? "io_uring" : "worker threads";
+}
+
+static void ListFilesRecursively(const std::string& directory, const std::string& prefix, std::vector<std::string>& filepaths)
+{
+#ifdef _WIN32
+    WIN32_FIND_DATAA findData;
+    HANDLE findHandle = FindFirstFileA((directory + "\\*").c_str(), &findData);
+    if (findHandle == INVALID_HANDLE_VALUE)
+        return;
+
+    do
+    {
+        std::string name = findData.cFileName;
+        if (name == "." || name == "..")
+            continue;
+
+        if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            ListFilesRecursively(directory + "/" + name, prefix + name + "/", filepaths);
+        else
+            filepaths.push_back(prefix + name);
+    } while (FindNextFileA(findHandle, &findData));
+
+    FindClose(findHandle);
+#else
+    DIR* dir = opendir(directory.c_str());
+    if (dir == NULL)
+        return;
+
+    while (dirent* entry = readdir(dir))
+    {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..")
+            continue;
+
+        struct stat attrib;
+        if (stat((directory + "/" + name).c_str(), &attrib) != 0)
+            continue;
+
+        if (S_ISDIR(attrib.st_mode))
+            ListFilesRecursively(directory + "/" + name, prefix + name + "/", filepaths);
+        else
+            filepaths.push_back(prefix + name);
+    }
+
+    closedir(dir);
+#endif
+}
+
+std::vector<std::string> ListFiles(const char* directory)
+{
+    std::vector<std::string> filepaths;
+    ListFilesRecursively(directory, "", filepaths);
+    std::sort(filepaths.begin(), filepaths.end());
+    return filepaths;
+}
+
+bool SetWorkingDirectory(const char* directory)
 {
 #ifdef _WIN32
+    return _chdir(directory) == 0;
+#else
+    return chdir(directory) == 0;
+#endif
+}
+
+std::string GetExecutableDirectory()
+{
+    char path[1024] = {};
+#ifdef _WIN32
+    GetModuleFileNameA(NULL, path, sizeof(path) - 1);
+#else
+    if (readlink("/proc/self/exe", path, sizeof(path) - 1) < 0)
+        return "./";
+#endif
+
+    std::string directory = path;
+    size_t separator = directory.find_last_of("/\\");
+    return separator == std::string::npos ? "./" : directory.substr(0, separator + 1);
+}
+
+bool StartProcess(const char* executable, const std::vector<std::string>& arguments, Process& process)
+{
+    process = {};
+
+#ifdef _WIN32
+    std::string commandLine = std::string("\"") + executable + "\"";
+    for (u32 i = 0; i < arguments.size(); ++i)
+        commandLine += " \"" + arguments[i] + "\"";
+
+    STARTUPINFOA startupInfo = {};
+    startupInfo.cb = sizeof(startupInfo);
+    PROCESS_INFORMATION processInfo = {};
+    if (!CreateProcessA(executable, &commandLine[0], NULL, NULL, FALSE, CREATE_NO_WINDOW, NULL, NULL, &startupInfo, &processInfo))
+        return false;
+
+    CloseHandle(processInfo.hThread);
+    process.handle = processInfo.hProcess;
+    process.pid = processInfo.dwProcessId;
+#else
+    std::vector<char*> argv;
+    argv.push_back((char*)executable);
+    for (u32 i = 0; i < arguments.size(); ++i)
+        argv.push_back((char*)arguments[i].c_str());
+    argv.push_back(NULL);
+
+    extern char** environ;
+    pid_t pid;
+    if (posix_spawn(&pid, executable, NULL, NULL, argv.data(), environ) != 0)
+        return false;
+
+    process.pid = pid;
+#endif
+
+    return true;
+}
+
+i32 WaitForProcess(Process& process, u32 timeoutSeconds)
+{
+    i32 exitCode = -1;
+
+#ifdef _WIN32
+    if (WaitForSingleObject((HANDLE)process.handle, timeoutSeconds * 1000) != WAIT_OBJECT_0)
+    {
+        TerminateProcess((HANDLE)process.handle, (UINT)-1);
+        WaitForSingleObject((HANDLE)process.handle, INFINITE);
+    }
+    else
+    {
+        DWORD code;
+        if (GetExitCodeProcess((HANDLE)process.handle, &code) && code < 0xC0000000) // Not an exception code
+            exitCode = (i32)code;
+    }
+    CloseHandle((HANDLE)process.handle);
+#else
+    // Polled, so a process that hangs can be killed. The deadline is on the clock, as the sleeps
+    // last longer than asked
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeoutSeconds);
+    int status = 0;
+    pid_t result = 0;
+    while ((result = waitpid((pid_t)process.pid, &status, WNOHANG)) == 0)
+    {
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            kill((pid_t)process.pid, SIGKILL);
+            result = waitpid((pid_t)process.pid, &status, 0);
+            status = -1;
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    if (result > 0 && status != -1 && WIFEXITED(status))
+        exitCode = WEXITSTATUS(status);
+#endif
+
+    process = {};
+    return exitCode;
+}
+
+void LogString(const char* str)
+{
+#if defined(_WIN32) && !defined(ASSET_COOKER)
     OutputDebugStringA(str);
     OutputDebugStringA("\n");
 #else
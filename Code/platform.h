@@ -14,6 +14,7 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <vector>
 #include <string>
+#include <functional>
 
 #pragma warning(disable : 4267) // conversion from X to Y, possible loss of data
 
@@ -81,6 +82,103 @@ String ReadTextFile(const char *filepath);
  */
 u64 GetFileLastWriteTimestamp(const char *filepath);
 
+struct MappedFile
+{
+    const u8* data;
+    u64       size;
+    void*     fileHandle;    // Platform file handle (only used on Windows)
+    void*     mappingHandle; // Platform mapping handle (only used on Windows)
+    bool      packed;        // Points into the mounted asset pack, there is nothing to unmap
+    bool      owned;         // Read into memory by ReadFileAsync(), freed by UnmapFile()
+};
+
+/**
+ * Maps a whole file into read-only memory. The returned view stays valid until
+ * UnmapFile() is called. On failure, the returned MappedFile has a NULL data pointer.
+ */
+MappedFile MapFile(const char *filepath);
+
+void UnmapFile(MappedFile& file);
+
+/**
+ * Mounts an asset pack (see asset_pack.h). Until it is unmounted, MapFile(), ReadTextFile() and
+ * GetFileLastWriteTimestamp() serve the files it holds from its mapping, and only open loose
+ * files for the rest. Compressed entries are decompressed on the worker threads, so the job
+ * system has to be running. Neither is thread safe with the functions above.
+ */
+bool MountAssetPack(const char *filepath);
+
+void UnmountAssetPack();
+
+bool IsAssetPackMounted();
+
+/**
+ * Paths of the loose files read so far (or whose timestamp was checked), in the order they were
+ * first accessed. Those are the files an asset pack of this run has to hold.
+ */
+std::vector<std::string> GetAccessedFiles();
+
+/**
+ * Called on a worker thread with a file read by ReadFileAsync(), which has a NULL data pointer if
+ * it could not be read. The callback owns the file and releases it with UnmapFile().
+ */
+typedef std::function<void(MappedFile& file)> FileReadCallback;
+
+/**
+ * Starts the I/O thread of ReadFileAsync(). On Linux it submits the reads through io_uring, so
+ * they are in flight all at once; elsewhere (or where io_uring is not available) there is no I/O
+ * thread and the reads are done on the workers. The job system has to be running.
+ */
+void InitAsyncFileIO();
+
+/**
+ * Completes the reads queued so far and stops the I/O thread. Must be called before
+ * ShutdownJobSystem(), later reads are done on the workers while they finish their jobs.
+ */
+void ShutdownAsyncFileIO();
+
+/**
+ * Reads a whole file in the background and hands it to onRead on the job system, so decoding
+ * starts as soon as the data is in memory. Reads issued close together are submitted as one
+ * batch. The data is followed by a zero byte, like ReadTextFile(), and files of the mounted
+ * asset pack complete right away without a copy. Thread safe.
+ */
+void ReadFileAsync(const char *filepath, const FileReadCallback& onRead);
+
+u32 GetPendingFileReadCount();
+
+const char* GetAsyncFileIOBackendName();
+
+/**
+ * Lists the files under a directory and its subdirectories, sorted, as paths relative to it
+ * with forward slashes.
+ */
+std::vector<std::string> ListFiles(const char *directory);
+
+bool SetWorkingDirectory(const char *directory);
+
+/**
+ * Directory of the running executable, with a trailing slash.
+ */
+std::string GetExecutableDirectory();
+
+struct Process
+{
+    void* handle; // Platform process handle (only used on Windows)
+    i64   pid;
+};
+
+/**
+ * Starts an executable with the given arguments, in the working directory of this process.
+ */
+bool StartProcess(const char *executable, const std::vector<std::string>& arguments, Process& process);
+
+/**
+ * Waits for a process to exit and returns its exit code, or -1 if it crashed. A process still
+ * running after timeoutSeconds is killed.
+ */
+i32 WaitForProcess(Process& process, u32 timeoutSeconds);
+
 /**
  * It logs a string to whichever outputs are configured in the platform layer.
  * By default, the string is printed in the output console of VisualStudio.
@@ -0,0 +1,299 @@
+#include "residency.h"
+#include "assimp_model_loading.h"
+#include "geometry_pool.h"
+#include "job_system.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+struct ResidentResource
+{
+    std::string name;
+    u64         bytes;
+    f64         lastUsed; // Residency time, -1 if never used
+};
+
+struct ReloadedMesh
+{
+    u32           meshIdx;
+    std::string   source;
+    bool          success;
+    ImportedModel imported;
+};
+
+struct Residency
+{
+    std::unordered_map<u64, ResidentResource> resources; // By category (high bits) and id
+    u64                        categoryBytes[ResidencyCategory_Count];
+    f64                        time;                     // Accumulated frame time, in seconds
+
+    std::unordered_set<u32>    evictedMeshes;
+    std::unordered_set<u32>    reloadingMeshes;          // Evicted meshes whose import is in flight
+
+    std::mutex                 mutex;                    // Protects reloaded, filled by the workers, and reloadsInFlight
+    std::condition_variable    reloadFinished;
+    std::vector<ReloadedMesh>  reloaded;
+    u32                        reloadsInFlight;          // Pushed and not imported yet
+};
+
+static Residency GlobalResidency;
+
+static u64 GetResourceKey(ResidencyCategory category, u32 id)
+{
+    return ((u64)category << 32) | id;
+}
+
+// Submesh data that stays in system memory once the buffers are uploaded
+static u64 GetMeshCpuBytes(const Mesh& mesh)
+{
+    u64 bytes = mesh.submeshes.capacity() * sizeof(Submesh);
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    {
+        const Submesh& submesh = mesh.submeshes[i];
+        bytes += submesh.vertices.capacity() + submesh.indices.capacity() * sizeof(u32);
+        bytes += submesh.lods.capacity() * sizeof(SubmeshLod) + submesh.meshlets.capacity() * sizeof(Meshlet);
+        bytes += submesh.vertexBufferLayout.attributes.capacity() * sizeof(VertexBufferAttribute);
+    }
+    return bytes;
+}
+
+static void EvictMesh(App* app, u32 meshIdx)
+{
+    Mesh& mesh = app->meshes[meshIdx];
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+        FreeSubmeshGeometry(mesh.submeshes[i]);
+    mesh.resident = false;
+
+    SetResidentBytes(ResidencyCategory_Geometry, meshIdx, NULL, 0);
+    GlobalResidency.evictedMeshes.insert(meshIdx);
+}
+
+// Imports the source of an evicted mesh again (from its mesh cache) on a worker
+static void ReloadMesh(App* app, u32 meshIdx)
+{
+    std::string source = app->meshes[meshIdx].source;
+    GlobalResidency.reloadingMeshes.insert(meshIdx);
+    {
+        std::lock_guard<std::mutex> lock(GlobalResidency.mutex);
+        GlobalResidency.reloadsInFlight++;
+    }
+
+    PushJob([meshIdx, source]() {
+        ImportModelAsync(source.c_str(), false, NULL, [meshIdx, source](bool success, ImportedModel& imported) {
+            ReloadedMesh reloaded;
+            reloaded.meshIdx = meshIdx;
+            reloaded.source = source;
+            reloaded.success = success;
+            reloaded.imported = std::move(imported);
+
+            {
+                std::lock_guard<std::mutex> lock(GlobalResidency.mutex);
+                GlobalResidency.reloaded.push_back(std::move(reloaded));
+                GlobalResidency.reloadsInFlight--;
+            }
+            GlobalResidency.reloadFinished.notify_all();
+        });
+    });
+}
+
+void InitResidency()
+{
+    Residency& residency = GlobalResidency;
+    residency.resources.clear();
+    for (u32 i = 0; i < ResidencyCategory_Count; ++i)
+        residency.categoryBytes[i] = 0;
+    residency.time = 0.0;
+    residency.reloadsInFlight = 0;
+}
+
+void WaitForMeshReloads()
+{
+    // Reloads that went to an import worker process still push a job once it exits
+    std::unique_lock<std::mutex> lock(GlobalResidency.mutex);
+    GlobalResidency.reloadFinished.wait(lock, [] { return GlobalResidency.reloadsInFlight == 0; });
+}
+
+void ShutdownResidency()
+{
+    Residency& residency = GlobalResidency;
+    for (u32 i = 0; i < residency.reloaded.size(); ++i)
+        ReleaseImportedModel(residency.reloaded[i].imported);
+
+    residency.reloaded.clear();
+    residency.evictedMeshes.clear();
+    residency.reloadingMeshes.clear();
+    residency.resources.clear();
+    for (u32 i = 0; i < ResidencyCategory_Count; ++i)
+        residency.categoryBytes[i] = 0;
+}
+
+void SetResidentBytes(ResidencyCategory category, u32 id, const char* name, u64 bytes)
+{
+    Residency& residency = GlobalResidency;
+    const u64 key = GetResourceKey(category, id);
+
+    std::unordered_map<u64, ResidentResource>::iterator it = residency.resources.find(key);
+    if (it != residency.resources.end())
+    {
+        residency.categoryBytes[category] -= it->second.bytes;
+        if (bytes == 0)
+        {
+            residency.resources.erase(it);
+            return;
+        }
+        it->second.bytes = bytes;
+        if (name)
+            it->second.name = name;
+    }
+    else if (bytes > 0)
+    {
+        ResidentResource resource = {};
+        resource.name = name ? name : "";
+        resource.bytes = bytes;
+        resource.lastUsed = -1.0;
+        residency.resources[key] = resource;
+    }
+
+    residency.categoryBytes[category] += bytes;
+}
+
+void MarkResourceUsed(ResidencyCategory category, u32 id)
+{
+    std::unordered_map<u64, ResidentResource>::iterator it = GlobalResidency.resources.find(GetResourceKey(category, id));
+    if (it != GlobalResidency.resources.end())
+        it->second.lastUsed = GlobalResidency.time;
+}
+
+void TrackMesh(App* app, u32 meshIdx)
+{
+    const Mesh& mesh = app->meshes[meshIdx];
+    const u64 bufferBytes = (u64)mesh.vertexBufferSize + mesh.indexBufferSize;
+
+    // Reloaded meshes count as used, or they could be evicted again before being drawn
+    SetResidentBytes(ResidencyCategory_Geometry, meshIdx, mesh.source.c_str(), bufferBytes);
+    SetResidentBytes(ResidencyCategory_CpuGeometry, meshIdx, mesh.source.c_str(), GetMeshCpuBytes(mesh));
+    MarkResourceUsed(ResidencyCategory_Geometry, meshIdx);
+
+    GlobalResidency.evictedMeshes.erase(meshIdx);
+    GlobalResidency.reloadingMeshes.erase(meshIdx);
+}
+
+void UntrackMesh(u32 meshIdx)
+{
+    SetResidentBytes(ResidencyCategory_Geometry, meshIdx, NULL, 0);
+    SetResidentBytes(ResidencyCategory_CpuGeometry, meshIdx, NULL, 0);
+    GlobalResidency.evictedMeshes.erase(meshIdx);
+    GlobalResidency.reloadingMeshes.erase(meshIdx);
+}
+
+bool RequestMeshResidency(App* app, u32 meshIdx)
+{
+    Residency& residency = GlobalResidency;
+    if (residency.evictedMeshes.find(meshIdx) == residency.evictedMeshes.end())
+    {
+        MarkResourceUsed(ResidencyCategory_Geometry, meshIdx);
+        return true;
+    }
+
+    if (residency.reloadingMeshes.find(meshIdx) == residency.reloadingMeshes.end())
+        ReloadMesh(app, meshIdx);
+    return false;
+}
+
+void UpdateResidency(App* app)
+{
+    Residency& residency = GlobalResidency;
+    residency.time += app->deltaTime;
+
+    // Upload the meshes that were reloaded (unless they were deleted or replaced meanwhile)
+    std::vector<ReloadedMesh> reloaded;
+    {
+        std::lock_guard<std::mutex> lock(residency.mutex);
+        reloaded.swap(residency.reloaded);
+    }
+
+    for (u32 i = 0; i < reloaded.size(); ++i)
+    {
+        ReloadedMesh& mesh = reloaded[i];
+        const bool pending = residency.reloadingMeshes.find(mesh.meshIdx) != residency.reloadingMeshes.end() &&
+            app->meshes[mesh.meshIdx].source == mesh.source;
+
+        // A failed reload is not retried every frame, the mesh stays evicted
+        if (pending && !(mesh.success && RestoreMesh(app, mesh.meshIdx, mesh.imported)))
+            ELOG("Mesh %u could not be reloaded from %s, it stays evicted", mesh.meshIdx, mesh.source.c_str());
+        ReleaseImportedModel(mesh.imported);
+    }
+
+    // Over the budget, the meshes that have not been needed for a while go first
+    const u64 budget = GetResidencyBudget(app, ResidencyCategory_Geometry);
+    if (residency.categoryBytes[ResidencyCategory_Geometry] <= budget)
+        return;
+
+    std::vector<std::pair<f64, u32>> evictable;
+    for (std::unordered_map<u64, ResidentResource>::const_iterator it = residency.resources.begin(); it != residency.resources.end(); ++it)
+    {
+        const u32 meshIdx = (u32)it->first;
+        if ((ResidencyCategory)(it->first >> 32) == ResidencyCategory_Geometry && residency.time - it->second.lastUsed >= MESH_EVICTION_DELAY &&
+            !app->meshes[meshIdx].source.empty())
+            evictable.push_back(std::make_pair(it->second.lastUsed, meshIdx));
+    }
+    std::sort(evictable.begin(), evictable.end());
+
+    for (u32 i = 0; i < evictable.size() && residency.categoryBytes[ResidencyCategory_Geometry] > budget; ++i)
+        EvictMesh(app, evictable[i].second);
+}
+
+u64 GetResidentBytes(ResidencyCategory category)
+{
+    return GlobalResidency.categoryBytes[category];
+}
+
+u64 GetResidencyBudget(App* app, ResidencyCategory category)
+{
+    switch (category)
+    {
+        case ResidencyCategory_Textures: return (u64)MB((u64)glm::max(app->textureBudgetMB, 0));
+        case ResidencyCategory_Geometry: return (u64)MB((u64)glm::max(app->geometryBudgetMB, 0));
+        default:                         return 0;
+    }
+}
+
+const char* GetResidencyCategoryName(ResidencyCategory category)
+{
+    switch (category)
+    {
+        case ResidencyCategory_Textures:      return "Textures";
+        case ResidencyCategory_Atlases:       return "Atlases";
+        case ResidencyCategory_Geometry:      return "Geometry";
+        case ResidencyCategory_CpuGeometry:   return "CPU geometry";
+        case ResidencyCategory_RenderTargets: return "Render targets";
+        default:                              return "Unknown";
+    }
+}
+
+u32 GetEvictedMeshCount()
+{
+    return (u32)GlobalResidency.evictedMeshes.size();
+}
+
+void GetResidencyEntries(std::vector<ResidencyEntry>& entries)
+{
+    const Residency& residency = GlobalResidency;
+
+    entries.clear();
+    for (std::unordered_map<u64, ResidentResource>::const_iterator it = residency.resources.begin(); it != residency.resources.end(); ++it)
+    {
+        ResidencyEntry entry;
+        entry.category = (ResidencyCategory)(it->first >> 32);
+        entry.id = (u32)it->first;
+        entry.name = it->second.name;
+        entry.bytes = it->second.bytes;
+        entry.lastUsed = it->second.lastUsed >= 0.0 ? residency.time - it->second.lastUsed : -1.0;
+        entries.push_back(entry);
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const ResidencyEntry& a, const ResidencyEntry& b) { return a.bytes > b.bytes; });
+}
@@ -0,0 +1,87 @@
+//
+// residency.h: Accounting of the memory held by textures, meshes and render targets, by category
+// and by asset. Mesh geometry is evicted least recently used first while its category is over
+// app->geometryBudgetMB, and reloaded from their mesh cache as soon as an entity needs them again
+// (texture mips are evicted the same way by the texture streamer, against app->textureBudgetMB).
+// Main thread only.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define MESH_EVICTION_DELAY 10.0 // Seconds a mesh is kept after the last frame that needed it
+
+enum ResidencyCategory
+{
+    ResidencyCategory_Textures,      // Material textures (streamed mips included), by texture index
+    ResidencyCategory_Atlases,       // Texture atlas layers and virtual texture pages, by GL name
+    ResidencyCategory_Geometry,      // Vertex and index data in the geometry pool, by mesh index
+    ResidencyCategory_CpuGeometry,   // Submesh data kept in system memory (LODs, meshlets...), by mesh index
+    ResidencyCategory_RenderTargets, // G-buffer and feedback attachments, by GL name
+    ResidencyCategory_Count
+};
+
+struct ResidencyEntry
+{
+    ResidencyCategory category;
+    u32               id;       // Identifies the resource within its category
+    std::string       name;     // Asset the memory belongs to
+    u64               bytes;
+    f64               lastUsed; // Seconds since it was last used (negative if it never was)
+};
+
+void InitResidency();
+
+/**
+ * Blocks until the meshes being reloaded are imported. Must be called before ShutdownJobSystem(),
+ * which the reloads push their jobs to.
+ */
+void WaitForMeshReloads();
+
+/**
+ * Must be called after WaitForMeshReloads() and ShutdownJobSystem().
+ */
+void ShutdownResidency();
+
+/**
+ * Accounts the memory of a resource, replacing what was accounted for it before. Zero bytes
+ * stop tracking it.
+ */
+void SetResidentBytes(ResidencyCategory category, u32 id, const char* name, u64 bytes);
+
+/** Marks a tracked resource as used this frame */
+void MarkResourceUsed(ResidencyCategory category, u32 id);
+
+/**
+ * Accounts the buffers and CPU data of a mesh just uploaded (in full, or again after an
+ * eviction), named after the file its submeshes were imported from.
+ */
+void TrackMesh(App* app, u32 meshIdx);
+
+/** Stops tracking a mesh that is being deleted */
+void UntrackMesh(u32 meshIdx);
+
+/**
+ * Marks the mesh as needed this frame. Returns false if it is evicted, in which case its reload
+ * is requested and it must not be drawn until it is back.
+ */
+bool RequestMeshResidency(App* app, u32 meshIdx);
+
+/**
+ * Called once per frame on the main thread. Uploads the meshes that finished reloading and,
+ * while the geometry is over budget, evicts the meshes not needed lately.
+ */
+void UpdateResidency(App* app);
+
+u64 GetResidentBytes(ResidencyCategory category);
+
+/** Budget of a category in bytes, 0 if it has none */
+u64 GetResidencyBudget(App* app, ResidencyCategory category);
+
+const char* GetResidencyCategoryName(ResidencyCategory category);
+
+u32 GetEvictedMeshCount();
+
+/** Every tracked resource, largest first */
+void GetResidencyEntries(std::vector<ResidencyEntry>& entries);
@@ -0,0 +1,184 @@
+#include "texture_atlas.h"
+#include "residency.h"
+
+#define TEXTURE_ATLAS_ALIGNMENT (1 << (TEXTURE_ATLAS_LEVELS - 1)) // Texel offsets stay integers in every level
+
+// A row of textures of about the same height
+struct AtlasShelf
+{
+    u32 layer;
+    u32 y;
+    u32 height;
+    u32 x;        // Where the next texture goes
+};
+
+struct TextureAtlas
+{
+    GLuint                  handle;
+    u32                     layerCount;
+    u32                     lastLayerHeight; // Used by the shelves of the last layer
+    std::vector<AtlasShelf> shelves;
+};
+
+static TextureAtlas GlobalTextureAtlas;
+
+// Replaces the array by one with an extra layer, copying the existing layers on the GPU
+static void AddAtlasLayer()
+{
+    TextureAtlas& atlas = GlobalTextureAtlas;
+
+    GLuint handle;
+    glGenTextures(1, &handle);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, handle);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, TEXTURE_ATLAS_LEVELS, GL_RGBA8, TEXTURE_ATLAS_LAYER_SIZE, TEXTURE_ATLAS_LAYER_SIZE, atlas.layerCount + 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    if (atlas.handle != 0)
+    {
+        for (u32 level = 0; level < TEXTURE_ATLAS_LEVELS; ++level)
+        {
+            const u32 levelSize = TEXTURE_ATLAS_LAYER_SIZE >> level;
+            glCopyImageSubData(atlas.handle, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+                               handle, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, levelSize, levelSize, atlas.layerCount);
+        }
+        glDeleteTextures(1, &atlas.handle);
+        SetResidentBytes(ResidencyCategory_Atlases, atlas.handle, NULL, 0);
+    }
+
+    atlas.handle = handle;
+    atlas.layerCount++;
+    atlas.lastLayerHeight = 0;
+
+    u64 layerBytes = 0;
+    for (u32 level = 0; level < TEXTURE_ATLAS_LEVELS; ++level)
+        layerBytes += (u64)(TEXTURE_ATLAS_LAYER_SIZE >> level) * (TEXTURE_ATLAS_LAYER_SIZE >> level) * 4;
+    SetResidentBytes(ResidencyCategory_Atlases, atlas.handle, "Texture atlas", layerBytes * atlas.layerCount);
+}
+
+// Finds room for a cell on a shelf of similar height, or opens a new shelf (and a new layer if needed)
+static bool AllocateCell(ivec2 cellSize, u32& layer, ivec2& origin)
+{
+    TextureAtlas& atlas = GlobalTextureAtlas;
+
+    for (u32 i = 0; i < atlas.shelves.size(); ++i)
+    {
+        AtlasShelf& shelf = atlas.shelves[i];
+        if (shelf.height >= (u32)cellSize.y && shelf.height <= 2 * (u32)cellSize.y && shelf.x + cellSize.x <= TEXTURE_ATLAS_LAYER_SIZE)
+        {
+            layer = shelf.layer;
+            origin = ivec2(shelf.x, shelf.y);
+            shelf.x += cellSize.x;
+            return true;
+        }
+    }
+
+    if (cellSize.x > TEXTURE_ATLAS_LAYER_SIZE || cellSize.y > TEXTURE_ATLAS_LAYER_SIZE)
+        return false;
+
+    if (atlas.layerCount == 0 || atlas.lastLayerHeight + cellSize.y > TEXTURE_ATLAS_LAYER_SIZE)
+        AddAtlasLayer();
+
+    AtlasShelf shelf = { atlas.layerCount - 1, atlas.lastLayerHeight, (u32)cellSize.y, (u32)cellSize.x };
+    atlas.shelves.push_back(shelf);
+    atlas.lastLayerHeight += cellSize.y;
+
+    layer = shelf.layer;
+    origin = ivec2(0, shelf.y);
+    return true;
+}
+
+void ShutdownTextureAtlas()
+{
+    TextureAtlas& atlas = GlobalTextureAtlas;
+    glDeleteTextures(1, &atlas.handle);
+    SetResidentBytes(ResidencyCategory_Atlases, atlas.handle, NULL, 0);
+    atlas.handle = 0;
+    atlas.layerCount = 0;
+    atlas.lastLayerHeight = 0;
+    atlas.shelves.clear();
+}
+
+bool CanAtlasTexture(ivec2 size)
+{
+    return size.x > 0 && size.y > 0 && size.x <= TEXTURE_ATLAS_MAX_TEXTURE_SIZE && size.y <= TEXTURE_ATLAS_MAX_TEXTURE_SIZE;
+}
+
+bool AddTextureToAtlas(Texture& texture, const Image& image)
+{
+    if (!image.pixels || !CanAtlasTexture(image.size) || image.nchannels < 1 || image.nchannels > 4)
+        return false;
+
+    const i32 gutter = TEXTURE_ATLAS_GUTTER;
+    const ivec2 cellSize = (image.size + 2 * gutter + TEXTURE_ATLAS_ALIGNMENT - 1) / TEXTURE_ATLAS_ALIGNMENT * TEXTURE_ATLAS_ALIGNMENT;
+
+    u32 layer;
+    ivec2 origin;
+    if (!AllocateCell(cellSize, layer, origin))
+        return false;
+
+    // The cell as RGBA, with the edges clamped into the gutter. Missing channels read as GL_RED/GL_RG textures do.
+    std::vector<u8> cell(cellSize.x * cellSize.y * 4);
+    const u8* pixels = (const u8*)image.pixels;
+    const i32 n = image.nchannels;
+    for (i32 y = 0; y < cellSize.y; ++y)
+    {
+        const u8* srcRow = pixels + glm::clamp(y - gutter, 0, image.size.y - 1) * image.stride;
+        for (i32 x = 0; x < cellSize.x; ++x)
+        {
+            const u8* texel = srcRow + glm::clamp(x - gutter, 0, image.size.x - 1) * n;
+            u8* dst = &cell[(y * cellSize.x + x) * 4];
+            dst[0] = texel[0];
+            dst[1] = n >= 2 ? texel[1] : 0;
+            dst[2] = n >= 3 ? texel[2] : 0;
+            dst[3] = n == 4 ? texel[3] : 255;
+        }
+    }
+
+    // Each level averages the previous one, the cell size is a multiple of two for all of them.
+    // The caller may be uploading from a pixel buffer, which stays bound once the cell is copied
+    GLint unpackBuffer = 0;
+    glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &unpackBuffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, GlobalTextureAtlas.handle);
+    ivec2 levelSize = cellSize;
+    for (u32 level = 0; level < TEXTURE_ATLAS_LEVELS; ++level)
+    {
+        if (level > 0)
+        {
+            const ivec2 srcSize = levelSize;
+            levelSize /= 2;
+            for (i32 y = 0; y < levelSize.y; ++y)
+            {
+                for (i32 x = 0; x < levelSize.x; ++x)
+                {
+                    const u8* src = &cell[((2 * y) * srcSize.x + 2 * x) * 4];
+                    u8* dst = &cell[(y * levelSize.x + x) * 4];
+                    for (u32 c = 0; c < 4; ++c)
+                        dst[c] = (u8)((src[c] + src[c + 4] + src[srcSize.x * 4 + c] + src[srcSize.x * 4 + c + 4] + 2) / 4);
+                }
+            }
+        }
+
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, origin.x >> level, origin.y >> level, layer, levelSize.x, levelSize.y, 1, GL_RGBA, GL_UNSIGNED_BYTE, cell.data());
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuffer);
+
+    texture.atlasLayer = (i32)layer;
+    texture.atlasRect = vec4(vec2(image.size), vec2(origin + gutter)) / (f32)TEXTURE_ATLAS_LAYER_SIZE;
+    return true;
+}
+
+GLuint GetTextureAtlasHandle()
+{
+    return GlobalTextureAtlas.handle;
+}
+
+u32 GetTextureAtlasLayerCount()
+{
+    return GlobalTextureAtlas.layerCount;
+}
@@ -0,0 +1,30 @@
+//
+// texture_atlas.h: Small textures (solid colors, tiny material maps) are also copied into the
+// layers of a shared texture array, so the deferred geometry pass samples all of them through a
+// single binding with a UV scale and offset per texture instead of binding each one.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define TEXTURE_ATLAS_MAX_TEXTURE_SIZE 64   // Textures up to this size along both axes are atlased (never more than TEXTURE_MIP_TAIL_SIZE)
+#define TEXTURE_ATLAS_LAYER_SIZE       1024
+#define TEXTURE_ATLAS_GUTTER           4    // Edge texels repeated around every texture, so filtering clamps like GL_CLAMP_TO_EDGE
+#define TEXTURE_ATLAS_LEVELS           3    // Mip levels of the atlas, the gutter is still one texel wide in the last one
+
+void ShutdownTextureAtlas();
+
+bool CanAtlasTexture(ivec2 size);
+
+/**
+ * Copies a decoded image (8 bits per channel) into the atlas, growing it by a layer if it is full,
+ * and stores where it landed in texture.atlasLayer and texture.atlasRect. The texture keeps its own
+ * handle for the passes that do not sample the atlas. The pixel unpack buffer binding is left as
+ * it was. Main thread only.
+ */
+bool AddTextureToAtlas(Texture& texture, const Image& image);
+
+GLuint GetTextureAtlasHandle(); // GL_TEXTURE_2D_ARRAY, 0 while nothing is atlased
+
+u32 GetTextureAtlasLayerCount();
@@ -0,0 +1,478 @@
+#include "texture_cache.h"
+#include "asset_manifest.h"
+#include "buffer_management.h"
+#include "job_system.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define TEXTURE_CACHE_SSE2
+#include <emmintrin.h>
+#endif
+
+#define TEXTURE_MIP_ROWS_PER_JOB 16
+
+// Source texels and weights each destination texel takes along one axis (padded with zero weights)
+struct MipFilterTaps
+{
+    u32              tapCount;
+    std::vector<u32> indices;
+    std::vector<f32> weights;
+};
+
+static std::string GetTextureCachePath(const char* filename, TextureUsage usage)
+{
+    return std::string(filename) + (usage == TextureUsage_Virtual ? TEXTURE_CACHE_VIRTUAL_EXTENSION : TEXTURE_CACHE_EXTENSION);
+}
+
+static f32 BesselI0(f32 x)
+{
+    // Power series, converges quickly for the small arguments of the Kaiser window
+    f32 sum = 1.0f;
+    f32 term = 1.0f;
+    for (u32 k = 1; k < 32; ++k)
+    {
+        f32 y = x / (2.0f * k);
+        term *= y * y;
+        sum += term;
+        if (term < sum * 1e-7f)
+            break;
+    }
+    return sum;
+}
+
+static f32 KaiserSinc(f32 x)
+{
+    const f32 t = x / TEXTURE_KAISER_WIDTH;
+    if (t <= -1.0f || t >= 1.0f)
+        return 0.0f;
+
+    const f32 pix = 3.14159265f * x;
+    const f32 sinc = fabsf(x) < 1e-5f ? 1.0f : sinf(pix) / pix;
+    const f32 window = BesselI0(TEXTURE_KAISER_ALPHA * sqrtf(1.0f - t * t)) / BesselI0(TEXTURE_KAISER_ALPHA);
+    return sinc * window;
+}
+
+static MipFilterTaps ComputeMipFilterTaps(u32 srcSize, u32 dstSize, TextureMipFilter mipFilter)
+{
+    MipFilterTaps taps = {};
+    const f32 scale = (f32)srcSize / (f32)dstSize;
+
+    // Distances are measured in destination texels, so the filter widens with the reduction
+    f32 radius = 0.0f;
+    if (srcSize != dstSize)
+        radius = mipFilter == TextureMipFilter_Kaiser ? TEXTURE_KAISER_WIDTH * scale : 0.5f * scale;
+
+    taps.tapCount = 2 * (u32)ceilf(radius) + 1;
+    taps.indices.assign(dstSize * taps.tapCount, 0);
+    taps.weights.assign(dstSize * taps.tapCount, 0.0f);
+
+    for (u32 j = 0; j < dstSize; ++j)
+    {
+        u32* indices = &taps.indices[j * taps.tapCount];
+        f32* weights = &taps.weights[j * taps.tapCount];
+
+        if (srcSize == dstSize)
+        {
+            indices[0] = j;
+            weights[0] = 1.0f;
+            continue;
+        }
+
+        const f32 center = (j + 0.5f) * scale;
+        const i32 first = (i32)floorf(center - radius);
+
+        f32 weightSum = 0.0f;
+        for (u32 t = 0; t < taps.tapCount; ++t)
+        {
+            const i32 i = first + (i32)t;
+            const f32 x = ((f32)i + 0.5f - center) / scale;
+
+            f32 weight = 0.0f;
+            if (mipFilter == TextureMipFilter_Kaiser)
+                weight = KaiserSinc(x);
+            else
+                weight = (x > -0.5f && x < 0.5f) ? 1.0f : 0.0f;
+
+            indices[t] = (u32)glm::clamp(i, 0, (i32)srcSize - 1); // Clamp to edge, like the sampler
+            weights[t] = weight;
+            weightSum += weight;
+        }
+
+        for (u32 t = 0; t < taps.tapCount; ++t)
+            weights[t] /= weightSum;
+    }
+
+    return taps;
+}
+
+// row[k] += weight * src[k] for a whole row of 8-bit texels
+static void AccumulateRow(f32* row, const u8* src, u32 count, f32 weight)
+{
+    u32 k = 0;
+#ifdef TEXTURE_CACHE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 w = _mm_set1_ps(weight);
+    for (; k + 16 <= count; k += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(src + k));
+        __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+        __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+
+        __m128 v0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+        __m128 v1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+        __m128 v2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+        __m128 v3 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
+
+        _mm_storeu_ps(row + k +  0, _mm_add_ps(_mm_loadu_ps(row + k +  0), _mm_mul_ps(v0, w)));
+        _mm_storeu_ps(row + k +  4, _mm_add_ps(_mm_loadu_ps(row + k +  4), _mm_mul_ps(v1, w)));
+        _mm_storeu_ps(row + k +  8, _mm_add_ps(_mm_loadu_ps(row + k +  8), _mm_mul_ps(v2, w)));
+        _mm_storeu_ps(row + k + 12, _mm_add_ps(_mm_loadu_ps(row + k + 12), _mm_mul_ps(v3, w)));
+    }
+#endif
+    for (; k < count; ++k)
+        row[k] += weight * src[k];
+}
+
+// Filters a vertically filtered row horizontally and packs it back to 8 bits
+static void ResolveRow(u8* dst, const f32* row, u32 dstWidth, i32 nchannels, const MipFilterTaps& taps)
+{
+    for (u32 x = 0; x < dstWidth; ++x)
+    {
+        const u32* indices = &taps.indices[x * taps.tapCount];
+        const f32* weights = &taps.weights[x * taps.tapCount];
+
+#ifdef TEXTURE_CACHE_SSE2
+        if (nchannels == 4)
+        {
+            __m128 acc = _mm_setzero_ps();
+            for (u32 t = 0; t < taps.tapCount; ++t)
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(row + indices[t] * 4), _mm_set1_ps(weights[t])));
+
+            // Rounds, and saturates the overshoot of the sinc lobes
+            __m128i texel = _mm_cvtps_epi32(acc);
+            texel = _mm_packs_epi32(texel, texel);
+            texel = _mm_packus_epi16(texel, texel);
+            *(i32*)(dst + x * 4) = _mm_cvtsi128_si32(texel);
+            continue;
+        }
+#endif
+        for (i32 c = 0; c < nchannels; ++c)
+        {
+            f32 acc = 0.0f;
+            for (u32 t = 0; t < taps.tapCount; ++t)
+                acc += row[indices[t] * nchannels + c] * weights[t];
+            dst[x * nchannels + c] = (u8)glm::clamp(acc + 0.5f, 0.0f, 255.0f);
+        }
+    }
+}
+
+static void BuildMipLevel(const u8* src, ivec2 srcSize, u8* dst, ivec2 dstSize, i32 nchannels, TextureMipFilter mipFilter)
+{
+    const MipFilterTaps horizontal = ComputeMipFilterTaps(srcSize.x, dstSize.x, mipFilter);
+    const MipFilterTaps vertical   = ComputeMipFilterTaps(srcSize.y, dstSize.y, mipFilter);
+
+    const u32 srcStride = srcSize.x * nchannels;
+    const u32 dstStride = dstSize.x * nchannels;
+    const u32 jobCount  = (dstSize.y + TEXTURE_MIP_ROWS_PER_JOB - 1) / TEXTURE_MIP_ROWS_PER_JOB;
+
+    ParallelFor(jobCount, [&](u32 jobIdx) {
+        std::vector<f32> row(srcStride);
+
+        const u32 firstRow = jobIdx * TEXTURE_MIP_ROWS_PER_JOB;
+        const u32 lastRow  = glm::min(firstRow + TEXTURE_MIP_ROWS_PER_JOB, (u32)dstSize.y);
+        for (u32 y = firstRow; y < lastRow; ++y)
+        {
+            std::fill(row.begin(), row.end(), 0.0f);
+            for (u32 t = 0; t < vertical.tapCount; ++t)
+            {
+                const f32 weight = vertical.weights[y * vertical.tapCount + t];
+                if (weight != 0.0f)
+                    AccumulateRow(row.data(), src + vertical.indices[y * vertical.tapCount + t] * srcStride, srcStride, weight);
+            }
+            ResolveRow(dst + y * dstStride, row.data(), dstSize.x, nchannels, horizontal);
+        }
+    });
+}
+
+// Replaces the uncompressed levels with their blocks
+static bool CompressCookedTexture(TextureFormat format, CookedTexture& cooked)
+{
+    CookedTexture result = cooked;
+    result.format   = format;
+    result.dataSize = 0;
+    for (u32 level = 0; level < cooked.levelCount; ++level)
+    {
+        ivec2 levelSize = glm::max(cooked.size >> (i32)level, ivec2(1));
+        result.levelOffsets[level] = result.dataSize;
+        result.levelSizes[level]   = GetCompressedLevelSize(format, levelSize);
+        result.dataSize            = Align(result.dataSize + result.levelSizes[level], 16);
+    }
+
+    result.pixels = (u8*)malloc(result.dataSize);
+    if (!result.pixels)
+        return false;
+    result.data = result.pixels;
+
+    for (u32 level = 0; level < cooked.levelCount; ++level)
+    {
+        ivec2 levelSize = glm::max(cooked.size >> (i32)level, ivec2(1));
+        CompressTextureLevel(format, cooked.data + cooked.levelOffsets[level], levelSize, cooked.nchannels, result.pixels + result.levelOffsets[level]);
+    }
+
+    free(cooked.pixels);
+    cooked = result;
+    return true;
+}
+
+bool CookTexture(const Image& image, TextureMipFilter mipFilter, TextureUsage usage, CookedTexture& cooked)
+{
+    if (!image.pixels || image.nchannels < 1 || image.nchannels > 4)
+        return false;
+
+    // RGB has no 8-bit texel format the hardware stores natively, it is padded to RGBA once here
+    const i32 nchannels = image.nchannels == 3 ? 4 : image.nchannels;
+
+    u32 levelCount = 1;
+    while ((glm::max(image.size.x, image.size.y) >> levelCount) > 0 && levelCount < TEXTURE_CACHE_MAX_LEVELS)
+        levelCount++;
+
+    CookedTexture result = {};
+    result.size       = image.size;
+    result.nchannels  = nchannels;
+    result.levelCount = levelCount;
+    for (u32 level = 0; level < levelCount; ++level)
+    {
+        ivec2 levelSize = glm::max(image.size >> (i32)level, ivec2(1));
+        result.levelOffsets[level] = result.dataSize;
+        result.levelSizes[level]   = levelSize.x * levelSize.y * nchannels;
+        result.dataSize            = Align(result.dataSize + result.levelSizes[level], 16);
+    }
+
+    result.pixels = (u8*)malloc(result.dataSize);
+    if (!result.pixels)
+        return false;
+    result.data = result.pixels;
+
+    // Base level, already flipped by the decoder
+    const u8* srcPixels = (const u8*)image.pixels;
+    for (i32 y = 0; y < image.size.y; ++y)
+    {
+        const u8* src = srcPixels + y * image.stride;
+        u8* dst = result.pixels + y * image.size.x * nchannels;
+        if (image.nchannels == nchannels)
+        {
+            memcpy(dst, src, image.size.x * nchannels);
+            continue;
+        }
+
+        for (i32 x = 0; x < image.size.x; ++x)
+        {
+            dst[x * 4 + 0] = src[x * 3 + 0];
+            dst[x * 4 + 1] = src[x * 3 + 1];
+            dst[x * 4 + 2] = src[x * 3 + 2];
+            dst[x * 4 + 3] = 255;
+        }
+    }
+
+    // Each level is filtered from the previous one
+    for (u32 level = 1; level < levelCount; ++level)
+    {
+        ivec2 srcSize = glm::max(image.size >> (i32)(level - 1), ivec2(1));
+        ivec2 dstSize = glm::max(image.size >> (i32)level, ivec2(1));
+        BuildMipLevel(result.pixels + result.levelOffsets[level - 1], srcSize, result.pixels + result.levelOffsets[level], dstSize, nchannels, mipFilter);
+    }
+
+    // Compressed from the filtered levels, so every level gets its own block endpoints
+    TextureFormat format = ChooseTextureFormat(usage, result.pixels, result.size, nchannels);
+    if (format != TextureFormat_Uncompressed && !CompressCookedTexture(format, result))
+    {
+        free(result.pixels);
+        return false;
+    }
+
+    cooked = result;
+    return true;
+}
+
+static bool IsValidTextureCache(const MappedFile& file, const char* filename, bool flipVertically, TextureUsage usage, u64 sourceHash)
+{
+    if (file.size < sizeof(TextureCacheHeader))
+        return false;
+
+    const TextureCacheHeader* header = (const TextureCacheHeader*)file.data;
+    if (header->magic != TEXTURE_CACHE_MAGIC || header->version != TEXTURE_CACHE_VERSION)
+        return false;
+
+    if (header->sourceHash != sourceHash || header->flipVertically != (u32)flipVertically || header->mipFilter != (u32)TEXTURE_MIP_FILTER)
+        return false;
+
+    if (header->usage != (u32)usage || header->compressionKey != GetTextureCompressionKey() || header->format > TextureFormat_BC5)
+        return false;
+
+    if (strncmp(header->sourcePath, filename, TEXTURE_CACHE_MAX_PATH) != 0)
+        return false;
+
+    if (header->levelCount == 0 || header->levelCount > TEXTURE_CACHE_MAX_LEVELS || (u64)header->dataOffset + header->dataSize > file.size)
+        return false;
+
+    for (u32 level = 0; level < header->levelCount; ++level)
+        if ((u64)header->levelOffsets[level] + header->levelSizes[level] > header->dataSize)
+            return false;
+
+    return true;
+}
+
+// Takes the cache file, mapped or read already, and keeps it in the cooked texture if it is up to date
+static bool ReadTextureCacheFile(const char* filename, bool flipVertically, TextureUsage usage, MappedFile& file, CookedTexture& cooked)
+{
+    if (file.data == NULL)
+        return false;
+
+    u64 sourceHash = GetAssetHash(filename);
+    if (sourceHash == 0 || !IsValidTextureCache(file, filename, flipVertically, usage, sourceHash))
+    {
+        ILOG("Texture cache %s is out of date", GetTextureCachePath(filename, usage).c_str());
+        UnmapFile(file);
+        return false;
+    }
+
+    const TextureCacheHeader* header = (const TextureCacheHeader*)file.data;
+
+    CookedTexture result = {};
+    result.size       = ivec2(header->width, header->height);
+    result.nchannels  = header->nchannels;
+    result.format     = (TextureFormat)header->format;
+    result.levelCount = header->levelCount;
+    memcpy(result.levelOffsets, header->levelOffsets, sizeof(result.levelOffsets));
+    memcpy(result.levelSizes, header->levelSizes, sizeof(result.levelSizes));
+    result.data       = file.data + header->dataOffset;
+    result.dataSize   = header->dataSize;
+    result.file       = file;
+
+    cooked = result;
+    return true;
+}
+
+bool ReadTextureCache(const char* filename, bool flipVertically, TextureUsage usage, CookedTexture& cooked)
+{
+    if (GetAssetHash(filename) == 0)
+        return false;
+
+    MappedFile file = MapFile(GetTextureCachePath(filename, usage).c_str());
+    return ReadTextureCacheFile(filename, flipVertically, usage, file, cooked);
+}
+
+bool WriteTextureCache(const char* filename, bool flipVertically, TextureUsage usage, const CookedTexture& cooked)
+{
+    TextureCacheHeader header = {};
+    header.magic           = TEXTURE_CACHE_MAGIC;
+    header.version         = TEXTURE_CACHE_VERSION;
+    header.sourceHash = GetAssetHash(filename);
+    header.flipVertically  = flipVertically;
+    header.mipFilter       = TEXTURE_MIP_FILTER;
+    header.usage           = usage;
+    header.compressionKey  = GetTextureCompressionKey();
+    header.format          = cooked.format;
+    header.width           = cooked.size.x;
+    header.height          = cooked.size.y;
+    header.nchannels       = cooked.nchannels;
+    header.levelCount      = cooked.levelCount;
+    header.dataOffset      = Align(sizeof(TextureCacheHeader), 16);
+    header.dataSize        = cooked.dataSize;
+    memcpy(header.levelOffsets, cooked.levelOffsets, sizeof(header.levelOffsets));
+    memcpy(header.levelSizes, cooked.levelSizes, sizeof(header.levelSizes));
+
+    u32 len = glm::min((u32)strlen(filename), (u32)TEXTURE_CACHE_MAX_PATH - 1);
+    memcpy(header.sourcePath, filename, len);
+
+    std::string cachePath = GetTextureCachePath(filename, usage);
+    FILE* file = fopen(cachePath.c_str(), "wb");
+    if (!file)
+    {
+        ELOG("fopen() failed writing texture cache %s", cachePath.c_str());
+        return false;
+    }
+
+    // The header is written last, so an interrupted write never looks like a valid cache
+    const u8 zeros[16] = {};
+    TextureCacheHeader emptyHeader = {};
+    fwrite(&emptyHeader, sizeof(emptyHeader), 1, file);
+    fwrite(zeros, 1, header.dataOffset - sizeof(TextureCacheHeader), file);
+    fwrite(cooked.data, 1, cooked.dataSize, file);
+
+    fseek(file, 0, SEEK_SET);
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+    success = (ferror(file) == 0) && success;
+    fclose(file);
+
+    if (!success)
+    {
+        ELOG("Error writing texture cache %s", cachePath.c_str());
+        remove(cachePath.c_str());
+    }
+
+    return success;
+}
+
+// Decodes and cooks a source image read already, and writes its cache
+static bool CookTextureFile(const char* filename, bool flipVertically, TextureUsage usage, const MappedFile& source, CookedTexture& cooked)
+{
+    if (source.data == NULL)
+    {
+        ELOG("Could not open file %s", filename);
+        return false;
+    }
+
+    Image image = LoadImageFromMemory(source.data, (u32)source.size, flipVertically);
+    if (!image.pixels)
+        return false;
+
+    bool success = CookTexture(image, TEXTURE_MIP_FILTER, usage, cooked);
+    FreeImage(image);
+
+    // Sources that cannot be hashed could never validate their cache
+    if (success && GetAssetHash(filename) != 0)
+        WriteTextureCache(filename, flipVertically, usage, cooked);
+
+    return success;
+}
+
+bool LoadCookedTexture(const char* filename, bool flipVertically, TextureUsage usage, CookedTexture& cooked)
+{
+    if (ReadTextureCache(filename, flipVertically, usage, cooked))
+        return true;
+
+    MappedFile source = MapFile(filename);
+    bool success = CookTextureFile(filename, flipVertically, usage, source, cooked);
+    UnmapFile(source);
+    return success;
+}
+
+void LoadCookedTextureAsync(const char* filename, bool flipVertically, TextureUsage usage, const CookedTextureCallback& onLoaded)
+{
+    std::string path = filename;
+    ReadFileAsync(GetTextureCachePath(filename, usage).c_str(), [path, flipVertically, usage, onLoaded](MappedFile& cacheFile) {
+        CookedTexture cooked = {};
+        if (ReadTextureCacheFile(path.c_str(), flipVertically, usage, cacheFile, cooked))
+        {
+            onLoaded(cooked);
+            return;
+        }
+
+        // Missing or stale cache, the source is read in turn
+        ReadFileAsync(path.c_str(), [path, flipVertically, usage, onLoaded](MappedFile& source) {
+            CookedTexture cooked = {};
+            CookTextureFile(path.c_str(), flipVertically, usage, source, cooked);
+            UnmapFile(source);
+            onLoaded(cooked);
+        });
+    });
+}
+
+void ReleaseCookedTexture(CookedTexture& cooked)
+{
+    free(cooked.pixels);
+    UnmapFile(cooked.file);
+    cooked.pixels = NULL;
+    cooked.data   = NULL;
+    cooked.file   = MappedFile{};
+}
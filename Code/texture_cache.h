@@ -0,0 +1,101 @@
+//
+// texture_cache.h: Cooked textures. Source images are decoded once, flipped, expanded from RGB
+// to RGBA, given their full mip chain (filtered on the worker threads) and block compressed
+// for their usage, then saved next to the source so later runs map the file and upload its
+// levels as they are.
+//
+
+#pragma once
+
+#include "engine.h"
+#include "texture_compression.h"
+
+#define TEXTURE_CACHE_MAGIC             0x58544D47 // "GMTX"
+#define TEXTURE_CACHE_VERSION           4
+#define TEXTURE_CACHE_EXTENSION         ".texcache"
+#define TEXTURE_CACHE_VIRTUAL_EXTENSION ".vtcache" // Virtual textures are cooked apart, so the same image can also be streamed
+#define TEXTURE_CACHE_MAX_PATH          256
+#define TEXTURE_CACHE_MAX_LEVELS        16
+
+#define TEXTURE_KAISER_WIDTH 2.0f // Filter radius, in texels of the destination level
+#define TEXTURE_KAISER_ALPHA 4.0f // Window sharpness (higher is smoother, with less ringing)
+
+enum TextureMipFilter
+{
+    TextureMipFilter_Box,    // Average of the source texels covered by each destination texel
+    TextureMipFilter_Kaiser, // Kaiser windowed sinc, sharper mips for a few more taps
+};
+
+#define TEXTURE_MIP_FILTER TextureMipFilter_Kaiser
+
+// On-disk layout:
+// [TextureCacheHeader][level 0][level 1]... each level tightly packed and 16-byte aligned
+struct TextureCacheHeader
+{
+    u32  magic;
+    u32  version;
+    u64  sourceHash;     // GetAssetHash() of the source
+    u32  flipVertically;
+    u32  mipFilter;
+    u32  usage;          // TextureUsage
+    u32  compressionKey; // GetTextureCompressionKey() when cooked
+    u32  format;         // TextureFormat
+    i32  width;
+    i32  height;
+    i32  nchannels;
+    u32  levelCount;
+    u32  dataOffset;
+    u32  dataSize;
+    u32  levelOffsets[TEXTURE_CACHE_MAX_LEVELS]; // Relative to the data
+    u32  levelSizes[TEXTURE_CACHE_MAX_LEVELS];
+    char sourcePath[TEXTURE_CACHE_MAX_PATH];
+};
+
+// A texture with all its mip levels, ready to be uploaded
+struct CookedTexture
+{
+    ivec2         size;
+    i32           nchannels;                              // 1, 2 or 4 (RGB is expanded to RGBA) before compression
+    TextureFormat format;
+    u32           levelCount;
+    u32           levelOffsets[TEXTURE_CACHE_MAX_LEVELS]; // Relative to data
+    u32           levelSizes[TEXTURE_CACHE_MAX_LEVELS];
+    const u8*     data;                                   // All the levels, back to back
+    u32           dataSize;
+    u8*           pixels;                                 // Owned copy of the data, if cooked in memory
+    MappedFile    file;                                   // Mapped cache, if read from it
+};
+
+/**
+ * Builds a cooked texture from a decoded image. The mip levels are filtered, then compressed in the
+ * format ChooseTextureFormat() picks for the usage, on the worker threads.
+ */
+bool CookTexture(const Image& image, TextureMipFilter mipFilter, TextureUsage usage, CookedTexture& cooked);
+
+/**
+ * Maps the cache of a source image if it is up to date (same source contents, flip, mip filter, usage
+ * and compression support). On success, cooked.data points into the mapped file.
+ */
+bool ReadTextureCache(const char* filename, bool flipVertically, TextureUsage usage, CookedTexture& cooked);
+
+bool WriteTextureCache(const char* filename, bool flipVertically, TextureUsage usage, const CookedTexture& cooked);
+
+/**
+ * Reads a texture from its cache or, if it is missing or stale, decodes and cooks the source
+ * image and writes the cache. Can run on any thread.
+ */
+bool LoadCookedTexture(const char* filename, bool flipVertically, TextureUsage usage, CookedTexture& cooked);
+
+typedef std::function<void(CookedTexture& cooked)> CookedTextureCallback;
+
+/**
+ * Same as LoadCookedTexture(), with the cache (and the source, if the cache is stale) read by
+ * ReadFileAsync(). onLoaded runs on a worker thread, with a NULL data pointer on failure, and
+ * owns the cooked texture.
+ */
+void LoadCookedTextureAsync(const char* filename, bool flipVertically, TextureUsage usage, const CookedTextureCallback& onLoaded);
+
+/**
+ * Frees (or unmaps) the levels. The size and level layout stay valid, with data set to NULL.
+ */
+void ReleaseCookedTexture(CookedTexture& cooked);
@@ -0,0 +1,343 @@
+#include "texture_compression.h"
+#include "job_system.h"
+#include "texture_atlas.h"
+
+#include <algorithm>
+#include <float.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define TEXTURE_COMPRESSION_SSE2
+#include <emmintrin.h>
+#endif
+
+#define BLOCK_TEXEL_COUNT (TEXTURE_BLOCK_SIZE * TEXTURE_BLOCK_SIZE)
+
+struct TextureCompressionSupport
+{
+    bool s3tc; // BC1 and BC3
+};
+
+static TextureCompressionSupport GlobalTextureCompressionSupport;
+
+void InitTextureCompression(App* app)
+{
+    const std::vector<std::string>& extensions = app->openglInfo.extensions;
+    GlobalTextureCompressionSupport.s3tc = std::find(extensions.begin(), extensions.end(), "GL_EXT_texture_compression_s3tc") != extensions.end();
+
+    if (!GlobalTextureCompressionSupport.s3tc)
+        ILOG("GL_EXT_texture_compression_s3tc is not supported, color textures stay uncompressed");
+}
+
+u32 GetTextureCompressionKey()
+{
+    return GlobalTextureCompressionSupport.s3tc ? 1 : 0;
+}
+
+TextureFormat ChooseTextureFormat(TextureUsage usage, const u8* pixels, ivec2 size, i32 nchannels)
+{
+    // Small textures are copied into the texture atlas, which only holds uncompressed texels
+    if (usage != TextureUsage_Virtual && CanAtlasTexture(size))
+        return TextureFormat_Uncompressed;
+
+    switch (usage)
+    {
+        case TextureUsage_Color:
+        {
+            // Gray images keep their single channel, sampled as before
+            if (nchannels != 4 || !GlobalTextureCompressionSupport.s3tc)
+                return TextureFormat_Uncompressed;
+
+            for (i32 i = 0; i < size.x * size.y; ++i)
+                if (pixels[i * 4 + 3] != 255)
+                    return TextureFormat_BC3;
+            return TextureFormat_BC1;
+        }
+        case TextureUsage_Mask:
+            return TextureFormat_BC4;
+        case TextureUsage_Normals:
+            return nchannels >= 2 ? TextureFormat_BC5 : TextureFormat_Uncompressed;
+        case TextureUsage_Virtual:
+            return TextureFormat_Uncompressed;
+        default:
+            return TextureFormat_Uncompressed;
+    }
+}
+
+u32 GetCompressedLevelSize(TextureFormat format, ivec2 size)
+{
+    u32 blockBytes = (format == TextureFormat_BC1 || format == TextureFormat_BC4) ? 8 : 16;
+    u32 blocksX = (glm::max(size.x, 1) + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+    u32 blocksY = (glm::max(size.y, 1) + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+    return blocksX * blocksY * blockBytes;
+}
+
+GLenum GetTextureFormatGL(TextureFormat format)
+{
+    switch (format)
+    {
+        case TextureFormat_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case TextureFormat_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case TextureFormat_BC4: return GL_COMPRESSED_RED_RGTC1;
+        case TextureFormat_BC5: return GL_COMPRESSED_RG_RGTC2;
+        default:                return GL_NONE;
+    }
+}
+
+// Copies a 4x4 block as RGBA, repeating the last row and column past the edges
+static void FetchBlock(const u8* pixels, ivec2 size, i32 nchannels, u32 blockX, u32 blockY, u8 texels[BLOCK_TEXEL_COUNT][4])
+{
+    for (u32 y = 0; y < TEXTURE_BLOCK_SIZE; ++y)
+    {
+        i32 py = glm::min((i32)(blockY * TEXTURE_BLOCK_SIZE + y), size.y - 1);
+        for (u32 x = 0; x < TEXTURE_BLOCK_SIZE; ++x)
+        {
+            i32 px = glm::min((i32)(blockX * TEXTURE_BLOCK_SIZE + x), size.x - 1);
+            const u8* src = pixels + (py * size.x + px) * nchannels;
+
+            u8* texel = texels[y * TEXTURE_BLOCK_SIZE + x];
+            texel[0] = src[0];
+            texel[1] = nchannels > 1 ? src[1] : 0;
+            texel[2] = nchannels > 2 ? src[2] : 0;
+            texel[3] = nchannels > 3 ? src[3] : 255;
+        }
+    }
+}
+
+static u16 PackColor565(vec3 color)
+{
+    color = glm::clamp(color, vec3(0.0f), vec3(255.0f));
+    u32 r = (u32)(color.r * 31.0f / 255.0f + 0.5f);
+    u32 g = (u32)(color.g * 63.0f / 255.0f + 0.5f);
+    u32 b = (u32)(color.b * 31.0f / 255.0f + 0.5f);
+    return (u16)((r << 11) | (g << 5) | b);
+}
+
+static vec3 UnpackColor565(u16 color)
+{
+    u32 r = (color >> 11) & 31;
+    u32 g = (color >> 5) & 63;
+    u32 b = color & 31;
+    return vec3((f32)((r << 3) | (r >> 2)), (f32)((g << 2) | (g >> 4)), (f32)((b << 3) | (b >> 2)));
+}
+
+// Picks the nearest of the 4 palette colors for each texel and returns the total squared error
+static f32 FitColorIndices(const f32* r, const f32* g, const f32* b, const vec3 palette[4], u32 indices[BLOCK_TEXEL_COUNT])
+{
+    f32 error = 0.0f;
+#ifdef TEXTURE_COMPRESSION_SSE2
+    // Four texels at a time, against every palette entry
+    __m128 errorSum = _mm_setzero_ps();
+    for (u32 i = 0; i < BLOCK_TEXEL_COUNT; i += 4)
+    {
+        const __m128 tr = _mm_loadu_ps(r + i);
+        const __m128 tg = _mm_loadu_ps(g + i);
+        const __m128 tb = _mm_loadu_ps(b + i);
+
+        __m128 best = _mm_set1_ps(FLT_MAX);
+        __m128i bestIdx = _mm_setzero_si128();
+        for (u32 k = 0; k < 4; ++k)
+        {
+            __m128 dr = _mm_sub_ps(tr, _mm_set1_ps(palette[k].r));
+            __m128 dg = _mm_sub_ps(tg, _mm_set1_ps(palette[k].g));
+            __m128 db = _mm_sub_ps(tb, _mm_set1_ps(palette[k].b));
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+
+            __m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, best));
+            bestIdx = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(k)), _mm_andnot_si128(closer, bestIdx));
+            best = _mm_min_ps(best, d);
+        }
+
+        _mm_storeu_si128((__m128i*)(indices + i), bestIdx);
+        errorSum = _mm_add_ps(errorSum, best);
+    }
+
+    f32 errors[4];
+    _mm_storeu_ps(errors, errorSum);
+    error = errors[0] + errors[1] + errors[2] + errors[3];
+#else
+    for (u32 i = 0; i < BLOCK_TEXEL_COUNT; ++i)
+    {
+        f32 best = FLT_MAX;
+        for (u32 k = 0; k < 4; ++k)
+        {
+            vec3 d = vec3(r[i], g[i], b[i]) - palette[k];
+            f32 distance = glm::dot(d, d);
+            if (distance < best)
+            {
+                best = distance;
+                indices[i] = k;
+            }
+        }
+        error += best;
+    }
+#endif
+    return error;
+}
+
+// Endpoints are always ordered for the 4-color mode (also the only one of the BC3 color block)
+static f32 EvaluateColorEndpoints(const f32* r, const f32* g, const f32* b, vec3 endpoint0, vec3 endpoint1, u16& color0, u16& color1, u32 indices[BLOCK_TEXEL_COUNT])
+{
+    color0 = PackColor565(endpoint0);
+    color1 = PackColor565(endpoint1);
+    if (color0 < color1)
+        std::swap(color0, color1);
+
+    vec3 palette[4];
+    palette[0] = UnpackColor565(color0);
+    palette[1] = UnpackColor565(color1);
+    palette[2] = (2.0f * palette[0] + palette[1]) / 3.0f;
+    palette[3] = (palette[0] + 2.0f * palette[1]) / 3.0f;
+
+    return FitColorIndices(r, g, b, palette, indices);
+}
+
+static void EncodeColorBlock(const u8 texels[BLOCK_TEXEL_COUNT][4], u8* dst)
+{
+    f32 r[BLOCK_TEXEL_COUNT], g[BLOCK_TEXEL_COUNT], b[BLOCK_TEXEL_COUNT];
+    vec3 mean = vec3(0.0f);
+    for (u32 i = 0; i < BLOCK_TEXEL_COUNT; ++i)
+    {
+        r[i] = texels[i][0];
+        g[i] = texels[i][1];
+        b[i] = texels[i][2];
+        mean += vec3(r[i], g[i], b[i]);
+    }
+    mean /= (f32)BLOCK_TEXEL_COUNT;
+
+    // Principal axis of the colors (power iteration on the covariance matrix)
+    glm::mat3 covariance = glm::mat3(0.0f);
+    for (u32 i = 0; i < BLOCK_TEXEL_COUNT; ++i)
+    {
+        vec3 d = vec3(r[i], g[i], b[i]) - mean;
+        covariance += glm::outerProduct(d, d);
+    }
+
+    vec3 axis = vec3(1.0f);
+    for (u32 iteration = 0; iteration < 8; ++iteration)
+    {
+        vec3 next = covariance * axis;
+        f32 length = glm::length(next);
+        if (length < 1e-4f)
+            break;
+        axis = next / length;
+    }
+
+    // Extremes along the axis, inset a little since the palette ends are rarely the best fit
+    f32 minProjection = FLT_MAX;
+    f32 maxProjection = -FLT_MAX;
+    for (u32 i = 0; i < BLOCK_TEXEL_COUNT; ++i)
+    {
+        f32 projection = glm::dot(vec3(r[i], g[i], b[i]) - mean, axis);
+        minProjection = glm::min(minProjection, projection);
+        maxProjection = glm::max(maxProjection, projection);
+    }
+    f32 inset = (maxProjection - minProjection) / 16.0f;
+    vec3 endpoint0 = mean + axis * (maxProjection - inset);
+    vec3 endpoint1 = mean + axis * (minProjection + inset);
+
+    u16 color0, color1;
+    u32 indices[BLOCK_TEXEL_COUNT];
+    f32 error = EvaluateColorEndpoints(r, g, b, endpoint0, endpoint1, color0, color1, indices);
+
+    // One least squares refinement of the endpoints for the chosen indices
+    if (color0 != color1)
+    {
+        static const f32 weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        f32 aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        vec3 ax = vec3(0.0f), bx = vec3(0.0f);
+        for (u32 i = 0; i < BLOCK_TEXEL_COUNT; ++i)
+        {
+            f32 alpha = weights[indices[i]];
+            f32 beta = 1.0f - alpha;
+            vec3 color = vec3(r[i], g[i], b[i]);
+            aa += alpha * alpha;
+            ab += alpha * beta;
+            bb += beta * beta;
+            ax += alpha * color;
+            bx += beta * color;
+        }
+
+        f32 determinant = aa * bb - ab * ab;
+        if (fabsf(determinant) > 1e-6f)
+        {
+            vec3 refined0 = (bb * ax - ab * bx) / determinant;
+            vec3 refined1 = (aa * bx - ab * ax) / determinant;
+
+            u16 refinedColor0, refinedColor1;
+            u32 refinedIndices[BLOCK_TEXEL_COUNT];
+            f32 refinedError = EvaluateColorEndpoints(r, g, b, refined0, refined1, refinedColor0, refinedColor1, refinedIndices);
+            if (refinedError < error)
+            {
+                color0 = refinedColor0;
+                color1 = refinedColor1;
+                memcpy(indices, refinedIndices, sizeof(indices));
+            }
+        }
+    }
+
+    u32 indexBits = 0;
+    if (color0 != color1)
+        for (u32 i = 0; i < BLOCK_TEXEL_COUNT; ++i)
+            indexBits |= indices[i] << (2 * i);
+
+    dst[0] = (u8)(color0 & 0xFF);
+    dst[1] = (u8)(color0 >> 8);
+    dst[2] = (u8)(color1 & 0xFF);
+    dst[3] = (u8)(color1 >> 8);
+    memcpy(dst + 4, &indexBits, sizeof(indexBits));
+}
+
+// BC4 block of one channel, in its 8 value mode (endpoint0 > endpoint1)
+static void EncodeChannelBlock(const u8 texels[BLOCK_TEXEL_COUNT][4], u32 channel, u8* dst)
+{
+    u8 minValue = 255;
+    u8 maxValue = 0;
+    for (u32 i = 0; i < BLOCK_TEXEL_COUNT; ++i)
+    {
+        minValue = glm::min(minValue, texels[i][channel]);
+        maxValue = glm::max(maxValue, texels[i][channel]);
+    }
+
+    u64 indexBits = 0;
+    if (maxValue > minValue)
+    {
+        const f32 scale = 7.0f / (f32)(maxValue - minValue);
+        for (u32 i = 0; i < BLOCK_TEXEL_COUNT; ++i)
+        {
+            // Steps up from the minimum, mapped to the codes: 0 is the maximum, 1 the minimum, 2..7 in between
+            u32 step = (u32)((texels[i][channel] - minValue) * scale + 0.5f);
+            u64 code = step == 7 ? 0 : step == 0 ? 1 : 8 - step;
+            indexBits |= code << (3 * i);
+        }
+    }
+
+    dst[0] = maxValue;
+    dst[1] = minValue;
+    for (u32 i = 0; i < 6; ++i)
+        dst[2 + i] = (u8)(indexBits >> (8 * i));
+}
+
+void CompressTextureLevel(TextureFormat format, const u8* pixels, ivec2 size, i32 nchannels, u8* dst)
+{
+    const u32 blockBytes = (format == TextureFormat_BC1 || format == TextureFormat_BC4) ? 8 : 16;
+    const u32 blocksX = (size.x + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+    const u32 blocksY = (size.y + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+
+    ParallelFor(blocksY, [&](u32 blockY) {
+        u8 texels[BLOCK_TEXEL_COUNT][4];
+        for (u32 blockX = 0; blockX < blocksX; ++blockX)
+        {
+            FetchBlock(pixels, size, nchannels, blockX, blockY, texels);
+
+            u8* block = dst + (blockY * blocksX + blockX) * blockBytes;
+            switch (format)
+            {
+                case TextureFormat_BC1: EncodeColorBlock(texels, block); break;
+                case TextureFormat_BC3: EncodeChannelBlock(texels, 3, block); EncodeColorBlock(texels, block + 8); break;
+                case TextureFormat_BC4: EncodeChannelBlock(texels, 0, block); break;
+                case TextureFormat_BC5: EncodeChannelBlock(texels, 0, block); EncodeChannelBlock(texels, 1, block + 8); break;
+                default: ASSERT(false, "Not a block compressed format");
+            }
+        }
+    });
+}
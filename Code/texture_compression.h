@@ -0,0 +1,61 @@
+//
+// texture_compression.h: CPU block compression of cooked textures. Color maps become BC1 (or BC3
+// with alpha), single-channel masks BC4 and normal maps BC5, encoded in 4x4 blocks across the
+// worker threads so they take 4-8x less video memory and bandwidth.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+#define TEXTURE_BLOCK_SIZE 4
+
+// What a texture holds, which decides how it can be compressed
+enum TextureUsage
+{
+    TextureUsage_Color,   // Albedo, emissive: BC1, or BC3 if any texel is translucent
+    TextureUsage_Mask,    // Specular, bump, any single-channel map sampled through .r: BC4
+    TextureUsage_Normals, // Tangent space normals: BC5 keeps X and Y, Z is rebuilt when sampled
+    TextureUsage_Virtual, // Paged into the virtual texture atlas, whose pages are all RGBA8: uncompressed
+};
+
+enum TextureFormat
+{
+    TextureFormat_Uncompressed, // 8 bits per channel, 1, 2 or 4 channels
+    TextureFormat_BC1,          // RGB, 8 bytes per block
+    TextureFormat_BC3,          // RGBA, 16 bytes per block
+    TextureFormat_BC4,          // R, 8 bytes per block
+    TextureFormat_BC5,          // RG, 16 bytes per block
+};
+
+/**
+ * Checks which compressed formats the context can sample (BC4/BC5 are core, BC1/BC3 need
+ * EXT_texture_compression_s3tc). Must be called on the main thread before any texture is cooked.
+ */
+void InitTextureCompression(App* app);
+
+/**
+ * Identifies the formats the current context allows, so cooked textures can tell whether they
+ * were compressed under the same conditions.
+ */
+u32 GetTextureCompressionKey();
+
+/**
+ * Picks the format for a texture of the given usage with the given uncompressed base level.
+ */
+TextureFormat ChooseTextureFormat(TextureUsage usage, const u8* pixels, ivec2 size, i32 nchannels);
+
+u32 GetCompressedLevelSize(TextureFormat format, ivec2 size);
+
+GLenum GetTextureFormatGL(TextureFormat format);
+
+/**
+ * Encodes one level of tightly packed pixels (1, 2 or 4 channels). Blocks on the right and bottom
+ * edges repeat their last texels. dst must hold GetCompressedLevelSize() bytes.
+ */
+void CompressTextureLevel(TextureFormat format, const u8* pixels, ivec2 size, i32 nchannels, u8* dst);
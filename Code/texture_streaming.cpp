@@ -0,0 +1,607 @@
+#include "texture_streaming.h"
+#include "buffer_management.h"
+#include "job_system.h"
+#include "residency.h"
+#include "texture_atlas.h"
+#include "texture_cache.h"
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+
+#define TEXTURE_STAGING_ALIGNMENT 16
+
+struct TextureUpload
+{
+    u32           texIdx;
+    u32           firstLevel;    // Levels [firstLevel, lastLevel) of the cooked texture are uploaded
+    u32           lastLevel;
+    bool          firstUpload;   // Brings the cooked texture along, later uploads only read from it
+    CookedTexture cooked;
+    u32           stagingOffset; // UINT32_MAX while the levels are not staged
+    u32           stagingSize;
+    u64           stagingId;
+};
+
+// Mip residency of a streamed texture (main thread only)
+struct ResidentTexture
+{
+    CookedTexture cooked;                                 // Every level, to stream in the finer ones (mapped cache or owned pixels)
+    u32           residentLevel;                          // levelCount while only the placeholder is bound
+    bool          loading;                                // Finer levels are on their way
+    f64           lastNeeded[TEXTURE_CACHE_MAX_LEVELS];   // When each level was last the one a visible entity needed
+};
+
+struct StagingAllocation
+{
+    u64  id;
+    u32  end;      // Where the ring tail moves once this allocation (and all the previous ones) is released
+    bool released;
+};
+
+struct StagingFence
+{
+    GLsync           fence;
+    std::vector<u64> allocationIds; // Copied into their textures once the fence signals
+};
+
+struct TextureStreamer
+{
+    std::mutex                    mutex;
+    Buffer                        stagingBuffer;      // Pixel unpack buffer, persistently mapped so the workers fill it
+    u32                           stagingHead;
+    u32                           stagingTail;
+    u64                           nextStagingId;
+    std::deque<StagingAllocation> stagingAllocations; // In allocation order
+    std::vector<TextureUpload>    decoded;            // Waiting to be finalized, staged or not
+    std::vector<StagingFence>     fences;             // Oldest first (main thread only)
+    std::vector<u32>              pendingTextures;    // Requested and not finalized yet (main thread only)
+    std::vector<ResidentTexture>  residentTextures;   // Indexed by texture (main thread only)
+    u64                           residentBytes;
+    f64                           time;
+};
+
+static TextureStreamer GlobalTextureStreamer;
+
+// Allocates from the staging ring, or returns UINT32_MAX if there is no room. The mutex must be held.
+static u32 AllocateStaging(u32 size, u64& id)
+{
+    TextureStreamer& streamer = GlobalTextureStreamer;
+    const u32 capacity = streamer.stagingBuffer.size;
+
+    size = Align(size, TEXTURE_STAGING_ALIGNMENT);
+    if (size > capacity)
+        return UINT32_MAX;
+
+    if (streamer.stagingAllocations.empty())
+        streamer.stagingHead = streamer.stagingTail = 0;
+
+    const u32 head = streamer.stagingHead;
+    const u32 tail = streamer.stagingTail;
+
+    u32 offset = UINT32_MAX;
+    if (streamer.stagingAllocations.empty() || head > tail)
+    {
+        // Free space after the head and before the tail; wrapping leaves the end unused until the tail passes it
+        if (capacity - head >= size)
+            offset = head;
+        else if (tail >= size)
+            offset = 0;
+    }
+    else if (head < tail && tail - head >= size)
+    {
+        offset = head;
+    }
+
+    if (offset == UINT32_MAX)
+        return UINT32_MAX;
+
+    id = streamer.nextStagingId++;
+    streamer.stagingHead = offset + size;
+    streamer.stagingAllocations.push_back(StagingAllocation{ id, offset + size, false });
+    return offset;
+}
+
+// Allocations can be released in any order, the tail only moves past the oldest ones. The mutex must be held.
+static void ReleaseStaging(u64 id)
+{
+    TextureStreamer& streamer = GlobalTextureStreamer;
+    for (u32 i = 0; i < streamer.stagingAllocations.size(); ++i)
+        if (streamer.stagingAllocations[i].id == id)
+            streamer.stagingAllocations[i].released = true;
+
+    while (!streamer.stagingAllocations.empty() && streamer.stagingAllocations.front().released)
+    {
+        streamer.stagingTail = streamer.stagingAllocations.front().end;
+        streamer.stagingAllocations.pop_front();
+    }
+}
+
+static ivec2 GetLevelSize(ivec2 size, u32 level)
+{
+    return glm::max(size >> (i32)level, ivec2(1));
+}
+
+// Bytes of levels [firstLevel, lastLevel), which are contiguous in the cooked data
+static u32 GetLevelRangeSize(const CookedTexture& cooked, u32 firstLevel, u32 lastLevel)
+{
+    if (firstLevel >= lastLevel)
+        return 0;
+    return cooked.levelOffsets[lastLevel - 1] + cooked.levelSizes[lastLevel - 1] - cooked.levelOffsets[firstLevel];
+}
+
+// First level small enough to be loaded along with the texture
+static u32 GetMipTailLevel(const CookedTexture& cooked)
+{
+    u32 level = 0;
+    while (level + 1 < cooked.levelCount && glm::max(cooked.size.x, cooked.size.y) >> level > TEXTURE_MIP_TAIL_SIZE)
+        level++;
+    return level;
+}
+
+// Runs on a worker: copies the levels to upload into the staging buffer if there is room, and hands them to the main thread
+static void StageTexture(TextureUpload upload)
+{
+    TextureStreamer& streamer = GlobalTextureStreamer;
+
+    if (upload.cooked.data && streamer.stagingBuffer.data)
+    {
+        const u32 size = GetLevelRangeSize(upload.cooked, upload.firstLevel, upload.lastLevel);
+        {
+            std::lock_guard<std::mutex> lock(streamer.mutex);
+            upload.stagingOffset = AllocateStaging(size, upload.stagingId);
+        }
+
+        if (upload.stagingOffset != UINT32_MAX)
+        {
+            memcpy((u8*)streamer.stagingBuffer.data + upload.stagingOffset, upload.cooked.data + upload.cooked.levelOffsets[upload.firstLevel], size);
+            upload.stagingSize = size;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(streamer.mutex);
+    streamer.decoded.push_back(upload);
+}
+
+// Runs on a worker: the cooked texture is kept as the source of the finer levels, only the mip tail goes to the GPU now
+static void StageCookedTexture(u32 texIdx, const CookedTexture& cooked)
+{
+    TextureUpload upload = {};
+    upload.texIdx = texIdx;
+    upload.firstUpload = true;
+    upload.cooked = cooked;
+    upload.stagingOffset = UINT32_MAX;
+    if (cooked.data)
+    {
+        upload.firstLevel = GetMipTailLevel(cooked);
+        upload.lastLevel = cooked.levelCount;
+    }
+    StageTexture(upload);
+}
+
+void InitTextureStreaming()
+{
+    TextureStreamer& streamer = GlobalTextureStreamer;
+    streamer.stagingBuffer = CreatePersistentBuffer(TEXTURE_STAGING_BUFFER_SIZE, GL_PIXEL_UNPACK_BUFFER);
+    streamer.stagingHead = 0;
+    streamer.stagingTail = 0;
+    streamer.nextStagingId = 0;
+    streamer.residentBytes = 0;
+    streamer.time = 0.0;
+}
+
+void ShutdownTextureStreaming()
+{
+    TextureStreamer& streamer = GlobalTextureStreamer;
+
+    for (u32 i = 0; i < streamer.decoded.size(); ++i)
+        if (streamer.decoded[i].firstUpload)
+            ReleaseCookedTexture(streamer.decoded[i].cooked);
+
+    for (u32 i = 0; i < streamer.residentTextures.size(); ++i)
+        ReleaseCookedTexture(streamer.residentTextures[i].cooked);
+
+    for (u32 i = 0; i < streamer.fences.size(); ++i)
+        glDeleteSync(streamer.fences[i].fence);
+
+    DestroyPersistentBuffer(streamer.stagingBuffer);
+
+    streamer.stagingAllocations.clear();
+    streamer.decoded.clear();
+    streamer.fences.clear();
+    streamer.pendingTextures.clear();
+    streamer.residentTextures.clear();
+}
+
+/**
+ * Creates the storage for levels [firstLevel, levelCount) of a cooked texture. The levels the
+ * previous storage has (from previousFirstLevel on) are copied on the GPU, the finer ones come
+ * from data, which holds the levels from firstLevel on (or is their offset in the bound pixel
+ * unpack buffer).
+ */
+static GLuint CreateResidentLevels(const CookedTexture& cooked, u32 firstLevel, const u8* data, GLuint previousHandle, u32 previousFirstLevel)
+{
+    GLenum internalFormat = GetTextureFormatGL(cooked.format);
+    GLenum dataFormat     = GL_RGBA;
+    if (cooked.format == TextureFormat_Uncompressed)
+    {
+        switch (cooked.nchannels)
+        {
+            case 1: dataFormat = GL_RED; internalFormat = GL_R8; break;
+            case 2: dataFormat = GL_RG; internalFormat = GL_RG8; break;
+            default: dataFormat = GL_RGBA; internalFormat = GL_RGBA8; break;
+        }
+    }
+
+    const ivec2 size = GetLevelSize(cooked.size, firstLevel);
+
+    GLuint texHandle;
+    glGenTextures(1, &texHandle);
+    glBindTexture(GL_TEXTURE_2D, texHandle);
+    glTexStorage2D(GL_TEXTURE_2D, cooked.levelCount - firstLevel, internalFormat, size.x, size.y);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (u32 level = firstLevel; level < cooked.levelCount; ++level)
+    {
+        const ivec2 levelSize = GetLevelSize(cooked.size, level);
+        if (previousHandle != 0 && level >= previousFirstLevel)
+        {
+            glCopyImageSubData(previousHandle, GL_TEXTURE_2D, level - previousFirstLevel, 0, 0, 0,
+                               texHandle, GL_TEXTURE_2D, level - firstLevel, 0, 0, 0, levelSize.x, levelSize.y, 1);
+            continue;
+        }
+
+        const u8* levelData = data + (cooked.levelOffsets[level] - cooked.levelOffsets[firstLevel]);
+        if (cooked.format == TextureFormat_Uncompressed)
+            glTexSubImage2D(GL_TEXTURE_2D, level - firstLevel, 0, 0, levelSize.x, levelSize.y, dataFormat, GL_UNSIGNED_BYTE, levelData);
+        else
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, level - firstLevel, 0, 0, levelSize.x, levelSize.y, internalFormat, cooked.levelSizes[level], levelData);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return texHandle;
+}
+
+// Swaps the texture storage for one starting at another level
+static void SetResidentLevel(App* app, u32 texIdx, u32 firstLevel, const u8* data)
+{
+    TextureStreamer& streamer = GlobalTextureStreamer;
+    ResidentTexture& resident = streamer.residentTextures[texIdx];
+    Texture& texture = app->textures[texIdx];
+
+    // Until the first levels arrive, the handle is the placeholder's, which is not ours to delete
+    const bool hasLevels = resident.residentLevel < resident.cooked.levelCount;
+    GLuint handle = CreateResidentLevels(resident.cooked, firstLevel, data, hasLevels ? texture.handle : 0, resident.residentLevel);
+    if (hasLevels)
+    {
+        glDeleteTextures(1, &texture.handle);
+        streamer.residentBytes -= GetLevelRangeSize(resident.cooked, resident.residentLevel, resident.cooked.levelCount);
+    }
+
+    streamer.residentBytes += GetLevelRangeSize(resident.cooked, firstLevel, resident.cooked.levelCount);
+    resident.residentLevel = firstLevel;
+    texture.handle = handle;
+    texture.residentLevel = firstLevel;
+    SetResidentBytes(ResidencyCategory_Textures, texIdx, texture.filepath.c_str(), GetLevelRangeSize(resident.cooked, firstLevel, resident.cooked.levelCount));
+}
+
+static u32 AddStreamedTexture(App* app, const char* filepath, u32 placeholderTexIdx)
+{
+    // The texture samples the placeholder until its own storage is created
+    GLuint placeholderHandle = placeholderTexIdx < app->textures.size() ? app->textures[placeholderTexIdx].handle : 0;
+    u32 texIdx = AddTexture2D(app, filepath, placeholderHandle);
+    GlobalTextureStreamer.pendingTextures.push_back(texIdx);
+    return texIdx;
+}
+
+u32 RequestTexture2D(App* app, const char* filepath, u32 placeholderTexIdx, bool flipVertically, TextureUsage usage)
+{
+    u32 texIdx = FindTexture2D(app, filepath);
+    if (texIdx != UINT32_MAX)
+        return texIdx;
+
+    texIdx = AddStreamedTexture(app, filepath, placeholderTexIdx);
+
+    // The cache is read along with the other requests of the frame, then staged on the worker that gets it
+    LoadCookedTextureAsync(filepath, flipVertically, usage, [texIdx](CookedTexture& cooked) {
+        StageCookedTexture(texIdx, cooked);
+    });
+
+    return texIdx;
+}
+
+u32 RequestTexture2DFromImage(App* app, const char* filepath, Image image, u32 placeholderTexIdx, TextureUsage usage)
+{
+    u32 texIdx = FindTexture2D(app, filepath);
+    if (texIdx != UINT32_MAX)
+    {
+        FreeImage(image);
+        return texIdx;
+    }
+
+    texIdx = AddStreamedTexture(app, filepath, placeholderTexIdx);
+
+    // Images without a source file of their own are cooked every time
+    PushJob([texIdx, image, usage]() {
+        CookedTexture cooked = {};
+        CookTexture(image, TEXTURE_MIP_FILTER, usage, cooked);
+        FreeImage(image);
+        StageCookedTexture(texIdx, cooked);
+    });
+
+    return texIdx;
+}
+
+void RequestTextureDensity(App* app, u32 texIdx, f32 uvUnitsPerPixel)
+{
+    TextureStreamer& streamer = GlobalTextureStreamer;
+    if (texIdx >= streamer.residentTextures.size() || !streamer.residentTextures[texIdx].cooked.data)
+        return;
+
+    // The level whose texels are closest to one per pixel (rounding to the finer one)
+    ResidentTexture& resident = streamer.residentTextures[texIdx];
+    const Texture& texture = app->textures[texIdx];
+    f32 texelsPerPixel = uvUnitsPerPixel * glm::max(texture.size.x, texture.size.y);
+    u32 level = texelsPerPixel > 1.0f ? (u32)floorf(log2f(texelsPerPixel)) : 0;
+    level = glm::min(level, resident.cooked.levelCount - 1);
+
+    resident.lastNeeded[level] = streamer.time;
+}
+
+// Finest level needed in the last TEXTURE_MIP_EVICTION_DELAY seconds, never finer than what the mip tail starts with
+static u32 GetNeededLevel(const ResidentTexture& resident)
+{
+    const u32 tailLevel = GetMipTailLevel(resident.cooked);
+    for (u32 level = 0; level < tailLevel; ++level)
+        if (GlobalTextureStreamer.time - resident.lastNeeded[level] < TEXTURE_MIP_EVICTION_DELAY)
+            return level;
+    return tailLevel;
+}
+
+static void FinalizeUpload(App* app, TextureUpload& upload, const u8* data)
+{
+    TextureStreamer& streamer = GlobalTextureStreamer;
+
+    if (upload.firstUpload)
+    {
+        if (streamer.residentTextures.size() <= upload.texIdx)
+            streamer.residentTextures.resize(upload.texIdx + 1, ResidentTexture{});
+
+        ResidentTexture& resident = streamer.residentTextures[upload.texIdx];
+        resident.cooked = upload.cooked;
+        resident.residentLevel = upload.cooked.levelCount;
+        for (u32 level = 0; level < TEXTURE_CACHE_MAX_LEVELS; ++level)
+            resident.lastNeeded[level] = -TEXTURE_MIP_EVICTION_DELAY;
+
+        Texture& texture = app->textures[upload.texIdx];
+        texture.size = upload.cooked.size;
+        texture.levelCount = upload.cooked.levelCount;
+
+        // Small textures are also sampled from the atlas, copied from the cooked level 0 (data may be a staging offset)
+        if (upload.firstLevel == 0 && upload.cooked.format == TextureFormat_Uncompressed && CanAtlasTexture(upload.cooked.size))
+        {
+            Image image = {};
+            image.pixels = (void*)(upload.cooked.data + upload.cooked.levelOffsets[0]);
+            image.size = upload.cooked.size;
+            image.nchannels = upload.cooked.nchannels;
+            image.stride = upload.cooked.size.x * upload.cooked.nchannels;
+            AddTextureToAtlas(texture, image);
+        }
+    }
+
+    SetResidentLevel(app, upload.texIdx, upload.firstLevel, data);
+    streamer.residentTextures[upload.texIdx].loading = false;
+}
+
+// Streams in the levels visible entities need and, over the budget, drops the ones they stopped needing
+static void UpdateMipResidency(App* app)
+{
+    TextureStreamer& streamer = GlobalTextureStreamer;
+    const u64 budget = (u64)MB((u64)glm::max(app->textureBudgetMB, 0));
+
+    std::vector<u32> evictable;
+    for (u32 texIdx = 0; texIdx < streamer.residentTextures.size(); ++texIdx)
+    {
+        const ResidentTexture& resident = streamer.residentTextures[texIdx];
+        if (resident.cooked.data && !resident.loading && resident.residentLevel < GetNeededLevel(resident))
+            evictable.push_back(texIdx);
+    }
+
+    if (streamer.residentBytes > budget && !evictable.empty())
+    {
+        // Least recently needed first
+        std::sort(evictable.begin(), evictable.end(), [&](u32 a, u32 b) {
+            const ResidentTexture& residentA = streamer.residentTextures[a];
+            const ResidentTexture& residentB = streamer.residentTextures[b];
+            return residentA.lastNeeded[residentA.residentLevel] < residentB.lastNeeded[residentB.residentLevel];
+        });
+
+        for (u32 i = 0; i < evictable.size() && streamer.residentBytes > budget; ++i)
+            SetResidentLevel(app, evictable[i], GetNeededLevel(streamer.residentTextures[evictable[i]]), NULL);
+    }
+
+    u64 requestedBytes = 0;
+    for (u32 texIdx = 0; texIdx < streamer.residentTextures.size(); ++texIdx)
+    {
+        ResidentTexture& resident = streamer.residentTextures[texIdx];
+        if (!resident.cooked.data || resident.loading)
+            continue;
+
+        u32 neededLevel = GetNeededLevel(resident);
+        if (neededLevel >= resident.residentLevel)
+            continue;
+
+        u32 size = GetLevelRangeSize(resident.cooked, neededLevel, resident.residentLevel);
+        if (streamer.residentBytes + requestedBytes + size > budget)
+            continue;
+        requestedBytes += size;
+
+        // A worker stages the finer levels, the ones already resident are copied on the GPU once they land
+        TextureUpload upload = {};
+        upload.texIdx = texIdx;
+        upload.firstLevel = neededLevel;
+        upload.lastLevel = resident.residentLevel;
+        upload.cooked = resident.cooked;
+        upload.stagingOffset = UINT32_MAX;
+        resident.loading = true;
+        PushJob([upload]() { StageTexture(upload); });
+    }
+}
+
+void UpdateTextureStreaming(App* app)
+{
+    TextureStreamer& streamer = GlobalTextureStreamer;
+    streamer.time += app->deltaTime;
+
+    // Staging memory is free again once the GPU has copied it into the textures
+    u32 signaledCount = 0;
+    while (signaledCount < streamer.fences.size())
+    {
+        GLenum status = glClientWaitSync(streamer.fences[signaledCount].fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        signaledCount++;
+    }
+
+    if (signaledCount > 0)
+    {
+        std::lock_guard<std::mutex> lock(streamer.mutex);
+        for (u32 i = 0; i < signaledCount; ++i)
+        {
+            for (u32 j = 0; j < streamer.fences[i].allocationIds.size(); ++j)
+                ReleaseStaging(streamer.fences[i].allocationIds[j]);
+            glDeleteSync(streamer.fences[i].fence);
+        }
+        streamer.fences.erase(streamer.fences.begin(), streamer.fences.begin() + signaledCount);
+    }
+
+    // Take the staged levels that fit in this frame's budget (always at least one upload)
+    std::vector<TextureUpload> uploads;
+    {
+        std::lock_guard<std::mutex> lock(streamer.mutex);
+
+        u32 uploadBytes = 0;
+        u32 uploadCount = 0;
+        while (uploadCount < streamer.decoded.size())
+        {
+            const TextureUpload& upload = streamer.decoded[uploadCount];
+            u32 size = GetLevelRangeSize(upload.cooked, upload.firstLevel, upload.lastLevel);
+            if (uploadCount > 0 && uploadBytes + size > TEXTURE_UPLOAD_BYTES_PER_FRAME)
+                break;
+            uploadBytes += size;
+            uploadCount++;
+        }
+
+        uploads.assign(streamer.decoded.begin(), streamer.decoded.begin() + uploadCount);
+        streamer.decoded.erase(streamer.decoded.begin(), streamer.decoded.begin() + uploadCount);
+    }
+
+    StagingFence fence = {};
+    for (u32 i = 0; i < uploads.size(); ++i)
+    {
+        TextureUpload& upload = uploads[i];
+        const u32 size = GetLevelRangeSize(upload.cooked, upload.firstLevel, upload.lastLevel);
+
+        if (upload.stagingOffset != UINT32_MAX)
+        {
+            // The copy from the staging buffer runs on the GPU timeline
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, streamer.stagingBuffer.handle);
+            FinalizeUpload(app, upload, (const u8*)(u64)upload.stagingOffset);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            fence.allocationIds.push_back(upload.stagingId);
+        }
+        else if (upload.cooked.data && streamer.stagingBuffer.data && size <= streamer.stagingBuffer.size)
+        {
+            // The staging buffer was full, a worker tries again
+            PushJob([upload]() { StageTexture(upload); });
+            continue;
+        }
+        else if (upload.cooked.data)
+        {
+            // Larger than the staging buffer (or no persistent mapping): the driver copies it from client memory
+            FinalizeUpload(app, upload, upload.cooked.data + upload.cooked.levelOffsets[upload.firstLevel]);
+        }
+        else
+        {
+            ELOG("Texture %s failed to stream, it keeps its placeholder", app->textures[upload.texIdx].filepath.c_str());
+        }
+
+        if (upload.firstUpload)
+        {
+            std::vector<u32>& pendingTextures = streamer.pendingTextures;
+            pendingTextures.erase(std::remove(pendingTextures.begin(), pendingTextures.end(), upload.texIdx), pendingTextures.end());
+        }
+    }
+
+    if (!fence.allocationIds.empty())
+    {
+        fence.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        streamer.fences.push_back(fence);
+    }
+
+    UpdateMipResidency(app);
+}
+
+bool IsTextureStreaming(u32 texIdx)
+{
+    const std::vector<u32>& pendingTextures = GlobalTextureStreamer.pendingTextures;
+    return std::find(pendingTextures.begin(), pendingTextures.end(), texIdx) != pendingTextures.end();
+}
+
+u32 GetPendingTextureCount()
+{
+    return (u32)GlobalTextureStreamer.pendingTextures.size();
+}
+
+u64 GetResidentTextureBytes()
+{
+    return GlobalTextureStreamer.residentBytes;
+}
+
+f32 ComputeSubmeshUvDensity(const Submesh& submesh)
+{
+    const VertexBufferAttribute* position = NULL;
+    const VertexBufferAttribute* uv = NULL;
+    for (u32 i = 0; i < submesh.vertexBufferLayout.attributes.size(); ++i)
+    {
+        const VertexBufferAttribute& attribute = submesh.vertexBufferLayout.attributes[i];
+        if (attribute.location == 0 && attribute.type == GL_FLOAT && attribute.componentCount == 3)
+            position = &attribute;
+        if (attribute.location == 2 && attribute.type == GL_FLOAT && attribute.componentCount == 2)
+            uv = &attribute;
+    }
+
+    const u32 stride = submesh.vertexBufferLayout.stride;
+    if (!position || !uv || stride == 0)
+        return 0.0f;
+
+    const u32 vertexCount = (u32)submesh.vertices.size() / stride;
+    f64 objectArea = 0.0;
+    f64 uvArea = 0.0;
+    for (u32 i = 0; i + 2 < submesh.indices.size(); i += 3)
+    {
+        vec3 p[3];
+        vec2 t[3];
+        for (u32 j = 0; j < 3; ++j)
+        {
+            u32 index = submesh.indices[i + j];
+            if (index >= vertexCount)
+                return 0.0f;
+            const u8* vertex = submesh.vertices.data() + (u64)index * stride;
+            memcpy(&p[j], vertex + position->offset, sizeof(vec3));
+            memcpy(&t[j], vertex + uv->offset, sizeof(vec2));
+        }
+
+        vec2 uvEdge0 = t[1] - t[0];
+        vec2 uvEdge1 = t[2] - t[0];
+        objectArea += 0.5 * glm::length(glm::cross(p[1] - p[0], p[2] - p[0]));
+        uvArea += 0.5 * fabsf(uvEdge0.x * uvEdge1.y - uvEdge0.y * uvEdge1.x);
+    }
+
+    return objectArea > 0.0 ? (f32)sqrt(uvArea / objectArea) : 0.0f;
+}
@@ -0,0 +1,64 @@
+//
+// texture_streaming.h: Non-blocking texture loading. Texture caches are read in batches by
+// ReadFileAsync() (their sources decoded and cooked if stale) and, on the worker the read
+// completes on, their mip levels copied into a persistently mapped pixel unpack buffer; the main
+// thread only creates the texture storage and issues the copies from that buffer, fenced so the
+// staging memory can be reused.
+//
+// Textures start with their coarsest levels only. The finer ones are streamed in as the texel
+// density of the entities using them asks for them, and dropped again when over budget.
+//
+
+#pragma once
+
+#include "engine.h"
+#include "texture_compression.h"
+
+#define TEXTURE_STAGING_BUFFER_SIZE MB(64) // Larger images are uploaded from client memory
+#define TEXTURE_UPLOAD_BYTES_PER_FRAME MB(32) // At least one texture is finalized per frame
+#define TEXTURE_MIP_TAIL_SIZE 64 // Levels up to this size are resident as soon as the texture is loaded
+#define TEXTURE_MIP_EVICTION_DELAY 3.0 // Seconds a level is kept after the last frame that needed it
+
+void InitTextureStreaming();
+
+/**
+ * Must be called after ShutdownJobSystem(), once no worker can be writing to the staging buffer.
+ */
+void ShutdownTextureStreaming();
+
+/**
+ * Returns the index of a texture that samples as the placeholder texture until the file has been
+ * cooked in the background (compressed as its usage allows) and uploaded by UpdateTextureStreaming().
+ * Paths that are loaded or requested already return their existing texture.
+ */
+u32 RequestTexture2D(App* app, const char* filepath, u32 placeholderTexIdx, bool flipVertically = false, TextureUsage usage = TextureUsage_Color);
+
+/**
+ * Same as RequestTexture2D() for an image that is decoded already. Takes ownership of the image.
+ */
+u32 RequestTexture2DFromImage(App* app, const char* filepath, Image image, u32 placeholderTexIdx, TextureUsage usage = TextureUsage_Color);
+
+/**
+ * Called once per frame on the main thread. Releases the staging memory the GPU is done with,
+ * finalizes the staged levels within TEXTURE_UPLOAD_BYTES_PER_FRAME, requests the finer levels
+ * that were needed and evicts the ones that were not (while over app->textureBudgetMB).
+ */
+void UpdateTextureStreaming(App* app);
+
+/**
+ * Marks the level that samples uvUnitsPerPixel (UV units covered by a screen pixel) at about one
+ * texel per pixel as needed this frame. Does nothing for textures that are not streamed.
+ */
+void RequestTextureDensity(App* app, u32 texIdx, f32 uvUnitsPerPixel);
+
+bool IsTextureStreaming(u32 texIdx);
+
+u32 GetPendingTextureCount();
+
+u64 GetResidentTextureBytes();
+
+/**
+ * Average UV units per object space unit of a submesh with float positions and UVs, from the
+ * areas of its triangles (0 for other layouts).
+ */
+f32 ComputeSubmeshUvDensity(const Submesh& submesh);
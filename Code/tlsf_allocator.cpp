@@ -0,0 +1,280 @@
+#include "tlsf_allocator.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static u32 FindLastSetBit(u32 value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse(&index, value);
+    return index;
+#else
+    return 31 - __builtin_clz(value);
+#endif
+}
+
+static u32 FindFirstSetBit(u32 value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return index;
+#else
+    return __builtin_ctz(value);
+#endif
+}
+
+// Bin of the blocks of a size: sizes under TLSF_SL_COUNT get one bin each, the rest are split in
+// TLSF_SL_COUNT bins per power of 2
+static void MapBlockSize(u32 size, u32& fl, u32& sl)
+{
+    if (size < TLSF_SL_COUNT)
+    {
+        fl = 0;
+        sl = size;
+    }
+    else
+    {
+        const u32 msb = FindLastSetBit(size);
+        fl = msb - TLSF_SL_LOG2 + 1;
+        sl = (size >> (msb - TLSF_SL_LOG2)) - TLSF_SL_COUNT;
+    }
+}
+
+static u32 CreateBlock(TlsfAllocator& allocator)
+{
+    if (!allocator.unusedBlocks.empty())
+    {
+        u32 block = allocator.unusedBlocks.back();
+        allocator.unusedBlocks.pop_back();
+        return block;
+    }
+
+    allocator.blocks.push_back(TlsfBlock{});
+    return (u32)allocator.blocks.size() - 1u;
+}
+
+static void InsertFreeBlock(TlsfAllocator& allocator, u32 blockIdx)
+{
+    TlsfBlock& block = allocator.blocks[blockIdx];
+    u32 fl, sl;
+    MapBlockSize(block.size, fl, sl);
+
+    block.free = true;
+    block.prevFree = TLSF_INVALID_BLOCK;
+    block.nextFree = allocator.freeLists[fl][sl];
+    if (block.nextFree != TLSF_INVALID_BLOCK)
+        allocator.blocks[block.nextFree].prevFree = blockIdx;
+
+    allocator.freeLists[fl][sl] = blockIdx;
+    allocator.flBitmap |= 1u << fl;
+    allocator.slBitmaps[fl] |= 1u << sl;
+}
+
+static void RemoveFreeBlock(TlsfAllocator& allocator, u32 blockIdx)
+{
+    TlsfBlock& block = allocator.blocks[blockIdx];
+    u32 fl, sl;
+    MapBlockSize(block.size, fl, sl);
+
+    if (block.prevFree != TLSF_INVALID_BLOCK)
+        allocator.blocks[block.prevFree].nextFree = block.nextFree;
+    else
+        allocator.freeLists[fl][sl] = block.nextFree;
+    if (block.nextFree != TLSF_INVALID_BLOCK)
+        allocator.blocks[block.nextFree].prevFree = block.prevFree;
+
+    if (allocator.freeLists[fl][sl] == TLSF_INVALID_BLOCK)
+    {
+        allocator.slBitmaps[fl] &= ~(1u << sl);
+        if (allocator.slBitmaps[fl] == 0)
+            allocator.flBitmap &= ~(1u << fl);
+    }
+
+    block.free = false;
+}
+
+// Absorbs the physical successor of a block (free, and out of its free list already)
+static void MergeNextBlock(TlsfAllocator& allocator, u32 blockIdx)
+{
+    TlsfBlock& block = allocator.blocks[blockIdx];
+    const u32 nextIdx = block.nextPhysical;
+    const TlsfBlock& next = allocator.blocks[nextIdx];
+
+    block.size += next.size;
+    block.nextPhysical = next.nextPhysical;
+    if (block.nextPhysical != TLSF_INVALID_BLOCK)
+        allocator.blocks[block.nextPhysical].prevPhysical = blockIdx;
+    else
+        allocator.lastBlock = blockIdx;
+
+    allocator.unusedBlocks.push_back(nextIdx);
+}
+
+void InitTlsfAllocator(TlsfAllocator& allocator, u32 size)
+{
+    allocator.size = size;
+    allocator.blocks.clear();
+    allocator.unusedBlocks.clear();
+    allocator.flBitmap = 0;
+    allocator.firstBlock = TLSF_INVALID_BLOCK;
+    allocator.lastBlock = TLSF_INVALID_BLOCK;
+    allocator.usedSize = 0;
+    allocator.allocationCount = 0;
+    for (u32 fl = 0; fl < TLSF_FL_COUNT; ++fl)
+    {
+        allocator.slBitmaps[fl] = 0;
+        for (u32 sl = 0; sl < TLSF_SL_COUNT; ++sl)
+            allocator.freeLists[fl][sl] = TLSF_INVALID_BLOCK;
+    }
+
+    if (size == 0)
+        return;
+
+    u32 blockIdx = CreateBlock(allocator);
+    TlsfBlock& block = allocator.blocks[blockIdx];
+    block.offset = 0;
+    block.size = size;
+    block.prevPhysical = TLSF_INVALID_BLOCK;
+    block.nextPhysical = TLSF_INVALID_BLOCK;
+    allocator.firstBlock = blockIdx;
+    allocator.lastBlock = blockIdx;
+    InsertFreeBlock(allocator, blockIdx);
+}
+
+u32 TlsfAllocate(TlsfAllocator& allocator, u32 size)
+{
+    size = glm::max(size, 1u);
+
+    // The size is rounded up to the next bin, so any block in it or above is big enough
+    u64 searchSize = size;
+    if (size >= TLSF_SL_COUNT)
+        searchSize += (1u << (FindLastSetBit(size) - TLSF_SL_LOG2)) - 1u;
+    if (searchSize > UINT32_MAX)
+        return TLSF_INVALID_BLOCK;
+
+    u32 fl, sl;
+    MapBlockSize((u32)searchSize, fl, sl);
+
+    u32 slBitmap = allocator.slBitmaps[fl] & (~0u << sl);
+    if (slBitmap == 0)
+    {
+        const u32 flBitmap = fl + 1 < TLSF_FL_COUNT ? allocator.flBitmap & (~0u << (fl + 1)) : 0;
+        if (flBitmap == 0)
+            return TLSF_INVALID_BLOCK;
+
+        fl = FindFirstSetBit(flBitmap);
+        slBitmap = allocator.slBitmaps[fl];
+    }
+    sl = FindFirstSetBit(slBitmap);
+
+    const u32 blockIdx = allocator.freeLists[fl][sl];
+    RemoveFreeBlock(allocator, blockIdx);
+
+    // The rest of the block stays free
+    if (allocator.blocks[blockIdx].size > size)
+    {
+        const u32 restIdx = CreateBlock(allocator);
+        TlsfBlock& block = allocator.blocks[blockIdx];
+        TlsfBlock& rest = allocator.blocks[restIdx];
+
+        rest.offset = block.offset + size;
+        rest.size = block.size - size;
+        rest.prevPhysical = blockIdx;
+        rest.nextPhysical = block.nextPhysical;
+        if (rest.nextPhysical != TLSF_INVALID_BLOCK)
+            allocator.blocks[rest.nextPhysical].prevPhysical = restIdx;
+        else
+            allocator.lastBlock = restIdx;
+
+        block.size = size;
+        block.nextPhysical = restIdx;
+        InsertFreeBlock(allocator, restIdx);
+    }
+
+    allocator.usedSize += allocator.blocks[blockIdx].size;
+    allocator.allocationCount++;
+    return blockIdx;
+}
+
+void TlsfFree(TlsfAllocator& allocator, u32 blockIdx)
+{
+    ASSERT(!allocator.blocks[blockIdx].free, "Block freed twice");
+    allocator.usedSize -= allocator.blocks[blockIdx].size;
+    allocator.allocationCount--;
+
+    const u32 nextIdx = allocator.blocks[blockIdx].nextPhysical;
+    if (nextIdx != TLSF_INVALID_BLOCK && allocator.blocks[nextIdx].free)
+    {
+        RemoveFreeBlock(allocator, nextIdx);
+        MergeNextBlock(allocator, blockIdx);
+    }
+
+    const u32 prevIdx = allocator.blocks[blockIdx].prevPhysical;
+    if (prevIdx != TLSF_INVALID_BLOCK && allocator.blocks[prevIdx].free)
+    {
+        RemoveFreeBlock(allocator, prevIdx);
+        MergeNextBlock(allocator, prevIdx);
+        blockIdx = prevIdx;
+    }
+
+    InsertFreeBlock(allocator, blockIdx);
+}
+
+bool TlsfMoveBlockDown(TlsfAllocator& allocator, u32 blockIdx)
+{
+    const u32 holeIdx = allocator.blocks[blockIdx].prevPhysical;
+    if (holeIdx == TLSF_INVALID_BLOCK || !allocator.blocks[holeIdx].free)
+        return false;
+
+    RemoveFreeBlock(allocator, holeIdx);
+
+    // [before, hole, block, after] becomes [before, block, hole, after]
+    TlsfBlock& block = allocator.blocks[blockIdx];
+    TlsfBlock& hole = allocator.blocks[holeIdx];
+    const u32 beforeIdx = hole.prevPhysical;
+    const u32 afterIdx = block.nextPhysical;
+
+    block.offset = hole.offset;
+    hole.offset = block.offset + block.size;
+
+    block.prevPhysical = beforeIdx;
+    block.nextPhysical = holeIdx;
+    hole.prevPhysical = blockIdx;
+    hole.nextPhysical = afterIdx;
+
+    if (beforeIdx != TLSF_INVALID_BLOCK)
+        allocator.blocks[beforeIdx].nextPhysical = blockIdx;
+    else
+        allocator.firstBlock = blockIdx;
+    if (afterIdx != TLSF_INVALID_BLOCK)
+        allocator.blocks[afterIdx].prevPhysical = holeIdx;
+    else
+        allocator.lastBlock = holeIdx;
+
+    if (afterIdx != TLSF_INVALID_BLOCK && allocator.blocks[afterIdx].free)
+    {
+        RemoveFreeBlock(allocator, afterIdx);
+        MergeNextBlock(allocator, holeIdx);
+    }
+
+    InsertFreeBlock(allocator, holeIdx);
+    return true;
+}
+
+u32 GetTlsfLargestFreeSize(const TlsfAllocator& allocator)
+{
+    if (allocator.flBitmap == 0)
+        return 0;
+
+    // Only the blocks of the highest bin can be the largest
+    const u32 fl = FindLastSetBit(allocator.flBitmap);
+    const u32 sl = FindLastSetBit(allocator.slBitmaps[fl]);
+
+    u32 largest = 0;
+    for (u32 blockIdx = allocator.freeLists[fl][sl]; blockIdx != TLSF_INVALID_BLOCK; blockIdx = allocator.blocks[blockIdx].nextFree)
+        largest = glm::max(largest, allocator.blocks[blockIdx].size);
+    return largest;
+}
@@ -0,0 +1,63 @@
+//
+// tlsf_allocator.h: Two-level segregated fit suballocator of a range of units (bytes, vertices...)
+// kept apart from the memory it describes, e.g. a GL buffer. Free blocks are binned by size in a
+// two-level table with bitmaps, so allocating and freeing are O(1), and freed blocks are merged
+// with their free neighbours right away.
+//
+
+#pragma once
+
+#include "platform.h"
+
+#include <vector>
+
+#define TLSF_SL_LOG2 4 // Second level bins per power of 2: 16
+#define TLSF_SL_COUNT (1 << TLSF_SL_LOG2)
+#define TLSF_FL_COUNT 32
+
+#define TLSF_INVALID_BLOCK UINT32_MAX
+
+struct TlsfBlock
+{
+    u32  offset;
+    u32  size;
+    u32  prevPhysical; // Neighbours in the range, TLSF_INVALID_BLOCK at its ends
+    u32  nextPhysical;
+    u32  prevFree;     // Neighbours in the free list of its bin, while free
+    u32  nextFree;
+    bool free;
+};
+
+struct TlsfAllocator
+{
+    u32                    size;
+    std::vector<TlsfBlock> blocks;       // Referred to by index, which stays valid until the block is freed
+    std::vector<u32>       unusedBlocks; // Entries of blocks merged away, reused first
+    u32                    flBitmap;     // First level bins with free blocks
+    u32                    slBitmaps[TLSF_FL_COUNT];
+    u32                    freeLists[TLSF_FL_COUNT][TLSF_SL_COUNT];
+    u32                    firstBlock;   // Physically first and last, TLSF_INVALID_BLOCK if the range is empty
+    u32                    lastBlock;
+    u32                    usedSize;
+    u32                    allocationCount;
+};
+
+void InitTlsfAllocator(TlsfAllocator& allocator, u32 size);
+
+/**
+ * Returns the block of at least size units (1 if 0), or TLSF_INVALID_BLOCK if no free block is
+ * big enough. Its offset is in allocator.blocks[block].offset.
+ */
+u32 TlsfAllocate(TlsfAllocator& allocator, u32 size);
+
+void TlsfFree(TlsfAllocator& allocator, u32 block);
+
+/**
+ * Moves an allocated block to the start of the free block before it, which ends up after it
+ * (merged with the next one if free). The block keeps its index; copying the data it describes
+ * is up to the caller. Returns false if the block before is not free.
+ */
+bool TlsfMoveBlockDown(TlsfAllocator& allocator, u32 block);
+
+/** Size of the largest free block, which bounds the biggest allocation that can succeed */
+u32 GetTlsfLargestFreeSize(const TlsfAllocator& allocator);
@@ -0,0 +1,188 @@
+#include "vertex_quantization.h"
+
+#include <cfloat>
+#include <glm/gtc/packing.hpp>
+
+// Half floats keep 11 bits of precision relative to the magnitude of each coordinate, so a small
+// mesh far from its origin would visibly snap. Positions are only halved when their rounding error
+// stays under this fraction of the submesh bounding box diagonal (what a mesh around its origin
+// gets), else they stay floats
+#define MAX_HALF_FLOAT_POSITION_ERROR (1.0f / 2048.0f)
+#define MAX_HALF_FLOAT 65504.0f // Largest finite half float, anything above converts to infinity
+
+static const VertexBufferAttribute* FindAttribute(const VertexBufferLayout& layout, u8 location)
+{
+    for (u32 i = 0; i < layout.attributes.size(); ++i)
+        if (layout.attributes[i].location == location)
+            return &layout.attributes[i];
+    return NULL;
+}
+
+static vec3 ReadVec3(const u8* vertex, const VertexBufferAttribute& attribute)
+{
+    vec3 value;
+    memcpy(&value, vertex + attribute.offset, sizeof(value));
+    return value;
+}
+
+static vec2 ReadVec2(const u8* vertex, const VertexBufferAttribute& attribute)
+{
+    vec2 value;
+    memcpy(&value, vertex + attribute.offset, sizeof(value));
+    return value;
+}
+
+// Octahedral mapping: the unit sphere is projected onto an octahedron and unfolded into a square
+static void WriteOctahedral(u8* dst, vec3 n)
+{
+    n /= glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z) + 1e-20f;
+
+    vec2 e = vec2(n.x, n.y);
+    if (n.z < 0.0f)
+    {
+        e.x = (1.0f - glm::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        e.y = (1.0f - glm::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+
+    u32 packed = glm::packSnorm2x16(e);
+    memcpy(dst, &packed, sizeof(packed));
+}
+
+// Largest rounding error of a half float whose magnitude is at most value
+static f32 GetHalfFloatError(f32 value)
+{
+    if (value == 0.0f)
+        return 0.0f;
+
+    i32 exponent;
+    frexpf(value, &exponent); // value = [0.5, 1) * 2^exponent
+    return ldexpf(1.0f, glm::max(exponent - 1, -14) - 11); // Half of the step, subnormals have the step of 2^-14
+}
+
+static void AddAttribute(VertexBufferLayout& layout, u8 location, u8 componentCount, GLenum type, GLboolean normalized, u8 size)
+{
+    layout.attributes.push_back(VertexBufferAttribute{ location, componentCount, layout.stride, type, normalized });
+    layout.stride += size;
+}
+
+void QuantizeSubmesh(Submesh& submesh)
+{
+    const VertexBufferLayout& srcLayout = submesh.vertexBufferLayout;
+    const VertexBufferAttribute* position  = FindAttribute(srcLayout, 0);
+    const VertexBufferAttribute* normal    = FindAttribute(srcLayout, 1);
+    const VertexBufferAttribute* texCoord  = FindAttribute(srcLayout, 2);
+    const VertexBufferAttribute* tangent   = FindAttribute(srcLayout, 3);
+    const VertexBufferAttribute* bitangent = FindAttribute(srcLayout, 4);
+    ASSERT(position && normal, "Only submeshes with positions and normals can be quantized");
+
+    const u32 srcStride = srcLayout.stride;
+    const u32 vertexCount = (u32)submesh.vertices.size() / srcStride;
+
+    // Pick the formats that can hold this submesh's data
+    vec3 boundsMin = vec3(FLT_MAX);
+    vec3 boundsMax = vec3(-FLT_MAX);
+    bool unormTexCoords = true;
+    for (u32 i = 0; i < vertexCount; ++i)
+    {
+        const u8* vertex = submesh.vertices.data() + i * srcStride;
+
+        vec3 p = ReadVec3(vertex, *position);
+        boundsMin = glm::min(boundsMin, p);
+        boundsMax = glm::max(boundsMax, p);
+
+        if (texCoord)
+        {
+            vec2 uv = ReadVec2(vertex, *texCoord);
+            unormTexCoords = unormTexCoords && uv.x >= 0.0f && uv.x <= 1.0f && uv.y >= 0.0f && uv.y <= 1.0f;
+        }
+    }
+
+    const vec3 maxAbs = glm::max(glm::abs(boundsMin), glm::abs(boundsMax));
+    const f32 maxCoord = glm::max(maxAbs.x, glm::max(maxAbs.y, maxAbs.z));
+    const f32 halfError = GetHalfFloatError(maxCoord);
+    const bool halfPositions = vertexCount > 0 && maxCoord <= MAX_HALF_FLOAT && halfError <= glm::length(boundsMax - boundsMin) * MAX_HALF_FLOAT_POSITION_ERROR;
+
+    // create the compact vertex format (every attribute stays 4-byte aligned)
+    VertexBufferLayout layout = {};
+    if (halfPositions)
+        AddAttribute(layout, 0, 3, GL_HALF_FLOAT, GL_FALSE, 4 * sizeof(u16)); // vec3, and 2 bytes of padding
+    else
+        AddAttribute(layout, 0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float));
+    AddAttribute(layout, 1, 2, GL_SHORT, GL_TRUE, 2 * sizeof(u16));
+    if (texCoord)
+    {
+        if (unormTexCoords)
+            AddAttribute(layout, 2, 2, GL_UNSIGNED_SHORT, GL_TRUE, 2 * sizeof(u16));
+        else
+            AddAttribute(layout, 2, 2, GL_HALF_FLOAT, GL_FALSE, 2 * sizeof(u16)); // tiling uvs
+    }
+    if (tangent && bitangent)
+    {
+        AddAttribute(layout, 3, 2, GL_SHORT, GL_TRUE, 2 * sizeof(u16));
+        AddAttribute(layout, 4, 2, GL_SHORT, GL_TRUE, 2 * sizeof(u16));
+    }
+
+    // pack the vertices
+    std::vector<u8> vertices(vertexCount * layout.stride);
+    for (u32 i = 0; i < vertexCount; ++i)
+    {
+        const u8* src = submesh.vertices.data() + i * srcStride;
+        u8* dst = vertices.data() + i * layout.stride;
+        u32 attributeIdx = 0;
+
+        vec3 p = ReadVec3(src, *position);
+        if (halfPositions)
+        {
+            u64 packed = glm::packHalf4x16(vec4(p, 0.0f)); // The padding is zeroed
+            memcpy(dst + layout.attributes[attributeIdx].offset, &packed, sizeof(packed));
+        }
+        else
+        {
+            memcpy(dst + layout.attributes[attributeIdx].offset, &p, sizeof(p));
+        }
+        attributeIdx++;
+
+        WriteOctahedral(dst + layout.attributes[attributeIdx++].offset, ReadVec3(src, *normal));
+
+        if (texCoord)
+        {
+            vec2 uv = ReadVec2(src, *texCoord);
+            u32 packed = unormTexCoords ? glm::packUnorm2x16(uv) : glm::packHalf2x16(uv);
+            memcpy(dst + layout.attributes[attributeIdx++].offset, &packed, sizeof(packed));
+        }
+
+        if (tangent && bitangent)
+        {
+            WriteOctahedral(dst + layout.attributes[attributeIdx++].offset, ReadVec3(src, *tangent));
+            WriteOctahedral(dst + layout.attributes[attributeIdx++].offset, ReadVec3(src, *bitangent));
+        }
+    }
+
+    submesh.vertexBufferLayout = layout;
+    submesh.vertices.swap(vertices);
+    submesh.indexType = vertexCount < 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+u32 GetIndexSize(GLenum indexType)
+{
+    switch (indexType)
+    {
+        case GL_UNSIGNED_BYTE:  return sizeof(u8);
+        case GL_UNSIGNED_SHORT: return sizeof(u16);
+        default:                return sizeof(u32);
+    }
+}
+
+void WriteSubmeshIndices(const Submesh& submesh, void* dst)
+{
+    if (submesh.indexType == GL_UNSIGNED_SHORT)
+    {
+        u16* index = (u16*)dst;
+        for (u32 i = 0; i < submesh.indices.size(); ++i)
+            *index++ = (u16)submesh.indices[i];
+    }
+    else
+    {
+        memcpy(dst, submesh.indices.data(), submesh.indices.size() * sizeof(u32));
+    }
+}
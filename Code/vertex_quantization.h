@@ -0,0 +1,24 @@
+//
+// vertex_quantization.h: Compact vertex and index formats. Submeshes are imported with float
+// attributes and 32-bit indices, and then packed into smaller formats the GPU decodes for free.
+//
+
+#pragma once
+
+#include "engine.h"
+
+/**
+ * Packs the vertices of a submesh imported with the float layout (position, normal, uv,
+ * tangent, bitangent) into half float positions (unless they would snap, relative to the size of
+ * the submesh), octahedral SNORM16 normals and tangents, and UNORM16 uvs (half floats if they tile). Submeshes with less than 65536 vertices also get
+ * 16-bit indices. The vertex shaders must be compiled with QUANTIZED_VERTICES defined.
+ */
+void QuantizeSubmesh(Submesh& submesh);
+
+u32 GetIndexSize(GLenum indexType);
+
+/**
+ * Writes the indices of the submesh with its indexType into dst, that must have room for
+ * indices.size() * GetIndexSize(indexType) bytes.
+ */
+void WriteSubmeshIndices(const Submesh& submesh, void* dst);
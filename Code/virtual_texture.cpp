@@ -0,0 +1,646 @@
+#include "virtual_texture.h"
+#include "job_system.h"
+#include "residency.h"
+#include "texture_cache.h"
+
+#include <algorithm>
+#include <mutex>
+#include <unordered_set>
+
+#define VIRTUAL_TEXTURE_SLOT_SIZE (VIRTUAL_TEXTURE_PAGE_SIZE + 2 * VIRTUAL_TEXTURE_PAGE_BORDER)
+#define VIRTUAL_TEXTURE_ATLAS_SIZE (VIRTUAL_TEXTURE_ATLAS_PAGES * VIRTUAL_TEXTURE_SLOT_SIZE)
+#define VIRTUAL_TEXTURE_MAX_COUNT 255 // Texture index + 1 is stored in the top byte of the page keys
+#define VIRTUAL_PAGE_NONE UINT32_MAX
+
+// Page keys, as written by the feedback pass: texture index + 1 (8 bits), level (4 bits), y and x (10 bits each).
+// Zero is cleared to, for pixels that need no page.
+static u32 MakePageKey(u32 virtualTexIdx, u32 level, u32 x, u32 y) { return ((virtualTexIdx + 1) << 24) | (level << 20) | (y << 10) | x; }
+static u32 GetPageKeyTexture(u32 key) { return (key >> 24) - 1; }
+static u32 GetPageKeyLevel(u32 key)   { return (key >> 20) & 0xF; }
+static u32 GetPageKeyX(u32 key)       { return key & 0x3FF; }
+static u32 GetPageKeyY(u32 key)       { return (key >> 10) & 0x3FF; }
+
+struct VirtualTexture
+{
+    std::string      filepath;
+    CookedTexture    cooked;                                 // Uncompressed levels the pages are copied from (mapped cache or owned pixels)
+    u32              levelCount;                             // Paged levels, the last one fits in a single page
+    ivec2            pageCounts[TEXTURE_CACHE_MAX_LEVELS];   // Pages along each axis of every level (the indirection mip sizes)
+    u32              firstPages[TEXTURE_CACHE_MAX_LEVELS];   // Where every level starts in pageSlots and indirection
+    std::vector<u32> pageSlots;                              // Atlas slot of every page, VIRTUAL_PAGE_NONE if not resident
+    std::vector<u8>  indirection;                            // RGBA: atlas slot x, y and level of the page sampled for every page
+    GLuint           indirectionHandle;
+    bool             indirectionDirty;
+};
+
+struct AtlasSlot
+{
+    u32  key;          // Page held, 0 if free
+    u64  lastUsedFrame;
+    bool pinned;       // Coarsest level of a texture, never evicted
+};
+
+struct PageLoad
+{
+    u32 key;
+    u8* texels;        // RGBA, VIRTUAL_TEXTURE_SLOT_SIZE^2 texels with the border
+};
+
+struct FeedbackReadback
+{
+    GLuint handle;     // Pixel pack buffer
+    GLsync fence;      // Set while the copy is in flight
+    ivec2  size;
+};
+
+struct VirtualTexturing
+{
+    std::mutex                  mutex;
+    std::vector<u32>            requestedPages;  // Unique keys of the last feedback analyzed, coarser levels first
+    std::vector<PageLoad>       loadedPages;     // Copied by the workers, waiting to be uploaded
+    bool                        analyzing;       // A worker is reading the feedback
+
+    std::vector<VirtualTexture> textures;        // Main thread only, from here on
+    GLuint                      atlasHandle;
+    std::vector<AtlasSlot>      slots;
+    u32                         residentPages;
+    std::unordered_set<u32>     loadingPages;
+    std::vector<PageLoad>       uploads;         // Taken from loadedPages, uploaded a few per frame
+    u64                         frame;
+
+    GLuint                      feedbackFramebuffer;
+    GLuint                      feedbackTexture;
+    GLuint                      feedbackDepth;
+    ivec2                       feedbackSize;
+    FeedbackReadback            readbacks[2];
+    u32                         nextReadback;
+};
+
+static VirtualTexturing GlobalVirtualTexturing;
+
+static i32 WrapTexel(i32 coord, i32 size)
+{
+    coord %= size;
+    return coord < 0 ? coord + size : coord;
+}
+
+// Copies a page and its border (wrapping around the texture, which tiles) as RGBA
+static void CopyPageTexels(const CookedTexture& cooked, u32 level, u32 pageX, u32 pageY, u8* texels)
+{
+    const ivec2 levelSize = glm::max(cooked.size >> (i32)level, ivec2(1));
+    const u8* src = cooked.data + cooked.levelOffsets[level];
+    const i32 n = cooked.nchannels;
+
+    for (i32 y = 0; y < VIRTUAL_TEXTURE_SLOT_SIZE; ++y)
+    {
+        i32 srcY = WrapTexel((i32)pageY * VIRTUAL_TEXTURE_PAGE_SIZE + y - VIRTUAL_TEXTURE_PAGE_BORDER, levelSize.y);
+        const u8* srcRow = src + (u64)srcY * levelSize.x * n;
+        u8* dst = texels + y * VIRTUAL_TEXTURE_SLOT_SIZE * 4;
+
+        for (i32 x = 0; x < VIRTUAL_TEXTURE_SLOT_SIZE; ++x, dst += 4)
+        {
+            i32 srcX = WrapTexel((i32)pageX * VIRTUAL_TEXTURE_PAGE_SIZE + x - VIRTUAL_TEXTURE_PAGE_BORDER, levelSize.x);
+            const u8* texel = srcRow + srcX * n;
+
+            // Gray images are expanded to gray, not red, two channel ones keep their RG
+            dst[0] = texel[0];
+            dst[1] = n >= 2 ? texel[1] : texel[0];
+            dst[2] = n == 4 ? texel[2] : (n == 1 ? texel[0] : 0);
+            dst[3] = n == 4 ? texel[3] : 255;
+        }
+    }
+}
+
+static void UploadPage(u32 slotIdx, const u8* texels)
+{
+    const u32 x = (slotIdx % VIRTUAL_TEXTURE_ATLAS_PAGES) * VIRTUAL_TEXTURE_SLOT_SIZE;
+    const u32 y = (slotIdx / VIRTUAL_TEXTURE_ATLAS_PAGES) * VIRTUAL_TEXTURE_SLOT_SIZE;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, GlobalVirtualTexturing.atlasHandle);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, VIRTUAL_TEXTURE_SLOT_SIZE, VIRTUAL_TEXTURE_SLOT_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+static bool IsValidPageKey(u32 key)
+{
+    VirtualTexturing& vt = GlobalVirtualTexturing;
+    u32 virtualTexIdx = GetPageKeyTexture(key);
+    if (key == 0 || virtualTexIdx >= vt.textures.size())
+        return false;
+
+    const VirtualTexture& texture = vt.textures[virtualTexIdx];
+    u32 level = GetPageKeyLevel(key);
+    return level < texture.levelCount && (i32)GetPageKeyX(key) < texture.pageCounts[level].x && (i32)GetPageKeyY(key) < texture.pageCounts[level].y;
+}
+
+static u32& GetPageSlot(u32 key)
+{
+    VirtualTexture& texture = GlobalVirtualTexturing.textures[GetPageKeyTexture(key)];
+    u32 level = GetPageKeyLevel(key);
+    return texture.pageSlots[texture.firstPages[level] + GetPageKeyY(key) * texture.pageCounts[level].x + GetPageKeyX(key)];
+}
+
+// A free slot or, if there is none, the least recently used page not needed by the last feedback
+static u32 AllocateSlot()
+{
+    VirtualTexturing& vt = GlobalVirtualTexturing;
+
+    u32 victim = VIRTUAL_PAGE_NONE;
+    for (u32 i = 0; i < vt.slots.size(); ++i)
+    {
+        const AtlasSlot& slot = vt.slots[i];
+        if (slot.key == 0)
+            return i;
+        if (!slot.pinned && slot.lastUsedFrame < vt.frame && (victim == VIRTUAL_PAGE_NONE || slot.lastUsedFrame < vt.slots[victim].lastUsedFrame))
+            victim = i;
+    }
+
+    if (victim != VIRTUAL_PAGE_NONE)
+    {
+        AtlasSlot& slot = vt.slots[victim];
+        GetPageSlot(slot.key) = VIRTUAL_PAGE_NONE;
+        vt.textures[GetPageKeyTexture(slot.key)].indirectionDirty = true;
+        slot.key = 0;
+        vt.residentPages--;
+    }
+
+    return victim;
+}
+
+static void MapPage(u32 key, u32 slotIdx, bool pinned)
+{
+    VirtualTexturing& vt = GlobalVirtualTexturing;
+
+    AtlasSlot& slot = vt.slots[slotIdx];
+    slot.key           = key;
+    slot.lastUsedFrame = vt.frame;
+    slot.pinned        = pinned;
+    vt.residentPages++;
+
+    GetPageSlot(key) = slotIdx;
+    vt.textures[GetPageKeyTexture(key)].indirectionDirty = true;
+}
+
+// Pages that are not resident sample the closest coarser page that is, starting from the always resident coarsest level
+static void UpdateIndirection(VirtualTexture& texture)
+{
+    for (i32 level = (i32)texture.levelCount - 1; level >= 0; --level)
+    {
+        const ivec2 pageCounts = texture.pageCounts[level];
+        for (i32 y = 0; y < pageCounts.y; ++y)
+        {
+            for (i32 x = 0; x < pageCounts.x; ++x)
+            {
+                const u32 pageIdx = texture.firstPages[level] + y * pageCounts.x + x;
+                u8* entry = &texture.indirection[pageIdx * 4];
+
+                const u32 slotIdx = texture.pageSlots[pageIdx];
+                if (slotIdx != VIRTUAL_PAGE_NONE)
+                {
+                    entry[0] = (u8)(slotIdx % VIRTUAL_TEXTURE_ATLAS_PAGES);
+                    entry[1] = (u8)(slotIdx / VIRTUAL_TEXTURE_ATLAS_PAGES);
+                    entry[2] = (u8)level;
+                    entry[3] = 0;
+                }
+                else if (level + 1 < (i32)texture.levelCount)
+                {
+                    const u32 parentIdx = texture.firstPages[level + 1] + (y >> 1) * texture.pageCounts[level + 1].x + (x >> 1);
+                    memcpy(entry, &texture.indirection[parentIdx * 4], 4);
+                }
+            }
+        }
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, texture.indirectionHandle);
+    for (u32 level = 0; level < texture.levelCount; ++level)
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, texture.pageCounts[level].x, texture.pageCounts[level].y, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, &texture.indirection[texture.firstPages[level] * 4]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    texture.indirectionDirty = false;
+}
+
+// Runs on a worker: reduces the feedback to its unique pages, adding the coarser levels above them
+// so the fallbacks get sharper while the requested pages load
+static void AnalyzeFeedback(std::vector<u32>& feedback)
+{
+    std::sort(feedback.begin(), feedback.end());
+    feedback.erase(std::unique(feedback.begin(), feedback.end()), feedback.end());
+
+    std::vector<u32> pages;
+    pages.reserve(feedback.size() * 2);
+    for (u32 i = 0; i < feedback.size(); ++i)
+    {
+        u32 key = feedback[i];
+        if (key == 0)
+            continue;
+
+        // Levels past the texture's last one are dropped by the main thread
+        u32 virtualTexIdx = GetPageKeyTexture(key);
+        u32 x = GetPageKeyX(key);
+        u32 y = GetPageKeyY(key);
+        for (u32 level = GetPageKeyLevel(key); level < TEXTURE_CACHE_MAX_LEVELS; ++level, x >>= 1, y >>= 1)
+            pages.push_back(MakePageKey(virtualTexIdx, level, x, y));
+    }
+
+    // Coarser pages first, they replace the largest areas of blurry fallback
+    std::sort(pages.begin(), pages.end(), [](u32 a, u32 b)
+    {
+        return GetPageKeyLevel(a) != GetPageKeyLevel(b) ? GetPageKeyLevel(a) > GetPageKeyLevel(b) : a < b;
+    });
+    pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+
+    VirtualTexturing& vt = GlobalVirtualTexturing;
+    std::lock_guard<std::mutex> lock(vt.mutex);
+    vt.requestedPages.swap(pages);
+    vt.analyzing = false;
+}
+
+static void DestroyFeedbackTarget()
+{
+    VirtualTexturing& vt = GlobalVirtualTexturing;
+
+    SetResidentBytes(ResidencyCategory_RenderTargets, vt.feedbackTexture, NULL, 0);
+    glDeleteFramebuffers(1, &vt.feedbackFramebuffer);
+    glDeleteTextures(1, &vt.feedbackTexture);
+    glDeleteTextures(1, &vt.feedbackDepth);
+    for (u32 i = 0; i < ARRAY_COUNT(vt.readbacks); ++i)
+    {
+        if (vt.readbacks[i].fence)
+            glDeleteSync(vt.readbacks[i].fence);
+        glDeleteBuffers(1, &vt.readbacks[i].handle);
+        vt.readbacks[i] = FeedbackReadback{};
+    }
+
+    vt.feedbackFramebuffer = 0;
+    vt.feedbackTexture = 0;
+    vt.feedbackDepth = 0;
+    vt.feedbackSize = ivec2(0);
+}
+
+static void CreateFeedbackTarget(ivec2 size)
+{
+    VirtualTexturing& vt = GlobalVirtualTexturing;
+    DestroyFeedbackTarget();
+
+    glGenTextures(1, &vt.feedbackTexture);
+    glBindTexture(GL_TEXTURE_2D, vt.feedbackTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32UI, size.x, size.y);
+
+    glGenTextures(1, &vt.feedbackDepth);
+    glBindTexture(GL_TEXTURE_2D, vt.feedbackDepth);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, size.x, size.y);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &vt.feedbackFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, vt.feedbackFramebuffer);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, vt.feedbackTexture, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, vt.feedbackDepth, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        ELOG("Virtual texture feedback framebuffer is not complete");
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    for (u32 i = 0; i < ARRAY_COUNT(vt.readbacks); ++i)
+    {
+        glGenBuffers(1, &vt.readbacks[i].handle);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, vt.readbacks[i].handle);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size.x * size.y * sizeof(u32), NULL, GL_STREAM_READ);
+        vt.readbacks[i].size = size;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // Color and depth attachments, and the readback buffers (all 32 bits per pixel)
+    const u64 pixelCount = (u64)size.x * size.y;
+    SetResidentBytes(ResidencyCategory_RenderTargets, vt.feedbackTexture, "Virtual texture feedback", pixelCount * 4 * (2 + ARRAY_COUNT(vt.readbacks)));
+
+    vt.feedbackSize = size;
+}
+
+void InitVirtualTexturing()
+{
+    VirtualTexturing& vt = GlobalVirtualTexturing;
+
+    glGenTextures(1, &vt.atlasHandle);
+    glBindTexture(GL_TEXTURE_2D, vt.atlasHandle);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, VIRTUAL_TEXTURE_ATLAS_SIZE, VIRTUAL_TEXTURE_ATLAS_SIZE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    SetResidentBytes(ResidencyCategory_Atlases, vt.atlasHandle, "Virtual texture pages", (u64)VIRTUAL_TEXTURE_ATLAS_SIZE * VIRTUAL_TEXTURE_ATLAS_SIZE * 4);
+
+    vt.slots.assign(VIRTUAL_TEXTURE_ATLAS_PAGES * VIRTUAL_TEXTURE_ATLAS_PAGES, AtlasSlot{});
+    vt.residentPages = 0;
+    vt.frame = 1;
+    vt.analyzing = false;
+}
+
+void ShutdownVirtualTexturing()
+{
+    VirtualTexturing& vt = GlobalVirtualTexturing;
+
+    for (u32 i = 0; i < vt.loadedPages.size(); ++i)
+        free(vt.loadedPages[i].texels);
+    for (u32 i = 0; i < vt.uploads.size(); ++i)
+        free(vt.uploads[i].texels);
+    vt.loadedPages.clear();
+    vt.uploads.clear();
+    vt.requestedPages.clear();
+    vt.loadingPages.clear();
+
+    for (u32 i = 0; i < vt.textures.size(); ++i)
+    {
+        ReleaseCookedTexture(vt.textures[i].cooked);
+        glDeleteTextures(1, &vt.textures[i].indirectionHandle);
+    }
+    vt.textures.clear();
+
+    DestroyFeedbackTarget();
+    SetResidentBytes(ResidencyCategory_Atlases, vt.atlasHandle, NULL, 0);
+    glDeleteTextures(1, &vt.atlasHandle);
+    vt.atlasHandle = 0;
+    vt.slots.clear();
+    vt.residentPages = 0;
+}
+
+u32 LoadVirtualTexture(const char* filepath, bool flipVertically)
+{
+    VirtualTexturing& vt = GlobalVirtualTexturing;
+
+    for (u32 i = 0; i < vt.textures.size(); ++i)
+        if (vt.textures[i].filepath == filepath)
+            return i;
+
+    // Every texture pins a page, at least half of the atlas is left for the others
+    if (vt.textures.size() >= glm::min((u32)VIRTUAL_TEXTURE_MAX_COUNT, (u32)vt.slots.size() / 2))
+    {
+        ELOG("Too many virtual textures, %s is not loaded", filepath);
+        return UINT32_MAX;
+    }
+
+    VirtualTexture texture = {};
+    if (!LoadCookedTexture(filepath, flipVertically, TextureUsage_Virtual, texture.cooked))
+    {
+        ELOG("Could not load virtual texture %s", filepath);
+        return UINT32_MAX;
+    }
+
+    const ivec2 size = texture.cooked.size;
+    const i32 maxPages = 1 << 10;
+    if (texture.cooked.format != TextureFormat_Uncompressed || size.x > maxPages * VIRTUAL_TEXTURE_PAGE_SIZE || size.y > maxPages * VIRTUAL_TEXTURE_PAGE_SIZE)
+    {
+        ELOG("Virtual texture %s is too large or compressed", filepath);
+        ReleaseCookedTexture(texture.cooked);
+        return UINT32_MAX;
+    }
+
+    // The page grid of level 0 is rounded up to a power of two, so the halved grids of the
+    // indirection mips still cover the rounded up page counts of every level
+    ivec2 pageCounts = (size + VIRTUAL_TEXTURE_PAGE_SIZE - 1) / VIRTUAL_TEXTURE_PAGE_SIZE;
+    ivec2 gridSize(1);
+    while (gridSize.x < pageCounts.x) gridSize.x <<= 1;
+    while (gridSize.y < pageCounts.y) gridSize.y <<= 1;
+
+    texture.filepath = filepath;
+    texture.levelCount = 1;
+    while ((gridSize.x >> (texture.levelCount - 1)) > 1 || (gridSize.y >> (texture.levelCount - 1)) > 1)
+        texture.levelCount++;
+    texture.levelCount = glm::min(texture.levelCount, texture.cooked.levelCount);
+
+    u32 pageCount = 0;
+    for (u32 level = 0; level < texture.levelCount; ++level)
+    {
+        texture.pageCounts[level] = glm::max(gridSize >> (i32)level, ivec2(1));
+        texture.firstPages[level] = pageCount;
+        pageCount += texture.pageCounts[level].x * texture.pageCounts[level].y;
+    }
+    texture.pageSlots.assign(pageCount, VIRTUAL_PAGE_NONE);
+    texture.indirection.assign(pageCount * 4, 0);
+
+    glGenTextures(1, &texture.indirectionHandle);
+    glBindTexture(GL_TEXTURE_2D, texture.indirectionHandle);
+    glTexStorage2D(GL_TEXTURE_2D, texture.levelCount, GL_RGBA8UI, gridSize.x, gridSize.y);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.levelCount - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    u32 virtualTexIdx = (u32)vt.textures.size();
+    vt.textures.push_back(texture);
+
+    // The coarsest level is uploaded right away and never evicted
+    u8* texels = (u8*)malloc(VIRTUAL_TEXTURE_SLOT_SIZE * VIRTUAL_TEXTURE_SLOT_SIZE * 4);
+    const u32 lastLevel = texture.levelCount - 1;
+    CopyPageTexels(texture.cooked, lastLevel, 0, 0, texels);
+
+    u32 slotIdx = AllocateSlot();
+    UploadPage(slotIdx, texels);
+    MapPage(MakePageKey(virtualTexIdx, lastLevel, 0, 0), slotIdx, true);
+    free(texels);
+
+    UpdateIndirection(vt.textures[virtualTexIdx]);
+    return virtualTexIdx;
+}
+
+u32 GetVirtualTextureCount()
+{
+    return (u32)GlobalVirtualTexturing.textures.size();
+}
+
+u32 GetResidentVirtualPageCount()
+{
+    return GlobalVirtualTexturing.residentPages;
+}
+
+// Hands the oldest finished readback to a worker, unless the previous one is still being analyzed
+static void ReadFeedback()
+{
+    VirtualTexturing& vt = GlobalVirtualTexturing;
+
+    for (u32 i = 0; i < ARRAY_COUNT(vt.readbacks); ++i)
+    {
+        FeedbackReadback& readback = vt.readbacks[(vt.nextReadback + i) % ARRAY_COUNT(vt.readbacks)];
+        if (!readback.fence || glClientWaitSync(readback.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            continue;
+
+        {
+            std::lock_guard<std::mutex> lock(vt.mutex);
+            if (vt.analyzing)
+                return;
+            vt.analyzing = true;
+        }
+
+        glDeleteSync(readback.fence);
+        readback.fence = 0;
+
+        std::vector<u32> feedback(readback.size.x * readback.size.y);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.handle);
+        const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, feedback.size() * sizeof(u32), GL_MAP_READ_BIT);
+        if (data)
+            memcpy(feedback.data(), data, feedback.size() * sizeof(u32));
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        PushJob([feedback]() mutable
+        {
+            AnalyzeFeedback(feedback);
+        });
+        return;
+    }
+}
+
+// Touches the resident pages the feedback asked for and starts copying the missing ones
+static void RequestPages()
+{
+    VirtualTexturing& vt = GlobalVirtualTexturing;
+
+    std::vector<u32> pages;
+    {
+        std::lock_guard<std::mutex> lock(vt.mutex);
+        pages.swap(vt.requestedPages);
+    }
+
+    for (u32 i = 0; i < pages.size(); ++i)
+    {
+        const u32 key = pages[i];
+        if (!IsValidPageKey(key))
+            continue;
+
+        const u32 slotIdx = GetPageSlot(key);
+        if (slotIdx != VIRTUAL_PAGE_NONE)
+        {
+            vt.slots[slotIdx].lastUsedFrame = vt.frame;
+            continue;
+        }
+
+        if (vt.loadingPages.size() >= VIRTUAL_TEXTURE_MAX_PAGE_LOADS || vt.loadingPages.count(key))
+            continue;
+
+        vt.loadingPages.insert(key);
+
+        // The cooked levels are never released while the job system runs
+        const CookedTexture cooked = vt.textures[GetPageKeyTexture(key)].cooked;
+        PushJob([key, cooked]()
+        {
+            PageLoad load = { key, (u8*)malloc(VIRTUAL_TEXTURE_SLOT_SIZE * VIRTUAL_TEXTURE_SLOT_SIZE * 4) };
+            CopyPageTexels(cooked, GetPageKeyLevel(key), GetPageKeyX(key), GetPageKeyY(key), load.texels);
+
+            VirtualTexturing& vt = GlobalVirtualTexturing;
+            std::lock_guard<std::mutex> lock(vt.mutex);
+            vt.loadedPages.push_back(load);
+        });
+    }
+}
+
+void UpdateVirtualTexturing()
+{
+    VirtualTexturing& vt = GlobalVirtualTexturing;
+    if (vt.textures.empty())
+        return;
+
+    vt.frame++;
+
+    ReadFeedback();
+    RequestPages();
+
+    {
+        std::lock_guard<std::mutex> lock(vt.mutex);
+        vt.uploads.insert(vt.uploads.end(), vt.loadedPages.begin(), vt.loadedPages.end());
+        vt.loadedPages.clear();
+    }
+
+    u32 uploadCount = glm::min((u32)vt.uploads.size(), (u32)VIRTUAL_TEXTURE_UPLOADS_PER_FRAME);
+    for (u32 i = 0; i < uploadCount; ++i)
+    {
+        const PageLoad& load = vt.uploads[i];
+        vt.loadingPages.erase(load.key);
+
+        // With the whole atlas in use by the last feedback the page is dropped, it will be requested again
+        u32 slotIdx = AllocateSlot();
+        if (slotIdx != VIRTUAL_PAGE_NONE)
+        {
+            UploadPage(slotIdx, load.texels);
+            MapPage(load.key, slotIdx, false);
+        }
+
+        free(load.texels);
+    }
+    vt.uploads.erase(vt.uploads.begin(), vt.uploads.begin() + uploadCount);
+
+    for (u32 i = 0; i < vt.textures.size(); ++i)
+        if (vt.textures[i].indirectionDirty)
+            UpdateIndirection(vt.textures[i]);
+}
+
+void BeginVirtualTextureFeedback(App* app, const Program& feedbackProgram)
+{
+    VirtualTexturing& vt = GlobalVirtualTexturing;
+
+    ivec2 size = glm::max(app->displaySize / VIRTUAL_TEXTURE_FEEDBACK_SCALE, ivec2(1));
+    if (size != vt.feedbackSize)
+        CreateFeedbackTarget(size);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, vt.feedbackFramebuffer);
+    glViewport(0, 0, size.x, size.y);
+
+    const GLuint noPage[4] = {};
+    glClearBufferuiv(GL_COLOR, 0, noPage);
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    // Derivatives are larger at the lower resolution, the levels picked must match the full resolution ones
+    glUseProgram(feedbackProgram.handle);
+    glUniform1f(glGetUniformLocation(feedbackProgram.handle, "uLodBias"), -glm::log2((f32)VIRTUAL_TEXTURE_FEEDBACK_SCALE));
+}
+
+void EndVirtualTextureFeedback(App* app)
+{
+    VirtualTexturing& vt = GlobalVirtualTexturing;
+
+    // Skipped while both readbacks are in flight or waiting to be analyzed
+    FeedbackReadback& readback = vt.readbacks[vt.nextReadback];
+    if (!readback.fence)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.handle);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glReadPixels(0, 0, readback.size.x, readback.size.y, GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        vt.nextReadback = (vt.nextReadback + 1) % ARRAY_COUNT(vt.readbacks);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, app->displaySize.x, app->displaySize.y);
+}
+
+void FindVirtualTextureUniforms(Program& program)
+{
+    program.programUniformVirtualTexture = glGetUniformLocation(program.handle, "uVirtualTexture");
+    program.programUniformPageAtlas = glGetUniformLocation(program.handle, "uPageAtlas");
+    program.programUniformIndirection = glGetUniformLocation(program.handle, "uIndirection");
+}
+
+void BindVirtualTexture(const Program& program, u32 virtualTexIdx)
+{
+    VirtualTexturing& vt = GlobalVirtualTexturing;
+
+    // The samplers always get their own units, samplers of different types cannot share one
+    glUniform1i(program.programUniformPageAtlas, 2);
+    glUniform1i(program.programUniformIndirection, 3);
+
+    GLint location = program.programUniformVirtualTexture;
+    if (virtualTexIdx >= vt.textures.size())
+    {
+        glUniform4i(location, 0, 0, 0, -1);
+        return;
+    }
+
+    const VirtualTexture& texture = vt.textures[virtualTexIdx];
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, vt.atlasHandle);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, texture.indirectionHandle);
+    glUniform4i(location, texture.cooked.size.x, texture.cooked.size.y, texture.levelCount, virtualTexIdx);
+}
@@ -0,0 +1,64 @@
+//
+// virtual_texture.h: Software virtual texturing. Large textures are split in pages of every mip
+// level and only the pages the visible surfaces sample are kept in video memory, in a fixed size
+// page atlas. A low resolution feedback pass writes the page each pixel needs; the worker threads
+// read it back, and copy the missing pages out of the cooked texture while the least recently
+// used ones are evicted. Each texture has an indirection texture, sampled by the shaders, that
+// maps its pages to the atlas (or to the closest coarser page resident). No sparse texture
+// support is needed.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define VIRTUAL_TEXTURE_PAGE_SIZE         128 // Texels of a page without its border (must match g_buffer.glsl)
+#define VIRTUAL_TEXTURE_PAGE_BORDER       4   // Texels around each page repeated from its neighbours, for filtering (must match g_buffer.glsl)
+#define VIRTUAL_TEXTURE_ATLAS_PAGES       16  // Pages along each side of the atlas
+#define VIRTUAL_TEXTURE_FEEDBACK_SCALE    8   // The feedback pass renders at 1/8 of the display size
+#define VIRTUAL_TEXTURE_MAX_PAGE_LOADS    64  // Pages being copied by the workers at once
+#define VIRTUAL_TEXTURE_UPLOADS_PER_FRAME 16
+
+void InitVirtualTexturing();
+
+/**
+ * Must be called after ShutdownJobSystem(), once no worker is reading the textures.
+ */
+void ShutdownVirtualTexturing();
+
+/**
+ * Loads (or cooks) a texture to be sampled through the page atlas and returns its index. Its
+ * coarsest level, a single page, stays resident so every lookup finds something to sample.
+ */
+u32 LoadVirtualTexture(const char* filepath, bool flipVertically = false);
+
+u32 GetVirtualTextureCount();
+
+u32 GetResidentVirtualPageCount();
+
+/**
+ * Called once per frame on the main thread. Hands the last feedback read back to the workers,
+ * touches the resident pages it asked for, requests the missing ones and uploads the pages that
+ * were copied, evicting the least recently used when the atlas is full.
+ */
+void UpdateVirtualTexturing();
+
+/**
+ * Binds the low resolution feedback target and the feedback program. Every surface drawn until
+ * EndVirtualTextureFeedback() writes the page it samples (or none, only occluding the others).
+ */
+void BeginVirtualTextureFeedback(App* app, const Program& feedbackProgram);
+
+/**
+ * Starts reading the feedback back asynchronously and restores the default framebuffer.
+ */
+void EndVirtualTextureFeedback(App* app);
+
+/** Looks up the uniforms BindVirtualTexture() sets, once per (re)linked program */
+void FindVirtualTextureUniforms(Program& program);
+
+/**
+ * Binds the page atlas and the indirection texture of a virtual texture to the program (texture
+ * units 2 and 3), or tells it to sample its regular textures if virtualTexIdx is UINT32_MAX.
+ */
+void BindVirtualTexture(const Program& program, u32 virtualTexIdx);
@@ -0,0 +1,134 @@
+#include "tests.h"
+#include "geometry_codec.h"
+
+#include <string.h>
+
+#define CODEC_TEST_GRID_SIZE 100 // Vertices per side, so the streams have several chunks
+
+// Quantized positions of a wavy grid, with an 8-bit normal and a padding byte: neighbours differ in their low bits
+static std::vector<u8> CreateGridVertices(u32 stride)
+{
+    std::vector<u8> vertices(CODEC_TEST_GRID_SIZE * CODEC_TEST_GRID_SIZE * stride, 0);
+    for (u32 y = 0; y < CODEC_TEST_GRID_SIZE; ++y)
+    {
+        for (u32 x = 0; x < CODEC_TEST_GRID_SIZE; ++x)
+        {
+            const u16 position[] = { (u16)(x * 16), (u16)(y * 16), (u16)(32768 + 200.0f * sinf(x * 0.1f) * cosf(y * 0.1f)) };
+            u8* vertex = &vertices[(y * CODEC_TEST_GRID_SIZE + x) * stride];
+            memcpy(vertex, position, sizeof(position));
+            vertex[6] = (u8)(128 + 100.0f * cosf(x * 0.1f));
+        }
+    }
+    return vertices;
+}
+
+static std::vector<u32> CreateGridIndices()
+{
+    std::vector<u32> indices;
+    for (u32 y = 0; y + 1 < CODEC_TEST_GRID_SIZE; ++y)
+    {
+        for (u32 x = 0; x + 1 < CODEC_TEST_GRID_SIZE; ++x)
+        {
+            const u32 v = y * CODEC_TEST_GRID_SIZE + x;
+            const u32 quad[] = { v, v + 1, v + CODEC_TEST_GRID_SIZE, v + CODEC_TEST_GRID_SIZE, v + 1, v + CODEC_TEST_GRID_SIZE + 1 };
+            indices.insert(indices.end(), quad, quad + ARRAY_COUNT(quad));
+        }
+    }
+    return indices;
+}
+
+// Decodes every chunk of a stream, returns false if any fails
+static bool DecodeStream(const std::vector<u8>& stream, void* dst, u32 dstSize)
+{
+    const u32 chunkCount = GetGeometryStreamChunkCount(stream.data(), (u32)stream.size(), dstSize);
+    if (chunkCount == 0)
+        return false;
+
+    for (u32 chunk = 0; chunk < chunkCount; ++chunk)
+        if (!DecodeGeometryStreamChunk(dst, stream.data(), (u32)stream.size(), chunk))
+            return false;
+    return true;
+}
+
+// Vertices decode to the same bytes, and smooth quantized data takes less room than raw
+static void TestVertexRoundTrip()
+{
+    const u32 stride = 8;
+    const std::vector<u8> vertices = CreateGridVertices(stride);
+    const u32 vertexCount = (u32)vertices.size() / stride;
+
+    std::vector<u8> stream;
+    EncodeVertexStream(stream, vertices.data(), vertexCount, stride);
+    CHECK(stream.size() < vertices.size() / 2);
+    CHECK(GetGeometryStreamChunkCount(stream.data(), (u32)stream.size(), (u32)vertices.size()) == (vertexCount + GEOMETRY_VERTEX_CHUNK_SIZE - 1) / GEOMETRY_VERTEX_CHUNK_SIZE);
+
+    std::vector<u8> decoded(vertices.size(), 0xCD);
+    CHECK(DecodeStream(stream, decoded.data(), (u32)decoded.size()));
+    CHECK(decoded == vertices);
+}
+
+// Vertices too large to encode are stored as they are
+static void TestRawVertices()
+{
+    const u32 stride = GEOMETRY_MAX_VERTEX_STRIDE + 4;
+    const std::vector<u8> vertices = CreateGridVertices(stride);
+
+    std::vector<u8> stream;
+    EncodeVertexStream(stream, vertices.data(), (u32)vertices.size() / stride, stride);
+    CHECK(stream.size() >= vertices.size());
+
+    std::vector<u8> decoded(vertices.size());
+    CHECK(DecodeStream(stream, decoded.data(), (u32)decoded.size()));
+    CHECK(decoded == vertices);
+}
+
+// Each triangle decodes to the same vertices in the same winding, possibly rotated
+static void TestIndexRoundTrip()
+{
+    const std::vector<u32> indices = CreateGridIndices();
+    const u32 indexCount = (u32)indices.size();
+
+    std::vector<u8> stream;
+    EncodeIndexStream(stream, indices.data(), indexCount, sizeof(u16), CODEC_TEST_GRID_SIZE * CODEC_TEST_GRID_SIZE);
+    CHECK(stream.size() < indexCount * sizeof(u16) / 2);
+
+    std::vector<u16> decoded(indexCount);
+    CHECK(DecodeStream(stream, decoded.data(), indexCount * sizeof(u16)));
+
+    u32 mismatchCount = 0;
+    for (u32 i = 0; i < indexCount; i += 3)
+    {
+        bool match = false;
+        for (u32 rotation = 0; rotation < 3; ++rotation)
+            match = match || (decoded[i] == indices[i + rotation] && decoded[i + 1] == indices[i + (rotation + 1) % 3] && decoded[i + 2] == indices[i + (rotation + 2) % 3]);
+        if (!match)
+            mismatchCount++;
+    }
+    CHECK(mismatchCount == 0);
+}
+
+// Streams that do not match the destination, or are cut short, are rejected
+static void TestCorruptStreams()
+{
+    const std::vector<u32> indices = CreateGridIndices();
+    const u32 indexCount = (u32)indices.size();
+
+    std::vector<u8> stream;
+    EncodeIndexStream(stream, indices.data(), indexCount, sizeof(u32), CODEC_TEST_GRID_SIZE * CODEC_TEST_GRID_SIZE);
+    CHECK(GetGeometryStreamChunkCount(stream.data(), (u32)stream.size(), indexCount * sizeof(u16)) == 0);
+    CHECK(GetGeometryStreamChunkCount(stream.data(), 4, indexCount * sizeof(u32)) == 0);
+
+    std::vector<u32> decoded(indexCount);
+    const u32 chunkCount = GetGeometryStreamChunkCount(stream.data(), (u32)stream.size(), indexCount * sizeof(u32));
+    CHECK(chunkCount > 1);
+    CHECK(!DecodeGeometryStreamChunk(decoded.data(), stream.data(), (u32)stream.size() - 16, chunkCount - 1));
+    CHECK(!DecodeGeometryStreamChunk(decoded.data(), stream.data(), (u32)stream.size(), chunkCount));
+}
+
+void RunGeometryCodecTests()
+{
+    TestVertexRoundTrip();
+    TestRawVertices();
+    TestIndexRoundTrip();
+    TestCorruptStreams();
+}
@@ -0,0 +1,107 @@
+#include "tests.h"
+#include "geometry_pool.h"
+
+#include <string.h>
+
+// Vertices of a single float, so the vertex allocator counts in 4-byte units like the index one
+static VertexBufferLayout CreateTestLayout()
+{
+    VertexBufferLayout layout = {};
+    layout.attributes.push_back({ 0, 1, 0, GL_FLOAT, GL_FALSE });
+    layout.stride = sizeof(f32);
+    return layout;
+}
+
+// Submeshes of vertexCount vertices and twice as many 16-bit indices, all holding the submesh index
+static void AllocateTestSubmeshes(App* app, const u32* vertexCounts, u32 submeshCount)
+{
+    app->meshes.push_back(Mesh{});
+    Mesh& mesh = app->meshes.back();
+    mesh.submeshes.resize(submeshCount);
+    for (u32 i = 0; i < submeshCount; ++i)
+    {
+        Submesh& submesh = mesh.submeshes[i];
+        submesh.vertexBufferLayout = CreateTestLayout();
+        submesh.vertexCount = vertexCounts[i];
+        submesh.indexCount = 2 * vertexCounts[i];
+        submesh.indexType = GL_UNSIGNED_SHORT;
+
+        const std::vector<f32> vertices(submesh.vertexCount, (f32)i);
+        const std::vector<u16> indices(submesh.indexCount, (u16)i);
+        ModelSubmesh owner = { (u32)app->meshes.size() - 1u, i };
+        AllocateSubmeshGeometry(submesh, owner, vertices.data(), indices.data());
+    }
+}
+
+// The data of a submesh is where it points, read through the buffers of the VAO of its arena
+static bool CheckTestSubmesh(const Submesh& submesh, u32 value)
+{
+    Program program = {};
+    program.handle = 1;
+    program.vertexInputLayout.attributes.push_back({ 0, 1 });
+
+    GLint vertexBufferHandle = 0;
+    GLint indexBufferHandle = 0;
+    glBindVertexArray(FindGeometryVAO(submesh, program));
+    glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &vertexBufferHandle);
+    glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &indexBufferHandle);
+    glBindVertexArray(0);
+
+    std::vector<f32> vertices(submesh.vertexCount);
+    glBindBuffer(GL_COPY_READ_BUFFER, vertexBufferHandle);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, submesh.vertexOffset, vertices.size() * sizeof(f32), vertices.data());
+    std::vector<u16> indices(submesh.indexCount);
+    glBindBuffer(GL_COPY_READ_BUFFER, indexBufferHandle);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, submesh.indexOffset, indices.size() * sizeof(u16), indices.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    bool valid = submesh.vertexOffset == submesh.baseVertex * sizeof(f32);
+    for (u32 i = 0; i < vertices.size(); ++i)
+        valid = valid && vertices[i] == (f32)value;
+    for (u32 i = 0; i < indices.size(); ++i)
+        valid = valid && indices[i] == value;
+    return valid;
+}
+
+// Blocks move into the holes below them, the walk going on under the ones moved, and the free
+// space ends up in one piece
+static void TestDefragment()
+{
+    InitGeometryPool();
+    App* app = new App{};
+
+    // [0][hole of 30][2][hole of 10][4]: 4 fills the hole right below it, the walk skips it and
+    // moves 2 into the lower hole, then 4 slides down after 2
+    const u32 vertexCounts[] = { 10, 30, 5, 10, 10 };
+    AllocateTestSubmeshes(app, vertexCounts, ARRAY_COUNT(vertexCounts));
+    Mesh& mesh = app->meshes[0];
+    FreeSubmeshGeometry(mesh.submeshes[1]);
+    FreeSubmeshGeometry(mesh.submeshes[3]);
+
+    GeometryPoolStats stats;
+    GetGeometryPoolStats(stats);
+    CHECK(stats.submeshCount == 3);
+    CHECK(stats.usedVertexBytes == 25 * sizeof(f32));
+    CHECK(stats.usedIndexBytes == 2 * 25 * sizeof(u16));
+    CHECK(stats.freeHoleBytes == 40 * sizeof(f32) + 2 * 40 * sizeof(u16));
+
+    DefragmentGeometryPool(app);
+
+    GetGeometryPoolStats(stats);
+    CHECK(stats.freeHoleBytes == 0);
+    CHECK(stats.movedBytes == 25 * sizeof(f32) + 2 * 25 * sizeof(u16));
+    CHECK(mesh.submeshes[0].baseVertex == 0);
+    CHECK(mesh.submeshes[2].baseVertex == 10);
+    CHECK(mesh.submeshes[4].baseVertex == 15);
+    CHECK(CheckTestSubmesh(mesh.submeshes[0], 0));
+    CHECK(CheckTestSubmesh(mesh.submeshes[2], 2));
+    CHECK(CheckTestSubmesh(mesh.submeshes[4], 4));
+
+    delete app;
+    ShutdownGeometryPool();
+}
+
+void RunGeometryPoolTests()
+{
+    TestDefragment();
+}
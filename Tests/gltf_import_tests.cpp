@@ -0,0 +1,179 @@
+#include "tests.h"
+#include "assimp_model_loading.h"
+#include "gltf_model_loading.h"
+#include "mesh_cache.h"
+
+#include <string.h>
+
+#define GLTF_TEST_FILENAME "test_import.glb"
+
+// A quad with interleaved positions and normals (stride 24), 16-bit indices, and an embedded base color image
+static const char* GltfTestJson =
+    "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+    "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1},\"indices\":2,\"material\":0}]}],"
+    "\"materials\":[{\"pbrMetallicRoughness\":{\"baseColorTexture\":{\"index\":0}}}],"
+    "\"textures\":[{\"source\":0}],\"images\":[{\"bufferView\":2,\"mimeType\":\"image/png\"}],"
+    "\"buffers\":[{\"byteLength\":177}],"
+    "\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":96,\"byteStride\":24},{\"buffer\":0,\"byteOffset\":96,\"byteLength\":12},"
+    "{\"buffer\":0,\"byteOffset\":108,\"byteLength\":69}],"
+    "\"accessors\":[{\"bufferView\":0,\"byteOffset\":0,\"componentType\":5126,\"count\":4,\"type\":\"VEC3\"},"
+    "{\"bufferView\":0,\"byteOffset\":12,\"componentType\":5126,\"count\":4,\"type\":\"VEC3\"},"
+    "{\"bufferView\":1,\"componentType\":5123,\"count\":6,\"type\":\"SCALAR\"}]}";
+
+static const f32 GltfTestVertices[] =
+{
+    0.0f, 0.0f, 0.0f,  0.0f, 0.0f, 1.0f,
+    1.0f, 0.0f, 0.0f,  0.0f, 0.0f, 1.0f,
+    0.0f, 1.0f, 0.0f,  0.0f, 0.0f, 1.0f,
+    1.0f, 1.0f, 0.0f,  0.0f, 0.0f, 1.0f,
+};
+
+// 1x1 red PNG
+static const u8 GltfTestImage[] =
+{
+    0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A, 0x00, 0x00, 0x00, 0x0D, 0x49, 0x48, 0x44, 0x52, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x01, 0x08, 0x02, 0x00, 0x00, 0x00, 0x90, 0x77, 0x53, 0xDE, 0x00, 0x00, 0x00, 0x0C, 0x49, 0x44, 0x41,
+    0x54, 0x78, 0x9C, 0x63, 0xF8, 0xCF, 0xC0, 0x00, 0x00, 0x03, 0x01, 0x01, 0x00, 0xC9, 0xFE, 0x92, 0xEF, 0x00, 0x00, 0x00,
+    0x00, 0x49, 0x45, 0x4E, 0x44, 0xAE, 0x42, 0x60, 0x82,
+};
+
+static void AppendU32(std::vector<u8>& data, u32 value)
+{
+    data.insert(data.end(), (const u8*)&value, (const u8*)&value + sizeof(value));
+}
+
+static bool WriteTestGlb(const u16* indices)
+{
+    std::string json = GltfTestJson;
+    json.resize((json.size() + 3) & ~3, ' ');
+
+    std::vector<u8> bin((const u8*)GltfTestVertices, (const u8*)GltfTestVertices + sizeof(GltfTestVertices));
+    bin.insert(bin.end(), (const u8*)indices, (const u8*)indices + 6 * sizeof(u16));
+    bin.insert(bin.end(), GltfTestImage, GltfTestImage + sizeof(GltfTestImage));
+
+    std::vector<u8> glb;
+    AppendU32(glb, 0x46546C67); // "glTF"
+    AppendU32(glb, 2);
+    AppendU32(glb, 12 + 8 + (u32)json.size() + 8 + (u32)bin.size());
+    AppendU32(glb, (u32)json.size());
+    AppendU32(glb, 0x4E4F534A); // "JSON"
+    glb.insert(glb.end(), json.begin(), json.end());
+    AppendU32(glb, (u32)bin.size());
+    AppendU32(glb, 0x004E4942); // "BIN\0"
+    glb.insert(glb.end(), bin.begin(), bin.end());
+
+    return WriteTestFile(GLTF_TEST_FILENAME, glb.data(), (u32)glb.size());
+}
+
+// The file data is described as it is, and the ranges hold what UploadMesh() copies
+static void TestDirectSubmesh()
+{
+    const u16 indices[] = { 0, 1, 2, 2, 1, 3 };
+    CHECK(WriteTestGlb(indices));
+
+    ImportedModel imported;
+    imported.importOptions = 0;
+    CHECK(ImportGltfModel(GLTF_TEST_FILENAME, imported));
+    CHECK(imported.submeshes.size() == 1);
+    CHECK(imported.vertexRanges.size() == 1);
+    CHECK(imported.indexRanges.size() == 1);
+
+    if (imported.submeshes.size() == 1 && imported.vertexRanges.size() == 1 && imported.indexRanges.size() == 1)
+    {
+        const Submesh& submesh = imported.submeshes[0];
+        CHECK(submesh.vertexCount == 4);
+        CHECK(submesh.indexCount == 6);
+        CHECK(submesh.indexType == GL_UNSIGNED_SHORT);
+        CHECK(submesh.vertexBufferLayout.stride == 24);
+        CHECK(submesh.vertexBufferLayout.attributes.size() == 2);
+
+        const ImportedBufferRange& vertexRange = imported.vertexRanges[0];
+        const ImportedBufferRange& indexRange = imported.indexRanges[0];
+        CHECK(submesh.vertexOffset >= vertexRange.offset);
+        CHECK(submesh.vertexOffset + submesh.vertexCount * submesh.vertexBufferLayout.stride <= vertexRange.offset + vertexRange.size);
+        CHECK(submesh.indexOffset + submesh.indexCount * sizeof(u16) <= indexRange.offset + indexRange.size);
+        CHECK(memcmp(vertexRange.data + (submesh.vertexOffset - vertexRange.offset), GltfTestVertices, sizeof(GltfTestVertices)) == 0);
+        CHECK(memcmp(indexRange.data + (submesh.indexOffset - indexRange.offset), indices, sizeof(indices)) == 0);
+
+        // Hashed from the file data, so the registry can share it
+        const u32 indexValues[] = { 0, 1, 2, 2, 1, 3 };
+        CHECK(submesh.geometryHash != 0);
+        CHECK(submesh.geometryHash == HashSubmeshGeometry(submesh, (const u8*)GltfTestVertices, sizeof(GltfTestVertices), indexValues, ARRAY_COUNT(indexValues)));
+    }
+
+    ReleaseImportedModel(imported);
+    remove(GLTF_TEST_FILENAME);
+}
+
+// Indices past the vertices can't be drawn from the file, nor decoded
+static void TestIndexOutOfRange()
+{
+    const u16 indices[] = { 0, 1, 2, 2, 1, 4 };
+    CHECK(WriteTestGlb(indices));
+
+    ImportedModel imported;
+    imported.importOptions = 0;
+    CHECK(!ImportGltfModel(GLTF_TEST_FILENAME, imported));
+    CHECK(imported.submeshes.empty());
+
+    ReleaseImportedModel(imported);
+    remove(GLTF_TEST_FILENAME);
+}
+
+// Quantized layouts need the vertices decoded, so the file is not kept mapped
+static void TestQuantizedDecode()
+{
+    const u16 indices[] = { 0, 1, 2, 2, 1, 3 };
+    CHECK(WriteTestGlb(indices));
+
+    ImportedModel imported;
+    imported.importOptions = MeshImportOption_QuantizeVertices;
+    CHECK(ImportGltfModel(GLTF_TEST_FILENAME, imported));
+    CHECK(imported.vertexRanges.empty());
+    CHECK(imported.submeshes.size() == 1);
+    if (imported.submeshes.size() == 1)
+    {
+        CHECK(imported.submeshes[0].vertices.size() == 4 * imported.submeshes[0].vertexBufferLayout.stride);
+        CHECK(imported.submeshes[0].indices.size() == 6);
+    }
+
+    ReleaseImportedModel(imported);
+    remove(GLTF_TEST_FILENAME);
+}
+
+// Decoded files are read back from their mesh cache, and the embedded images from the file
+static void TestMeshCache()
+{
+    const u16 indices[] = { 0, 1, 2, 2, 1, 3 };
+    CHECK(WriteTestGlb(indices));
+
+    ImportedModel imported;
+    CHECK(ImportModel(GLTF_TEST_FILENAME, false, imported));
+    CHECK(!imported.fromCache);
+    CHECK(imported.images.size() == 1 && imported.images[0].pixels);
+    CHECK(WriteMeshCache(GLTF_TEST_FILENAME, imported.importFlags, imported.importOptions, imported));
+    const u32 vertexCount = imported.submeshes.size() == 1 ? imported.submeshes[0].vertexCount : 0;
+    ReleaseImportedModel(imported);
+
+    CHECK(ImportModel(GLTF_TEST_FILENAME, false, imported));
+    CHECK(imported.fromCache);
+    CHECK(imported.submeshes.size() == 1 && imported.submeshes[0].vertexCount == vertexCount);
+    CHECK(imported.texturePaths.size() == 1 && imported.images.empty());
+
+    LoadGltfEmbeddedImages(GLTF_TEST_FILENAME, imported);
+    CHECK(imported.images.size() == 1 && imported.images[0].pixels);
+    if (imported.images.size() == 1 && imported.images[0].pixels)
+        CHECK(imported.images[0].size == ivec2(1, 1) && ((const u8*)imported.images[0].pixels)[0] == 0xFF);
+
+    ReleaseImportedModel(imported);
+    remove(GetMeshCachePath(GLTF_TEST_FILENAME).c_str());
+    remove(GLTF_TEST_FILENAME);
+}
+
+void RunGltfImportTests()
+{
+    TestDirectSubmesh();
+    TestIndexOutOfRange();
+    TestQuantizedDecode();
+    TestMeshCache();
+}
@@ -0,0 +1,80 @@
+#include "tests.h"
+#include "obj_model_loading.h"
+
+#include <string.h>
+
+#define OBJ_TEST_FILENAME "test_import.obj"
+#define OBJ_TEST_MTL_FILENAME "test_import.mtl"
+
+static u32 GetMaterialTriangleCount(const ImportedModel& imported, const char* materialName)
+{
+    u32 triangleCount = 0;
+    for (u32 i = 0; i < imported.submeshes.size(); ++i)
+        if (imported.materials[imported.submeshMaterials[i]].name == materialName)
+            triangleCount += (u32)imported.submeshes[i].indices.size() / 3;
+    return triangleCount;
+}
+
+// Faces alternate between two materials with a usemtl before each one. The usemtl lines are
+// much longer than the faces, so the chunks the file is split in almost always end with one.
+static void TestMaterialsAcrossChunks()
+{
+    const std::string red = "red" + std::string(200, 'r');
+    const std::string green = "green" + std::string(200, 'g');
+    const u32 faceCount = 10001;
+
+    std::string mtl = "newmtl " + red + "\nKd 1 0 0\nnewmtl " + green + "\nKd 0 1 0\n";
+
+    std::string obj = "mtllib " OBJ_TEST_MTL_FILENAME "\n";
+    obj += "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\n";
+    for (u32 i = 0; i < faceCount; ++i)
+    {
+        obj += "usemtl " + (i % 2 == 0 ? red : green) + "\n";
+        obj += i % 2 == 0 ? "f 1 2 3\n" : "f 2 4 3\n";
+    }
+    CHECK(obj.size() > 2 * OBJ_MIN_CHUNK_SIZE);
+
+    CHECK(WriteTestFile(OBJ_TEST_MTL_FILENAME, mtl.data(), (u32)mtl.size()));
+    CHECK(WriteTestFile(OBJ_TEST_FILENAME, obj.data(), (u32)obj.size()));
+
+    ImportedModel imported;
+    CHECK(ImportObjModel(OBJ_TEST_FILENAME, imported));
+    CHECK(imported.submeshes.size() == 2);
+    CHECK(GetMaterialTriangleCount(imported, red.c_str()) == (faceCount + 1) / 2);
+    CHECK(GetMaterialTriangleCount(imported, green.c_str()) == faceCount / 2);
+
+    remove(OBJ_TEST_FILENAME);
+    remove(OBJ_TEST_MTL_FILENAME);
+}
+
+// A usemtl as the last line holds for no face, and faces before the first one get the default material
+static void TestMaterialSwitchAtEnd()
+{
+    const char* mtl = "newmtl red\nKd 1 0 0\n";
+    const char* obj =
+        "mtllib " OBJ_TEST_MTL_FILENAME "\n"
+        "v 0 0 0\nv 1 0 0\nv 0 1 0\n"
+        "f 1 2 3\n"
+        "usemtl red\n"
+        "f 1 2 3\n"
+        "f 1 2 3\n"
+        "usemtl red\n";
+
+    CHECK(WriteTestFile(OBJ_TEST_MTL_FILENAME, mtl, (u32)strlen(mtl)));
+    CHECK(WriteTestFile(OBJ_TEST_FILENAME, obj, (u32)strlen(obj)));
+
+    ImportedModel imported;
+    CHECK(ImportObjModel(OBJ_TEST_FILENAME, imported));
+    CHECK(imported.submeshes.size() == 2);
+    CHECK(GetMaterialTriangleCount(imported, "red") == 2);
+    CHECK(GetMaterialTriangleCount(imported, "DefaultMaterial") == 1);
+
+    remove(OBJ_TEST_FILENAME);
+    remove(OBJ_TEST_MTL_FILENAME);
+}
+
+void RunObjImportTests()
+{
+    TestMaterialsAcrossChunks();
+    TestMaterialSwitchAtEnd();
+}
@@ -0,0 +1,130 @@
+#include "tests.h"
+#include "buffer_management.h"
+
+#define RING_TEST_REGION_SIZE 256
+#define RING_TEST_REGION_COUNT 3
+
+static u32 ReadRingU32(const RingBuffer& ring, u32 offset)
+{
+    u32 value = 0;
+    glBindBuffer(ring.buffer.type, ring.buffer.handle);
+    glGetBufferSubData(ring.buffer.type, offset, sizeof(value), &value);
+    glBindBuffer(ring.buffer.type, 0);
+    return value;
+}
+
+// Each frame writes the next region, and what it wrote is what the GPU reads
+static void TestRegionsInTurns()
+{
+    RingBuffer ring = CreateRingBuffer(RING_TEST_REGION_SIZE, RING_TEST_REGION_COUNT, GL_UNIFORM_BUFFER);
+
+    for (u32 frame = 0; frame < 2 * RING_TEST_REGION_COUNT + 1; ++frame)
+    {
+        const u32 region = frame % RING_TEST_REGION_COUNT;
+        MapRingBufferRegion(ring, sizeof(u32));
+        CHECK(ring.region == region);
+        CHECK(ring.buffer.head == region * RING_TEST_REGION_SIZE);
+
+        PushUInt(ring.buffer, 100 + frame);
+        UnmapRingBufferRegion(ring);
+        FenceRingBufferRegion(ring);
+        CHECK(ReadRingU32(ring, region * RING_TEST_REGION_SIZE) == 100 + frame);
+    }
+
+    CHECK(ring.growCount == 0);
+    CHECK(ring.overflowCount == 0);
+    DestroyRingBuffer(ring);
+}
+
+// Reservations past the end of the region are skipped, and the next frame grows it to fit them
+static void TestOverflowGrows()
+{
+    RingBuffer ring = CreateRingBuffer(RING_TEST_REGION_SIZE, RING_TEST_REGION_COUNT, GL_UNIFORM_BUFFER);
+
+    MapRingBufferRegion(ring, 0);
+    const u32 regionStart = ring.buffer.head;
+    u32 reserved = 0;
+    for (u32 i = 0; i < 10; ++i)
+    {
+        if (ReserveRingBufferSpace(ring, sizeof(mat4), 64))
+        {
+            PushMat4(ring.buffer, mat4(1.0f));
+            reserved++;
+        }
+    }
+    CHECK(reserved == 4);
+    CHECK(ring.overflowCount == 6);
+    CHECK(ring.overflowBytes == 6 * sizeof(mat4));
+    CHECK(ring.buffer.head == regionStart + RING_TEST_REGION_SIZE);
+    UnmapRingBufferRegion(ring);
+    FenceRingBufferRegion(ring);
+    CHECK(ring.peakBytes == 10 * sizeof(mat4));
+
+    MapRingBufferRegion(ring, 0);
+    CHECK(ring.growCount == 1);
+    CHECK(ring.regionSize == 4 * RING_TEST_REGION_SIZE);
+    CHECK(ring.overflowBytes == 0);
+    reserved = 0;
+    for (u32 i = 0; i < 10; ++i)
+    {
+        if (ReserveRingBufferSpace(ring, sizeof(mat4), 64))
+        {
+            PushUInt(ring.buffer, i);
+            ring.buffer.head += sizeof(mat4) - sizeof(u32);
+            reserved++;
+        }
+    }
+    CHECK(reserved == 10);
+    UnmapRingBufferRegion(ring);
+    FenceRingBufferRegion(ring);
+    CHECK(ReadRingU32(ring, ring.region * ring.regionSize + 9 * sizeof(mat4)) == 9);
+
+    DestroyRingBuffer(ring);
+}
+
+// The shortfall counts the alignment of each skipped block, not a worst case, and a failed
+// reservation leaves the head where it was
+static void TestOverflowShortfall()
+{
+    RingBuffer ring = CreateRingBuffer(RING_TEST_REGION_SIZE, RING_TEST_REGION_COUNT, GL_UNIFORM_BUFFER);
+
+    MapRingBufferRegion(ring, 0);
+    const u32 regionStart = ring.buffer.head;
+    PushUInt(ring.buffer, 1);
+    CHECK(!ReserveRingBufferSpace(ring, RING_TEST_REGION_SIZE, 64));
+    CHECK(ring.buffer.head == regionStart + sizeof(u32));
+    CHECK(ring.overflowBytes == 64);
+    UnmapRingBufferRegion(ring);
+    FenceRingBufferRegion(ring);
+
+    MapRingBufferRegion(ring, 0);
+    CHECK(ring.regionSize == 2 * RING_TEST_REGION_SIZE);
+    UnmapRingBufferRegion(ring);
+    FenceRingBufferRegion(ring);
+
+    // 48 byte blocks every 64 bytes: 8 fit in 512, then 2 more need 64 + 48 bytes
+    MapRingBufferRegion(ring, 0);
+    u32 reserved = 0;
+    for (u32 i = 0; i < 10; ++i)
+    {
+        if (ReserveRingBufferSpace(ring, 48, 64))
+        {
+            ring.buffer.head += 48;
+            reserved++;
+        }
+    }
+    CHECK(reserved == 8);
+    CHECK(ring.overflowBytes == 64 + 48);
+    UnmapRingBufferRegion(ring);
+    FenceRingBufferRegion(ring);
+    CHECK(ring.peakBytes == 2 * RING_TEST_REGION_SIZE + 64 + 48);
+
+    DestroyRingBuffer(ring);
+}
+
+void RunRingBufferTests()
+{
+    TestRegionsInTurns();
+    TestOverflowGrows();
+    TestOverflowShortfall();
+}
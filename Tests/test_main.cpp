@@ -0,0 +1,88 @@
+//
+// test_main.cpp: Entry point of the Tests project, built from the engine sources with
+// ASSET_COOKER defined like the Cooker, so the platform layer has no entry point of its own.
+// It creates a hidden window for the tests that need an OpenGL context, runs every test file,
+// and returns the number of failed checks.
+//
+// Usage: Tests [working directory]
+//
+
+#include "tests.h"
+#include "job_system.h"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+u32 GlobalTestCheckCount = 0;
+u32 GlobalTestFailureCount = 0;
+
+bool WriteTestFile(const char* filepath, const void* data, u32 size)
+{
+    FILE* file = fopen(filepath, "wb");
+    if (!file)
+    {
+        ELOG("Cannot create test file %s", filepath);
+        return false;
+    }
+
+    const bool written = fwrite(data, 1, size, file) == size;
+    fclose(file);
+    return written;
+}
+
+int main(int argc, char** argv)
+{
+    const char* workingDirectory = argc > 1 ? argv[1] : ".";
+    if (!SetWorkingDirectory(workingDirectory))
+    {
+        ELOG("Cannot open the working directory %s", workingDirectory);
+        return 1;
+    }
+
+    if (!glfwInit())
+    {
+        ELOG("glfwInit() failed");
+        return 1;
+    }
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+    GLFWwindow* window = glfwCreateWindow(64, 64, "Tests", NULL, NULL);
+    if (!window)
+    {
+        ELOG("glfwCreateWindow() failed");
+        glfwTerminate();
+        return 1;
+    }
+
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress))
+    {
+        ELOG("Failed to initialize OpenGL context");
+        glfwTerminate();
+        return 1;
+    }
+
+    InitJobSystem();
+
+    RunObjImportTests();
+    RunGltfImportTests();
+    RunRingBufferTests();
+    RunVertexQuantizationTests();
+    RunTlsfAllocatorTests();
+    RunGeometryPoolTests();
+    RunGeometryCodecTests();
+    RunTextureCompressionTests();
+    RunTextureStreamingTests();
+
+    ShutdownJobSystem();
+    glfwDestroyWindow(window);
+    glfwTerminate();
+
+    ILOG("%u checks, %u failed", GlobalTestCheckCount, GlobalTestFailureCount);
+    return (int)GlobalTestFailureCount;
+}
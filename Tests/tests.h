@@ -0,0 +1,36 @@
+//
+// tests.h: Checks of the engine subsystems, built from the engine sources into the Tests
+// project (see Tests.vcxproj). Each file of the Tests folder has a Run*Tests() function that
+// test_main.cpp calls with a job system running and an OpenGL context current. Files the tests
+// write go to the working directory, and are removed when they finish.
+//
+
+#pragma once
+
+#include "platform.h"
+
+extern u32 GlobalTestCheckCount;
+extern u32 GlobalTestFailureCount;
+
+#define CHECK(condition)                                                      \
+{                                                                             \
+    GlobalTestCheckCount++;                                                   \
+    if (!(condition))                                                         \
+    {                                                                         \
+        GlobalTestFailureCount++;                                             \
+        ELOG("%s(%d): check failed: %s", __FILE__, __LINE__, #condition);     \
+    }                                                                         \
+}
+
+/** Writes size bytes to a file, returns false if it cannot be created */
+bool WriteTestFile(const char* filepath, const void* data, u32 size);
+
+void RunObjImportTests();
+void RunGltfImportTests();
+void RunRingBufferTests();
+void RunVertexQuantizationTests();
+void RunTlsfAllocatorTests();
+void RunGeometryPoolTests();
+void RunGeometryCodecTests();
+void RunTextureCompressionTests();
+void RunTextureStreamingTests();
@@ -0,0 +1,208 @@
+#include "tests.h"
+#include "texture_compression.h"
+
+#include <string.h>
+
+static vec3 DecodeColor565(u16 color)
+{
+    const u32 r = (color >> 11) & 31;
+    const u32 g = (color >> 5) & 63;
+    const u32 b = color & 31;
+    return vec3((f32)((r << 3) | (r >> 2)), (f32)((g << 2) | (g >> 4)), (f32)((b << 3) | (b >> 2)));
+}
+
+// Reference decoders, as the GPU reads the blocks (both modes of each)
+static void DecodeColorBlock(const u8* block, u8 texels[16][4])
+{
+    const u16 color0 = (u16)(block[0] | (block[1] << 8));
+    const u16 color1 = (u16)(block[2] | (block[3] << 8));
+    u32 indexBits;
+    memcpy(&indexBits, block + 4, sizeof(indexBits));
+
+    vec3 palette[4];
+    palette[0] = DecodeColor565(color0);
+    palette[1] = DecodeColor565(color1);
+    if (color0 > color1)
+    {
+        palette[2] = (2.0f * palette[0] + palette[1]) / 3.0f;
+        palette[3] = (palette[0] + 2.0f * palette[1]) / 3.0f;
+    }
+    else
+    {
+        palette[2] = (palette[0] + palette[1]) / 2.0f;
+        palette[3] = vec3(0.0f); // Transparent black
+    }
+
+    for (u32 i = 0; i < 16; ++i)
+    {
+        const vec3 color = palette[(indexBits >> (2 * i)) & 3];
+        texels[i][0] = (u8)(color.r + 0.5f);
+        texels[i][1] = (u8)(color.g + 0.5f);
+        texels[i][2] = (u8)(color.b + 0.5f);
+    }
+}
+
+static void DecodeChannelBlock(const u8* block, u8 values[16])
+{
+    const f32 endpoint0 = block[0];
+    const f32 endpoint1 = block[1];
+    u64 indexBits = 0;
+    for (u32 i = 0; i < 6; ++i)
+        indexBits |= (u64)block[2 + i] << (8 * i);
+
+    f32 palette[8] = { endpoint0, endpoint1 };
+    if (endpoint0 > endpoint1)
+    {
+        for (u32 i = 1; i < 7; ++i)
+            palette[i + 1] = ((7 - i) * endpoint0 + i * endpoint1) / 7.0f;
+    }
+    else
+    {
+        for (u32 i = 1; i < 5; ++i)
+            palette[i + 1] = ((5 - i) * endpoint0 + i * endpoint1) / 5.0f;
+        palette[6] = 0.0f;
+        palette[7] = 255.0f;
+    }
+
+    for (u32 i = 0; i < 16; ++i)
+        values[i] = (u8)(palette[(indexBits >> (3 * i)) & 7] + 0.5f);
+}
+
+// Compresses a level and decodes it back to RGBA (what a format lacks stays 0, or 255 for alpha)
+static std::vector<u8> CompressAndDecode(TextureFormat format, const std::vector<u8>& pixels, ivec2 size, i32 nchannels)
+{
+    std::vector<u8> compressed(GetCompressedLevelSize(format, size));
+    CompressTextureLevel(format, pixels.data(), size, nchannels, compressed.data());
+
+    const u32 blockBytes = (format == TextureFormat_BC1 || format == TextureFormat_BC4) ? 8 : 16;
+    const i32 blocksX = (size.x + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+    std::vector<u8> decoded(size.x * size.y * 4, 0);
+    for (i32 y = 0; y < size.y; ++y)
+    {
+        for (i32 x = 0; x < size.x; ++x)
+        {
+            const u8* block = &compressed[((y / 4) * blocksX + x / 4) * blockBytes];
+            const u32 texel = (y % 4) * 4 + x % 4;
+
+            u8 colors[16][4] = {};
+            u8 values[16];
+            u8* out = &decoded[(y * size.x + x) * 4];
+            out[3] = 255;
+            switch (format)
+            {
+                case TextureFormat_BC1:
+                    DecodeColorBlock(block, colors);
+                    memcpy(out, colors[texel], 3);
+                    break;
+                case TextureFormat_BC3:
+                    DecodeChannelBlock(block, values);
+                    DecodeColorBlock(block + 8, colors);
+                    memcpy(out, colors[texel], 3);
+                    out[3] = values[texel];
+                    break;
+                case TextureFormat_BC4:
+                    DecodeChannelBlock(block, values);
+                    out[0] = values[texel];
+                    break;
+                case TextureFormat_BC5:
+                    DecodeChannelBlock(block, values);
+                    out[0] = values[texel];
+                    DecodeChannelBlock(block + 8, values);
+                    out[1] = values[texel];
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    return decoded;
+}
+
+// Largest difference of a channel between the source pixels and the decoded RGBA
+static u32 GetMaxError(const std::vector<u8>& pixels, i32 nchannels, const std::vector<u8>& decoded, u32 channel)
+{
+    u32 maxError = 0;
+    for (u32 i = 0; i < decoded.size() / 4; ++i)
+        maxError = glm::max(maxError, (u32)abs((i32)pixels[i * nchannels + channel] - (i32)decoded[i * 4 + channel]));
+    return maxError;
+}
+
+// Ramps going up and down across the image, in a different direction for each channel
+static std::vector<u8> CreateGradient(ivec2 size, i32 nchannels)
+{
+    std::vector<u8> pixels(size.x * size.y * nchannels);
+    for (i32 y = 0; y < size.y; ++y)
+    {
+        for (i32 x = 0; x < size.x; ++x)
+        {
+            for (i32 c = 0; c < nchannels; ++c)
+            {
+                const i32 ramp = (x * (4 + 2 * c) + y * (10 - 2 * c)) % 512;
+                pixels[(y * size.x + x) * nchannels + c] = (u8)(ramp < 256 ? ramp : 511 - ramp);
+            }
+        }
+    }
+    return pixels;
+}
+
+// Flat colors come back within the precision of 5:6:5, gradients within a palette step
+static void TestColorBlocks()
+{
+    const ivec2 size = ivec2(18, 13);
+    CHECK(GetCompressedLevelSize(TextureFormat_BC1, size) == 5 * 4 * 8);
+
+    std::vector<u8> color(size.x * size.y * 4);
+    for (u32 i = 0; i < color.size(); i += 4)
+    {
+        color[i + 0] = 100;
+        color[i + 1] = 150;
+        color[i + 2] = 200;
+        color[i + 3] = 255;
+    }
+    std::vector<u8> decoded = CompressAndDecode(TextureFormat_BC1, color, size, 4);
+    CHECK(GetMaxError(color, 4, decoded, 0) <= 4);
+    CHECK(GetMaxError(color, 4, decoded, 1) <= 2);
+    CHECK(GetMaxError(color, 4, decoded, 2) <= 4);
+
+    const std::vector<u8> gradient = CreateGradient(size, 4);
+    decoded = CompressAndDecode(TextureFormat_BC1, gradient, size, 4);
+    CHECK(GetMaxError(gradient, 4, decoded, 0) <= 24);
+    CHECK(GetMaxError(gradient, 4, decoded, 1) <= 24);
+    CHECK(GetMaxError(gradient, 4, decoded, 2) <= 24);
+}
+
+// Alpha and single channels are fit within a step of their 8 value palettes
+static void TestChannelBlocks()
+{
+    const ivec2 size = ivec2(13, 18);
+    CHECK(GetCompressedLevelSize(TextureFormat_BC4, size) == 4 * 5 * 8);
+    CHECK(GetCompressedLevelSize(TextureFormat_BC5, size) == 4 * 5 * 16);
+
+    const std::vector<u8> gradient = CreateGradient(size, 4);
+    std::vector<u8> decoded = CompressAndDecode(TextureFormat_BC3, gradient, size, 4);
+    CHECK(GetMaxError(gradient, 4, decoded, 3) <= 10);
+
+    const std::vector<u8> mask = CreateGradient(size, 1);
+    decoded = CompressAndDecode(TextureFormat_BC4, mask, size, 1);
+    CHECK(GetMaxError(mask, 1, decoded, 0) <= 10);
+
+    const std::vector<u8> normals = CreateGradient(size, 2);
+    decoded = CompressAndDecode(TextureFormat_BC5, normals, size, 2);
+    CHECK(GetMaxError(normals, 2, decoded, 0) <= 10);
+    CHECK(GetMaxError(normals, 2, decoded, 1) <= 10);
+
+    // Flat blocks, and the two extremes, are exact
+    std::vector<u8> values(size.x * size.y, 77);
+    decoded = CompressAndDecode(TextureFormat_BC4, values, size, 1);
+    CHECK(GetMaxError(values, 1, decoded, 0) == 0);
+    for (u32 i = 0; i < values.size(); ++i)
+        values[i] = i % 2 ? 255 : 0;
+    decoded = CompressAndDecode(TextureFormat_BC4, values, size, 1);
+    CHECK(GetMaxError(values, 1, decoded, 0) == 0);
+}
+
+void RunTextureCompressionTests()
+{
+    TestColorBlocks();
+    TestChannelBlocks();
+}
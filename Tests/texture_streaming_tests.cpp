@@ -0,0 +1,84 @@
+#include "tests.h"
+#include "residency.h"
+#include "texture_atlas.h"
+#include "texture_streaming.h"
+
+#include <chrono>
+#include <string.h>
+#include <thread>
+
+#define TEXTURE_STREAMING_TEST_SIZE 32
+#define TEXTURE_STREAMING_TEST_FRAMES 1000
+
+static Image CreateTestImage(i32 size)
+{
+    Image image = {};
+    image.size = ivec2(size);
+    image.nchannels = 4;
+    image.stride = size * 4;
+    image.pixels = malloc(size * size * 4);
+
+    u8* pixels = (u8*)image.pixels;
+    for (i32 i = 0; i < size * size; ++i)
+    {
+        pixels[i * 4 + 0] = (u8)(i % size * 8);
+        pixels[i * 4 + 1] = (u8)(i / size * 8);
+        pixels[i * 4 + 2] = (u8)i;
+        pixels[i * 4 + 3] = 255;
+    }
+    return image;
+}
+
+// Textures up to the mip tail size arrive with their level 0, which also goes to the atlas. The
+// level 0 of the texture is uploaded from the staging buffer after that, and must still find it bound
+static void TestSmallTexture()
+{
+    InitResidency();
+    InitTextureStreaming();
+    App* app = new App{};
+    app->textureBudgetMB = 256;
+
+    const i32 size = TEXTURE_STREAMING_TEST_SIZE;
+    Image image = CreateTestImage(size);
+    std::vector<u8> expected((const u8*)image.pixels, (const u8*)image.pixels + size * size * 4);
+    const u32 texIdx = RequestTexture2DFromImage(app, "small texture", image, UINT32_MAX);
+
+    for (u32 frame = 0; frame < TEXTURE_STREAMING_TEST_FRAMES && GetPendingTextureCount() > 0; ++frame)
+    {
+        UpdateTextureStreaming(app);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(GetPendingTextureCount() == 0);
+
+    GLint unpackBuffer = -1;
+    glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &unpackBuffer);
+    CHECK(unpackBuffer == 0);
+
+    const Texture& texture = app->textures[texIdx];
+    CHECK(texture.atlasLayer >= 0);
+    CHECK(texture.residentLevel == 0 && texture.handle != 0);
+    if (texture.handle != 0)
+    {
+        std::vector<u8> pixels(size * size * 4);
+        glBindTexture(GL_TEXTURE_2D, texture.handle);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        CHECK(pixels == expected);
+    }
+
+    // Let the GPU release the staging memory before it goes away
+    glFinish();
+    if (texture.handle != 0)
+        glDeleteTextures(1, &texture.handle);
+    delete app;
+    ShutdownTextureStreaming();
+    ShutdownTextureAtlas();
+    ShutdownResidency();
+}
+
+void RunTextureStreamingTests()
+{
+    TestSmallTexture();
+}
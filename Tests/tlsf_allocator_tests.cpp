@@ -0,0 +1,148 @@
+#include "tests.h"
+#include "tlsf_allocator.h"
+
+#include <random>
+
+#define TLSF_TEST_SIZE (1u << 20)
+
+// The blocks cover the range back to back, free ones are never next to each other, and the
+// allocated ones add up to the used size
+static bool CheckTlsfBlocks(const TlsfAllocator& allocator)
+{
+    u32 end = allocator.size;
+    u32 usedSize = 0;
+    u32 allocationCount = 0;
+    bool nextFree = false;
+    for (u32 blockIdx = allocator.lastBlock; blockIdx != TLSF_INVALID_BLOCK; blockIdx = allocator.blocks[blockIdx].prevPhysical)
+    {
+        const TlsfBlock& block = allocator.blocks[blockIdx];
+        if (block.offset + block.size != end || (block.free && nextFree))
+            return false;
+
+        if (!block.free)
+        {
+            usedSize += block.size;
+            allocationCount++;
+        }
+        end = block.offset;
+        nextFree = block.free;
+    }
+    return end == 0 && usedSize == allocator.usedSize && allocationCount == allocator.allocationCount;
+}
+
+// Blocks split and merge back into the whole range
+static void TestAllocateAndFree()
+{
+    TlsfAllocator allocator;
+    InitTlsfAllocator(allocator, 100);
+
+    const u32 a = TlsfAllocate(allocator, 10);
+    const u32 b = TlsfAllocate(allocator, 20);
+    const u32 c = TlsfAllocate(allocator, 0);
+    CHECK(allocator.blocks[a].offset == 0 && allocator.blocks[a].size == 10);
+    CHECK(allocator.blocks[b].offset == 10 && allocator.blocks[b].size == 20);
+    CHECK(allocator.blocks[c].offset == 30 && allocator.blocks[c].size == 1);
+    CHECK(allocator.usedSize == 31 && allocator.allocationCount == 3);
+    CHECK(TlsfAllocate(allocator, 70) == TLSF_INVALID_BLOCK);
+    CHECK(GetTlsfLargestFreeSize(allocator) == 69);
+
+    // A hole in the middle is reused by a request that fits it
+    TlsfFree(allocator, b);
+    CHECK(GetTlsfLargestFreeSize(allocator) == 69);
+    const u32 d = TlsfAllocate(allocator, 20);
+    CHECK(d != TLSF_INVALID_BLOCK && allocator.blocks[d].offset == 10);
+    CHECK(CheckTlsfBlocks(allocator));
+
+    TlsfFree(allocator, a);
+    TlsfFree(allocator, c);
+    TlsfFree(allocator, d);
+    CHECK(allocator.usedSize == 0 && allocator.allocationCount == 0);
+    CHECK(allocator.firstBlock == allocator.lastBlock);
+    CHECK(GetTlsfLargestFreeSize(allocator) == 100);
+}
+
+// A block moved down keeps its index and size, and the hole it leaves merges with the free space after it
+static void TestMoveBlockDown()
+{
+    TlsfAllocator allocator;
+    InitTlsfAllocator(allocator, 100);
+
+    const u32 a = TlsfAllocate(allocator, 10);
+    const u32 b = TlsfAllocate(allocator, 10);
+    const u32 c = TlsfAllocate(allocator, 10);
+    CHECK(!TlsfMoveBlockDown(allocator, a));
+    CHECK(!TlsfMoveBlockDown(allocator, c));
+
+    TlsfFree(allocator, b);
+    CHECK(TlsfMoveBlockDown(allocator, c));
+    CHECK(allocator.blocks[c].offset == 10 && allocator.blocks[c].size == 10);
+    CHECK(allocator.lastBlock == allocator.blocks[c].nextPhysical);
+    CHECK(GetTlsfLargestFreeSize(allocator) == 80);
+    CHECK(CheckTlsfBlocks(allocator));
+}
+
+// Random allocations, moves and frees keep the blocks consistent, and give the range back in one piece
+static void TestRandomOperations()
+{
+    TlsfAllocator allocator;
+    InitTlsfAllocator(allocator, TLSF_TEST_SIZE);
+
+    std::mt19937 random(1);
+    std::vector<u32> allocated;
+    u32 tooSmallCount = 0;
+    u32 badMoveCount = 0;
+    u32 badBlocksCount = 0;
+    for (u32 i = 0; i < 100000; ++i)
+    {
+        const u32 operation = random() % 8;
+        if (allocated.empty() || operation < 5)
+        {
+            const u32 size = random() % 4 == 0 ? random() % 20000 : random() % 300;
+            const u32 blockIdx = TlsfAllocate(allocator, size);
+            if (blockIdx == TLSF_INVALID_BLOCK)
+                continue;
+
+            if (allocator.blocks[blockIdx].size < glm::max(size, 1u))
+                tooSmallCount++;
+            allocated.push_back(blockIdx);
+        }
+        else if (operation == 5)
+        {
+            const u32 blockIdx = allocated[random() % allocated.size()];
+            const TlsfBlock block = allocator.blocks[blockIdx];
+            const bool holeBefore = block.prevPhysical != TLSF_INVALID_BLOCK && allocator.blocks[block.prevPhysical].free;
+            const bool moved = TlsfMoveBlockDown(allocator, blockIdx);
+            if (moved != holeBefore || allocator.blocks[blockIdx].size != block.size || (moved && allocator.blocks[blockIdx].offset >= block.offset))
+                badMoveCount++;
+        }
+        else
+        {
+            const u32 slot = random() % allocated.size();
+            TlsfFree(allocator, allocated[slot]);
+            allocated[slot] = allocated.back();
+            allocated.pop_back();
+        }
+
+        if (i % 1000 == 0 && !CheckTlsfBlocks(allocator))
+            badBlocksCount++;
+    }
+    CHECK(tooSmallCount == 0);
+    CHECK(badMoveCount == 0);
+    CHECK(badBlocksCount == 0);
+    CHECK(allocator.allocationCount == allocated.size());
+
+    for (u32 i = 0; i < allocated.size(); ++i)
+        TlsfFree(allocator, allocated[i]);
+    CHECK(allocator.usedSize == 0);
+    CHECK(GetTlsfLargestFreeSize(allocator) == TLSF_TEST_SIZE);
+
+    // Requests are rounded up to their bin, so the largest that surely succeeds is a sixteenth smaller
+    CHECK(TlsfAllocate(allocator, TLSF_TEST_SIZE - TLSF_TEST_SIZE / TLSF_SL_COUNT) != TLSF_INVALID_BLOCK);
+}
+
+void RunTlsfAllocatorTests()
+{
+    TestAllocateAndFree();
+    TestMoveBlockDown();
+    TestRandomOperations();
+}
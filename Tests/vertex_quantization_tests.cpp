@@ -0,0 +1,77 @@
+#include "tests.h"
+#include "assimp_model_loading.h"
+#include "vertex_quantization.h"
+
+#include <glm/gtc/packing.hpp>
+#include <string.h>
+
+// A triangle of the given size at offset, in the float import layout
+static Submesh CreateTestSubmesh(vec3 offset, f32 size)
+{
+    Submesh submesh = {};
+    submesh.vertexBufferLayout = CreateImportVertexLayout(false, false);
+
+    const vec3 positions[] = { offset, offset + vec3(size, 0.0f, 0.0f), offset + vec3(0.0f, size, 0.0f) };
+    const vec3 normal = vec3(0.0f, 0.0f, 1.0f);
+    for (u32 i = 0; i < ARRAY_COUNT(positions); ++i)
+    {
+        submesh.vertices.insert(submesh.vertices.end(), (const u8*)&positions[i], (const u8*)&positions[i] + sizeof(vec3));
+        submesh.vertices.insert(submesh.vertices.end(), (const u8*)&normal, (const u8*)&normal + sizeof(vec3));
+        submesh.indices.push_back(i);
+    }
+    return submesh;
+}
+
+// Half positions have the 3 components the shaders read, and a zeroed padding
+static void TestHalfPositions()
+{
+    Submesh submesh = CreateTestSubmesh(vec3(-1.0f), 2.0f);
+    QuantizeSubmesh(submesh);
+
+    const VertexBufferAttribute& position = submesh.vertexBufferLayout.attributes[0];
+    CHECK(position.type == GL_HALF_FLOAT);
+    CHECK(position.componentCount == 3);
+    CHECK(submesh.vertexBufferLayout.stride == 4 * sizeof(u16) + 2 * sizeof(u16));
+    CHECK(submesh.indexType == GL_UNSIGNED_SHORT);
+
+    u64 packed;
+    memcpy(&packed, submesh.vertices.data() + submesh.vertexBufferLayout.stride + position.offset, sizeof(packed));
+    CHECK(glm::unpackHalf4x16(packed) == vec4(1.0f, -1.0f, -1.0f, 0.0f));
+}
+
+// A small mesh far from its origin would snap to the half float steps there, so it keeps floats,
+// while a big one is fine with them
+static void TestFloatPositionsFarFromOrigin()
+{
+    Submesh big = CreateTestSubmesh(vec3(-500.0f), 1000.0f);
+    QuantizeSubmesh(big);
+    CHECK(big.vertexBufferLayout.attributes[0].type == GL_HALF_FLOAT);
+
+    Submesh far = CreateTestSubmesh(vec3(200.0f), 1.0f);
+    QuantizeSubmesh(far);
+    CHECK(far.vertexBufferLayout.attributes[0].type == GL_FLOAT);
+    CHECK(far.vertexBufferLayout.attributes[0].componentCount == 3);
+
+    vec3 position;
+    memcpy(&position, far.vertices.data() + 2 * far.vertexBufferLayout.stride, sizeof(position));
+    CHECK(position == vec3(200.0f, 201.0f, 200.0f));
+}
+
+// Coordinates past the largest half float would turn into infinities, however big the mesh is
+static void TestFloatPositionsOutOfHalfRange()
+{
+    Submesh huge = CreateTestSubmesh(vec3(-1e5f), 2e5f);
+    QuantizeSubmesh(huge);
+    CHECK(huge.vertexBufferLayout.attributes[0].type == GL_FLOAT);
+
+    vec3 position;
+    memcpy(&position, huge.vertices.data() + huge.vertexBufferLayout.stride, sizeof(position));
+    CHECK(position == vec3(1e5f, -1e5f, -1e5f));
+}
+
+void RunVertexQuantizationTests()
+{
+    TestHalfPositions();
+    TestFloatPositionsFarFromOrigin();
+    TestFloatPositionsOutOfHalfRange();
+}
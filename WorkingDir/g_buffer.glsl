@@ -1,13 +1,17 @@
 ///////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////
-#ifdef G_BUFFER
+#if defined(G_BUFFER) || defined(VIRTUAL_TEXTURE_FEEDBACK)
 
 #if defined(VERTEX) ///////////////////////////////////////////////////
 
 // TODO: Write your vertex shader here
 layout(location = 0) in vec3 aPosition;
+#if defined(QUANTIZED_VERTICES)
+layout(location = 1) in vec2 aNormal; // Octahedral encoded
+#else
 layout(location = 1) in vec3 aNormal;
+#endif
 layout(location = 2) in vec2 aTexCoord;
 
 // Uniform blocks
@@ -21,16 +25,75 @@ out vec2 vTexCoord;
 out vec3 vPosition; // In worldspace
 out vec3 vNormal;   // In worldspace
 
+vec3 DecodeNormal()
+{
+#if defined(QUANTIZED_VERTICES)
+    vec3 n = vec3(aNormal, 1.0 - abs(aNormal.x) - abs(aNormal.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+#else
+    return aNormal;
+#endif
+}
+
 void main()
 {
     vTexCoord = aTexCoord;
     vPosition = vec3(uWorldMatrix * vec4(aPosition, 1.0));
-    vNormal   = mat3(transpose(inverse(uWorldMatrix))) * aNormal; // TODO: Calculate the normal matrix on the CPU and send it to the shaders via a uniform before drawing (just like the model matrix)
+    vNormal   = mat3(transpose(inverse(uWorldMatrix))) * DecodeNormal(); // TODO: Calculate the normal matrix on the CPU and send it to the shaders via a uniform before drawing (just like the model matrix)
     gl_Position = uWorldViewProjectionMatrix * vec4(aPosition, 1.0);
 }
 
 #elif defined(FRAGMENT) ///////////////////////////////////////////////
 
+// Virtual texture pages, as in virtual_texture.h
+const float VT_PAGE_SIZE   = 128.0;
+const float VT_PAGE_BORDER = 4.0;
+
+uniform ivec4 uVirtualTexture; // Size of the finest level (xy), paged levels (z) and index (w, -1 if the albedo is a regular texture)
+
+in vec2 vTexCoord;
+in vec3 vPosition; // In worldspace
+in vec3 vNormal;   // In worldspace
+
+// The mip level sampled, at about one texel per pixel
+int VirtualTextureLevel(vec2 uv, float lodBias)
+{
+    vec2 texels = uv * vec2(uVirtualTexture.xy);
+    vec2 dx = dFdx(texels);
+    vec2 dy = dFdy(texels);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + lodBias;
+    return int(clamp(floor(lod), 0.0, float(uVirtualTexture.z - 1)));
+}
+
+ivec2 VirtualTexturePage(vec2 uv, int level)
+{
+    return ivec2(fract(uv) * vec2(max(uVirtualTexture.xy >> level, ivec2(1))) / VT_PAGE_SIZE);
+}
+
+#if defined(VIRTUAL_TEXTURE_FEEDBACK)
+
+layout(location = 0) out uint oPageKey; // Texture index + 1, level, page y and x (0 for surfaces without a virtual texture)
+
+uniform float uLodBias; // The feedback is rendered at a lower resolution
+
+void main()
+{
+    if (uVirtualTexture.w < 0)
+    {
+        oPageKey = 0u;
+        return;
+    }
+
+    int level = VirtualTextureLevel(vTexCoord, uLodBias);
+    ivec2 page = VirtualTexturePage(vTexCoord, level);
+    oPageKey = (uint(uVirtualTexture.w + 1) << 24) | (uint(level) << 20) | (uint(page.y) << 10) | uint(page.x);
+}
+
+#else
+
 struct Material
 {
     sampler2D diffuse;
@@ -42,12 +105,43 @@ layout(location = 0) out vec4 gPosition;   // Fragment positions, depth
 layout(location = 1) out vec3 gNormal;     // Normals
 layout(location = 2) out vec4 gAlbedoSpec; // Albedo, specular
 
-in vec2 vTexCoord;
-in vec3 vPosition; // In worldspace
-in vec3 vNormal;   // In worldspace
-
 uniform Material uMaterial;
 
+// Small textures are sampled from a layer of the texture atlas instead, as in texture_atlas.h
+uniform sampler2DArray uTextureAtlas;
+uniform vec4 uDiffuseAtlasRect;  // Scale (xy) and offset (zw), zero if the texture is not atlased
+uniform int  uDiffuseAtlasLayer;
+uniform vec4 uSpecularAtlasRect;
+uniform int  uSpecularAtlasLayer;
+
+uniform sampler2D  uPageAtlas;
+uniform usampler2D uIndirection; // Per page: atlas page x, y and level of the page resident for it
+
+vec4 SampleVirtualTexture(vec2 uv)
+{
+    int level = VirtualTextureLevel(uv, 0.0);
+    ivec2 page = VirtualTexturePage(uv, level);
+    uvec4 entry = texelFetch(uIndirection, page, level);
+
+    // The page resident may be a coarser one, that covers this one
+    int residentLevel = int(entry.z);
+    vec2 levelTexels = fract(uv) * vec2(max(uVirtualTexture.xy >> residentLevel, ivec2(1)));
+    vec2 pageTexels = levelTexels - vec2(page >> (residentLevel - level)) * VT_PAGE_SIZE;
+
+    vec2 atlasTexels = vec2(entry.xy) * (VT_PAGE_SIZE + 2.0 * VT_PAGE_BORDER) + VT_PAGE_BORDER + pageTexels;
+    return textureLod(uPageAtlas, atlasTexels / vec2(textureSize(uPageAtlas, 0)), 0.0);
+}
+
+vec4 SampleMaterialTexture(sampler2D tex, vec4 atlasRect, int atlasLayer, vec2 uv)
+{
+    if (atlasRect.x == 0.0)
+        return texture(tex, uv);
+
+    // Clamped like the textures themselves, the gradients of the texture UVs keep the mip selection
+    vec2 atlasUv = atlasRect.zw + clamp(uv, 0.0, 1.0) * atlasRect.xy;
+    return textureGrad(uTextureAtlas, vec3(atlasUv, float(atlasLayer)), dFdx(uv) * atlasRect.xy, dFdy(uv) * atlasRect.xy);
+}
+
 void main()
 {
     // store the fragment position vector in the first gbuffer texture
@@ -55,15 +149,19 @@ void main()
     // also store the per-fragment normals into the gbuffer
     gNormal = normalize(vNormal);
     // and the diffuse per-fragment color
-    gAlbedoSpec.rgb = texture(uMaterial.diffuse, vTexCoord).rgb;
+    if (uVirtualTexture.w >= 0)
+        gAlbedoSpec.rgb = SampleVirtualTexture(vTexCoord).rgb;
+    else
+        gAlbedoSpec.rgb = SampleMaterialTexture(uMaterial.diffuse, uDiffuseAtlasRect, uDiffuseAtlasLayer, vTexCoord).rgb;
     // store specular intensity in gAlbedoSpec's alpha component
-    gAlbedoSpec.a = texture(uMaterial.specular, vTexCoord).r;
+    gAlbedoSpec.a = SampleMaterialTexture(uMaterial.specular, uSpecularAtlasRect, uSpecularAtlasLayer, vTexCoord).r;
     // depth value
     gPosition.a = gl_FragCoord.z;
 }
 
 #endif
 #endif
+#endif
 
 
 // NOTE: You can write several shaders in the same file if you want as
@@ -26,7 +26,11 @@ struct Light
 
 // TODO: Write your vertex shader here
 layout(location = 0) in vec3 aPosition;
+#if defined(QUANTIZED_VERTICES)
+layout(location = 1) in vec2 aNormal; // Octahedral encoded
+#else
 layout(location = 1) in vec3 aNormal;
+#endif
 layout(location = 2) in vec2 aTexCoord;
 //layout(location = 3) in vec3 aTangent;
 //layout(location = 4) in vec2 aBitangent;
@@ -50,11 +54,24 @@ out vec3 vPosition; // In worldspace
 out vec3 vNormal;   // In worldspace
 out vec3 vViewDir;  // In worldspace
 
+vec3 DecodeNormal()
+{
+#if defined(QUANTIZED_VERTICES)
+    vec3 n = vec3(aNormal, 1.0 - abs(aNormal.x) - abs(aNormal.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+#else
+    return aNormal;
+#endif
+}
+
 void main()
 {
     vTexCoord = aTexCoord;
     vPosition = vec3(uWorldMatrix * vec4(aPosition, 1.0));
-    vNormal   = mat3(transpose(inverse(uWorldMatrix))) * aNormal; // TODO: Calculate the normal matrix on the CPU and send it to the shaders via a uniform before drawing (just like the model matrix)
+    vNormal   = mat3(transpose(inverse(uWorldMatrix))) * DecodeNormal(); // TODO: Calculate the normal matrix on the CPU and send it to the shaders via a uniform before drawing (just like the model matrix)
     vViewDir = uCameraPosition - vPosition;
     gl_Position = uWorldViewProjectionMatrix * vec4(aPosition, 1.0);
 }